@@ -111,6 +111,12 @@ ATOMIC_INLINE size_t atomic_cas_z(size_t *v, size_t old, size_t _new)
 #endif
 }
 
+/* Adding zero is the only atomic read all backends provide. */
+ATOMIC_INLINE size_t atomic_load_z(size_t *p)
+{
+	return atomic_fetch_and_add_z(p, 0);
+}
+
 /******************************************************************************/
 /* unsigned operations. */
 ATOMIC_INLINE unsigned atomic_add_and_fetch_u(unsigned *p, unsigned x)
@@ -168,6 +174,11 @@ ATOMIC_INLINE unsigned atomic_cas_u(unsigned *v, unsigned old, unsigned _new)
 #endif
 }
 
+ATOMIC_INLINE unsigned atomic_load_u(unsigned *p)
+{
+	return atomic_fetch_and_add_u(p, 0);
+}
+
 /******************************************************************************/
 /* float operations. */
 
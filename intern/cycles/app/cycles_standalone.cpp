@@ -21,15 +21,19 @@
 #include "device.h"
 #include "scene.h"
 #include "session.h"
+#include "stats.h"
 #include "integrator.h"
 
 #include "util_args.h"
+#include "util_debug.h"
 #include "util_foreach.h"
 #include "util_function.h"
 #include "util_logging.h"
+#include "util_optimization.h"
 #include "util_path.h"
 #include "util_progress.h"
 #include "util_string.h"
+#include "util_system.h"
 #include "util_time.h"
 #include "util_transform.h"
 #include "util_version.h"
@@ -46,13 +50,37 @@ struct Options {
 	Session *session;
 	Scene *scene;
 	string filepath;
+	vector<string> filepaths;
+	string profile_filepath;
+	string bvh_layout;
 	int width, height;
 	SceneParams scene_params;
 	SessionParams session_params;
 	bool quiet;
 	bool show_help, interactive, pause;
+
+	/* benchmark */
+	bool benchmark;
+	int benchmark_repeat;
+	int benchmark_seed;
+	vector<string> benchmark_kernels;
+	int benchmark_reference_samples;
 } options;
 
+static const char *cpu_kernel_names[] = {"sse2", "sse3", "sse41", "avx", "avx2"};
+static const int cpu_kernel_num = sizeof(cpu_kernel_names) / sizeof(*cpu_kernel_names);
+
+static void scene_params_set_bvh_layout()
+{
+	options.scene_params.use_qbvh = (options.bvh_layout == "qbvh" ||
+	                                 options.bvh_layout == "obvh");
+	options.scene_params.use_obvh = false;
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
+	/* only the AVX2 kernel can traverse 8-wide nodes */
+	options.scene_params.use_obvh = (options.bvh_layout == "obvh") && system_cpu_support_avx2();
+#endif
+}
+
 static void session_print(const string& str)
 {
 	/* print with carriage return to overwrite previous */
@@ -97,12 +125,18 @@ static BufferParams& session_buffer_params()
 	return buffer_params;
 }
 
+static void benchmark_write_render_tile(RenderTile& rtile);
+
 static void session_init()
 {
 	options.session = new Session(options.session_params);
 	options.session->reset(session_buffer_params(), options.session_params.samples);
 	options.session->scene = options.scene;
 
+	/* keep the rendered image to compare it with the reference */
+	if(options.benchmark && options.benchmark_reference_samples > 0)
+		options.session->write_render_tile_cb = function_bind(&benchmark_write_render_tile, _1);
+
 	if(options.session_params.background && !options.quiet)
 		options.session->progress.set_update_callback(function_bind(&session_print_status));
 #ifdef WITH_CYCLES_STANDALONE_GUI
@@ -139,6 +173,31 @@ static void scene_init()
 static void session_exit()
 {
 	if(options.session) {
+		if(options.session_params.background && !options.quiet) {
+			/* camera paths traced per second, to compare BVH layouts and
+			 * kernels on the same scene */
+			double total_time, render_time;
+			options.session->progress.get_time(total_time, render_time);
+			double num_paths = (double)options.width * options.height *
+			                   options.session_params.samples;
+
+			session_print(string_printf("Render time: %.2fs, %.3f M paths/s",
+			                            render_time,
+			                            (render_time > 0.0)? num_paths / render_time * 1e-6: 0.0));
+			printf("\n");
+		}
+
+		if(!options.profile_filepath.empty()) {
+			RenderStats stats;
+			options.session->collect_statistics(&stats);
+
+			string json = stats.to_json();
+			if(!path_write_text(options.profile_filepath, json)) {
+				fprintf(stderr, "Failed to write statistics to %s\n",
+				        options.profile_filepath.c_str());
+			}
+		}
+
 		delete options.session;
 		options.session = NULL;
 	}
@@ -317,19 +376,379 @@ static void keyboard(unsigned char key)
 
 static int files_parse(int argc, const char *argv[])
 {
-	if(argc > 0)
-		options.filepath = argv[0];
+	if(argc > 0) {
+		if(options.filepath == "")
+			options.filepath = argv[0];
+
+		options.filepaths.push_back(argv[0]);
+	}
 
 	return 0;
 }
 
+/* Benchmark */
+
+struct BenchmarkResult {
+	string filepath;
+	string kernel;
+	string bvh_layout;
+	int run;
+	double scene_update_time;
+	double render_time;
+	uint64_t pixel_samples;
+	size_t mem_peak;
+	/* error compared to the reference render */
+	double rmse;
+	double relmse;
+};
+
+struct BenchmarkReference {
+	string filepath;
+	double render_time;
+	vector<float> pixels;
+};
+
+/* RGBA pixels of the last benchmark render */
+static vector<float> benchmark_pixels;
+
+static void benchmark_write_render_tile(RenderTile& rtile)
+{
+	RenderBuffers *buffers = rtile.buffers;
+	BufferParams& params = buffers->params;
+	vector<float> tile_pixels(params.width*params.height*4);
+
+	buffers->copy_from_device();
+
+	if(!buffers->get_pass_rect(PASS_COMBINED, 1.0f, rtile.sample, 4, &tile_pixels[0]))
+		return;
+
+	for(int y = 0; y < params.height; y++) {
+		for(int x = 0; x < params.width; x++) {
+			size_t index = ((size_t)(params.full_y + y)*options.width + params.full_x + x)*4;
+
+			if(index + 4 > benchmark_pixels.size())
+				continue;
+
+			memcpy(&benchmark_pixels[index], &tile_pixels[(y*params.width + x)*4], sizeof(float)*4);
+		}
+	}
+}
+
+/* Root mean squared error of the color, and the mean squared error relative
+ * to the reference color, which weights dark and bright areas alike. */
+static void benchmark_image_error(const vector<float>& pixels,
+                                  const vector<float>& reference,
+                                  double *rmse,
+                                  double *relmse)
+{
+	double sum = 0.0, relative_sum = 0.0;
+	size_t num = 0;
+
+	for(size_t i = 0; i < pixels.size() && i < reference.size(); i++) {
+		/* skip alpha */
+		if(i % 4 == 3)
+			continue;
+
+		double diff = (double)pixels[i] - (double)reference[i];
+		double ref = reference[i];
+
+		sum += diff*diff;
+		relative_sum += diff*diff/(ref*ref + 1e-2);
+		num++;
+	}
+
+	*rmse = (num > 0)? sqrt(sum/num): 0.0;
+	*relmse = (num > 0)? relative_sum/num: 0.0;
+}
+
+/* Kernel names with a "_stream" suffix trace tiles as ray streams instead of
+ * path by path, so both can be compared on the same instruction set. */
+static bool benchmark_cpu_kernel_parse(const string& name, string *isa)
+{
+	const string suffix = "_stream";
+
+	if(string_endswith(name, suffix.c_str()) && name.size() > suffix.size()) {
+		*isa = name.substr(0, name.size() - suffix.size());
+		return true;
+	}
+
+	*isa = name;
+	return false;
+}
+
+/* Restrict the CPU device to the kernel for the given instruction set, or
+ * the best available one for "default". Returns false when the kernel is not
+ * compiled in or not supported by this CPU. */
+static bool benchmark_set_cpu_kernel(const string& kernel)
+{
+	string name;
+	bool stream = benchmark_cpu_kernel_parse(kernel, &name);
+
+	DebugFlags().cpu.reset();
+	DebugFlags().cpu.stream = stream;
+
+	if(name == "default")
+		return true;
+
+	int level = -1;
+	for(int i = 0; i < cpu_kernel_num; i++) {
+		if(name == cpu_kernel_names[i])
+			level = i;
+	}
+
+	DebugFlags::CPU& cpu = DebugFlags().cpu;
+	cpu.sse3 = (level >= 1);
+	cpu.sse41 = (level >= 2);
+	cpu.avx = (level >= 3);
+	cpu.avx2 = (level >= 4);
+
+	bool supported = false;
+	switch(level) {
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE2
+		case 0: supported = system_cpu_support_sse2(); break;
+#endif
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE3
+		case 1: supported = system_cpu_support_sse3(); break;
+#endif
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE41
+		case 2: supported = system_cpu_support_sse41(); break;
+#endif
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX
+		case 3: supported = system_cpu_support_avx(); break;
+#endif
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
+		case 4: supported = system_cpu_support_avx2(); break;
+#endif
+		default: break;
+	}
+
+	return supported;
+}
+
+/* Name of the kernel the CPU device will pick, matching CPUDevice. */
+static string benchmark_cpu_kernel_name()
+{
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
+	if(system_cpu_support_avx2()) return "avx2";
+#endif
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX
+	if(system_cpu_support_avx()) return "avx";
+#endif
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE41
+	if(system_cpu_support_sse41()) return "sse41";
+#endif
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE3
+	if(system_cpu_support_sse3()) return "sse3";
+#endif
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE2
+	if(system_cpu_support_sse2()) return "sse2";
+#endif
+	return "generic";
+}
+
+static void benchmark_print(const vector<BenchmarkResult>& results,
+                            const vector<BenchmarkReference>& references)
+{
+	const DeviceInfo& device = options.session_params.device;
+
+	printf("{\n");
+	printf("  \"version\": %s,\n", json_string(CYCLES_VERSION_STRING).c_str());
+	printf("  \"device\": %s,\n", json_string(device.description).c_str());
+	printf("  \"cpu\": %s,\n", json_string(system_cpu_brand_string()).c_str());
+	printf("  \"threads\": %d,\n", (options.session_params.threads > 0)?
+	                                   options.session_params.threads:
+	                                   system_cpu_thread_count());
+	printf("  \"samples\": %d,\n", options.session_params.samples);
+	printf("  \"seed\": %d,\n", options.benchmark_seed);
+	printf("  \"denoising\": %s,\n", (options.session_params.use_denoising)? "true": "false");
+
+	if(options.benchmark_reference_samples > 0) {
+		printf("  \"reference_samples\": %d,\n", options.benchmark_reference_samples);
+		printf("  \"references\": [");
+		for(size_t i = 0; i < references.size(); i++) {
+			printf("%s\n    {\"file\": %s, \"render_time\": %.6f}",
+			       (i == 0)? "": ",",
+			       json_string(references[i].filepath).c_str(),
+			       references[i].render_time);
+		}
+		printf("\n  ],\n");
+	}
+
+	printf("  \"runs\": [");
+	for(size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult& result = results[i];
+
+		printf("%s\n    {\"file\": %s, \"kernel\": %s, \"bvh_layout\": %s, \"run\": %d, "
+		       "\"scene_update_time\": %.6f, \"render_time\": %.6f, "
+		       "\"pixel_samples\": %llu, \"samples_per_second\": %.2f, "
+		       "\"memory_peak\": %llu, \"rmse\": %.6g, \"relmse\": %.6g}",
+		       (i == 0)? "": ",",
+		       json_string(result.filepath).c_str(),
+		       json_string(result.kernel).c_str(),
+		       json_string(result.bvh_layout).c_str(),
+		       result.run,
+		       result.scene_update_time,
+		       result.render_time,
+		       (unsigned long long)result.pixel_samples,
+		       (result.render_time > 0.0)? result.pixel_samples / result.render_time: 0.0,
+		       (unsigned long long)result.mem_peak,
+		       result.rmse,
+		       result.relmse);
+	}
+	printf("\n  ],\n");
+
+	/* best and mean render time of the repeated runs */
+	printf("  \"summary\": [");
+	for(size_t i = 0; i < results.size(); i += options.benchmark_repeat) {
+		double best_time = results[i].render_time;
+		double total_time = 0.0;
+		double update_time = 0.0;
+		double relmse = 0.0;
+
+		for(int run = 0; run < options.benchmark_repeat; run++) {
+			const BenchmarkResult& result = results[i + run];
+			best_time = min(best_time, result.render_time);
+			total_time += result.render_time;
+			update_time += result.scene_update_time;
+			relmse += result.relmse;
+		}
+
+		printf("%s\n    {\"file\": %s, \"kernel\": %s, \"render_time_best\": %.6f, "
+		       "\"render_time_mean\": %.6f, \"scene_update_time_mean\": %.6f, "
+		       "\"samples_per_second_best\": %.2f, \"relmse_mean\": %.6g}",
+		       (i == 0)? "": ",",
+		       json_string(results[i].filepath).c_str(),
+		       json_string(results[i].kernel).c_str(),
+		       best_time,
+		       total_time / options.benchmark_repeat,
+		       update_time / options.benchmark_repeat,
+		       (best_time > 0.0)? results[i].pixel_samples / best_time: 0.0,
+		       relmse / options.benchmark_repeat);
+	}
+	printf("\n  ]\n");
+	printf("}\n");
+}
+
+static void benchmark_render(const string& filepath, int width, int height, int seed)
+{
+	/* resolution from the camera of each file, unless overridden */
+	options.filepath = filepath;
+	options.width = width;
+	options.height = height;
+
+	scene_init();
+
+	options.scene->integrator->seed = seed;
+	options.scene->integrator->need_update = true;
+
+	benchmark_pixels.clear();
+	benchmark_pixels.resize((size_t)options.width*options.height*4, 0.0f);
+
+	session_init();
+	options.session->wait();
+}
+
+static void benchmark_run()
+{
+	vector<BenchmarkResult> results;
+	vector<BenchmarkReference> references;
+	int width = options.width;
+	int height = options.height;
+
+	/* high sample count renders without denoising, with a different seed so
+	 * the noise is not correlated with the benchmark runs */
+	if(options.benchmark_reference_samples > 0) {
+		SessionParams session_params = options.session_params;
+		options.session_params.samples = options.benchmark_reference_samples;
+		options.session_params.use_denoising = false;
+
+		benchmark_set_cpu_kernel("default");
+		scene_params_set_bvh_layout();
+
+		foreach(const string& filepath, options.filepaths) {
+			fprintf(stderr, "Rendering reference of %s with %d samples\n",
+			        filepath.c_str(), options.benchmark_reference_samples);
+
+			benchmark_render(filepath, width, height, options.benchmark_seed + 1);
+
+			RenderStats stats;
+			options.session->collect_statistics(&stats);
+
+			BenchmarkReference reference;
+			reference.filepath = filepath;
+			reference.render_time = stats.render_time;
+			reference.pixels = benchmark_pixels;
+			references.push_back(reference);
+
+			session_exit();
+		}
+
+		options.session_params = session_params;
+	}
+
+	foreach(const string& kernel, options.benchmark_kernels) {
+		if(!benchmark_set_cpu_kernel(kernel)) {
+			fprintf(stderr, "CPU kernel %s is not available, skipping\n", kernel.c_str());
+			continue;
+		}
+
+		/* 8-wide BVH depends on the kernel */
+		scene_params_set_bvh_layout();
+		string kernel_name = benchmark_cpu_kernel_name();
+		if(DebugFlags().cpu.stream)
+			kernel_name += "_stream";
+
+		foreach(const string& filepath, options.filepaths) {
+			for(int run = 0; run < options.benchmark_repeat; run++) {
+				fprintf(stderr, "Rendering %s with %s kernel, run %d of %d\n",
+				        filepath.c_str(), kernel_name.c_str(), run + 1, options.benchmark_repeat);
+
+				benchmark_render(filepath, width, height, options.benchmark_seed);
+
+				RenderStats stats;
+				options.session->collect_statistics(&stats);
+
+				BenchmarkResult result;
+				result.filepath = filepath;
+				result.kernel = kernel_name;
+				result.bvh_layout = stats.scene_update.bvh_layout;
+				result.run = run;
+				result.scene_update_time = stats.scene_update.total_time;
+				result.render_time = stats.render_time;
+				result.pixel_samples = stats.pixel_samples;
+				result.mem_peak = stats.mem_peak;
+				result.rmse = 0.0;
+				result.relmse = 0.0;
+
+				foreach(const BenchmarkReference& reference, references) {
+					if(reference.filepath == filepath)
+						benchmark_image_error(benchmark_pixels, reference.pixels, &result.rmse, &result.relmse);
+				}
+
+				results.push_back(result);
+
+				session_exit();
+			}
+		}
+	}
+
+	DebugFlags().cpu.reset();
+
+	benchmark_print(results, references);
+}
+
 static void options_parse(int argc, const char **argv)
 {
 	options.width = 0;
 	options.height = 0;
 	options.filepath = "";
+	options.profile_filepath = "";
 	options.session = NULL;
 	options.quiet = false;
+	options.benchmark = false;
+	options.benchmark_repeat = 3;
+	options.benchmark_seed = 0;
+	options.benchmark_reference_samples = 0;
 
 	/* device names */
 	string device_names = "";
@@ -353,6 +772,15 @@ static void options_parse(int argc, const char **argv)
 	/* shading system */
 	string ssname = "svm";
 
+	/* bvh layout */
+	options.bvh_layout = "bvh2";
+
+	/* benchmark kernels */
+	string kernelnames = "";
+
+	/* checkpoint */
+	float checkpoint_interval = (float)options.session_params.checkpoint_interval;
+
 	/* parse options */
 	ArgParse ap;
 	bool help = false, debug = false, version = false;
@@ -364,6 +792,7 @@ static void options_parse(int argc, const char **argv)
 #ifdef WITH_OSL
 		"--shadingsys %s", &ssname, "Shading system to use: svm, osl",
 #endif
+		"--bvh-layout %s", &options.bvh_layout, "BVH layout to use: bvh2, qbvh, obvh (CPU only)",
 		"--background", &options.session_params.background, "Render in background, without user interface",
 		"--quiet", &options.quiet, "In background mode, don't print progress messages",
 		"--samples %d", &options.session_params.samples, "Number of samples to render",
@@ -373,6 +802,18 @@ static void options_parse(int argc, const char **argv)
 		"--height %d", &options.height, "Window height in pixel",
 		"--tile-width %d", &options.session_params.tile_size.x, "Tile width in pixels",
 		"--tile-height %d", &options.session_params.tile_size.y, "Tile height in pixels",
+		"--checkpoint %s", &options.session_params.checkpoint_path, "Write accumulated buffers to file while rendering in background, to resume interrupted renders",
+		"--checkpoint-interval %f", &checkpoint_interval, "Seconds between checkpoints of the full image",
+		"--resume", &options.session_params.checkpoint_resume, "Continue the render from the checkpoint file",
+		"--denoise", &options.session_params.use_denoising, "Denoise the image in background mode (CPU only)",
+		"--denoise-radius %d", &options.session_params.denoising_radius, "Radius of the denoising search window in pixels",
+		"--denoise-strength %f", &options.session_params.denoising_strength, "Tolerance of the denoiser to color differences",
+		"--profile %s", &options.profile_filepath, "Write render statistics and CPU ray and shader evaluation counts as JSON to file",
+		"--benchmark", &options.benchmark, "Render all files in background with fixed seed and samples, and print timings and memory usage as JSON",
+		"--repeat %d", &options.benchmark_repeat, "Number of benchmark runs for each file and kernel",
+		"--seed %d", &options.benchmark_seed, "Integrator seed for benchmark runs",
+		"--reference-samples %d", &options.benchmark_reference_samples, "Render each benchmark file with this many samples first, and report the error of the runs compared to it",
+		"--kernels %s", &kernelnames, "Comma separated CPU kernels to benchmark: sse2, sse3, sse41, avx, avx2, with _stream suffix for ray stream tracing (default: best available)",
 		"--list-devices", &list, "List information about all available devices",
 #ifdef WITH_CYCLES_LOGGING
 		"--debug", &debug, "Enable debug logging",
@@ -420,10 +861,35 @@ static void options_parse(int argc, const char **argv)
 	else if(ssname == "svm")
 		options.scene_params.shadingsystem = SHADINGSYSTEM_SVM;
 
+	scene_params_set_bvh_layout();
+
+	options.session_params.checkpoint_interval = checkpoint_interval;
+
 #ifndef WITH_CYCLES_STANDALONE_GUI
 	options.session_params.background = true;
 #endif
 
+	if(options.benchmark) {
+		options.session_params.background = true;
+		options.quiet = true;
+
+		/* unlimited samples would never finish */
+		if(options.session_params.samples == INT_MAX)
+			options.session_params.samples = 64;
+
+		/* tiles are kept until the end of the render, so the denoiser and
+		 * the reference comparison get the whole image */
+		if(options.session_params.use_denoising || options.benchmark_reference_samples > 0)
+			options.session_params.progressive_refine = true;
+
+		if(kernelnames == "")
+			options.benchmark_kernels.push_back("default");
+		else
+			string_split(options.benchmark_kernels, kernelnames, ",");
+	}
+
+	options.session_params.use_profiling = !options.profile_filepath.empty();
+
 	/* Use progressive rendering */
 	options.session_params.progressive = true;
 
@@ -456,6 +922,20 @@ static void options_parse(int argc, const char **argv)
 		exit(EXIT_FAILURE);
 	}
 #endif
+	else if(!(options.bvh_layout == "bvh2" || options.bvh_layout == "qbvh" || options.bvh_layout == "obvh")) {
+		fprintf(stderr, "Unknown BVH layout: %s\n", options.bvh_layout.c_str());
+		exit(EXIT_FAILURE);
+	}
+	else if(options.scene_params.use_qbvh && options.session_params.device.type != DEVICE_CPU) {
+		fprintf(stderr, "QBVH and OBVH layouts only work with CPU device\n");
+		exit(EXIT_FAILURE);
+	}
+	else if(options.bvh_layout == "obvh" && !options.scene_params.use_obvh &&
+	        options.benchmark_kernels.empty())
+	{
+		fprintf(stderr, "OBVH layout requires the AVX2 kernel and a CPU supporting it\n");
+		exit(EXIT_FAILURE);
+	}
 	else if(options.session_params.samples < 0) {
 		fprintf(stderr, "Invalid number of samples: %d\n", options.session_params.samples);
 		exit(EXIT_FAILURE);
@@ -464,12 +944,37 @@ static void options_parse(int argc, const char **argv)
 		fprintf(stderr, "No file path specified\n");
 		exit(EXIT_FAILURE);
 	}
+	else if(options.benchmark && options.benchmark_repeat < 1) {
+		fprintf(stderr, "Invalid number of benchmark runs: %d\n", options.benchmark_repeat);
+		exit(EXIT_FAILURE);
+	}
+	else if(options.benchmark && kernelnames != "" && options.session_params.device.type != DEVICE_CPU) {
+		fprintf(stderr, "Benchmarking kernels only works with CPU device\n");
+		exit(EXIT_FAILURE);
+	}
+
+	foreach(const string& kernel, options.benchmark_kernels) {
+		string name;
+		benchmark_cpu_kernel_parse(kernel, &name);
+
+		bool found = (name == "default");
+		for(int i = 0; i < cpu_kernel_num; i++) {
+			if(name == cpu_kernel_names[i])
+				found = true;
+		}
+
+		if(!found) {
+			fprintf(stderr, "Unknown CPU kernel: %s\n", kernel.c_str());
+			exit(EXIT_FAILURE);
+		}
+	}
 
 	/* For smoother Viewport */
 	options.session_params.start_resolution = 64;
 
-	/* load scene */
-	scene_init();
+	/* load scene, benchmark loads every file itself */
+	if(!options.benchmark)
+		scene_init();
 }
 
 CCL_NAMESPACE_END
@@ -482,6 +987,11 @@ int main(int argc, const char **argv)
 	path_init();
 	options_parse(argc, argv);
 
+	if(options.benchmark) {
+		benchmark_run();
+		return 0;
+	}
+
 #ifdef WITH_CYCLES_STANDALONE_GUI
 	if(options.session_params.background) {
 #endif
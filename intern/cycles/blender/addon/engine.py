@@ -138,11 +138,28 @@ def free(engine):
         del engine.session
 
 
+# Statistics of the last finished render as JSON string, see render_stats().
+last_render_stats = None
+
+
 def render(engine):
     import _cycles
     if hasattr(engine, "session"):
         _cycles.render(engine.session)
 
+        global last_render_stats
+        last_render_stats = _cycles.render_stats(engine.session)
+
+
+def render_stats(engine):
+    """Scene update timing, BVH, ray and shader evaluation counts and memory
+    usage of the session as JSON string, None if there is no session"""
+    import _cycles
+    session = getattr(engine, "session", None)
+    if session is None:
+        return None
+    return _cycles.render_stats(session)
+
 
 def bake(engine, obj, pass_type, pass_filter, object_id, pixel_array, num_pixels, depth, result):
     import _cycles
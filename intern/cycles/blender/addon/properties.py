@@ -290,6 +290,29 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 min=0.0, max=1.0,
                 default=0.01,
                 )
+        cls.use_light_tree = BoolProperty(
+                name="Light Tree",
+                description="Sample mesh lights and lamps using a hierarchy over their position, orientation and strength, "
+                            "rather than proportional to their area only (faster for scenes with many lights)",
+                default=False,
+                )
+
+        cls.adaptive_threshold = FloatProperty(
+                name="Adaptive Threshold",
+                description="Stop sampling pixels once their noise level is below this threshold, "
+                            "and finish tiles early when all of their pixels converged. "
+                            "Zero disables adaptive sampling",
+                min=0.0, max=1.0,
+                default=0.0,
+                precision=3,
+                )
+        cls.adaptive_min_samples = IntProperty(
+                name="Adaptive Min Samples",
+                description="Minimum number of samples taken for every pixel before "
+                            "adaptive sampling checks for convergence",
+                min=2, max=4096,
+                default=16,
+                )
 
         cls.caustics_reflective = BoolProperty(
                 name="Reflective Caustics",
@@ -388,6 +411,13 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 min=2, max=65536
                 )
 
+        cls.volume_skip_empty = BoolProperty(
+                name="Skip Empty Space",
+                description="Skip steps through smoke where all voxel grids are empty, "
+                            "assuming the volume shader has no density there (CPU only)",
+                default=False,
+                )
+
         cls.dicing_rate = FloatProperty(
                 name="Dicing Rate",
                 description="Size of a micropolygon in pixels",
@@ -528,6 +558,19 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 description="Use special type BVH optimized for hair (uses more ram but renders faster)",
                 default=True,
                 )
+        cls.debug_use_bvh_refit = BoolProperty(
+                name="Refit BVH",
+                description="Refit the BVH instead of rebuilding it when only vertex positions changed, "
+                            "for faster updates of deforming meshes (requires Persistent Images for final renders)",
+                default=False,
+                )
+        cls.debug_bvh_refit_threshold = FloatProperty(
+                name="Rebuild Threshold",
+                description="Rebuild the BVH when refitting made its nodes this many times larger than after "
+                            "building, as it gets slow to render (zero to never rebuild)",
+                min=0.0, max=100.0,
+                default=2.0,
+                )
         cls.tile_order = EnumProperty(
                 name="Tile Order",
                 description="Tile order for rendering",
@@ -632,6 +675,76 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
             items=enum_texture_limit
             )
 
+        cls.use_texture_cache = BoolProperty(
+            name="Texture Cache",
+            description="Load image textures on demand in tiles and mipmap levels, "
+                        "instead of fully into memory (CPU and SVM only, .tx files "
+                        "converted with maketx load fastest)",
+            default=False,
+            )
+        cls.texture_cache_size = IntProperty(
+            name="Cache Size",
+            description="Maximum memory used by the texture cache in megabytes, "
+                        "0 for the default",
+            min=0, max=65536,
+            default=1024,
+            )
+
+        cls.use_persistent_scene = BoolProperty(
+            name="Persistent Scene",
+            description="Keep the synchronized scene in memory between frames of an animation render "
+                        "and only update changed objects, meshes and materials (requires Persistent Images)",
+            default=False,
+            )
+
+        cls.checkpoint_directory = StringProperty(
+            name="Checkpoint Directory",
+            description="Directory to write render checkpoints to during final renders, "
+                        "so interrupted renders can be resumed (empty to disable)",
+            subtype='DIR_PATH',
+            default="",
+            )
+        cls.checkpoint_interval = FloatProperty(
+            name="Interval",
+            description="Seconds between checkpoints with progressive refine, "
+                        "otherwise every finished tile is written",
+            min=1.0, soft_max=3600.0,
+            default=60.0,
+            )
+        cls.use_checkpoint_resume = BoolProperty(
+            name="Resume",
+            description="Continue interrupted renders from their checkpoint, instead of starting over",
+            default=False,
+            )
+
+        cls.use_denoising = BoolProperty(
+            name="Denoising",
+            description="Denoise the combined pass of final renders with a filter guided by normal, "
+                        "albedo and depth, each tile once its neighbors are rendered (CPU only)",
+            default=False,
+            )
+        cls.denoising_radius = IntProperty(
+            name="Radius",
+            description="Size of the image area that is searched for similar pixels, "
+                        "larger is smoother but slower",
+            min=1, max=25,
+            default=8,
+            )
+        cls.denoising_strength = FloatProperty(
+            name="Strength",
+            description="Tolerance to color differences between pixels, "
+                        "higher removes more noise but blurs more detail",
+            min=0.0, max=1.0,
+            default=0.5,
+            )
+        cls.denoising_feature_strength = FloatProperty(
+            name="Feature Strength",
+            description="Tolerance to differences in normal, albedo and depth between pixels, "
+                        "higher removes more noise but blurs edges and textures",
+            min=0.0, max=1.0,
+            default=0.5,
+            )
+
         # Various fine-tuning debug flags
 
         def devices_update_callback(self, context):
@@ -645,6 +758,24 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
         cls.debug_use_cpu_sse3 = BoolProperty(name="SSE3", default=True)
         cls.debug_use_cpu_sse2 = BoolProperty(name="SSE2", default=True)
         cls.debug_use_qbvh = BoolProperty(name="QBVH", default=True)
+        cls.debug_use_obvh = BoolProperty(name="OBVH", default=True)
+        cls.debug_use_cpu_stream = BoolProperty(
+                name="Ray Stream",
+                description="Trace tiles as batches of rays sorted by shader, instead of one path at a time",
+                default=False,
+                )
+        cls.debug_use_cpu_sparse_volumes = BoolProperty(
+                name="Sparse Volumes",
+                description="Store mostly empty smoke voxel grids as sparse tiles, instead of dense arrays",
+                default=True,
+                )
+
+        cls.debug_use_profiling = BoolProperty(
+                name="Profiling",
+                description="Count rays and shader evaluations while rendering on the CPU, "
+                            "for the statistics of the last render",
+                default=False,
+                )
 
         cls.debug_use_cuda_adaptive_compile = BoolProperty(name="Adaptive Compile", default=False)
 
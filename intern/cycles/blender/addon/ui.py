@@ -175,6 +175,13 @@ class CyclesRender_PT_sampling(CyclesButtonsPanel, Panel):
         sub.prop(cscene, "sample_clamp_direct")
         sub.prop(cscene, "sample_clamp_indirect")
         sub.prop(cscene, "light_sampling_threshold")
+        sub.prop(cscene, "use_light_tree")
+
+        sub.separator()
+        sub.prop(cscene, "adaptive_threshold")
+        subsub = sub.row(align=True)
+        subsub.active = cscene.adaptive_threshold > 0.0
+        subsub.prop(cscene, "adaptive_min_samples", text="Min Samples")
 
         if cscene.progressive == 'PATH' or use_branched_path(context) is False:
             col = split.column()
@@ -236,6 +243,7 @@ class CyclesRender_PT_geometery(CyclesButtonsPanel, Panel):
             sub.label("Volume Sampling:")
             sub.prop(cscene, "volume_step_size")
             sub.prop(cscene, "volume_max_steps")
+            sub.prop(cscene, "volume_skip_empty")
 
             col = split.column()
 
@@ -251,6 +259,7 @@ class CyclesRender_PT_geometery(CyclesButtonsPanel, Panel):
             row = layout.row()
             row.prop(cscene, "volume_step_size")
             row.prop(cscene, "volume_max_steps")
+            layout.prop(cscene, "volume_skip_empty")
 
 
 class CyclesRender_PT_light_paths(CyclesButtonsPanel, Panel):
@@ -394,6 +403,23 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
         subsub = sub.column(align=True)
         subsub.prop(rd, "use_save_buffers")
 
+        sub = col.column(align=True)
+        sub.label(text="Checkpoints:")
+        sub.prop(cscene, "checkpoint_directory", text="")
+        subsub = sub.column(align=True)
+        subsub.active = bool(cscene.checkpoint_directory)
+        subsub.prop(cscene, "checkpoint_interval")
+        subsub.prop(cscene, "use_checkpoint_resume")
+
+        sub = col.column(align=True)
+        sub.label(text="Denoising:")
+        sub.prop(cscene, "use_denoising")
+        subsub = sub.column(align=True)
+        subsub.active = cscene.use_denoising
+        subsub.prop(cscene, "denoising_radius")
+        subsub.prop(cscene, "denoising_strength", slider=True)
+        subsub.prop(cscene, "denoising_feature_strength", slider=True)
+
         col = split.column(align=True)
 
         col.label(text="Viewport:")
@@ -405,12 +431,27 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
 
         col.label(text="Final Render:")
         col.prop(rd, "use_persistent_data", text="Persistent Images")
+        sub = col.column()
+        sub.active = rd.use_persistent_data
+        sub.prop(cscene, "use_persistent_scene")
 
         col.separator()
 
         col.label(text="Acceleration structure:")
         col.prop(cscene, "debug_use_spatial_splits")
         col.prop(cscene, "debug_use_hair_bvh")
+        col.prop(cscene, "debug_use_bvh_refit")
+        sub = col.column(align=True)
+        sub.active = cscene.debug_use_bvh_refit
+        sub.prop(cscene, "debug_bvh_refit_threshold")
+
+        col.separator()
+
+        col.label(text="Textures:")
+        col.prop(cscene, "use_texture_cache")
+        sub = col.column(align=True)
+        sub.active = cscene.use_texture_cache
+        sub.prop(cscene, "texture_cache_size")
 
 
 class CyclesRender_PT_layer_options(CyclesButtonsPanel, Panel):
@@ -1527,6 +1568,10 @@ class CyclesRender_PT_debug(CyclesButtonsPanel, Panel):
         row.prop(cscene, "debug_use_cpu_avx", toggle=True)
         row.prop(cscene, "debug_use_cpu_avx2", toggle=True)
         col.prop(cscene, "debug_use_qbvh")
+        col.prop(cscene, "debug_use_obvh")
+        col.prop(cscene, "debug_use_cpu_stream")
+        col.prop(cscene, "debug_use_cpu_sparse_volumes")
+        col.prop(cscene, "debug_use_profiling")
 
         col = layout.column()
         col.label('CUDA Flags:')
@@ -21,6 +21,9 @@
 #include "blender_sync.h"
 #include "blender_session.h"
 
+#include "session.h"
+#include "stats.h"
+
 #include "util_foreach.h"
 #include "util_logging.h"
 #include "util_md5.h"
@@ -67,6 +70,9 @@ bool debug_flags_sync_from_scene(BL::Scene b_scene)
 	flags.cpu.sse3 = get_boolean(cscene, "debug_use_cpu_sse3");
 	flags.cpu.sse2 = get_boolean(cscene, "debug_use_cpu_sse2");
 	flags.cpu.qbvh = get_boolean(cscene, "debug_use_qbvh");
+	flags.cpu.obvh = get_boolean(cscene, "debug_use_obvh");
+	flags.cpu.stream = get_boolean(cscene, "debug_use_cpu_stream");
+	flags.cpu.sparse_volumes = get_boolean(cscene, "debug_use_cpu_sparse_volumes");
 	/* Synchronize CUDA flags. */
 	flags.cuda.adaptive_compile = get_boolean(cscene, "debug_use_cuda_adaptive_compile");
 	/* Synchronize OpenCL kernel type. */
@@ -286,6 +292,25 @@ static PyObject *render_func(PyObject * /*self*/, PyObject *value)
 	Py_RETURN_NONE;
 }
 
+static PyObject *render_stats_func(PyObject * /*self*/, PyObject *value)
+{
+	BlenderSession *session = (BlenderSession*)PyLong_AsVoidPtr(value);
+
+	if(session->session == NULL) {
+		Py_RETURN_NONE;
+	}
+
+	/* final renders free the device memory when done */
+	if(!session->last_render_stats.empty()) {
+		return PyUnicode_FromString(session->last_render_stats.c_str());
+	}
+
+	RenderStats stats;
+	session->session->collect_statistics(&stats);
+
+	return PyUnicode_FromString(stats.to_json().c_str());
+}
+
 /* pixel_array and result passed as pointers */
 static PyObject *bake_func(PyObject * /*self*/, PyObject *args)
 {
@@ -696,6 +721,7 @@ static PyMethodDef methods[] = {
 	{"create", create_func, METH_VARARGS, ""},
 	{"free", free_func, METH_O, ""},
 	{"render", render_func, METH_O, ""},
+	{"render_stats", render_stats_func, METH_O, ""},
 	{"bake", bake_func, METH_VARARGS, ""},
 	{"draw", draw_func, METH_VARARGS, ""},
 	{"sync", sync_func, METH_O, ""},
@@ -28,12 +28,14 @@
 #include "scene.h"
 #include "session.h"
 #include "shader.h"
+#include "stats.h"
 
 #include "util_color.h"
 #include "util_foreach.h"
 #include "util_function.h"
 #include "util_hash.h"
 #include "util_logging.h"
+#include "util_path.h"
 #include "util_progress.h"
 #include "util_time.h"
 
@@ -189,7 +191,7 @@ void BlenderSession::reset_session(BL::BlendData& b_data_, BL::Scene& b_scene_)
 		 * them rather than trying to distinguish which settings need to be updated
 		 */
 
-		delete session;
+		free_session();
 
 		create_session();
 
@@ -197,7 +199,6 @@ void BlenderSession::reset_session(BL::BlendData& b_data_, BL::Scene& b_scene_)
 	}
 
 	session->progress.reset();
-	scene->reset();
 
 	session->tile_manager.set_tile_order(session_params.tile_order);
 
@@ -206,8 +207,20 @@ void BlenderSession::reset_session(BL::BlendData& b_data_, BL::Scene& b_scene_)
 	 */
 	session->stats.mem_peak = session->stats.mem_used;
 
-	/* sync object should be re-created */
-	sync = new BlenderSync(b_engine, b_data, b_scene, scene, !background, session->progress, is_cpu);
+	if(scene_params.persistent_scene && sync) {
+		/* scene and sync object are kept from the previous frame, only copy the
+		 * recalc flags so objects, meshes and shaders that did not change are
+		 * not synced again and keep their device memory */
+		VLOG(1) << "Reusing persistent scene, syncing changed data only.";
+		sync->sync_recalc();
+	}
+	else {
+		scene->reset();
+
+		/* sync object should be re-created */
+		delete sync;
+		sync = new BlenderSync(b_engine, b_data, b_scene, scene, !background, session->progress, is_cpu);
+	}
 
 	/* for final render we will do full data sync per render layer, only
 	 * do some basic syncing here, no objects or materials for speed */
@@ -311,6 +324,8 @@ static PassType get_pass_type(BL::RenderPass& b_pass)
 				return PASS_BVH_TRAVERSED_INSTANCES;
 			if(b_pass.debug_type() == BL::RenderPass::debug_type_RAY_BOUNCES)
 				return PASS_RAY_BOUNCES;
+			if(b_pass.debug_type() == BL::RenderPass::debug_type_SAMPLE_COUNT)
+				return PASS_SAMPLE_COUNT;
 			break;
 		}
 #endif
@@ -452,6 +467,11 @@ void BlenderSession::render()
 	SessionParams session_params = BlenderSync::get_session_params(b_engine, b_userpref, b_scene, background);
 	BufferParams buffer_params = BlenderSync::get_buffer_params(b_render, b_v3d, b_rv3d, scene->camera, width, height);
 
+	/* checkpoints for resuming interrupted renders */
+	PointerRNA cscene = RNA_pointer_get(&b_scene.ptr, "cycles");
+	BL::ID b_scene_id(b_scene);
+	string checkpoint_dir = blender_absolute_path(b_data, b_scene_id, get_string(cscene, "checkpoint_directory"));
+
 	/* render each layer */
 	BL::RenderSettings r = b_scene.render();
 	BL::RenderSettings::layers_iterator b_layer_iter;
@@ -535,6 +555,19 @@ void BlenderSession::render()
 			/* Update tile manager if we're doing resumable render. */
 			update_resumable_tile_manager(effective_layer_samples);
 
+			/* One checkpoint for every frame, layer and view. */
+			if(!checkpoint_dir.empty()) {
+				string filename = string_printf("%s_%s_%s_%s_%04d.ckpt",
+				                                path_filename(b_data.filepath()).c_str(),
+				                                b_scene.name().c_str(),
+				                                b_rlay_name.c_str(),
+				                                b_rview_name.c_str(),
+				                                b_scene.frame_current());
+				string_replace(filename, "/", "_");
+				string_replace(filename, "\\", "_");
+				session->set_checkpoint_path(path_join(checkpoint_dir, filename));
+			}
+
 			/* Update session itself. */
 			session->reset(buffer_params, effective_layer_samples);
 
@@ -558,18 +591,25 @@ void BlenderSession::render()
 	VLOG(1) << "Total render time: " << total_time;
 	VLOG(1) << "Render time (without synchronization): " << render_time;
 
+	/* memory statistics are only meaningful while the scene is on the device */
+	RenderStats render_stats;
+	session->collect_statistics(&render_stats);
+	last_render_stats = render_stats.to_json();
+
 	/* clear callback */
 	session->write_render_tile_cb = function_null;
 	session->update_render_tile_cb = function_null;
 
 	/* free all memory used (host and device), so we wouldn't leave render
-	 * engine with extra memory allocated
+	 * engine with extra memory allocated, unless the scene is kept for the
+	 * next frame
 	 */
+	if(!scene->params.persistent_scene) {
+		session->device_free();
 
-	session->device_free();
-
-	delete sync;
-	sync = NULL;
+		delete sync;
+		sync = NULL;
+	}
 }
 
 static void populate_bake_data(BakeData *data, const
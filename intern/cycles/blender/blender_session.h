@@ -114,6 +114,10 @@ public:
 	string last_error;
 	float last_progress;
 
+	/* statistics of the last final render as JSON, collected before the
+	 * device memory is freed */
+	string last_render_stats;
+
 	int width, height;
 	double start_resize_time;
 
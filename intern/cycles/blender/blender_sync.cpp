@@ -36,6 +36,7 @@
 #include "util_debug.h"
 #include "util_foreach.h"
 #include "util_opengl.h"
+#include "util_optimization.h"
 #include "util_hash.h"
 
 CCL_NAMESPACE_BEGIN
@@ -249,6 +250,7 @@ void BlenderSync::sync_integrator()
 
 	integrator->volume_max_steps = get_int(cscene, "volume_max_steps");
 	integrator->volume_step_size = get_float(cscene, "volume_step_size");
+	integrator->volume_skip_empty = get_boolean(cscene, "volume_skip_empty");
 
 	integrator->caustics_reflective = get_boolean(cscene, "caustics_reflective");
 	integrator->caustics_refractive = get_boolean(cscene, "caustics_refractive");
@@ -295,6 +297,16 @@ void BlenderSync::sync_integrator()
 	integrator->sample_all_lights_indirect = get_boolean(cscene, "sample_all_lights_indirect");
 	integrator->light_sampling_threshold = get_float(cscene, "light_sampling_threshold");
 
+	/* light tree is built along with the light distribution */
+	bool use_light_tree = get_boolean(cscene, "use_light_tree");
+	if(integrator->use_light_tree != use_light_tree) {
+		scene->light_manager->tag_update(scene);
+	}
+	integrator->use_light_tree = use_light_tree;
+
+	integrator->adaptive_threshold = get_float(cscene, "adaptive_threshold");
+	integrator->adaptive_min_samples = get_int(cscene, "adaptive_min_samples");
+
 	int diffuse_samples = get_int(cscene, "diffuse_samples");
 	int glossy_samples = get_int(cscene, "glossy_samples");
 	int transmission_samples = get_int(cscene, "transmission_samples");
@@ -498,12 +510,18 @@ SceneParams BlenderSync::get_scene_params(BL::Scene& b_scene,
 
 	params.use_bvh_spatial_split = RNA_boolean_get(&cscene, "debug_use_spatial_splits");
 	params.use_bvh_unaligned_nodes = RNA_boolean_get(&cscene, "debug_use_hair_bvh");
+	params.use_bvh_refit = RNA_boolean_get(&cscene, "debug_use_bvh_refit");
+	params.bvh_refit_threshold = RNA_float_get(&cscene, "debug_bvh_refit_threshold");
 
 	if(background && params.shadingsystem != SHADINGSYSTEM_OSL)
 		params.persistent_data = r.use_persistent_data();
 	else
 		params.persistent_data = false;
 
+	/* keep objects, meshes, shaders and device memory between frames as well,
+	 * only syncing the datablocks changed since the previous frame */
+	params.persistent_scene = params.persistent_data && RNA_boolean_get(&cscene, "use_persistent_scene");
+
 	int texture_limit;
 	if(background) {
 		texture_limit = RNA_enum_get(&cscene, "texture_limit_render");
@@ -518,14 +536,28 @@ SceneParams BlenderSync::get_scene_params(BL::Scene& b_scene,
 		params.texture_limit = 0;
 	}
 
+	/* texture cache is only implemented for SVM on the CPU device */
+	params.use_texture_cache = is_cpu &&
+	                           params.shadingsystem == SHADINGSYSTEM_SVM &&
+	                           RNA_boolean_get(&cscene, "use_texture_cache");
+	params.texture_cache_size = RNA_int_get(&cscene, "texture_cache_size");
+
 #if !(defined(__GNUC__) && (defined(i386) || defined(_M_IX86)))
 	if(is_cpu) {
 		params.use_qbvh = DebugFlags().cpu.qbvh && system_cpu_support_sse2();
+		/* 8-wide nodes are only traversed by the AVX2 kernel, so only use
+		 * them when the device is going to pick that kernel. */
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
+		params.use_obvh = params.use_qbvh &&
+		                  DebugFlags().cpu.obvh &&
+		                  system_cpu_support_avx2();
+#endif
 	}
 	else
 #endif
 	{
 		params.use_qbvh = false;
+		params.use_obvh = false;
 	}
 
 	return params;
@@ -698,6 +730,17 @@ SessionParams BlenderSync::get_session_params(BL::RenderEngine& b_engine,
 		params.shadingsystem = SHADINGSYSTEM_SVM;
 	else if(shadingsystem == 1)
 		params.shadingsystem = SHADINGSYSTEM_OSL;
+
+	params.use_profiling = get_boolean(cscene, "debug_use_profiling");
+
+	/* checkpoint file is set for each render layer */
+	params.checkpoint_interval = (double)get_float(cscene, "checkpoint_interval");
+	params.checkpoint_resume = get_boolean(cscene, "use_checkpoint_resume");
+
+	params.use_denoising = get_boolean(cscene, "use_denoising");
+	params.denoising_radius = get_int(cscene, "denoising_radius");
+	params.denoising_strength = get_float(cscene, "denoising_strength");
+	params.denoising_feature_strength = get_float(cscene, "denoising_feature_strength");
 	
 	/* color managagement */
 #ifdef GLEW_MX
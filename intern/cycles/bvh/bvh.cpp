@@ -32,6 +32,7 @@
 #include "util_map.h"
 #include "util_progress.h"
 #include "util_system.h"
+#include "util_task.h"
 #include "util_types.h"
 #include "util_math.h"
 
@@ -60,11 +61,23 @@ struct BVHStackEntry
 BVH::BVH(const BVHParams& params_, const vector<Object*>& objects_)
 : params(params_), objects(objects_)
 {
+	build_area_ratio = 0.0f;
+	area_ratio = 0.0f;
+	node_area = 0.0f;
+	num_nodes = 0;
+	num_leaf_nodes = 0;
+
+	top_level_prims = 0;
+	top_level_tri_verts = 0;
+	top_level_nodes = 0;
+	top_level_leaf_nodes = 0;
 }
 
 BVH *BVH::create(const BVHParams& params, const vector<Object*>& objects)
 {
-	if(params.use_qbvh)
+	if(params.use_obvh)
+		return new OBVH(params, objects);
+	else if(params.use_qbvh)
 		return new QBVH(params, objects);
 	else
 		return new RegularBVH(params, objects);
@@ -90,6 +103,9 @@ void BVH::build(Progress& progress)
 		return;
 	}
 
+	num_nodes = root->getSubtreeSize(BVH_STAT_NODE_COUNT);
+	num_leaf_nodes = root->getSubtreeSize(BVH_STAT_LEAF_COUNT);
+
 	/* pack triangles */
 	progress.set_substatus("Packing BVH triangles and strands");
 	pack_primitives();
@@ -101,23 +117,169 @@ void BVH::build(Progress& progress)
 
 	/* pack nodes */
 	progress.set_substatus("Packing BVH nodes");
+	node_area = 0.0f;
 	pack_nodes(root);
 
+	area_ratio = node_area / max(root->m_bounds.safe_area(), FLT_MIN);
+	build_area_ratio = area_ratio;
+
 	/* free build nodes */
 	root->deleteSubtree();
 }
 
 /* Refitting */
 
-void BVH::refit(Progress& progress)
+bool BVH::refit(Progress& progress)
 {
-	progress.set_substatus("Packing BVH primitives");
-	pack_primitives();
+	/* Instances were merged into the top level arrays after packing, strip
+	 * them off so only the top level part is refitted. */
+	if(params.top_level && !unpack_instances()) {
+		return false;
+	}
 
-	if(progress.get_cancel()) return;
+	/* Leaf nodes and their primitives are independent from each other, and
+	 * take most of the time, so they are refitted in parallel. */
+	progress.set_substatus("Refitting BVH leaf nodes");
+
+	const size_t num_leaf_nodes = pack.leaf_nodes.size();
+	refit_leaf_bounds.resize(num_leaf_nodes);
+	refit_leaf_visibility.resize(num_leaf_nodes);
+
+	TaskPool pool;
+	for(size_t start = 0; start < num_leaf_nodes; start += REFIT_TASK_SIZE) {
+		pool.push(function_bind(&BVH::refit_leaf_nodes,
+		                        this,
+		                        start,
+		                        min(start + REFIT_TASK_SIZE, num_leaf_nodes)));
+	}
+	pool.wait_work();
+
+	BoundBox bounds = BoundBox::empty;
+	foreach(const BoundBox& leaf_bounds, refit_leaf_bounds) {
+		bounds.grow(leaf_bounds);
+	}
 
 	progress.set_substatus("Refitting BVH nodes");
+	node_area = 0.0f;
 	refit_nodes();
+
+	refit_leaf_bounds.free_memory();
+	refit_leaf_visibility.free_memory();
+
+	if(params.top_level) {
+		pack_instances(top_level_nodes, top_level_leaf_nodes);
+	}
+
+	area_ratio = node_area / max(bounds.safe_area(), FLT_MIN);
+
+	/* Rebuild if the nodes overlap too much, the tree got slow to traverse. */
+	if(params.refit_rebuild_threshold > 0.0f &&
+	   area_ratio > build_area_ratio * params.refit_rebuild_threshold)
+	{
+		VLOG(1) << "BVH quality degraded from " << build_area_ratio
+		        << " to " << area_ratio << ", rebuilding.";
+		return false;
+	}
+
+	return true;
+}
+
+void BVH::refit_leaf_nodes(size_t start, size_t end)
+{
+	for(size_t idx = start; idx < end; idx += BVH_NODE_LEAF_SIZE) {
+		refit_leaf_node(idx);
+	}
+}
+
+void BVH::refit_leaf_node(int idx)
+{
+	int4 *data = &pack.leaf_nodes[idx];
+	int4 c = data[0];
+	BoundBox bbox = BoundBox::empty;
+	uint visibility = 0;
+
+	/* Object instance leaves store the inverted primitive index. */
+	const int prim_start = (c.x < 0)? ~c.x: c.x;
+	const int prim_end = (c.x < 0)? prim_start + 1: c.y;
+
+	for(int prim = prim_start; prim < prim_end; prim++) {
+		int pidx = pack.prim_index[prim];
+		int tob = pack.prim_object[prim];
+		Object *ob = objects[tob];
+
+		if(pidx == -1) {
+			/* Object instance. */
+			bbox.grow(ob->bounds);
+		}
+		else {
+			/* Primitives. */
+			const Mesh *mesh = ob->mesh;
+
+			if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
+				/* Curves. */
+				Mesh::Curve curve = mesh->get_curve(pidx);
+				int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
+
+				curve.bounds_grow(k, &mesh->curve_keys[0], &mesh->curve_radius[0], bbox);
+
+				visibility |= PATH_RAY_CURVE;
+
+				/* Motion curves. */
+				if(mesh->use_motion_blur) {
+					Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+
+					if(attr) {
+						size_t mesh_size = mesh->curve_keys.size();
+						size_t steps = mesh->motion_steps - 1;
+						float3 *key_steps = attr->data_float3();
+
+						for(size_t i = 0; i < steps; i++)
+							curve.bounds_grow(k, key_steps + i*mesh_size, &mesh->curve_radius[0], bbox);
+					}
+				}
+
+				pack.prim_visibility[prim] = ob->visibility | PATH_RAY_CURVE;
+			}
+			else {
+				/* Triangles. */
+				Mesh::Triangle triangle = mesh->get_triangle(pidx);
+				const float3 *vpos = &mesh->verts[0];
+
+				triangle.bounds_grow(vpos, bbox);
+
+				/* Motion triangles. */
+				if(mesh->use_motion_blur) {
+					Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+
+					if(attr) {
+						size_t mesh_size = mesh->verts.size();
+						size_t steps = mesh->motion_steps - 1;
+						float3 *vert_steps = attr->data_float3();
+
+						for(size_t i = 0; i < steps; i++)
+							triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
+					}
+				}
+
+				/* Every primitive is in exactly one leaf, so the packed
+				 * vertices can be updated here as well. */
+				pack_triangle(prim, (float4*)&pack.prim_tri_verts[pack.prim_tri_index[prim]]);
+				pack.prim_visibility[prim] = ob->visibility;
+			}
+		}
+
+		visibility |= ob->visibility;
+	}
+
+	float4 leaf_data[BVH_NODE_LEAF_SIZE];
+	leaf_data[0].x = __int_as_float(c.x);
+	leaf_data[0].y = __int_as_float(c.y);
+	leaf_data[0].z = __uint_as_float(visibility);
+	leaf_data[0].w = __uint_as_float(c.w);
+	memcpy(&pack.leaf_nodes[idx], leaf_data, sizeof(float4)*BVH_NODE_LEAF_SIZE);
+
+	refit_leaf_bounds[idx] = bbox;
+	refit_leaf_visibility[idx] = visibility;
 }
 
 /* Triangles */
@@ -196,6 +358,12 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 	 * top level BVH, adjusting indexes and offsets where appropriate.
 	 */
 	const bool use_qbvh = params.use_qbvh;
+	const bool use_obvh = params.use_obvh;
+
+	top_level_prims = pack.prim_index.size();
+	top_level_tri_verts = pack.prim_tri_verts.size();
+	top_level_nodes = nodes_size;
+	top_level_leaf_nodes = leaf_nodes_size;
 
 	/* Adjust primitive index to point to the triangle in the global array, for
 	 * meshes with transform applied and already in the top level BVH.
@@ -363,39 +531,55 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 			for(size_t i = 0, j = 0; i < bvh_nodes_size; j++) {
 				size_t nsize, nsize_bbox;
 				if(bvh_nodes[i].x & PATH_RAY_NODE_UNALIGNED) {
-					nsize = use_qbvh
-					            ? BVH_UNALIGNED_QNODE_SIZE
-					            : BVH_UNALIGNED_NODE_SIZE;
-					nsize_bbox = (use_qbvh)? 13: 0;
+					if(use_obvh) {
+						nsize = BVH_UNALIGNED_ONODE_SIZE;
+						nsize_bbox = 26;
+					}
+					else {
+						nsize = use_qbvh
+						            ? BVH_UNALIGNED_QNODE_SIZE
+						            : BVH_UNALIGNED_NODE_SIZE;
+						nsize_bbox = (use_qbvh)? 13: 0;
+					}
 				}
 				else {
-					nsize = (use_qbvh)? BVH_QNODE_SIZE: BVH_NODE_SIZE;
-					nsize_bbox = (use_qbvh)? 7: 0;
+					if(use_obvh) {
+						nsize = BVH_ONODE_SIZE;
+						nsize_bbox = 14;
+					}
+					else {
+						nsize = (use_qbvh)? BVH_QNODE_SIZE: BVH_NODE_SIZE;
+						nsize_bbox = (use_qbvh)? 7: 0;
+					}
 				}
+				/* OBVH stores eight child indices in two int4. */
+				const size_t nsize_child = (use_obvh)? 2: 1;
 
 				memcpy(pack_nodes + pack_nodes_offset,
 				       bvh_nodes + i,
 				       nsize_bbox*sizeof(int4));
 
 				/* Modify offsets into arrays */
-				int4 data = bvh_nodes[i + nsize_bbox];
+				for(size_t k = 0; k < nsize_child; k++) {
+					int4 data = bvh_nodes[i + nsize_bbox + k];
 
-				data.z += (data.z < 0)? -noffset_leaf: noffset;
-				data.w += (data.w < 0)? -noffset_leaf: noffset;
+					data.z += (data.z < 0)? -noffset_leaf: noffset;
+					data.w += (data.w < 0)? -noffset_leaf: noffset;
 
-				if(use_qbvh) {
-					data.x += (data.x < 0)? -noffset_leaf: noffset;
-					data.y += (data.y < 0)? -noffset_leaf: noffset;
-				}
+					if(use_qbvh || use_obvh) {
+						data.x += (data.x < 0)? -noffset_leaf: noffset;
+						data.y += (data.y < 0)? -noffset_leaf: noffset;
+					}
 
-				pack_nodes[pack_nodes_offset + nsize_bbox] = data;
+					pack_nodes[pack_nodes_offset + nsize_bbox + k] = data;
+				}
 
 				/* Usually this copies nothing, but we better
 				 * be prepared for possible node size extension.
 				 */
-				memcpy(&pack_nodes[pack_nodes_offset + nsize_bbox+1],
-				       &bvh_nodes[i + nsize_bbox+1],
-				       sizeof(int4) * (nsize - (nsize_bbox+1)));
+				memcpy(&pack_nodes[pack_nodes_offset + nsize_bbox + nsize_child],
+				       &bvh_nodes[i + nsize_bbox + nsize_child],
+				       sizeof(int4) * (nsize - (nsize_bbox + nsize_child)));
 
 				pack_nodes_offset += nsize;
 				i += nsize;
@@ -408,6 +592,62 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 	}
 }
 
+bool BVH::unpack_instances()
+{
+	pack.prim_index.resize(top_level_prims);
+	pack.prim_type.resize(top_level_prims);
+	pack.prim_object.resize(top_level_prims);
+	pack.prim_visibility.resize(top_level_prims);
+	pack.prim_tri_index.resize(top_level_prims);
+	pack.prim_tri_verts.resize(top_level_tri_verts);
+	pack.nodes.resize(top_level_nodes);
+	pack.leaf_nodes.resize(top_level_leaf_nodes);
+
+	/* Make primitive indexes local to the mesh again, checking that they
+	 * still match the meshes, otherwise the BVH has to be rebuilt. */
+	for(size_t i = 0; i < top_level_prims; i++) {
+		int tob = pack.prim_object[i];
+		if(tob >= objects.size()) {
+			return false;
+		}
+
+		const Mesh *mesh = objects[tob]->mesh;
+		if(pack.prim_index[i] == -1) {
+			if(!mesh->is_instanced()) {
+				return false;
+			}
+			continue;
+		}
+		else if(mesh->is_instanced()) {
+			return false;
+		}
+
+		const bool motion = (pack.prim_type[i] & PRIMITIVE_ALL_MOTION) != 0;
+		if(pack.prim_type[i] & PRIMITIVE_ALL_CURVE) {
+			int pidx = pack.prim_index[i] - mesh->curve_offset;
+			if(pidx < 0 || pidx >= mesh->num_curves() ||
+			   motion != (mesh->has_motion_blur() &&
+			              mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION)))
+			{
+				return false;
+			}
+			pack.prim_index[i] = pidx;
+		}
+		else {
+			int pidx = pack.prim_index[i] - mesh->tri_offset;
+			if(pidx < 0 || pidx >= mesh->num_triangles() ||
+			   motion != (mesh->has_motion_blur() &&
+			              mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION)))
+			{
+				return false;
+			}
+			pack.prim_index[i] = pidx;
+		}
+	}
+
+	return true;
+}
+
 /* Regular BVH */
 
 static bool node_bvh_is_unaligned(const BVHNode *node)
@@ -450,6 +690,8 @@ void RegularBVH::pack_inner(const BVHStackEntry& e,
                             const BVHStackEntry& e0,
                             const BVHStackEntry& e1)
 {
+	node_area += e0.node->m_bounds.safe_area() + e1.node->m_bounds.safe_area();
+
 	if(e0.node->is_unaligned() || e1.node->is_unaligned()) {
 		pack_unaligned_inner(e, e0, e1);
 	} else {
@@ -622,8 +864,6 @@ void RegularBVH::pack_nodes(const BVHNode *root)
 
 void RegularBVH::refit_nodes()
 {
-	assert(!params.top_level);
-
 	BoundBox bbox = BoundBox::empty;
 	uint visibility = 0;
 	refit_node(0, (pack.root_index == -1)? true: false, bbox, visibility);
@@ -632,82 +872,10 @@ void RegularBVH::refit_nodes()
 void RegularBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 {
 	if(leaf) {
+		/* Leaf nodes were refitted beforehand. */
 		assert(idx + BVH_NODE_LEAF_SIZE <= pack.leaf_nodes.size());
-		const int4 *data = &pack.leaf_nodes[idx];
-		const int c0 = data[0].x;
-		const int c1 = data[0].y;
-		/* refit leaf node */
-		for(int prim = c0; prim < c1; prim++) {
-			int pidx = pack.prim_index[prim];
-			int tob = pack.prim_object[prim];
-			Object *ob = objects[tob];
-
-			if(pidx == -1) {
-				/* object instance */
-				bbox.grow(ob->bounds);
-			}
-			else {
-				/* primitives */
-				const Mesh *mesh = ob->mesh;
-
-				if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
-					/* curves */
-					int str_offset = (params.top_level)? mesh->curve_offset: 0;
-					Mesh::Curve curve = mesh->get_curve(pidx - str_offset);
-					int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
-
-					curve.bounds_grow(k, &mesh->curve_keys[0], &mesh->curve_radius[0], bbox);
-
-					visibility |= PATH_RAY_CURVE;
-
-					/* motion curves */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->curve_keys.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *key_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								curve.bounds_grow(k, key_steps + i*mesh_size, &mesh->curve_radius[0], bbox);
-						}
-					}
-				}
-				else {
-					/* triangles */
-					int tri_offset = (params.top_level)? mesh->tri_offset: 0;
-					Mesh::Triangle triangle = mesh->get_triangle(pidx - tri_offset);
-					const float3 *vpos = &mesh->verts[0];
-
-					triangle.bounds_grow(vpos, bbox);
-
-					/* motion triangles */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->verts.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *vert_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-			}
-
-			visibility |= ob->visibility;
-		}
-
-		/* TODO(sergey): De-duplicate with pack_leaf(). */
-		float4 leaf_data[BVH_NODE_LEAF_SIZE];
-		leaf_data[0].x = __int_as_float(c0);
-		leaf_data[0].y = __int_as_float(c1);
-		leaf_data[0].z = __uint_as_float(visibility);
-		leaf_data[0].w = __uint_as_float(data[0].w);
-		memcpy(&pack.leaf_nodes[idx], leaf_data, sizeof(float4)*BVH_NODE_LEAF_SIZE);
+		bbox.grow(refit_leaf_bounds[idx]);
+		visibility |= refit_leaf_visibility[idx];
 	}
 	else {
 		assert(idx + BVH_NODE_SIZE <= pack.nodes.size());
@@ -723,6 +891,8 @@ void RegularBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility
 		refit_node((c0 < 0)? -c0-1: c0, (c0 < 0), bbox0, visibility0);
 		refit_node((c1 < 0)? -c1-1: c1, (c1 < 0), bbox1, visibility1);
 
+		node_area += bbox0.safe_area() + bbox1.safe_area();
+
 		if(is_unaligned) {
 			Transform aligned_space = transform_identity();
 			pack_unaligned_node(idx,
@@ -807,6 +977,10 @@ void QBVH::pack_inner(const BVHStackEntry& e,
                       const BVHStackEntry *en,
                       int num)
 {
+	for(int i = 0; i < num; i++) {
+		node_area += en[i].node->m_bounds.safe_area();
+	}
+
 	bool has_unaligned = false;
 	/* Check whether we have to create unaligned node or all nodes are aligned
 	 * and we can cut some corner here.
@@ -1075,8 +1249,6 @@ void QBVH::pack_nodes(const BVHNode *root)
 
 void QBVH::refit_nodes()
 {
-	assert(!params.top_level);
-
 	BoundBox bbox = BoundBox::empty;
 	uint visibility = 0;
 	refit_node(0, (pack.root_index == -1)? true: false, bbox, visibility);
@@ -1085,89 +1257,9 @@ void QBVH::refit_nodes()
 void QBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 {
 	if(leaf) {
-		int4 *data = &pack.leaf_nodes[idx];
-		int4 c = data[0];
-		/* Refit leaf node. */
-		for(int prim = c.x; prim < c.y; prim++) {
-			int pidx = pack.prim_index[prim];
-			int tob = pack.prim_object[prim];
-			Object *ob = objects[tob];
-
-			if(pidx == -1) {
-				/* Object instance. */
-				bbox.grow(ob->bounds);
-			}
-			else {
-				/* Primitives. */
-				const Mesh *mesh = ob->mesh;
-
-				if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
-					/* Curves. */
-					int str_offset = (params.top_level)? mesh->curve_offset: 0;
-					Mesh::Curve curve = mesh->get_curve(pidx - str_offset);
-					int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
-
-					curve.bounds_grow(k, &mesh->curve_keys[0], &mesh->curve_radius[0], bbox);
-
-					visibility |= PATH_RAY_CURVE;
-
-					/* Motion curves. */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->curve_keys.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *key_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								curve.bounds_grow(k, key_steps + i*mesh_size, &mesh->curve_radius[0], bbox);
-						}
-					}
-				}
-				else {
-					/* Triangles. */
-					int tri_offset = (params.top_level)? mesh->tri_offset: 0;
-					Mesh::Triangle triangle = mesh->get_triangle(pidx - tri_offset);
-					const float3 *vpos = &mesh->verts[0];
-
-					triangle.bounds_grow(vpos, bbox);
-
-					/* Motion triangles. */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->verts.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *vert_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-			}
-
-			visibility |= ob->visibility;
-		}
-
-		/* TODO(sergey): This is actually a copy of pack_leaf(),
-		 * but this chunk of code only knows actual data and has
-		 * no idea about BVHNode.
-		 *
-		 * Would be nice to de-duplicate code, but trying to make
-		 * making code more general ends up in much nastier code
-		 * in my opinion so far.
-		 *
-		 * Same applies to the inner nodes case below.
-		 */
-		float4 leaf_data[BVH_QNODE_LEAF_SIZE];
-		leaf_data[0].x = __int_as_float(c.x);
-		leaf_data[0].y = __int_as_float(c.y);
-		leaf_data[0].z = __uint_as_float(visibility);
-		leaf_data[0].w = __uint_as_float(c.w);
-		memcpy(&pack.leaf_nodes[idx], leaf_data, sizeof(float4)*BVH_QNODE_LEAF_SIZE);
+		/* Leaf nodes were refitted beforehand. */
+		bbox.grow(refit_leaf_bounds[idx]);
+		visibility |= refit_leaf_visibility[idx];
 	}
 	else {
 		int4 *data = &pack.nodes[idx];
@@ -1192,6 +1284,7 @@ void QBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 				refit_node((c[i] < 0)? -c[i]-1: c[i], (c[i] < 0),
 				           child_bbox[i], child_visibility[i]);
 				++num_nodes;
+				node_area += child_bbox[i].safe_area();
 				bbox.grow(child_bbox[i]);
 				visibility |= child_visibility[i];
 			}
@@ -1219,4 +1312,413 @@ void QBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 	}
 }
 
+/* OBVH */
+
+/* Collapse binary nodes below the given one into up to eight children,
+ * always opening the inner child with the largest surface area, as it is
+ * the most likely one to be intersected by a ray. */
+static int obvh_node_children(const BVHNode *node, const BVHNode *nodes[8])
+{
+	int num_nodes = 2;
+	nodes[0] = node->get_child(0);
+	nodes[1] = node->get_child(1);
+
+	while(num_nodes < 8) {
+		int best_child = -1;
+		float best_area = -FLT_MAX;
+		for(int i = 0; i < num_nodes; i++) {
+			if(nodes[i]->is_leaf()) {
+				continue;
+			}
+			const float area = nodes[i]->m_bounds.safe_area();
+			if(area > best_area) {
+				best_child = i;
+				best_area = area;
+			}
+		}
+		if(best_child == -1) {
+			break;
+		}
+		const BVHNode *best_node = nodes[best_child];
+		nodes[best_child] = best_node->get_child(0);
+		nodes[num_nodes++] = best_node->get_child(1);
+	}
+
+	return num_nodes;
+}
+
+static bool obvh_node_is_unaligned(const BVHNode *node)
+{
+	const BVHNode *nodes[8];
+	const int num_nodes = obvh_node_children(node, nodes);
+	for(int i = 0; i < num_nodes; i++) {
+		if(nodes[i]->is_unaligned()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Number of inner nodes in the collapsed tree, which can not be derived from
+ * the binary tree statistics like it is done for QBVH. */
+static void obvh_count_inner_nodes(const BVHNode *node,
+                                   size_t *num_inner_nodes,
+                                   size_t *num_unaligned_nodes)
+{
+	if(node->is_leaf()) {
+		return;
+	}
+	const BVHNode *nodes[8];
+	const int num_nodes = obvh_node_children(node, nodes);
+	bool has_unaligned = false;
+	for(int i = 0; i < num_nodes; i++) {
+		has_unaligned |= nodes[i]->is_unaligned();
+		obvh_count_inner_nodes(nodes[i], num_inner_nodes, num_unaligned_nodes);
+	}
+	(*num_inner_nodes)++;
+	if(has_unaligned) {
+		(*num_unaligned_nodes)++;
+	}
+}
+
+OBVH::OBVH(const BVHParams& params_, const vector<Object*>& objects_)
+: BVH(params_, objects_)
+{
+	params.use_obvh = true;
+}
+
+void OBVH::pack_leaf(const BVHStackEntry& e, const LeafNode *leaf)
+{
+	float4 data[BVH_ONODE_LEAF_SIZE];
+	memset(data, 0, sizeof(data));
+	if(leaf->num_triangles() == 1 && pack.prim_index[leaf->m_lo] == -1) {
+		/* object */
+		data[0].x = __int_as_float(~(leaf->m_lo));
+		data[0].y = __int_as_float(0);
+	}
+	else {
+		/* triangle */
+		data[0].x = __int_as_float(leaf->m_lo);
+		data[0].y = __int_as_float(leaf->m_hi);
+	}
+	data[0].z = __uint_as_float(leaf->m_visibility);
+	if(leaf->num_triangles() != 0) {
+		data[0].w = __uint_as_float(pack.prim_type[leaf->m_lo]);
+	}
+
+	memcpy(&pack.leaf_nodes[e.idx], data, sizeof(float4)*BVH_ONODE_LEAF_SIZE);
+}
+
+void OBVH::pack_inner(const BVHStackEntry& e,
+                      const BVHStackEntry *en,
+                      int num)
+{
+	for(int i = 0; i < num; i++) {
+		node_area += en[i].node->m_bounds.safe_area();
+	}
+
+	bool has_unaligned = false;
+	if(params.use_unaligned_nodes) {
+		for(int i = 0; i < num; i++) {
+			if(en[i].node->is_unaligned()) {
+				has_unaligned = true;
+				break;
+			}
+		}
+	}
+	if(has_unaligned) {
+		pack_unaligned_inner(e, en, num);
+	}
+	else {
+		pack_aligned_inner(e, en, num);
+	}
+}
+
+void OBVH::pack_aligned_inner(const BVHStackEntry& e,
+                              const BVHStackEntry *en,
+                              int num)
+{
+	BoundBox bounds[8];
+	int child[8];
+	for(int i = 0; i < num; ++i) {
+		bounds[i] = en[i].node->m_bounds;
+		child[i] = en[i].encodeIdx();
+	}
+	pack_aligned_node(e.idx,
+	                  bounds,
+	                  child,
+	                  e.node->m_visibility,
+	                  num);
+}
+
+/* Every value of the node takes two float4, lanes 0-3 are stored in the
+ * first one and lanes 4-7 in the second, so the kernel can fetch them as a
+ * single AVX register. First two float4 hold the node visibility. */
+void OBVH::pack_aligned_node(int idx,
+                             const BoundBox *bounds,
+                             const int *child,
+                             const uint visibility,
+                             const int num)
+{
+	float4 data[BVH_ONODE_SIZE];
+	memset(data, 0, sizeof(data));
+
+	data[0].x = __uint_as_float(visibility & ~PATH_RAY_NODE_UNALIGNED);
+	for(int i = 0; i < num; i++) {
+		const int row = i / 4, lane = i % 4;
+		float3 bb_min = bounds[i].min;
+		float3 bb_max = bounds[i].max;
+
+		data[2+row][lane] = bb_min.x;
+		data[4+row][lane] = bb_max.x;
+		data[6+row][lane] = bb_min.y;
+		data[8+row][lane] = bb_max.y;
+		data[10+row][lane] = bb_min.z;
+		data[12+row][lane] = bb_max.z;
+
+		data[14+row][lane] = __int_as_float(child[i]);
+	}
+
+	for(int i = num; i < 8; i++) {
+		const int row = i / 4, lane = i % 4;
+		/* We store BB which would never be recorded as intersection
+		 * so kernel might safely assume there are always 8 child nodes.
+		 */
+		data[2+row][lane] = FLT_MAX;
+		data[4+row][lane] = -FLT_MAX;
+
+		data[6+row][lane] = FLT_MAX;
+		data[8+row][lane] = -FLT_MAX;
+
+		data[10+row][lane] = FLT_MAX;
+		data[12+row][lane] = -FLT_MAX;
+
+		data[14+row][lane] = __int_as_float(0);
+	}
+
+	memcpy(&pack.nodes[idx], data, sizeof(float4)*BVH_ONODE_SIZE);
+}
+
+void OBVH::pack_unaligned_inner(const BVHStackEntry& e,
+                                const BVHStackEntry *en,
+                                int num)
+{
+	Transform aligned_space[8];
+	BoundBox bounds[8];
+	int child[8];
+	for(int i = 0; i < num; ++i) {
+		aligned_space[i] = en[i].node->get_aligned_space();
+		bounds[i] = en[i].node->m_bounds;
+		child[i] = en[i].encodeIdx();
+	}
+	pack_unaligned_node(e.idx,
+	                    aligned_space,
+	                    bounds,
+	                    child,
+	                    e.node->m_visibility,
+	                    num);
+}
+
+void OBVH::pack_unaligned_node(int idx,
+                               const Transform *aligned_space,
+                               const BoundBox *bounds,
+                               const int *child,
+                               const uint visibility,
+                               const int num)
+{
+	float4 data[BVH_UNALIGNED_ONODE_SIZE];
+	memset(data, 0, sizeof(data));
+
+	data[0].x = __uint_as_float(visibility | PATH_RAY_NODE_UNALIGNED);
+
+	for(int i = 0; i < num; i++) {
+		const int row = i / 4, lane = i % 4;
+		Transform space = BVHUnaligned::compute_node_transform(
+		        bounds[i],
+		        aligned_space[i]);
+
+		data[2+row][lane] = space.x.x;
+		data[4+row][lane] = space.x.y;
+		data[6+row][lane] = space.x.z;
+
+		data[8+row][lane] = space.y.x;
+		data[10+row][lane] = space.y.y;
+		data[12+row][lane] = space.y.z;
+
+		data[14+row][lane] = space.z.x;
+		data[16+row][lane] = space.z.y;
+		data[18+row][lane] = space.z.z;
+
+		data[20+row][lane] = space.x.w;
+		data[22+row][lane] = space.y.w;
+		data[24+row][lane] = space.z.w;
+
+		data[26+row][lane] = __int_as_float(child[i]);
+	}
+
+	for(int i = num; i < 8; i++) {
+		const int row = i / 4, lane = i % 4;
+		/* We store BB which would never be recorded as intersection
+		 * so kernel might safely assume there are always 8 child nodes.
+		 */
+		data[2+row][lane] = 1.0f;
+		data[4+row][lane] = 0.0f;
+		data[6+row][lane] = 0.0f;
+
+		data[8+row][lane] = 0.0f;
+		data[10+row][lane] = 0.0f;
+		data[12+row][lane] = 0.0f;
+
+		data[14+row][lane] = 0.0f;
+		data[16+row][lane] = 0.0f;
+		data[18+row][lane] = 0.0f;
+
+		data[20+row][lane] = -FLT_MAX;
+		data[22+row][lane] = -FLT_MAX;
+		data[24+row][lane] = -FLT_MAX;
+
+		data[26+row][lane] = __int_as_float(0);
+	}
+
+	memcpy(&pack.nodes[idx], data, sizeof(float4)*BVH_UNALIGNED_ONODE_SIZE);
+}
+
+/* Octo SIMD Nodes */
+
+void OBVH::pack_nodes(const BVHNode *root)
+{
+	/* Calculate size of the arrays required. */
+	const size_t num_leaf_nodes = root->getSubtreeSize(BVH_STAT_LEAF_COUNT);
+	size_t num_inner_nodes = 0, num_unaligned_nodes = 0;
+	obvh_count_inner_nodes(root, &num_inner_nodes, &num_unaligned_nodes);
+	size_t node_size;
+	if(params.use_unaligned_nodes) {
+		node_size = (num_unaligned_nodes * BVH_UNALIGNED_ONODE_SIZE) +
+		            (num_inner_nodes - num_unaligned_nodes) * BVH_ONODE_SIZE;
+	}
+	else {
+		node_size = num_inner_nodes * BVH_ONODE_SIZE;
+	}
+	/* Resize arrays. */
+	pack.nodes.clear();
+	pack.leaf_nodes.clear();
+	/* For top level BVH, first merge existing BVH's so we know the offsets. */
+	if(params.top_level) {
+		pack_instances(node_size, num_leaf_nodes*BVH_ONODE_LEAF_SIZE);
+	}
+	else {
+		pack.nodes.resize(node_size);
+		pack.leaf_nodes.resize(num_leaf_nodes*BVH_ONODE_LEAF_SIZE);
+	}
+
+	int nextNodeIdx = 0, nextLeafNodeIdx = 0;
+
+	vector<BVHStackEntry> stack;
+	stack.reserve(BVHParams::MAX_DEPTH*8);
+	if(root->is_leaf()) {
+		stack.push_back(BVHStackEntry(root, nextLeafNodeIdx++));
+	}
+	else {
+		stack.push_back(BVHStackEntry(root, nextNodeIdx));
+		nextNodeIdx += (params.use_unaligned_nodes && obvh_node_is_unaligned(root))
+		                       ? BVH_UNALIGNED_ONODE_SIZE
+		                       : BVH_ONODE_SIZE;
+	}
+
+	while(stack.size()) {
+		BVHStackEntry e = stack.back();
+		stack.pop_back();
+
+		if(e.node->is_leaf()) {
+			/* leaf node */
+			const LeafNode *leaf = reinterpret_cast<const LeafNode*>(e.node);
+			pack_leaf(e, leaf);
+		}
+		else {
+			/* Inner node. */
+			const BVHNode *nodes[8];
+			const int numnodes = obvh_node_children(e.node, nodes);
+			/* Push entries on the stack. */
+			for(int i = 0; i < numnodes; ++i) {
+				int idx;
+				if(nodes[i]->is_leaf()) {
+					idx = nextLeafNodeIdx++;
+				}
+				else {
+					idx = nextNodeIdx;
+					nextNodeIdx += (params.use_unaligned_nodes &&
+					                obvh_node_is_unaligned(nodes[i]))
+					                       ? BVH_UNALIGNED_ONODE_SIZE
+					                       : BVH_ONODE_SIZE;
+				}
+				stack.push_back(BVHStackEntry(nodes[i], idx));
+			}
+			/* Set node. */
+			pack_inner(e, &stack[stack.size()-numnodes], numnodes);
+		}
+	}
+	assert(node_size == nextNodeIdx);
+	/* Root index to start traversal at, to handle case of single leaf node. */
+	pack.root_index = (root->is_leaf())? -1: 0;
+}
+
+void OBVH::refit_nodes()
+{
+	BoundBox bbox = BoundBox::empty;
+	uint visibility = 0;
+	refit_node(0, (pack.root_index == -1)? true: false, bbox, visibility);
+}
+
+void OBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
+{
+	if(leaf) {
+		/* Leaf nodes were refitted beforehand. */
+		bbox.grow(refit_leaf_bounds[idx]);
+		visibility |= refit_leaf_visibility[idx];
+	}
+	else {
+		int4 *data = &pack.nodes[idx];
+		bool is_unaligned = (data[0].x & PATH_RAY_NODE_UNALIGNED) != 0;
+		int c[8];
+		const int4 *child_data = (is_unaligned)? &data[26]: &data[14];
+		for(int i = 0; i < 8; ++i) {
+			c[i] = child_data[i / 4][i % 4];
+		}
+		/* Refit inner node, set bbox from children. */
+		BoundBox child_bbox[8];
+		uint child_visibility[8] = {0};
+
+		for(int i = 0; i < 8; ++i) {
+			child_bbox[i] = BoundBox::empty;
+			if(c[i] != 0) {
+				refit_node((c[i] < 0)? -c[i]-1: c[i], (c[i] < 0),
+				           child_bbox[i], child_visibility[i]);
+				node_area += child_bbox[i].safe_area();
+				bbox.grow(child_bbox[i]);
+				visibility |= child_visibility[i];
+			}
+		}
+
+		if(is_unaligned) {
+			Transform aligned_space[8];
+			for(int i = 0; i < 8; ++i) {
+				aligned_space[i] = transform_identity();
+			}
+			pack_unaligned_node(idx,
+			                    aligned_space,
+			                    child_bbox,
+			                    c,
+			                    visibility,
+			                    8);
+		}
+		else {
+			pack_aligned_node(idx,
+			                  child_bbox,
+			                  c,
+			                  visibility,
+			                  8);
+		}
+	}
+}
+
 CCL_NAMESPACE_END
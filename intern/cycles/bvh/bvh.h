@@ -37,11 +37,14 @@ class Progress;
 #define BVH_NODE_LEAF_SIZE	1
 #define BVH_QNODE_SIZE	8
 #define BVH_QNODE_LEAF_SIZE	1
+#define BVH_ONODE_SIZE	16
+#define BVH_ONODE_LEAF_SIZE	1
 #define BVH_ALIGN		4096
 #define TRI_NODE_SIZE	3
 
 #define BVH_UNALIGNED_NODE_SIZE 7
 #define BVH_UNALIGNED_QNODE_SIZE 14
+#define BVH_UNALIGNED_ONODE_SIZE 28
 
 /* Packed BVH
  *
@@ -87,21 +90,55 @@ public:
 	BVHParams params;
 	vector<Object*> objects;
 
+	/* Sum of child node surface areas relative to the root surface area,
+	 * after the build and after the last refit. Lower is better, refitting
+	 * deforming geometry makes it grow. */
+	float build_area_ratio;
+	float area_ratio;
+
+	/* Number of nodes and leaf nodes of the built tree, before packing. */
+	size_t num_nodes;
+	size_t num_leaf_nodes;
+
 	static BVH *create(const BVHParams& params, const vector<Object*>& objects);
 	virtual ~BVH() {}
 
 	void build(Progress& progress);
-	void refit(Progress& progress);
+	/* Update bounds of the nodes for changed vertex positions, keeping the
+	 * tree structure. Returns false if the BVH must be rebuilt instead,
+	 * because primitives changed or the tree quality degraded too much. */
+	bool refit(Progress& progress);
 
 protected:
 	BVH(const BVHParams& params, const vector<Object*>& objects);
 
+	/* Sum of child node surface areas, accumulated by pack and refit. */
+	float node_area;
+
+	/* Size of the top level arrays before instances were merged into them,
+	 * so instances can be merged again after refitting. */
+	size_t top_level_prims;
+	size_t top_level_tri_verts;
+	size_t top_level_nodes;
+	size_t top_level_leaf_nodes;
+
+	/* Bounds and visibility of leaf nodes, refitted in parallel before
+	 * inner nodes are refitted from them. */
+	vector<BoundBox> refit_leaf_bounds;
+	vector<uint> refit_leaf_visibility;
+
 	/* triangles and strands */
 	void pack_primitives();
 	void pack_triangle(int idx, float4 storage[3]);
 
 	/* merge instance BVH's */
 	void pack_instances(size_t nodes_size, size_t leaf_nodes_size);
+	bool unpack_instances();
+
+	/* refit, leaf nodes are the same for all layouts */
+	enum { REFIT_TASK_SIZE = 4096 };
+	void refit_leaf_nodes(size_t start, size_t end);
+	void refit_leaf_node(int idx);
 
 	/* for subclasses to implement */
 	virtual void pack_nodes(const BVHNode *root) = 0;
@@ -192,6 +229,48 @@ protected:
 	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
 };
 
+/* OBVH
+ *
+ * Octo BVH, with each node having eight children, to use with AVX2
+ * instructions. Nodes are collapsed from the binary BVH, opening the
+ * children with the largest surface area first. */
+
+class OBVH : public BVH {
+protected:
+	/* constructor */
+	friend class BVH;
+	OBVH(const BVHParams& params, const vector<Object*>& objects);
+
+	/* pack */
+	void pack_nodes(const BVHNode *root);
+
+	void pack_leaf(const BVHStackEntry& e, const LeafNode *leaf);
+	void pack_inner(const BVHStackEntry& e, const BVHStackEntry *en, int num);
+
+	void pack_aligned_inner(const BVHStackEntry& e,
+	                        const BVHStackEntry *en,
+	                        int num);
+	void pack_aligned_node(int idx,
+	                       const BoundBox *bounds,
+	                       const int *child,
+	                       const uint visibility,
+	                       const int num);
+
+	void pack_unaligned_inner(const BVHStackEntry& e,
+	                          const BVHStackEntry *en,
+	                          int num);
+	void pack_unaligned_node(int idx,
+	                         const Transform *aligned_space,
+	                         const BoundBox *bounds,
+	                         const int *child,
+	                         const uint visibility,
+	                         const int num);
+
+	/* refit */
+	void refit_nodes();
+	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+};
+
 CCL_NAMESPACE_END
 
 #endif /* __BVH_H__ */
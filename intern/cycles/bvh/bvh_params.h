@@ -51,6 +51,13 @@ public:
 	/* QBVH */
 	bool use_qbvh;
 
+	/* OBVH, eight children per node, requires AVX2 kernel */
+	bool use_obvh;
+
+	/* Rebuild instead of refit when the child node surface areas grew by
+	 * more than this factor compared to the build, zero to always refit. */
+	float refit_rebuild_threshold;
+
 	/* Mask of primitives to be included into the BVH. */
 	int primitive_mask;
 
@@ -84,6 +91,8 @@ public:
 
 		top_level = false;
 		use_qbvh = false;
+		use_obvh = false;
+		refit_rebuild_threshold = 0.0f;
 		use_unaligned_nodes = false;
 
 		primitive_mask = PRIMITIVE_ALL;
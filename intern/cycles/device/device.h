@@ -32,7 +32,9 @@
 CCL_NAMESPACE_BEGIN
 
 class Progress;
+class ProfilingCounters;
 class RenderTile;
+class TextureCache;
 
 /* Device Types */
 
@@ -196,6 +198,27 @@ public:
 std::ostream& operator <<(std::ostream &os,
                           const DeviceRequestedFeatures& requested_features);
 
+/* Network Server Statistics
+ *
+ * Tiles rendered by a network render server and memory sent to it, to see
+ * how the work was spread over servers of different speeds. */
+
+class NetworkServerStats {
+public:
+	NetworkServerStats()
+	: num_tiles(0), pixel_samples(0), render_time(0.0),
+	  mem_sent(0), mem_skipped(0) {}
+
+	string address;
+	int num_tiles;
+	uint64_t pixel_samples;
+	/* time spent waiting for the tasks of the server */
+	double render_time;
+	/* memory sent, and not sent because the server had it already */
+	size_t mem_sent;
+	size_t mem_skipped;
+};
+
 /* Device */
 
 struct DeviceDrawParams {
@@ -256,6 +279,17 @@ public:
 	/* open shading language, only for CPU device */
 	virtual void *osl_memory() { return NULL; }
 
+	/* on demand image texture cache, only for CPU device */
+	virtual TextureCache *get_texture_cache() { return NULL; }
+
+	/* kernel ray and shader evaluation counters, only for CPU device.
+	 * enabling clears the counters gathered so far */
+	virtual void set_profiling(bool /*enable*/) {}
+	virtual void get_profiling_counters(ProfilingCounters& /*counters*/) {}
+
+	/* statistics of each network render server, for network devices */
+	virtual void get_network_stats(vector<NetworkServerStats>& /*stats*/) {}
+
 	/* load/compile kernels, must be called before adding tasks */ 
 	virtual bool load_kernels(
 	        const DeviceRequestedFeatures& /*requested_features*/)
@@ -266,6 +300,10 @@ public:
 	virtual void task_add(DeviceTask& task) = 0;
 	virtual void task_wait() = 0;
 	virtual void task_cancel() = 0;
+
+	/* denoise prefiltered feature planes, synchronously in the calling thread
+	 * so it can be used while tiles are rendered. only for CPU device */
+	virtual bool denoise(DeviceDenoiseTask& /*task*/) { return false; }
 	
 	/* opengl drawing */
 	virtual void draw_pixels(device_memory& mem, int y, int w, int h,
@@ -273,8 +311,8 @@ public:
 		const DeviceDrawParams &draw_params);
 
 #ifdef WITH_NETWORK
-	/* networking */
-	void server_run();
+	/* networking, on the default port when port is 0 */
+	void server_run(int port = 0);
 #endif
 
 	/* multi device */
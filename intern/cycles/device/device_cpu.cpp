@@ -29,12 +29,16 @@
 
 #include "kernel.h"
 #include "kernel_compat_cpu.h"
+#include "kernel_math.h"
 #include "kernel_types.h"
 #include "kernel_globals.h"
+#include "kernel_film.h"
 
 #include "osl_shader.h"
 #include "osl_globals.h"
 
+#include "kernels/cpu/kernel_texture_cache.h"
+
 #include "buffers.h"
 
 #include "util_debug.h"
@@ -57,6 +61,13 @@ public:
 #ifdef WITH_OSL
 	OSLGlobals osl_globals;
 #endif
+
+	TextureCache texture_cache;
+
+	/* counters of finished render threads */
+	bool use_profiling;
+	ProfilingCounters profiling_counters;
+	thread_mutex profiling_mutex;
 	
 	CPUDevice(DeviceInfo& info, Stats &stats, bool background)
 	: Device(info, stats, background)
@@ -64,6 +75,10 @@ public:
 #ifdef WITH_OSL
 		kernel_globals.osl = &osl_globals;
 #endif
+		kernel_globals.texture_cache = NULL;
+		kernel_globals.texture_cache_tdata = NULL;
+		kernel_globals.profiling = NULL;
+		use_profiling = false;
 
 		/* do now to avoid thread issues */
 		system_cpu_support_sse2();
@@ -194,6 +209,24 @@ public:
 #endif
 	}
 
+	TextureCache *get_texture_cache()
+	{
+		return &texture_cache;
+	}
+
+	void set_profiling(bool enable)
+	{
+		thread_scoped_lock lock(profiling_mutex);
+		use_profiling = enable;
+		profiling_counters.clear();
+	}
+
+	void get_profiling_counters(ProfilingCounters& counters)
+	{
+		thread_scoped_lock lock(profiling_mutex);
+		counters.add(profiling_counters);
+	}
+
 	void thread_run(DeviceTask *task)
 	{
 		if(task->type == DeviceTask::PATH_TRACE)
@@ -213,6 +246,26 @@ public:
 		}
 	};
 
+	bool thread_adaptive_tile_converged(KernelGlobals *kg, RenderTile& tile, int sample)
+	{
+		if(!(kernel_data.film.pass_flag & PASS_ADAPTIVE_AUX))
+			return false;
+
+		float *render_buffer = (float*)tile.buffer;
+		int pass_stride = kernel_data.film.pass_stride;
+
+		for(int y = tile.y; y < tile.y + tile.h; y++) {
+			for(int x = tile.x; x < tile.x + tile.w; x++) {
+				int index = tile.offset + x + y*tile.stride;
+
+				if(!kernel_adaptive_pixel_converged(kg, render_buffer + index*pass_stride, sample))
+					return false;
+			}
+		}
+
+		return true;
+	}
+
 	void thread_path_trace(DeviceTask& task)
 	{
 		if(task_pool.canceled()) {
@@ -224,40 +277,50 @@ public:
 		RenderTile tile;
 
 		void(*path_trace_kernel)(KernelGlobals*, float*, unsigned int*, int, int, int, int, int);
+		void(*path_trace_stream_kernel)(KernelGlobals*, float*, unsigned int*, int, int, int, int, int, int, int);
 
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
 		if(system_cpu_support_avx2()) {
 			path_trace_kernel = kernel_cpu_avx2_path_trace;
+			path_trace_stream_kernel = kernel_cpu_avx2_path_trace_stream;
 		}
 		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX
 		if(system_cpu_support_avx()) {
 			path_trace_kernel = kernel_cpu_avx_path_trace;
+			path_trace_stream_kernel = kernel_cpu_avx_path_trace_stream;
 		}
 		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE41
 		if(system_cpu_support_sse41()) {
 			path_trace_kernel = kernel_cpu_sse41_path_trace;
+			path_trace_stream_kernel = kernel_cpu_sse41_path_trace_stream;
 		}
 		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE3
 		if(system_cpu_support_sse3()) {
 			path_trace_kernel = kernel_cpu_sse3_path_trace;
+			path_trace_stream_kernel = kernel_cpu_sse3_path_trace_stream;
 		}
 		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE2
 		if(system_cpu_support_sse2()) {
 			path_trace_kernel = kernel_cpu_sse2_path_trace;
+			path_trace_stream_kernel = kernel_cpu_sse2_path_trace_stream;
 		}
 		else
 #endif
 		{
 			path_trace_kernel = kernel_cpu_path_trace;
+			path_trace_stream_kernel = kernel_cpu_path_trace_stream;
 		}
+
+		/* trace whole tiles as ray streams instead of pixel by pixel */
+		bool use_stream = DebugFlags().cpu.stream;
 		
 		while(task.acquire_tile(this, tile)) {
 			float *render_buffer = (float*)tile.buffer;
@@ -271,10 +334,28 @@ public:
 						break;
 				}
 
-				for(int y = tile.y; y < tile.y + tile.h; y++) {
-					for(int x = tile.x; x < tile.x + tile.w; x++) {
-						path_trace_kernel(&kg, render_buffer, rng_state,
-						                  sample, x, y, tile.offset, tile.stride);
+				/* adaptive sampling, release the tile early once all of its pixels converged */
+				if(thread_adaptive_tile_converged(&kg, tile, sample)) {
+					tile.sample = end_sample;
+					tile.converged = true;
+
+					for(; sample < end_sample; sample++)
+						task.update_progress(&tile, tile.w*tile.h);
+
+					break;
+				}
+
+				if(use_stream) {
+					path_trace_stream_kernel(&kg, render_buffer, rng_state,
+					                         sample, tile.x, tile.y, tile.w, tile.h,
+					                         tile.offset, tile.stride);
+				}
+				else {
+					for(int y = tile.y; y < tile.y + tile.h; y++) {
+						for(int x = tile.x; x < tile.x + tile.w; x++) {
+							path_trace_kernel(&kg, render_buffer, rng_state,
+							                  sample, x, y, tile.offset, tile.stride);
+						}
 					}
 				}
 
@@ -390,6 +471,9 @@ public:
 #ifdef WITH_OSL
 		OSLShader::thread_init(&kg, &kernel_globals, &osl_globals);
 #endif
+		texture_cache.thread_init(&kg);
+		thread_profiling_init(&kg);
+
 		void(*shader_kernel)(KernelGlobals*, uint4*, float4*, float*, int, int, int, int, int);
 
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
@@ -448,6 +532,64 @@ public:
 #ifdef WITH_OSL
 		OSLShader::thread_free(&kg);
 #endif
+		texture_cache.thread_free(&kg);
+		thread_profiling_free(&kg);
+	}
+
+	bool denoise(DeviceDenoiseTask& task)
+	{
+		void(*denoise_kernel)(const float*, float*, float*, int, int, int, int, int, int, int, int, float, float);
+
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
+		if(system_cpu_support_avx2()) {
+			denoise_kernel = kernel_cpu_avx2_denoise;
+		}
+		else
+#endif
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX
+		if(system_cpu_support_avx()) {
+			denoise_kernel = kernel_cpu_avx_denoise;
+		}
+		else
+#endif
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE41
+		if(system_cpu_support_sse41()) {
+			denoise_kernel = kernel_cpu_sse41_denoise;
+		}
+		else
+#endif
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE3
+		if(system_cpu_support_sse3()) {
+			denoise_kernel = kernel_cpu_sse3_denoise;
+		}
+		else
+#endif
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE2
+		if(system_cpu_support_sse2()) {
+			denoise_kernel = kernel_cpu_sse2_denoise;
+		}
+		else
+#endif
+		{
+			denoise_kernel = kernel_cpu_denoise;
+		}
+
+		/* two planes of temporary memory for the patch distances */
+		vector<float> temp(2*(size_t)task.stride*task.height);
+
+		denoise_kernel((const float*)task.buffer,
+		               (float*)task.output,
+		               &temp[0],
+		               task.x, task.y,
+		               task.w, task.h,
+		               task.stride,
+		               task.height,
+		               task.radius,
+		               task.patch_radius,
+		               task.strength,
+		               task.feature_strength);
+
+		return true;
 	}
 
 	int get_split_task_count(DeviceTask& task)
@@ -493,9 +635,12 @@ protected:
 			kg.decoupled_volume_steps[i] = NULL;
 		}
 		kg.decoupled_volume_steps_index = 0;
+		kg.path_stream = NULL;
 #ifdef WITH_OSL
 		OSLShader::thread_init(&kg, &kernel_globals, &osl_globals);
 #endif
+		texture_cache.thread_init(&kg);
+		thread_profiling_init(&kg);
 		return kg;
 	}
 
@@ -511,9 +656,29 @@ protected:
 				free(kg->decoupled_volume_steps[i]);
 			}
 		}
+		if(kg->path_stream != NULL) {
+			free(kg->path_stream);
+		}
 #ifdef WITH_OSL
 		OSLShader::thread_free(kg);
 #endif
+		texture_cache.thread_free(kg);
+		thread_profiling_free(kg);
+	}
+
+	inline void thread_profiling_init(KernelGlobals *kg)
+	{
+		kg->profiling = (use_profiling)? new ProfilingCounters(): NULL;
+	}
+
+	inline void thread_profiling_free(KernelGlobals *kg)
+	{
+		if(kg->profiling) {
+			thread_scoped_lock lock(profiling_mutex);
+			profiling_counters.add(*kg->profiling);
+			delete kg->profiling;
+			kg->profiling = NULL;
+		}
 	}
 };
 
@@ -35,11 +35,13 @@ class MultiDevice : public Device
 {
 public:
 	struct SubDevice {
-		explicit SubDevice(Device *device_)
-		: device(device_) {}
+		explicit SubDevice(Device *device_, bool network_ = false)
+		: device(device_), network(network_) {}
 
 		Device *device;
 		map<device_ptr, device_ptr> ptr_map;
+		/* network devices serve tile requests of their server in task_wait() */
+		bool network;
 	};
 
 	list<SubDevice> devices;
@@ -65,7 +67,7 @@ public:
 		foreach(string& server, servers) {
 			device = device_network_create(info, stats, server.c_str());
 			if(device)
-				devices.push_back(SubDevice(device));
+				devices.push_back(SubDevice(device, true));
 		}
 #endif
 	}
@@ -213,6 +215,24 @@ public:
 		stats.mem_free(mem.device_size);
 	}
 
+	void set_profiling(bool enable)
+	{
+		foreach(SubDevice& sub, devices)
+			sub.device->set_profiling(enable);
+	}
+
+	void get_network_stats(vector<NetworkServerStats>& network_stats)
+	{
+		foreach(SubDevice& sub, devices)
+			sub.device->get_network_stats(network_stats);
+	}
+
+	void get_profiling_counters(ProfilingCounters& counters)
+	{
+		foreach(SubDevice& sub, devices)
+			sub.device->get_profiling_counters(counters);
+	}
+
 	void pixels_alloc(device_memory& mem)
 	{
 		foreach(SubDevice& sub, devices) {
@@ -339,8 +359,25 @@ public:
 
 	void task_wait()
 	{
-		foreach(SubDevice& sub, devices)
-			sub.device->task_wait();
+		/* servers only get tiles while their requests are served, so wait for
+		 * all of them at once, letting every device take tiles as fast as it
+		 * renders them */
+		vector<thread*> network_threads;
+
+		foreach(SubDevice& sub, devices) {
+			if(sub.network)
+				network_threads.push_back(new thread(function_bind(&Device::task_wait, sub.device)));
+		}
+
+		foreach(SubDevice& sub, devices) {
+			if(!sub.network)
+				sub.device->task_wait();
+		}
+
+		foreach(thread *network_thread, network_threads) {
+			network_thread->join();
+			delete network_thread;
+		}
 	}
 
 	void task_cancel()
@@ -20,6 +20,8 @@
 
 #include "util_foreach.h"
 #include "util_logging.h"
+#include "util_md5.h"
+#include "util_time.h"
 
 #if defined(WITH_NETWORK)
 
@@ -41,6 +43,65 @@ static TileList::iterator tile_list_find(TileList& tile_list, RenderTile& tile)
 	return tile_list.end();
 }
 
+/* Memory Block Hashes
+ *
+ * Hashes of the blocks of memory last sent to a server. When the server has
+ * the previous contents of the same memory, only blocks with a different hash
+ * are sent. */
+
+struct MemoryHashes {
+	size_t size;
+	vector<string> blocks;
+};
+
+typedef map<device_ptr, MemoryHashes> MemoryHashMap;
+typedef map<string, MemoryHashes> TextureHashMap;
+
+static size_t memory_block_size(size_t size, size_t block)
+{
+	size_t offset = block*NETWORK_MEMORY_BLOCK_SIZE;
+	return (size - offset < NETWORK_MEMORY_BLOCK_SIZE)? size - offset: NETWORK_MEMORY_BLOCK_SIZE;
+}
+
+static void memory_hashes(const uint8_t *data, size_t size, MemoryHashes& hashes)
+{
+	size_t num_blocks = (size + NETWORK_MEMORY_BLOCK_SIZE - 1)/NETWORK_MEMORY_BLOCK_SIZE;
+
+	hashes.size = size;
+	hashes.blocks.resize(num_blocks);
+
+	for(size_t i = 0; i < num_blocks; i++) {
+		MD5Hash md5;
+		md5.append(data + i*NETWORK_MEMORY_BLOCK_SIZE, (int)memory_block_size(size, i));
+		hashes.blocks[i] = md5.get_hex();
+	}
+}
+
+/* Blocks that differ, returns false if the size changed and all memory must
+ * be sent. */
+static bool memory_changed_blocks(const MemoryHashes& old_hashes,
+                                  const MemoryHashes& hashes,
+                                  vector<int>& blocks)
+{
+	blocks.clear();
+
+	if(old_hashes.size != hashes.size)
+		return false;
+
+	for(size_t i = 0; i < hashes.blocks.size(); i++)
+		if(old_hashes.blocks[i] != hashes.blocks[i])
+			blocks.push_back(i);
+
+	return true;
+}
+
+/* Hashes of the textures each server kept from the last session, so the
+ * textures of the next frame only need their changed blocks sent. Servers
+ * keep textures per client key, unique to this process. */
+static thread_mutex server_texture_hashes_mutex;
+static map<string, TextureHashMap> server_texture_hashes;
+static string server_texture_client_key;
+
 class NetworkDevice : public Device
 {
 public:
@@ -60,11 +121,21 @@ public:
 	: Device(info, stats, true), socket(io_service)
 	{
 		error_func = NetworkError();
-		stringstream portstr;
-		portstr << SERVER_PORT;
+
+		/* address with optional port, as found by server discovery */
+		string host = address;
+		string port = string_printf("%d", SERVER_PORT);
+		size_t port_pos = host.rfind(':');
+
+		if(port_pos != string::npos) {
+			port = host.substr(port_pos + 1);
+			host = host.substr(0, port_pos);
+		}
+
+		server_stats.address = host + ":" + port;
 
 		tcp::resolver resolver(io_service);
-		tcp::resolver::query query(address, portstr.str());
+		tcp::resolver::query query(host, port);
 		tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
 		tcp::resolver::iterator end;
 
@@ -79,12 +150,68 @@ public:
 			error_func.network_error(error.message());
 
 		mem_counter = 0;
+
+		if(!error_func.have_error())
+			texture_hashes_restore();
 	}
 
 	~NetworkDevice()
 	{
 		RPCSend snd(socket, &error_func, "stop");
 		snd.write();
+
+		texture_hashes_store();
+	}
+
+	/* continue from the textures the server kept from the last session, it
+	 * replies with the names of the textures it still has for this client */
+	void texture_hashes_restore()
+	{
+		string client_key;
+
+		{
+			thread_scoped_lock hashes_lock(server_texture_hashes_mutex);
+
+			if(server_texture_client_key.empty()) {
+				MD5Hash md5;
+				string seed = string_printf("%f-%p", time_dt(), (void*)this);
+				md5.append((const uint8_t*)seed.c_str(), (int)seed.size());
+				server_texture_client_key = md5.get_hex();
+			}
+
+			client_key = server_texture_client_key;
+		}
+
+		RPCSend snd(socket, &error_func, "texture_cache_restore");
+		snd.add(client_key);
+		snd.write();
+
+		vector<string> names;
+		RPCReceive rcv(socket, &error_func);
+		rcv.read(names);
+
+		thread_scoped_lock hashes_lock(server_texture_hashes_mutex);
+		TextureHashMap& server_hashes = server_texture_hashes[server_stats.address];
+
+		foreach(const string& name, names) {
+			TextureHashMap::iterator it = server_hashes.find(name);
+			if(it != server_hashes.end())
+				freed_texture_hashes[name] = it->second;
+		}
+
+		server_hashes.clear();
+	}
+
+	void texture_hashes_store()
+	{
+		thread_scoped_lock hashes_lock(server_texture_hashes_mutex);
+		TextureHashMap& server_hashes = server_texture_hashes[server_stats.address];
+
+		/* after an error the server may not have received every freed texture */
+		if(error_func.have_error())
+			server_hashes.clear();
+		else
+			server_hashes.swap(freed_texture_hashes);
 	}
 
 	void mem_alloc(device_memory& mem, MemoryType type)
@@ -104,11 +231,51 @@ public:
 	{
 		thread_scoped_lock lock(rpc_lock);
 
-		RPCSend snd(socket, &error_func, "mem_copy_to");
+		size_t data_size = mem.memory_size();
+		uint8_t *data = (uint8_t*)mem.data_pointer;
 
-		snd.add(mem);
-		snd.write();
-		snd.write_buffer((void*)mem.data_pointer, mem.memory_size());
+		/* the server still has the last copy of this memory */
+		MemoryHashes hashes;
+		memory_hashes(data, data_size, hashes);
+
+		MemoryHashMap::iterator it = mem_hashes.find(mem.device_pointer);
+		vector<int> blocks;
+		bool delta = (it != mem_hashes.end()) && memory_changed_blocks(it->second, hashes, blocks);
+
+		mem_hashes[mem.device_pointer] = hashes;
+
+		if(delta) {
+			RPCSend snd(socket, &error_func, "mem_copy_to_delta");
+
+			snd.add(mem);
+			snd.add(blocks);
+			snd.write();
+			write_blocks(snd, data, data_size, blocks);
+		}
+		else {
+			RPCSend snd(socket, &error_func, "mem_copy_to");
+
+			snd.add(mem);
+			snd.write();
+			snd.write_buffer((void*)mem.data_pointer, data_size);
+
+			server_stats.mem_sent += data_size;
+		}
+	}
+
+	void write_blocks(RPCSend& snd, uint8_t *data, size_t data_size, const vector<int>& blocks)
+	{
+		size_t sent_size = 0;
+
+		foreach(int block, blocks) {
+			size_t block_size = memory_block_size(data_size, block);
+
+			snd.write_buffer(data + block*NETWORK_MEMORY_BLOCK_SIZE, block_size);
+			sent_size += block_size;
+		}
+
+		server_stats.mem_sent += sent_size;
+		server_stats.mem_skipped += data_size - sent_size;
 	}
 
 	void mem_copy_from(device_memory& mem, int y, int w, int h, int elem)
@@ -117,6 +284,9 @@ public:
 
 		size_t data_size = mem.memory_size();
 
+		/* the server contents differ from what was sent */
+		mem_hashes.erase(mem.device_pointer);
+
 		RPCSend snd(socket, &error_func, "mem_copy_from");
 
 		snd.add(mem);
@@ -134,6 +304,8 @@ public:
 	{
 		thread_scoped_lock lock(rpc_lock);
 
+		mem_hashes.erase(mem.device_pointer);
+
 		RPCSend snd(socket, &error_func, "mem_zero");
 
 		snd.add(mem);
@@ -145,6 +317,8 @@ public:
 		if(mem.device_pointer) {
 			thread_scoped_lock lock(rpc_lock);
 
+			mem_hashes.erase(mem.device_pointer);
+
 			RPCSend snd(socket, &error_func, "mem_free");
 
 			snd.add(mem);
@@ -181,16 +355,42 @@ public:
 
 		mem.device_pointer = ++mem_counter;
 
-		RPCSend snd(socket, &error_func, "tex_alloc");
-
 		string name_string(name);
+		size_t data_size = mem.memory_size();
+		uint8_t *data = (uint8_t*)mem.data_pointer;
+
+		/* the server kept the texture with the same name when it was freed */
+		MemoryHashes hashes;
+		memory_hashes(data, data_size, hashes);
+
+		TextureHashMap::iterator it = freed_texture_hashes.find(name_string);
+		vector<int> blocks;
+		bool delta = (it != freed_texture_hashes.end()) &&
+		             memory_changed_blocks(it->second, hashes, blocks);
+
+		if(it != freed_texture_hashes.end())
+			freed_texture_hashes.erase(it);
+
+		mem_hashes[mem.device_pointer] = hashes;
+		texture_names[mem.device_pointer] = name_string;
+
+		RPCSend snd(socket, &error_func, "tex_alloc");
 
 		snd.add(name_string);
 		snd.add(mem);
 		snd.add(interpolation);
 		snd.add(extension);
+		snd.add(delta);
+		snd.add(blocks);
 		snd.write();
-		snd.write_buffer((void*)mem.data_pointer, mem.memory_size());
+
+		if(delta) {
+			write_blocks(snd, data, data_size, blocks);
+		}
+		else {
+			snd.write_buffer((void*)data, data_size);
+			server_stats.mem_sent += data_size;
+		}
 	}
 
 	void tex_free(device_memory& mem)
@@ -198,6 +398,18 @@ public:
 		if(mem.device_pointer) {
 			thread_scoped_lock lock(rpc_lock);
 
+			/* the server keeps freed textures for the next allocation */
+			map<device_ptr, string>::iterator name_it = texture_names.find(mem.device_pointer);
+			MemoryHashMap::iterator it = mem_hashes.find(mem.device_pointer);
+
+			if(name_it != texture_names.end() && it != mem_hashes.end())
+				freed_texture_hashes[name_it->second] = it->second;
+
+			if(name_it != texture_names.end())
+				texture_names.erase(name_it);
+			if(it != mem_hashes.end())
+				mem_hashes.erase(it);
+
 			RPCSend snd(socket, &error_func, "tex_free");
 
 			snd.add(mem);
@@ -249,6 +461,7 @@ public:
 		lock.unlock();
 
 		TileList the_tiles;
+		double start_time = time_dt();
 
 		/* todo: run this threaded for connecting to multiple clients */
 		for(;;) {
@@ -292,6 +505,9 @@ public:
 
 				assert(tile.buffers != NULL);
 
+				server_stats.num_tiles++;
+				server_stats.pixel_samples += (uint64_t)(tile.sample - tile.start_sample)*tile.w*tile.h;
+
 				the_task.release_tile(tile);
 
 				lock.lock();
@@ -306,6 +522,15 @@ public:
 			else
 				lock.unlock();
 		}
+
+		server_stats.render_time += time_dt() - start_time;
+
+		VLOG(1) << "Network server " << server_stats.address << ": "
+		        << server_stats.num_tiles << " tiles, "
+		        << string_human_readable_number(server_stats.pixel_samples) << " pixel samples in "
+		        << server_stats.render_time << " seconds, "
+		        << string_human_readable_size(server_stats.mem_sent) << " sent, "
+		        << string_human_readable_size(server_stats.mem_skipped) << " unchanged.";
 	}
 
 	void task_cancel()
@@ -320,8 +545,20 @@ public:
 		return 1;
 	}
 
+	void get_network_stats(vector<NetworkServerStats>& network_stats)
+	{
+		network_stats.push_back(server_stats);
+	}
+
 private:
 	NetworkError error_func;
+
+	NetworkServerStats server_stats;
+
+	/* memory as last sent to the server */
+	MemoryHashMap mem_hashes;
+	map<device_ptr, string> texture_names;
+	TextureHashMap freed_texture_hashes;
 };
 
 Device *device_network_create(DeviceInfo& info, Stats &stats, const char *address)
@@ -343,6 +580,101 @@ void device_network_info(vector<DeviceInfo>& devices)
 	devices.push_back(info);
 }
 
+/* Textures freed by clients, kept between connections so that for the next
+ * frame only their changed blocks are sent. Textures are kept per client key,
+ * so a client never starts from the data of another client. When over the
+ * size limit, the least recently freed textures are dropped; clients learn
+ * which textures are left when they connect. */
+class ServerTextureCache {
+public:
+	ServerTextureCache()
+	: size(0), counter(0)
+	{
+	}
+
+	/* take the texture out of the cache, returns false if it was not kept */
+	bool take(const string& client, const string& name, DataVector& data)
+	{
+		TextureMap::iterator it = textures.find(TextureKey(client, name));
+
+		if(it == textures.end())
+			return false;
+
+		size -= it->second.data.size();
+		data.swap(it->second.data);
+		textures.erase(it);
+
+		return true;
+	}
+
+	/* keep the texture, dropping textures of other clients when over the size
+	 * limit since this client may still allocate its textures again */
+	void insert(const string& client, const string& name, DataVector& data)
+	{
+		CachedTexture& texture = textures[TextureKey(client, name)];
+
+		size -= texture.data.size();
+		texture.data.swap(data);
+		texture.freed = ++counter;
+		size += texture.data.size();
+
+		trim(&client);
+	}
+
+	/* drop textures of any client until within the size limit, only done
+	 * between connections */
+	void trim()
+	{
+		trim(NULL);
+	}
+
+	void names(const string& client, vector<string>& names)
+	{
+		names.clear();
+
+		for(TextureMap::iterator it = textures.lower_bound(TextureKey(client, ""));
+		    it != textures.end() && it->first.first == client;
+		    ++it)
+		{
+			names.push_back(it->first.second);
+		}
+	}
+
+protected:
+	typedef pair<string, string> TextureKey;
+
+	struct CachedTexture {
+		DataVector data;
+		uint64_t freed;
+	};
+
+	typedef map<TextureKey, CachedTexture> TextureMap;
+
+	void trim(const string *keep_client)
+	{
+		while(size > NETWORK_TEXTURE_CACHE_MAX_SIZE) {
+			TextureMap::iterator oldest = textures.end();
+
+			for(TextureMap::iterator it = textures.begin(); it != textures.end(); ++it) {
+				if(keep_client && it->first.first == *keep_client)
+					continue;
+				if(oldest == textures.end() || it->second.freed < oldest->second.freed)
+					oldest = it;
+			}
+
+			if(oldest == textures.end())
+				break;
+
+			size -= oldest->second.data.size();
+			textures.erase(oldest);
+		}
+	}
+
+	TextureMap textures;
+	size_t size;
+	uint64_t counter;
+};
+
 class DeviceServer {
 public:
 	thread_mutex rpc_lock;
@@ -353,8 +685,9 @@ public:
 
 	bool have_error() { return error_func.have_error(); }
 
-	DeviceServer(Device *device_, tcp::socket& socket_)
-	: device(device_), socket(socket_), stop(false), blocked_waiting(false)
+	DeviceServer(Device *device_, tcp::socket& socket_, ServerTextureCache& texture_cache_)
+	: device(device_), socket(socket_), texture_cache(texture_cache_),
+	  stop(false), blocked_waiting(false)
 	{
 		error_func = NetworkError();
 	}
@@ -452,6 +785,13 @@ protected:
 		return result;
 	}
 
+	/* read the changed blocks of memory, the others are unchanged */
+	void read_blocks(RPCReceive& rcv, uint8_t *data, size_t data_size, const vector<int>& blocks)
+	{
+		foreach(int block, blocks)
+			rcv.read_buffer(data + block*NETWORK_MEMORY_BLOCK_SIZE, memory_block_size(data_size, block));
+	}
+
 	/* note that the lock must be already acquired upon entry.
 	 * This is necessary because the caller often peeks at
 	 * the header and delegates control to here when it doesn't
@@ -510,6 +850,29 @@ protected:
 			/* copy the data from the memory buffer to the device buffer */
 			device->mem_copy_to(mem);
 		}
+		else if(rcv.name == "mem_copy_to_delta") {
+			network_device_memory mem;
+			vector<int> blocks;
+
+			rcv.read(mem);
+			rcv.read(blocks);
+			lock.unlock();
+
+			device_ptr client_pointer = mem.device_pointer;
+
+			DataVector &data_v = data_vector_find(client_pointer);
+
+			size_t data_size = mem.memory_size();
+
+			/* memory buffer still has the last copy */
+			mem.data_pointer = (data_size)? (device_ptr)&data_v[0]: 0;
+
+			read_blocks(rcv, (uint8_t*)mem.data_pointer, data_size, blocks);
+
+			mem.device_pointer = device_ptr_from_client_pointer(client_pointer);
+
+			device->mem_copy_to(mem);
+		}
 		else if(rcv.name == "mem_copy_from") {
 			network_device_memory mem;
 			int y, w, h, elem;
@@ -583,11 +946,15 @@ protected:
 			InterpolationType interpolation;
 			ExtensionType extension_type;
 			device_ptr client_pointer;
+			bool delta;
+			vector<int> blocks;
 
 			rcv.read(name);
 			rcv.read(mem);
 			rcv.read(interpolation);
 			rcv.read(extension_type);
+			rcv.read(delta);
+			rcv.read(blocks);
 			lock.unlock();
 
 			client_pointer = mem.device_pointer;
@@ -596,16 +963,31 @@ protected:
 
 			DataVector &data_v = data_vector_insert(client_pointer, data_size);
 
+			/* start from the texture with the same name this client freed */
+			DataVector cached_v;
+			bool cached = texture_cache.take(client_key, name, cached_v);
+
+			if(delta) {
+				if(cached && cached_v.size() == data_size)
+					data_v.swap(cached_v);
+				else
+					network_error("Texture " + name + " sent as changes is not in the cache");
+			}
+
 			if(data_size)
 				mem.data_pointer = (device_ptr)&(data_v[0]);
 			else
 				mem.data_pointer = 0;
 
-			rcv.read_buffer((uint8_t*)mem.data_pointer, data_size);
+			if(delta)
+				read_blocks(rcv, (uint8_t*)mem.data_pointer, data_size, blocks);
+			else
+				rcv.read_buffer((uint8_t*)mem.data_pointer, data_size);
 
 			device->tex_alloc(name.c_str(), mem, interpolation, extension_type);
 
 			pointer_mapping_insert(client_pointer, mem.device_pointer);
+			texture_names[client_pointer] = name;
 		}
 		else if(rcv.name == "tex_free") {
 			network_device_memory mem;
@@ -616,10 +998,30 @@ protected:
 
 			client_pointer = mem.device_pointer;
 
+			/* keep the data for the next allocation of a texture with this name */
+			map<device_ptr, string>::iterator name_it = texture_names.find(client_pointer);
+
+			if(name_it != texture_names.end()) {
+				texture_cache.insert(client_key, name_it->second, data_vector_find(client_pointer));
+				texture_names.erase(name_it);
+			}
+
 			mem.device_pointer = device_ptr_from_client_pointer_erase(client_pointer);
 
 			device->tex_free(mem);
 		}
+		else if(rcv.name == "texture_cache_restore") {
+			rcv.read(client_key);
+
+			vector<string> names;
+			texture_cache.trim();
+			texture_cache.names(client_key, names);
+
+			RPCSend snd(socket, &error_func, "texture_cache_restore");
+			snd.add(names);
+			snd.write();
+			lock.unlock();
+		}
 		else if(rcv.name == "load_kernels") {
 			DeviceRequestedFeatures requested_features;
 			rcv.read(requested_features.experimental);
@@ -810,6 +1212,11 @@ protected:
 	PtrMap ptr_imap;
 	DataMap mem_data;
 
+	/* names of allocated textures, and textures kept after freeing */
+	map<device_ptr, string> texture_names;
+	ServerTextureCache& texture_cache;
+	string client_key;
+
 	struct AcquireEntry {
 		string name;
 		RenderTile tile;
@@ -827,16 +1234,22 @@ private:
 
 };
 
-void Device::server_run()
+void Device::server_run(int port)
 {
+	if(port == 0)
+		port = SERVER_PORT;
+
 	try {
 		/* starts thread that responds to discovery requests */
-		ServerDiscovery discovery;
+		ServerDiscovery discovery(false, port);
+
+		/* textures freed by a client are kept for its next connection */
+		ServerTextureCache texture_cache;
 
 		for(;;) {
 			/* accept connection */
 			boost::asio::io_service io_service;
-			tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), SERVER_PORT));
+			tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), port));
 
 			tcp::socket socket(io_service);
 			acceptor.accept(socket);
@@ -844,9 +1257,11 @@ void Device::server_run()
 			string remote_address = socket.remote_endpoint().address().to_string();
 			printf("Connected to remote client at: %s\n", remote_address.c_str());
 
-			DeviceServer server(this, socket);
+			DeviceServer server(this, socket, texture_cache);
 			server.listen();
 
+			texture_cache.trim();
+
 			printf("Disconnected.\n");
 		}
 	}
@@ -55,6 +55,14 @@ static const int DISCOVER_PORT = 5121;
 static const string DISCOVER_REQUEST_MSG = "REQUEST_RENDER_SERVER_IP";
 static const string DISCOVER_REPLY_MSG = "REPLY_RENDER_SERVER_IP";
 
+/* Memory is compared in blocks of this size, to only send changed blocks to
+ * servers that have an older copy of it */
+static const size_t NETWORK_MEMORY_BLOCK_SIZE = 64*1024;
+
+/* Servers keep at most this much memory of textures freed by clients, for
+ * clients to only send changed blocks when allocating them again */
+static const size_t NETWORK_TEXTURE_CACHE_MAX_SIZE = (size_t)1024*1024*1024;
+
 #if 0
 typedef boost::archive::text_oarchive o_archive;
 typedef boost::archive::text_iarchive i_archive;
@@ -126,6 +134,22 @@ public:
 		archive & data;
 	}
 
+	void add(const vector<int>& data)
+	{
+		size_t size = data.size();
+		archive & size;
+		for(size_t i = 0; i < size; i++)
+			archive & data[i];
+	}
+
+	void add(const vector<string>& data)
+	{
+		size_t size = data.size();
+		archive & size;
+		for(size_t i = 0; i < size; i++)
+			archive & data[i];
+	}
+
 	void add(const DeviceTask& task)
 	{
 		int type = (int)task.type;
@@ -271,6 +295,24 @@ public:
 		*archive & data;
 	}
 
+	void read(vector<int>& data)
+	{
+		size_t size;
+		*archive & size;
+		data.resize(size);
+		for(size_t i = 0; i < size; i++)
+			*archive & data[i];
+	}
+
+	void read(vector<string>& data)
+	{
+		size_t size;
+		*archive & size;
+		data.resize(size);
+		for(size_t i = 0; i < size; i++)
+			*archive & data[i];
+	}
+
 	void read_buffer(void *buffer, size_t size)
 	{
 		boost::system::error_code error;
@@ -322,9 +364,13 @@ protected:
 
 class ServerDiscovery {
 public:
-	explicit ServerDiscovery(bool discover = false)
+	/* servers reply with the port they listen on, so that multiple servers
+	 * can run on the same host. server addresses are "address:port" */
+	explicit ServerDiscovery(bool discover = false, int server_port = SERVER_PORT)
 	: listen_socket(io_service), collect_servers(false)
 	{
+		reply_msg = string_printf("%s:%d", DISCOVER_REPLY_MSG.c_str(), server_port);
+
 		/* setup listen socket */
 		listen_endpoint.address(boost::asio::ip::address_v4::any());
 		listen_endpoint.port(DISCOVER_PORT);
@@ -384,8 +430,12 @@ private:
 
 			/* handle incoming message */
 			if(collect_servers) {
-				if(msg == DISCOVER_REPLY_MSG) {
-					string address = receive_endpoint.address().to_string();
+				if(string_startswith(msg, DISCOVER_REPLY_MSG.c_str())) {
+					/* servers without a port in the reply use the default */
+					string port = (msg.size() > DISCOVER_REPLY_MSG.size() + 1)?
+					                  msg.substr(DISCOVER_REPLY_MSG.size() + 1):
+					                  string_printf("%d", SERVER_PORT);
+					string address = receive_endpoint.address().to_string() + ":" + port;
 
 					mutex.lock();
 
@@ -402,7 +452,7 @@ private:
 			else {
 				/* reply to request */
 				if(msg == DISCOVER_REQUEST_MSG)
-					broadcast_message(DISCOVER_REPLY_MSG);
+					broadcast_message(reply_msg);
 			}
 		}
 
@@ -462,6 +512,8 @@ private:
 	/* collection of server addresses in list */
 	bool collect_servers;
 	vector<string> servers;
+
+	string reply_msg;
 };
 
 CCL_NAMESPACE_END
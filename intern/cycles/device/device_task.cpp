@@ -125,5 +125,13 @@ void DeviceTask::update_progress(RenderTile *rtile, int pixel_samples)
 	}
 }
 
+/* Device Denoise Task */
+
+DeviceDenoiseTask::DeviceDenoiseTask()
+: buffer(0), output(0), x(0), y(0), w(0), h(0), stride(0), height(0),
+  radius(0), patch_radius(0), strength(0.0f), feature_strength(0.0f)
+{
+}
+
 CCL_NAMESPACE_END
 
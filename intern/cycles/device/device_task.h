@@ -71,6 +71,26 @@ protected:
 	double last_update_time;
 };
 
+/* Device Denoise Task
+ * Rectangle of the prefiltered feature planes to denoise, see kernel_denoise.h
+ * for the layout of the buffer and output. */
+
+class DeviceDenoiseTask {
+public:
+	device_ptr buffer;
+	device_ptr output;
+
+	int x, y, w, h;
+	int stride, height;
+
+	int radius;
+	int patch_radius;
+	float strength;
+	float feature_strength;
+
+	DeviceDenoiseTask();
+};
+
 CCL_NAMESPACE_END
 
 #endif /* __DEVICE_TASK_H__ */
@@ -18,6 +18,7 @@
 #include "node_type.h"
 
 #include "util_foreach.h"
+#include "util_md5.h"
 #include "util_param.h"
 #include "util_transform.h"
 
@@ -403,5 +404,50 @@ bool Node::equals(const Node& other) const
 	return true;
 }
 
+/* hash */
+
+template<typename T>
+static void array_hash(const Node *node, const SocketType& socket, MD5Hash& md5)
+{
+	const array<T>* a = (const array<T>*)(((char*)node) + socket.struct_offset);
+	size_t size = a->size();
+
+	md5.append((const uint8_t*)&size, sizeof(size));
+	if(size > 0) {
+		md5.append((const uint8_t*)a->data(), sizeof(T)*size);
+	}
+}
+
+void Node::hash(MD5Hash& md5) const
+{
+	const string& type_name = type->name.string();
+	md5.append((const uint8_t*)type_name.c_str(), type_name.size());
+
+	/* strings are hashed by their ustring pointer, which is unique for every
+	 * string in the process, same as in equals_value() */
+	foreach(const SocketType& socket, type->inputs) {
+		if(socket.is_array()) {
+			switch(socket.type) {
+				case SocketType::BOOLEAN_ARRAY: array_hash<bool>(this, socket, md5); break;
+				case SocketType::FLOAT_ARRAY: array_hash<float>(this, socket, md5); break;
+				case SocketType::INT_ARRAY: array_hash<int>(this, socket, md5); break;
+				case SocketType::COLOR_ARRAY: array_hash<float3>(this, socket, md5); break;
+				case SocketType::VECTOR_ARRAY: array_hash<float3>(this, socket, md5); break;
+				case SocketType::POINT_ARRAY: array_hash<float3>(this, socket, md5); break;
+				case SocketType::NORMAL_ARRAY: array_hash<float3>(this, socket, md5); break;
+				case SocketType::POINT2_ARRAY: array_hash<float2>(this, socket, md5); break;
+				case SocketType::STRING_ARRAY: array_hash<ustring>(this, socket, md5); break;
+				case SocketType::TRANSFORM_ARRAY: array_hash<Transform>(this, socket, md5); break;
+				case SocketType::NODE_ARRAY: array_hash<void*>(this, socket, md5); break;
+				default: assert(0); break;
+			}
+		}
+		else {
+			const void *value = ((char*)this) + socket.struct_offset;
+			md5.append((const uint8_t*)value, socket.size());
+		}
+	}
+}
+
 CCL_NAMESPACE_END
 
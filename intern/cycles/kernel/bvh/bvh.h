@@ -34,6 +34,11 @@ CCL_NAMESPACE_BEGIN
 #  include "qbvh_nodes.h"
 #endif
 
+/* Common OBVH functions. */
+#ifdef __OBVH__
+#  include "obvh_nodes.h"
+#endif
+
 /* Regular BVH traversal */
 
 #include "bvh_nodes.h"
@@ -166,6 +171,8 @@ ccl_device_intersect bool scene_intersect(KernelGlobals *kg,
                                           float difl,
                                           float extmax)
 {
+	PROFILING_RAY(kg, visibility);
+
 #ifdef __OBJECT_MOTION__
 	if(kernel_data.bvh.have_motion) {
 #  ifdef __HAIR__
@@ -209,6 +216,8 @@ ccl_device_intersect void scene_intersect_subsurface(KernelGlobals *kg,
                                                      uint *lcg_state,
                                                      int max_hits)
 {
+	PROFILING_RAY_TYPE(kg, PROFILING_RAY_SUBSURFACE);
+
 #ifdef __OBJECT_MOTION__
 	if(kernel_data.bvh.have_motion) {
 		return bvh_intersect_subsurface_motion(kg,
@@ -231,6 +240,8 @@ ccl_device_intersect void scene_intersect_subsurface(KernelGlobals *kg,
 #ifdef __SHADOW_RECORD_ALL__
 ccl_device_intersect bool scene_intersect_shadow_all(KernelGlobals *kg, const Ray *ray, Intersection *isect, uint max_hits, uint *num_hits)
 {
+	PROFILING_RAY_TYPE(kg, PROFILING_RAY_SHADOW);
+
 #  ifdef __OBJECT_MOTION__
 	if(kernel_data.bvh.have_motion) {
 #    ifdef __HAIR__
@@ -262,6 +273,8 @@ ccl_device_intersect bool scene_intersect_volume(KernelGlobals *kg,
                                                  Intersection *isect,
                                                  const uint visibility)
 {
+	PROFILING_RAY_TYPE(kg, PROFILING_RAY_VOLUME);
+
 #  ifdef __OBJECT_MOTION__
 	if(kernel_data.bvh.have_motion) {
 		return bvh_intersect_volume_motion(kg, ray, isect, visibility);
@@ -290,6 +303,8 @@ ccl_device_intersect uint scene_intersect_volume_all(KernelGlobals *kg,
                                                      const uint max_hits,
                                                      const uint visibility)
 {
+	PROFILING_RAY_TYPE(kg, PROFILING_RAY_VOLUME);
+
 #  ifdef __OBJECT_MOTION__
 	if(kernel_data.bvh.have_motion) {
 		return bvh_intersect_volume_all_motion(kg, ray, isect, max_hits, visibility);
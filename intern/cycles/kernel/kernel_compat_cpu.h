@@ -37,6 +37,7 @@
 
 #include "util_debug.h"
 #include "util_math.h"
+#include "util_profiling.h"
 #include "util_simd.h"
 #include "util_half.h"
 #include "util_types.h"
@@ -343,7 +344,7 @@ template<typename T> struct texture_image  {
 					return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
 			}
 
-			return read(data[ix + iy*width + iz*width*height]);
+			return fetch_3d(ix, iy, iz);
 		}
 		else if(interpolation == INTERPOLATION_LINEAR) {
 			float tx = frac(x*(float)width - 0.5f, &ix);
@@ -383,15 +384,15 @@ template<typename T> struct texture_image  {
 
 			float4 r;
 
-			r  = (1.0f - tz)*(1.0f - ty)*(1.0f - tx)*read(data[ix + iy*width + iz*width*height]);
-			r += (1.0f - tz)*(1.0f - ty)*tx*read(data[nix + iy*width + iz*width*height]);
-			r += (1.0f - tz)*ty*(1.0f - tx)*read(data[ix + niy*width + iz*width*height]);
-			r += (1.0f - tz)*ty*tx*read(data[nix + niy*width + iz*width*height]);
+			r  = (1.0f - tz)*(1.0f - ty)*(1.0f - tx)*fetch_3d(ix, iy, iz);
+			r += (1.0f - tz)*(1.0f - ty)*tx*fetch_3d(nix, iy, iz);
+			r += (1.0f - tz)*ty*(1.0f - tx)*fetch_3d(ix, niy, iz);
+			r += (1.0f - tz)*ty*tx*fetch_3d(nix, niy, iz);
 
-			r += tz*(1.0f - ty)*(1.0f - tx)*read(data[ix + iy*width + niz*width*height]);
-			r += tz*(1.0f - ty)*tx*read(data[nix + iy*width + niz*width*height]);
-			r += tz*ty*(1.0f - tx)*read(data[ix + niy*width + niz*width*height]);
-			r += tz*ty*tx*read(data[nix + niy*width + niz*width*height]);
+			r += tz*(1.0f - ty)*(1.0f - tx)*fetch_3d(ix, iy, niz);
+			r += tz*(1.0f - ty)*tx*fetch_3d(nix, iy, niz);
+			r += tz*ty*(1.0f - tx)*fetch_3d(ix, niy, niz);
+			r += tz*ty*tx*fetch_3d(nix, niy, niz);
 
 			return r;
 		}
@@ -450,20 +451,14 @@ template<typename T> struct texture_image  {
 			}
 
 			const int xc[4] = {pix, ix, nix, nnix};
-			const int yc[4] = {width * piy,
-			                   width * iy,
-			                   width * niy,
-			                   width * nniy};
-			const int zc[4] = {width * height * piz,
-			                   width * height * iz,
-			                   width * height * niz,
-			                   width * height * nniz};
+			const int yc[4] = {piy, iy, niy, nniy};
+			const int zc[4] = {piz, iz, niz, nniz};
 			float u[4], v[4], w[4];
 
 			/* Some helper macro to keep code reasonable size,
 			 * let compiler to inline all the matrix multiplications.
 			 */
-#define DATA(x, y, z) (read(data[xc[x] + yc[y] + zc[z]]))
+#define DATA(x, y, z) (fetch_3d(xc[x], yc[y], zc[z]))
 #define COL_TERM(col, row) \
 			(v[col] * (u[0] * DATA(0, col, row) + \
 			           u[1] * DATA(1, col, row) + \
@@ -488,6 +483,63 @@ template<typename T> struct texture_image  {
 		}
 	}
 
+	/* Voxel lookup, through the tile offsets for sparse images. */
+	ccl_always_inline float4 fetch_3d(int x, int y, int z)
+	{
+		if(tile_offsets) {
+			const int mask = TEX_SPARSE_TILE_SIZE - 1;
+			int tile = (x >> TEX_SPARSE_TILE_SHIFT) +
+			           tiles_x*((y >> TEX_SPARSE_TILE_SHIFT) +
+			                    tiles_y*(z >> TEX_SPARSE_TILE_SHIFT));
+			int index = (x & mask) +
+			            ((y & mask) << TEX_SPARSE_TILE_SHIFT) +
+			            ((z & mask) << (2*TEX_SPARSE_TILE_SHIFT));
+			return read(data[tile_offsets[tile] + index]);
+		}
+
+		return read(data[x + y*width + z*width*height]);
+	}
+
+	/* Distance along D from the normalized position P over which all lookups
+	 * only see background voxels of a sparse image, zero when P is not in
+	 * such empty space. Tiles next to allocated tiles are not empty, since
+	 * interpolation reads up to two voxels into the neighbouring tiles. */
+	ccl_always_inline float empty_distance_3d(float3 P, float3 D)
+	{
+		if(!tile_offsets || extension == EXTENSION_REPEAT)
+			return 0.0f;
+
+		const float p[3] = {P.x, P.y, P.z};
+		const float d[3] = {D.x, D.y, D.z};
+		const int size[3] = {width, height, depth};
+		const int tiles[3] = {tiles_x, tiles_y, tiles_z};
+		int t[3];
+		float dist = FLT_MAX;
+
+		for(int axis = 0; axis < 3; axis++) {
+			/* on a tile boundary take the tile ahead of the ray */
+			float v = clamp(p[axis]*(float)size[axis], -1.0f, (float)size[axis]);
+			int i = (d[axis] < 0.0f)? (int)ceilf(v) - 1: (int)floorf(v);
+			t[axis] = clamp(i >> TEX_SPARSE_TILE_SHIFT, 0, tiles[axis] - 1);
+
+			/* border tiles extend to infinity, lookups outside the image are
+			 * clamped to the border or clipped */
+			if(d[axis] > 0.0f && t[axis] < tiles[axis] - 1) {
+				float bound = (float)((t[axis] + 1) << TEX_SPARSE_TILE_SHIFT)/(float)size[axis];
+				dist = min(dist, (bound - p[axis])/d[axis]);
+			}
+			else if(d[axis] < 0.0f && t[axis] > 0) {
+				float bound = (float)(t[axis] << TEX_SPARSE_TILE_SHIFT)/(float)size[axis];
+				dist = min(dist, (bound - p[axis])/d[axis]);
+			}
+		}
+
+		if(tile_occupied[t[0] + tiles_x*(t[1] + tiles_y*t[2])])
+			return 0.0f;
+
+		return max(dist, 0.0f);
+	}
+
 	ccl_always_inline void dimensions_set(int width_, int height_, int depth_)
 	{
 		width = width_;
@@ -495,10 +547,34 @@ template<typename T> struct texture_image  {
 		depth = depth_;
 	}
 
+	/* Set tile offsets of a sparse image as created by the image manager, or
+	 * NULL for dense images. */
+	ccl_always_inline void sparse_set(int *header)
+	{
+		if(header == NULL) {
+			tile_offsets = NULL;
+			tile_occupied = NULL;
+			tiles_x = tiles_y = tiles_z = 0;
+			return;
+		}
+
+		dimensions_set(header[0], header[1], header[2]);
+		tiles_x = (width + TEX_SPARSE_TILE_SIZE - 1) >> TEX_SPARSE_TILE_SHIFT;
+		tiles_y = (height + TEX_SPARSE_TILE_SIZE - 1) >> TEX_SPARSE_TILE_SHIFT;
+		tiles_z = (depth + TEX_SPARSE_TILE_SIZE - 1) >> TEX_SPARSE_TILE_SHIFT;
+		tile_offsets = header + TEX_SPARSE_HEADER_SIZE;
+		tile_occupied = tile_offsets + tiles_x*tiles_y*tiles_z;
+	}
+
 	T *data;
 	int interpolation;
 	ExtensionType extension;
 	int width, height, depth;
+
+	/* sparse images only */
+	int *tile_offsets;
+	int *tile_occupied;
+	int tiles_x, tiles_y, tiles_z;
 #undef SET_CUBIC_SPLINE_WEIGHTS
 };
 
@@ -526,8 +602,10 @@ typedef texture_image<half4> texture_image_half4;
 #define kernel_tex_lookup(tex, t, offset, size) (kg->tex.lookup(t, offset, size))
 
 #define kernel_tex_image_interp(tex,x,y) kernel_tex_image_interp_impl(kg,tex,x,y)
+#define kernel_tex_image_interp_d(tex, x, y, dx, dy) kernel_tex_image_interp_d_impl(kg, tex, x, y, dx, dy)
 #define kernel_tex_image_interp_3d(tex, x, y, z) kernel_tex_image_interp_3d_impl(kg,tex,x,y,z)
 #define kernel_tex_image_interp_3d_ex(tex, x, y, z, interpolation) kernel_tex_image_interp_3d_ex_impl(kg,tex, x, y, z, interpolation)
+#define kernel_tex_image_empty_distance_3d(tex, P, D) kernel_tex_image_empty_distance_3d_impl(kg, tex, P, D)
 
 #define kernel_data (kg->__data)
 
@@ -557,6 +635,10 @@ ccl_device_inline void print_sse3i(const char *label, sse3i& a)
 	print_ssei(label, a.z);
 }
 
+#ifdef __KERNEL_AVX__
+typedef vector3<avxf> avx3f;
+#endif
+
 #endif
 
 CCL_NAMESPACE_END
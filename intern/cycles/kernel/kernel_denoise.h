@@ -0,0 +1,331 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+CCL_NAMESPACE_BEGIN
+
+/* Feature guided non-local means filter, following "Robust Denoising using
+ * Feature and Color Information" by Rousselle et al.
+ *
+ * The input buffer holds DENOISE_NUM_PLANES planes of stride*height floats,
+ * with the rectangle to denoise surrounded by a border of radius+patch_radius
+ * pixels. Pixels without data have a color far away from any rendered color,
+ * so they get no weight. Rows are padded by at least DENOISE_ROW_PADDING
+ * floats, which lets every loop run over whole SIMD vectors.
+ *
+ * Instead of looping over the search window for every pixel, every offset in
+ * the search window is applied to the entire rectangle at once. */
+
+#ifdef __KERNEL_CPU__
+
+#if defined(__KERNEL_AVX__)
+#  define DENOISE_VECTOR_SIZE 8
+typedef avxf denoise_vector;
+
+ccl_device_inline denoise_vector denoise_load(const float *p)
+{
+	return avxf(_mm256_loadu_ps(p));
+}
+
+ccl_device_inline void denoise_store(float *p, const denoise_vector& v)
+{
+	_mm256_storeu_ps(p, v);
+}
+#elif defined(__KERNEL_SSE2__)
+#  define DENOISE_VECTOR_SIZE 4
+typedef ssef denoise_vector;
+
+ccl_device_inline denoise_vector denoise_load(const float *p)
+{
+	return loadu4f(p);
+}
+
+ccl_device_inline void denoise_store(float *p, const denoise_vector& v)
+{
+	storeu4f(p, v);
+}
+#else
+#  define DENOISE_VECTOR_SIZE 1
+typedef float denoise_vector;
+
+ccl_device_inline denoise_vector denoise_load(const float *p)
+{
+	return *p;
+}
+
+ccl_device_inline void denoise_store(float *p, const denoise_vector& v)
+{
+	*p = v;
+}
+#endif
+
+#define DENOISE_COLOR_EPSILON 1e-10f
+#define DENOISE_FEATURE_TAU 1e-3f
+
+/* Color distance of every pixel to the pixel at the offset, before the patch
+ * is averaged. The variance term cancels out the expected difference from
+ * noise alone. */
+ccl_device_inline void kernel_denoise_color_distance(const float *buffer,
+                                                     float *difference,
+                                                     int x0, int x1,
+                                                     int y0, int y1,
+                                                     int offset,
+                                                     int stride,
+                                                     int pass_stride,
+                                                     float k2)
+{
+	const denoise_vector epsilon = denoise_vector(DENOISE_COLOR_EPSILON);
+	const denoise_vector vk2 = denoise_vector(k2);
+	const denoise_vector third = denoise_vector(1.0f/3.0f);
+
+	for(int y = y0; y < y1; y++) {
+		for(int x = x0; x < x1; x += DENOISE_VECTOR_SIZE) {
+			int p = y*stride + x;
+			denoise_vector distance = denoise_vector(0.0f);
+
+			for(int c = 0; c < 3; c++) {
+				const float *color = buffer + (DENOISE_PLANE_COLOR + c)*pass_stride;
+				const float *variance = buffer + (DENOISE_PLANE_COLOR_VAR + c)*pass_stride;
+
+				denoise_vector diff = denoise_load(color + p) - denoise_load(color + p + offset);
+				denoise_vector var_p = denoise_load(variance + p);
+				denoise_vector var_q = denoise_load(variance + p + offset);
+
+				distance = distance + (diff*diff - (var_p + min(var_p, var_q))) /
+				                      (epsilon + vk2*(var_p + var_q));
+			}
+
+			denoise_store(difference + p, distance*third);
+		}
+	}
+}
+
+/* Vertical part of the patch box filter, as a running sum over the rows. */
+ccl_device_inline void kernel_denoise_blur_rows(const float *in,
+                                                float *out,
+                                                int x0, int x1,
+                                                int y0, int y1,
+                                                int stride,
+                                                int f)
+{
+	for(int x = x0; x < x1; x += DENOISE_VECTOR_SIZE) {
+		denoise_vector sum = denoise_vector(0.0f);
+
+		for(int y = y0 - f; y <= y0 + f; y++)
+			sum = sum + denoise_load(in + y*stride + x);
+		denoise_store(out + y0*stride + x, sum);
+
+		for(int y = y0 + 1; y < y1; y++) {
+			sum = sum + denoise_load(in + (y + f)*stride + x) -
+			            denoise_load(in + (y - f - 1)*stride + x);
+			denoise_store(out + y*stride + x, sum);
+		}
+	}
+}
+
+/* Horizontal part of the patch box filter, normalized by the patch size. */
+ccl_device_inline void kernel_denoise_blur_columns(const float *in,
+                                                   float *out,
+                                                   int x0, int x1,
+                                                   int y0, int y1,
+                                                   int stride,
+                                                   int f)
+{
+	const float scale = 1.0f/((2*f + 1)*(2*f + 1));
+
+	for(int y = y0; y < y1; y++) {
+		const float *row_in = in + y*stride;
+		float *row_out = out + y*stride;
+		float sum = 0.0f;
+
+		for(int x = x0 - f; x <= x0 + f; x++)
+			sum += row_in[x];
+		row_out[x0] = sum*scale;
+
+		for(int x = x0 + 1; x < x1; x++) {
+			sum += row_in[x + f] - row_in[x - f - 1];
+			row_out[x] = sum*scale;
+		}
+	}
+}
+
+/* Combine the patch color distance with the feature distance, which is the
+ * largest distance over all features. */
+ccl_device_inline void kernel_denoise_feature_distance(const float *buffer,
+                                                       float *difference,
+                                                       int x0, int x1,
+                                                       int y0, int y1,
+                                                       int offset,
+                                                       int stride,
+                                                       int pass_stride,
+                                                       float kf2)
+{
+	const int feature_plane[DENOISE_NUM_FEATURES] = {DENOISE_PLANE_NORMAL,
+	                                                 DENOISE_PLANE_ALBEDO,
+	                                                 DENOISE_PLANE_DEPTH};
+	const int feature_channels[DENOISE_NUM_FEATURES] = {3, 3, 1};
+	const denoise_vector tau = denoise_vector(DENOISE_FEATURE_TAU);
+	const denoise_vector vkf2 = denoise_vector(kf2);
+
+	for(int y = y0; y < y1; y++) {
+		for(int x = x0; x < x1; x += DENOISE_VECTOR_SIZE) {
+			int p = y*stride + x;
+			denoise_vector distance = denoise_load(difference + p);
+
+			for(int j = 0; j < DENOISE_NUM_FEATURES; j++) {
+				denoise_vector feature_distance = denoise_vector(0.0f);
+
+				for(int c = 0; c < feature_channels[j]; c++) {
+					const float *feature = buffer + (feature_plane[j] + c)*pass_stride;
+					denoise_vector diff = denoise_load(feature + p) - denoise_load(feature + p + offset);
+					feature_distance = feature_distance + diff*diff;
+				}
+
+				const float *variance = buffer + (DENOISE_PLANE_FEATURE_VAR + j)*pass_stride;
+				const float *gradient = buffer + (DENOISE_PLANE_FEATURE_GRAD + j)*pass_stride;
+
+				denoise_vector var_p = denoise_load(variance + p);
+				denoise_vector var_q = denoise_load(variance + p + offset);
+				denoise_vector grad_p = denoise_load(gradient + p);
+
+				feature_distance = (feature_distance*denoise_vector(1.0f/feature_channels[j]) -
+				                    (var_p + min(var_p, var_q))) /
+				                   (vkf2*max(tau, max(var_p, grad_p)));
+
+				distance = max(distance, feature_distance);
+			}
+
+			denoise_store(difference + p, distance);
+		}
+	}
+}
+
+ccl_device_inline void kernel_denoise_weight(float *difference,
+                                             int x0, int x1,
+                                             int y0, int y1,
+                                             int stride)
+{
+	for(int y = y0; y < y1; y++) {
+		float *row = difference + y*stride;
+
+		for(int x = x0; x < x1; x++)
+			row[x] = fast_expf(-max(row[x], 0.0f));
+	}
+}
+
+ccl_device_inline void kernel_denoise_accumulate(const float *buffer,
+                                                 const float *weight,
+                                                 float *output,
+                                                 int x0, int x1,
+                                                 int y0, int y1,
+                                                 int offset,
+                                                 int stride,
+                                                 int pass_stride)
+{
+	for(int y = y0; y < y1; y++) {
+		for(int x = x0; x < x1; x += DENOISE_VECTOR_SIZE) {
+			int p = y*stride + x;
+			denoise_vector w = denoise_load(weight + p);
+
+			for(int c = 0; c < 3; c++) {
+				const float *color = buffer + (DENOISE_PLANE_COLOR + c)*pass_stride;
+				float *out = output + c*pass_stride;
+
+				denoise_store(out + p, denoise_load(out + p) + w*denoise_load(color + p + offset));
+			}
+
+			float *out_weight = output + 3*pass_stride;
+			denoise_store(out_weight + p, denoise_load(out_weight + p) + w);
+		}
+	}
+}
+
+/* Denoise the rectangle x, y, w, h. The output holds the color in three planes
+ * followed by the sum of the weights. Temporary memory must hold two planes. */
+ccl_device void kernel_denoise(const float *buffer,
+                               float *output,
+                               float *temp,
+                               int x, int y, int w, int h,
+                               int stride,
+                               int height,
+                               int radius,
+                               int patch_radius,
+                               float strength,
+                               float feature_strength)
+{
+	const int pass_stride = stride*height;
+	const int f = patch_radius;
+	const float k2 = strength*strength;
+	const float kf2 = feature_strength*feature_strength;
+
+	/* whole vectors, overlapping into the row padding */
+	const int x1 = x + align_up(w, DENOISE_VECTOR_SIZE);
+	const int y1 = y + h;
+	const int patch_x0 = x - f;
+	const int patch_x1 = patch_x0 + align_up(w + 2*f, DENOISE_VECTOR_SIZE);
+
+	float *difference = temp;
+	float *blurred = temp + pass_stride;
+
+	for(int i = 0; i < 4; i++) {
+		for(int py = y; py < y1; py++)
+			memset(output + i*pass_stride + py*stride + x, 0, sizeof(float)*(x1 - x));
+	}
+
+	for(int dy = -radius; dy <= radius; dy++) {
+		for(int dx = -radius; dx <= radius; dx++) {
+			int offset = dy*stride + dx;
+
+			kernel_denoise_color_distance(buffer, difference,
+			                              patch_x0, patch_x1, y - f, y1 + f,
+			                              offset, stride, pass_stride, k2);
+			kernel_denoise_blur_rows(difference, blurred,
+			                         patch_x0, patch_x1, y, y1,
+			                         stride, f);
+			kernel_denoise_blur_columns(blurred, difference,
+			                            x, x + w, y, y1,
+			                            stride, f);
+			kernel_denoise_feature_distance(buffer, difference,
+			                                x, x1, y, y1,
+			                                offset, stride, pass_stride, kf2);
+			kernel_denoise_weight(difference,
+			                      x, x1, y, y1,
+			                      stride);
+			kernel_denoise_accumulate(buffer, difference, output,
+			                          x, x1, y, y1,
+			                          offset, stride, pass_stride);
+		}
+	}
+
+	/* normalize, the center pixel always has weight one */
+	float *out_weight = output + 3*pass_stride;
+
+	for(int py = y; py < y1; py++) {
+		for(int px = x; px < x1; px += DENOISE_VECTOR_SIZE) {
+			int p = py*stride + px;
+			denoise_vector inv_weight = denoise_vector(1.0f)/max(denoise_load(out_weight + p),
+			                                                     denoise_vector(1e-8f));
+
+			for(int c = 0; c < 3; c++) {
+				float *out = output + c*pass_stride;
+				denoise_store(out + p, denoise_load(out + p)*inv_weight);
+			}
+		}
+	}
+}
+
+#endif  /* __KERNEL_CPU__ */
+
+CCL_NAMESPACE_END
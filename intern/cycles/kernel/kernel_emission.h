@@ -211,7 +211,9 @@ ccl_device_noinline float3 indirect_primitive_emission(KernelGlobals *kg, Shader
 	{
 		/* multiple importance sampling, get triangle light pdf,
 		 * and compute weight with respect to BSDF pdf */
-		float pdf = triangle_light_pdf(kg, ccl_fetch(sd, Ng), ccl_fetch(sd, I), t);
+		float3 ray_P = ccl_fetch(sd, P) + ccl_fetch(sd, I)*t;
+		float area_pdf = triangle_light_area_pdf(kg, ray_P, ccl_fetch(sd, object), ccl_fetch(sd, prim));
+		float pdf = triangle_light_pdf(kg, ccl_fetch(sd, Ng), ccl_fetch(sd, I), t, area_pdf);
 		float mis_weight = power_heuristic(bsdf_pdf, pdf);
 
 		return L*mis_weight;
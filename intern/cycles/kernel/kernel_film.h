@@ -16,6 +16,53 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Adaptive Sampling
+ *
+ * The auxiliary pass holds the sum and squared sum of the sample luminance and
+ * the number of samples traced for the pixel. Pixels stop being sampled once the
+ * standard error of their mean drops below the noise threshold, so filtered passes
+ * are normalized by the per pixel sample count rather than the tile one. */
+
+ccl_device_inline bool kernel_adaptive_pixel_converged(KernelGlobals *kg, ccl_global float *buffer, int sample)
+{
+	if(!(kernel_data.film.pass_flag & PASS_ADAPTIVE_AUX))
+		return false;
+
+	/* before the minimum number of samples the statistics could be left over
+	 * from a previous render in the same buffer */
+	int min_samples = kernel_data.integrator.adaptive_min_samples;
+	if(sample < min_samples)
+		return false;
+
+	ccl_global float *aux = buffer + kernel_data.film.pass_adaptive_aux;
+	float num_samples = aux[2];
+
+	if(num_samples < (float)min_samples)
+		return false;
+
+	float inv_num_samples = 1.0f/num_samples;
+	float mean = aux[0]*inv_num_samples;
+	float variance = max(aux[1]*inv_num_samples - mean*mean, 0.0f);
+
+	/* compare relative to the square root of the mean as a rough perceptual
+	 * response, so dark regions are not oversampled */
+	float error = sqrtf(variance*inv_num_samples);
+
+	return error <= kernel_data.integrator.adaptive_threshold*sqrtf(max(mean, 1e-4f));
+}
+
+ccl_device_inline float film_adaptive_sample_scale(KernelGlobals *kg, ccl_global float *buffer, float sample_scale)
+{
+	if(kernel_data.film.pass_flag & PASS_ADAPTIVE_AUX) {
+		float num_samples = buffer[kernel_data.film.pass_adaptive_aux + 2];
+
+		if(num_samples > 0.0f)
+			return 1.0f/num_samples;
+	}
+
+	return sample_scale;
+}
+
 ccl_device float4 film_map(KernelGlobals *kg, float4 irradiance, float scale)
 {
 	float exposure = kernel_data.film.exposure;
@@ -57,6 +104,7 @@ ccl_device void kernel_film_convert_to_byte(KernelGlobals *kg,
 
 	/* map colors */
 	float4 irradiance = *((ccl_global float4*)buffer);
+	sample_scale = film_adaptive_sample_scale(kg, buffer, sample_scale);
 	float4 float_result = film_map(kg, irradiance, sample_scale);
 	uchar4 byte_result = film_float_to_byte(float_result);
 
@@ -70,12 +118,15 @@ ccl_device void kernel_film_convert_to_half_float(KernelGlobals *kg,
 	/* buffer offset */
 	int index = offset + x + y*stride;
 
-	ccl_global float4 *in = (ccl_global float4*)(buffer + index*kernel_data.film.pass_stride);
+	buffer += index*kernel_data.film.pass_stride;
+
+	ccl_global float4 *in = (ccl_global float4*)buffer;
 	ccl_global half *out = (ccl_global half*)rgba + index*4;
 
 	float exposure = kernel_data.film.exposure;
 
 	float4 rgba_in = *in;
+	sample_scale = film_adaptive_sample_scale(kg, buffer, sample_scale);
 
 	if(exposure != 1.0f) {
 		rgba_in.x *= exposure;
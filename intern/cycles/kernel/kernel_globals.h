@@ -32,7 +32,11 @@ struct OSLShadingSystem;
 #  endif
 
 struct Intersection;
+struct PathStream;
 struct VolumeStep;
+struct TextureCacheThreadData;
+class TextureCache;
+class ProfilingCounters;
 
 typedef struct KernelGlobals {
 	texture_image_uchar4 texture_byte4_images[TEX_NUM_BYTE4_CPU];
@@ -56,6 +60,14 @@ typedef struct KernelGlobals {
 	OSLThreadData *osl_tdata;
 #  endif
 
+	/* Image textures read on demand, NULL when all images are loaded into
+	 * the texture slots. */
+	TextureCache *texture_cache;
+	TextureCacheThreadData *texture_cache_tdata;
+
+	/* Ray and shader evaluation counters, NULL unless profiling. */
+	ProfilingCounters *profiling;
+
 	/* **** Run-time data ****  */
 
 	/* Heap-allocated storage for transparent shadows intersections. */
@@ -64,6 +76,9 @@ typedef struct KernelGlobals {
 	/* Storage for decoupled volume steps. */
 	VolumeStep *decoupled_volume_steps[2];
 	int decoupled_volume_steps_index;
+
+	/* Heap-allocated storage for ray stream path tracing. */
+	PathStream *path_stream;
 } KernelGlobals;
 
 #endif  /* __KERNEL_CPU__ */
@@ -808,15 +808,121 @@ ccl_device void triangle_light_sample(KernelGlobals *kg, int prim, int object,
 }
 
 ccl_device float triangle_light_pdf(KernelGlobals *kg,
-	const float3 Ng, const float3 I, float t)
+	const float3 Ng, const float3 I, float t, float area_pdf)
 {
-	float pdf = kernel_data.integrator.pdf_triangles;
 	float cos_pi = fabsf(dot(Ng, I));
 
 	if(cos_pi == 0.0f)
 		return 0.0f;
 	
-	return t*t*pdf/cos_pi;
+	return t*t*area_pdf/cos_pi;
+}
+
+/* Light Tree
+ *
+ * Binary tree over the emissive triangles and lamps, built by LightTree on the
+ * host. Traversal picks a child proportional to an estimate of its
+ * contribution to the shading point, from the emitted power, the distance to
+ * the node bounds and the orientation of the normal cone. Distant and
+ * background lamps are not in the tree, they keep being selected uniformly
+ * with the same probability as in the light distribution. */
+
+ccl_device float light_tree_node_importance(KernelGlobals *kg, int node, float3 P)
+{
+	float4 sphere = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 0);
+	float4 cone = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 1);
+	float energy = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 2).x;
+
+	float3 D = P - float4_to_float3(sphere);
+	float radius = sphere.w;
+	float dist_sq = len_squared(D);
+	float radius_sq = radius*radius;
+
+	/* inside the bounds any orientation is possible, lamps can have no size */
+	if(dist_sq <= radius_sq)
+		return energy/max(radius_sq, 1e-8f);
+
+	float dist = sqrtf(dist_sq);
+	float cos_theta = fabsf(dot(float4_to_float3(cone), D))/dist;
+	float theta = safe_acosf(cos_theta);
+	float theta_u = safe_asinf(radius/dist);
+	float theta_i = max(theta - cone.w - theta_u, 0.0f);
+
+	return energy*max(cosf(theta_i), 0.0f)/dist_sq;
+}
+
+ccl_device_inline float light_tree_left_probability(KernelGlobals *kg, int node, int right, float3 P)
+{
+	float I_left = light_tree_node_importance(kg, node + 1, P);
+	float I_right = light_tree_node_importance(kg, right, P);
+	float I_total = I_left + I_right;
+
+	return (I_total > 0.0f)? I_left/I_total: 0.5f;
+}
+
+/* Returns the leaf node under root, and its selection probability in pdf. */
+ccl_device int light_tree_sample(KernelGlobals *kg, int root, float3 P, float randt, float *pdf)
+{
+	int node = root;
+	*pdf = 1.0f;
+
+	while(true) {
+		int child = __float_as_int(kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 2).z);
+
+		if(child < 0)
+			return node;
+
+		float P_left = light_tree_left_probability(kg, node, child, P);
+
+		if(randt < P_left) {
+			randt = randt/P_left;
+			*pdf *= P_left;
+			node = node + 1;
+		}
+		else {
+			randt = (randt - P_left)/(1.0f - P_left);
+			*pdf *= 1.0f - P_left;
+			node = child;
+		}
+	}
+}
+
+/* Selection probability of a leaf, walking up from the leaf to the root. */
+ccl_device float light_tree_pdf(KernelGlobals *kg, float3 P, int node)
+{
+	float pdf = 1.0f;
+
+	while(node != 0) {
+		int parent = __float_as_int(kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 2).y);
+		int right = __float_as_int(kernel_tex_fetch(__light_tree_nodes, parent*LIGHT_TREE_NODE_SIZE + 2).z);
+		float P_left = light_tree_left_probability(kg, parent, right, P);
+
+		pdf *= (node == right)? 1.0f - P_left: P_left;
+		node = parent;
+	}
+
+	return pdf;
+}
+
+/* Area measure pdf of sampling a point on a triangle from P. */
+ccl_device float triangle_light_area_pdf(KernelGlobals *kg, float3 P, int object, int prim)
+{
+	if(!kernel_data.integrator.use_light_tree)
+		return kernel_data.integrator.pdf_triangles;
+
+	/* lookup leaf of the triangle */
+	int offset = (int)kernel_tex_fetch(__light_tree_emitters, object*2 + 0);
+	if(offset == -1)
+		return 0.0f;
+
+	int tri_offset = (int)kernel_tex_fetch(__light_tree_emitters, object*2 + 1);
+	int leaf = (int)kernel_tex_fetch(__light_tree_emitters, offset + prim - tri_offset);
+	if(leaf == -1)
+		return 0.0f;
+
+	float area = kernel_tex_fetch(__light_tree_nodes, leaf*LIGHT_TREE_NODE_SIZE + 2).w;
+
+	return kernel_data.integrator.light_tree_fraction*light_tree_pdf(kg, P, leaf)/area;
 }
 
 /* Light Distribution */
@@ -856,18 +962,20 @@ ccl_device bool light_select_reached_max_bounces(KernelGlobals *kg, int index, i
 	return (bounce > __float_as_int(data4.x));
 }
 
-ccl_device_noinline bool light_sample(KernelGlobals *kg,
-                                      float randt,
-                                      float randu,
-                                      float randv,
-                                      float time,
-                                      float3 P,
-                                      int bounce,
-                                      LightSample *ls)
+/* Sample the light at index in the light distribution, area_pdf is the
+ * probability of picking a triangle divided by its area, lamp_pdf the
+ * probability of picking a lamp. */
+ccl_device_inline bool light_sample_index(KernelGlobals *kg,
+                                          int index,
+                                          float area_pdf,
+                                          float lamp_pdf,
+                                          float randu,
+                                          float randv,
+                                          float time,
+                                          float3 P,
+                                          int bounce,
+                                          LightSample *ls)
 {
-	/* sample index */
-	int index = light_distribution_sample(kg, randt);
-
 	/* fetch light data */
 	float4 l = kernel_tex_fetch(__light_distribution, index);
 	int prim = __float_as_int(l.y);
@@ -879,7 +987,7 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
 		triangle_light_sample(kg, prim, object, randu, randv, time, ls);
 		/* compute incoming direction, distance and pdf */
 		ls->D = normalize_len(ls->P - P, &ls->t);
-		ls->pdf = triangle_light_pdf(kg, ls->Ng, -ls->D, ls->t);
+		ls->pdf = triangle_light_pdf(kg, ls->Ng, -ls->D, ls->t, area_pdf);
 		ls->shader |= shader_flag;
 		return (ls->pdf > 0.0f);
 	}
@@ -890,8 +998,92 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
 			return false;
 		}
 
-		return lamp_light_sample(kg, lamp, randu, randv, P, ls);
+		if(!lamp_light_sample(kg, lamp, randu, randv, P, ls)) {
+			return false;
+		}
+
+		/* lamp_light_sample assumes lamps are picked with pdf_lights, the
+		 * lamp pdf is not part of ls->pdf so only the evaluation changes */
+		if(lamp_pdf != kernel_data.integrator.pdf_lights) {
+			ls->eval_fac *= kernel_data.integrator.pdf_lights/lamp_pdf;
+		}
+		return true;
+	}
+}
+
+ccl_device_noinline bool light_sample(KernelGlobals *kg,
+                                      float randt,
+                                      float randu,
+                                      float randv,
+                                      float time,
+                                      float3 P,
+                                      int bounce,
+                                      LightSample *ls)
+{
+	/* sample index */
+	int index;
+	float area_pdf = kernel_data.integrator.pdf_triangles;
+	float lamp_pdf = kernel_data.integrator.pdf_lights;
+
+	if(kernel_data.integrator.use_light_tree) {
+		float fraction = kernel_data.integrator.light_tree_fraction;
+
+		if(randt < fraction) {
+			float tree_pdf;
+			int leaf = light_tree_sample(kg, 0, P, randt/fraction, &tree_pdf);
+			float4 data = kernel_tex_fetch(__light_tree_nodes, leaf*LIGHT_TREE_NODE_SIZE + 2);
+
+			index = ~__float_as_int(data.z);
+			lamp_pdf = fraction*tree_pdf;
+			area_pdf = (data.w > 0.0f)? lamp_pdf/data.w: 0.0f;
+		}
+		else {
+			/* distant and background lamps */
+			int num_distant = kernel_data.integrator.light_tree_num_distant;
+			int distant = (int)((randt - fraction)/(1.0f - fraction)*num_distant);
+			int offset = kernel_data.integrator.light_tree_distant_offset + clamp(distant, 0, num_distant - 1);
+
+			index = (int)kernel_tex_fetch(__light_tree_emitters, offset);
+		}
+	}
+	else {
+		index = light_distribution_sample(kg, randt);
 	}
+
+	return light_sample_index(kg, index, area_pdf, lamp_pdf, randu, randv, time, P, bounce, ls);
+}
+
+/* Sample a triangle light only, for branched path tracing which samples the
+ * lamps separately. The pdf is that of picking among triangles only. */
+ccl_device_noinline bool light_sample_triangle(KernelGlobals *kg,
+                                               float randt,
+                                               float randu,
+                                               float randv,
+                                               float time,
+                                               float3 P,
+                                               int bounce,
+                                               LightSample *ls)
+{
+	if(kernel_data.integrator.use_light_tree) {
+		float tree_pdf;
+		int leaf = light_tree_sample(kg, kernel_data.integrator.light_tree_triangle_root, P, randt, &tree_pdf);
+		float4 data = kernel_tex_fetch(__light_tree_nodes, leaf*LIGHT_TREE_NODE_SIZE + 2);
+
+		return light_sample_index(kg, ~__float_as_int(data.z), tree_pdf/data.w, 0.0f,
+		                          randu, randv, time, P, bounce, ls);
+	}
+
+	/* triangles are the first half of the distribution when there are lamps */
+	if(kernel_data.integrator.num_all_lights)
+		randt = 0.5f*randt;
+
+	if(!light_sample(kg, randt, randu, randv, time, P, bounce, ls))
+		return false;
+
+	if(kernel_data.integrator.num_all_lights)
+		ls->pdf *= 2.0f;
+
+	return true;
 }
 
 ccl_device int light_select_num_samples(KernelGlobals *kg, int index)
@@ -60,6 +60,61 @@ ccl_device_inline void kernel_write_pass_float4(ccl_global float *buffer, int sa
 #endif // __SPLIT_KERNEL__ && __WORK_STEALING__
 }
 
+ccl_device_inline void kernel_write_adaptive_passes(KernelGlobals *kg, ccl_global float *buffer, int sample, float4 L)
+{
+	int flag = kernel_data.film.pass_flag;
+
+	if(flag & PASS_ADAPTIVE_AUX) {
+		float value = average(float4_to_float3(L));
+		kernel_write_pass_float4(buffer + kernel_data.film.pass_adaptive_aux,
+		                         sample,
+		                         make_float4(value, value*value, 1.0f, 0.0f));
+	}
+#ifdef __KERNEL_DEBUG__
+	if(flag & PASS_SAMPLE_COUNT) {
+		kernel_write_pass_float(buffer + kernel_data.film.pass_sample_count,
+		                        sample,
+		                        1.0f);
+	}
+#endif
+}
+
+#ifdef __DENOISING_FEATURES__
+/* Features of the first surface hit, guiding the denoiser. */
+ccl_device_inline void kernel_write_denoising_features(KernelGlobals *kg, ccl_global float *buffer,
+	ShaderData *sd, int sample)
+{
+	float3 normal = ccl_fetch(sd, N);
+	float3 albedo = shader_bsdf_diffuse(kg, sd) +
+	                shader_bsdf_glossy(kg, sd) +
+	                shader_bsdf_transmission(kg, sd) +
+	                shader_bsdf_subsurface(kg, sd);
+	float depth = camera_distance(kg, ccl_fetch(sd, P));
+
+	kernel_write_pass_float4(buffer + DENOISING_PASS_NORMAL, sample,
+	                         make_float4(normal.x, normal.y, normal.z, dot(normal, normal)));
+	kernel_write_pass_float4(buffer + DENOISING_PASS_ALBEDO, sample,
+	                         make_float4(albedo.x, albedo.y, albedo.z, dot(albedo, albedo)));
+	kernel_write_pass_float4(buffer + DENOISING_PASS_DEPTH, sample,
+	                         make_float4(depth, depth*depth, 1.0f, 0.0f));
+}
+#endif
+
+/* Per pixel mean and variance of the color, written for every sample. */
+ccl_device_inline void kernel_write_denoising_passes(KernelGlobals *kg, ccl_global float *buffer, int sample, float4 L)
+{
+#ifdef __DENOISING_FEATURES__
+	if(kernel_data.film.pass_denoising_data) {
+		buffer += kernel_data.film.pass_denoising_data;
+
+		kernel_write_pass_float4(buffer + DENOISING_PASS_COLOR, sample,
+		                         make_float4(L.x, L.y, L.z, 1.0f));
+		kernel_write_pass_float4(buffer + DENOISING_PASS_COLOR_SQ, sample,
+		                         make_float4(L.x*L.x, L.y*L.y, L.z*L.z, 0.0f));
+	}
+#endif
+}
+
 ccl_device_inline void kernel_write_data_passes(KernelGlobals *kg, ccl_global float *buffer, PathRadiance *L,
 	ShaderData *sd, int sample, ccl_addr_space PathState *state, float3 throughput)
 {
@@ -108,6 +163,11 @@ ccl_device_inline void kernel_write_data_passes(KernelGlobals *kg, ccl_global fl
 				kernel_write_pass_float4(buffer + kernel_data.film.pass_motion, sample, speed);
 				kernel_write_pass_float(buffer + kernel_data.film.pass_motion_weight, sample, 1.0f);
 			}
+#ifdef __DENOISING_FEATURES__
+			if(kernel_data.film.pass_denoising_data) {
+				kernel_write_denoising_features(kg, buffer + kernel_data.film.pass_denoising_data, sd, sample);
+			}
+#endif
 
 			state->flag |= PATH_RAY_SINGLE_PASS_DONE;
 		}
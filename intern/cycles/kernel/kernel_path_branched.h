@@ -597,6 +597,10 @@ ccl_device void kernel_branched_path_trace(KernelGlobals *kg,
 	rng_state += index;
 	buffer += index*pass_stride;
 
+	/* adaptive sampling, pixel is noise free already */
+	if(kernel_adaptive_pixel_converged(kg, buffer, sample))
+		return;
+
 	/* initialize random numbers and ray */
 	RNG rng;
 	Ray ray;
@@ -613,6 +617,8 @@ ccl_device void kernel_branched_path_trace(KernelGlobals *kg,
 
 	/* accumulate result in output buffer */
 	kernel_write_pass_float4(buffer, sample, L);
+	kernel_write_adaptive_passes(kg, buffer, sample, L);
+	kernel_write_denoising_passes(kg, buffer, sample, L);
 
 	path_rng_end(kg, rng_state, rng);
 }
@@ -0,0 +1,666 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Ray Stream Path Tracing, CPU only
+ *
+ * Instead of tracing one path until it terminates, a batch of paths of a tile
+ * is advanced one bounce at a time through the same stages as the split
+ * kernel: scene intersection, background, shader evaluation, shadow rays and
+ * the next bounce. Hits are sorted by shader before shading, so consecutive
+ * evaluations run the same SVM program and touch the same image textures, and
+ * all shadow rays of a bounce are traced together.
+ *
+ * The stages are built from the same functions as kernel_path_integrate(),
+ * and every path draws random numbers and accumulates radiance in the same
+ * order, so the result is identical to kernel_path_trace(). Volumes,
+ * subsurface scattering and the branched path integrator are not supported,
+ * callers must check kernel_path_stream_supported() first. */
+
+CCL_NAMESPACE_BEGIN
+
+/* Number of paths traced together. Storage is around 1.5kB per path and is
+ * allocated once for every render thread. */
+#define PATH_STREAM_SIZE 2048
+
+typedef enum PathStreamStatus {
+	/* pixel converged already, nothing is written */
+	PATH_STREAM_SKIP = 0,
+	/* no camera ray, black is written */
+	PATH_STREAM_EMPTY,
+	/* path is still bouncing */
+	PATH_STREAM_ACTIVE,
+	/* path terminated, radiance is written at the end of the batch */
+	PATH_STREAM_DONE,
+} PathStreamStatus;
+
+typedef struct PathStreamHit {
+	int shader;
+	int path;
+} PathStreamHit;
+
+typedef struct PathStreamShadow {
+	Ray ray;
+	int path;
+	int is_ao;
+} PathStreamShadow;
+
+typedef struct PathStream {
+	int num_paths;
+	int num_active;
+	int num_hits;
+	int num_shadows;
+
+	/* paths, indexed by position in the batch */
+	int *index;
+	int *status;
+	int *hit;
+	RNG *rng;
+	PathState *state;
+	Ray *ray;
+	Intersection *isect;
+	PathRadiance *L;
+	float3 *throughput;
+	float *L_transparent;
+
+	/* surface hits of this bounce, sorted by shader */
+	PathStreamHit *hits;
+
+	/* shadow rays of this bounce, and what is needed to accumulate their
+	 * contribution once traced */
+	PathStreamShadow *shadows;
+	PathState *shadow_state;
+	float3 *shadow_throughput;
+	float3 *ao_alpha;
+	float3 *ao_bsdf;
+	BsdfEval *L_light;
+	int *is_lamp;
+} PathStream;
+
+ccl_device_inline bool kernel_path_stream_supported(KernelGlobals *kg)
+{
+#ifdef __KERNEL_DEBUG__
+	/* debug passes are only written by the megakernel */
+	return false;
+#else
+#  ifdef __BRANCHED_PATH__
+	if(kernel_data.integrator.branched)
+		return false;
+#  endif
+	if(kernel_data.integrator.use_volumes || kernel_data.integrator.use_subsurface)
+		return false;
+
+	return true;
+#endif
+}
+
+/* Storage */
+
+ccl_device_inline void *path_stream_array(char **mem, size_t size)
+{
+	void *array = *mem;
+	*mem += align_up(size*PATH_STREAM_SIZE, 16);
+	return array;
+}
+
+ccl_device_inline size_t path_stream_size(size_t size)
+{
+	return align_up(size*PATH_STREAM_SIZE, 16);
+}
+
+ccl_device PathStream *path_stream_get(KernelGlobals *kg)
+{
+	if(kg->path_stream)
+		return kg->path_stream;
+
+	/* single allocation so it can be freed along with other thread storage */
+	size_t size = align_up(sizeof(PathStream), 16) +
+	              path_stream_size(sizeof(int))*3 +
+	              path_stream_size(sizeof(RNG)) +
+	              path_stream_size(sizeof(PathState)) +
+	              path_stream_size(sizeof(Ray)) +
+	              path_stream_size(sizeof(Intersection)) +
+	              path_stream_size(sizeof(PathRadiance)) +
+	              path_stream_size(sizeof(float3)) +
+	              path_stream_size(sizeof(float)) +
+	              path_stream_size(sizeof(PathStreamHit)) +
+	              path_stream_size(sizeof(PathStreamShadow))*2 +
+	              path_stream_size(sizeof(PathState)) +
+	              path_stream_size(sizeof(float3))*3 +
+	              path_stream_size(sizeof(BsdfEval)) +
+	              path_stream_size(sizeof(int));
+
+	char *mem = (char*)malloc(size);
+	PathStream *stream = (PathStream*)mem;
+	mem += align_up(sizeof(PathStream), 16);
+
+	stream->index = (int*)path_stream_array(&mem, sizeof(int));
+	stream->status = (int*)path_stream_array(&mem, sizeof(int));
+	stream->hit = (int*)path_stream_array(&mem, sizeof(int));
+	stream->rng = (RNG*)path_stream_array(&mem, sizeof(RNG));
+	stream->state = (PathState*)path_stream_array(&mem, sizeof(PathState));
+	stream->ray = (Ray*)path_stream_array(&mem, sizeof(Ray));
+	stream->isect = (Intersection*)path_stream_array(&mem, sizeof(Intersection));
+	stream->L = (PathRadiance*)path_stream_array(&mem, sizeof(PathRadiance));
+	stream->throughput = (float3*)path_stream_array(&mem, sizeof(float3));
+	stream->L_transparent = (float*)path_stream_array(&mem, sizeof(float));
+	stream->hits = (PathStreamHit*)path_stream_array(&mem, sizeof(PathStreamHit));
+	/* up to two shadow rays per path, ambient occlusion and direct light */
+	stream->shadows = (PathStreamShadow*)path_stream_array(&mem, sizeof(PathStreamShadow)*2);
+	stream->shadow_state = (PathState*)path_stream_array(&mem, sizeof(PathState));
+	stream->shadow_throughput = (float3*)path_stream_array(&mem, sizeof(float3));
+	stream->ao_alpha = (float3*)path_stream_array(&mem, sizeof(float3));
+	stream->ao_bsdf = (float3*)path_stream_array(&mem, sizeof(float3));
+	stream->L_light = (BsdfEval*)path_stream_array(&mem, sizeof(BsdfEval));
+	stream->is_lamp = (int*)path_stream_array(&mem, sizeof(int));
+
+	kg->path_stream = stream;
+	return stream;
+}
+
+/* Stages */
+
+ccl_device void kernel_path_stream_init(KernelGlobals *kg,
+                                        PathStream *stream,
+                                        ShaderData *emission_sd,
+                                        ccl_global float *buffer,
+                                        ccl_global uint *rng_state,
+                                        int sample,
+                                        int x, int y, int w,
+                                        int first, int num,
+                                        int offset, int stride)
+{
+	int pass_stride = kernel_data.film.pass_stride;
+
+	stream->num_paths = num;
+	stream->num_active = 0;
+
+	for(int p = 0; p < num; p++) {
+		int px = x + (first + p) % w;
+		int py = y + (first + p) / w;
+		int index = offset + px + py*stride;
+
+		stream->index[p] = index;
+
+		/* adaptive sampling, pixel is noise free already */
+		if(kernel_adaptive_pixel_converged(kg, buffer + index*pass_stride, sample)) {
+			stream->status[p] = PATH_STREAM_SKIP;
+			continue;
+		}
+
+		Ray *ray = &stream->ray[p];
+		kernel_path_trace_setup(kg, rng_state + index, sample, px, py, &stream->rng[p], ray);
+
+		if(ray->t == 0.0f) {
+			stream->status[p] = PATH_STREAM_EMPTY;
+			continue;
+		}
+
+		path_radiance_init(&stream->L[p], kernel_data.film.use_light_pass);
+		stream->throughput[p] = make_float3(1.0f, 1.0f, 1.0f);
+		stream->L_transparent[p] = 0.0f;
+
+		path_state_init(kg, emission_sd, &stream->state[p], &stream->rng[p], sample, ray);
+
+		stream->status[p] = PATH_STREAM_ACTIVE;
+		stream->num_active++;
+	}
+}
+
+ccl_device void kernel_path_stream_intersect(KernelGlobals *kg, PathStream *stream)
+{
+	for(int p = 0; p < stream->num_paths; p++) {
+		if(stream->status[p] != PATH_STREAM_ACTIVE)
+			continue;
+
+		PathState *state = &stream->state[p];
+		Ray *ray = &stream->ray[p];
+		uint visibility = path_state_ray_visibility(kg, state);
+
+#ifdef __HAIR__
+		float difl = 0.0f, extmax = 0.0f;
+		uint lcg_state = 0;
+
+		if(kernel_data.bvh.have_curves) {
+			if((kernel_data.cam.resolution == 1) && (state->flag & PATH_RAY_CAMERA)) {
+				float3 pixdiff = ray->dD.dx + ray->dD.dy;
+				difl = kernel_data.curve.minimum_width * len(pixdiff) * 0.5f;
+			}
+
+			extmax = kernel_data.curve.maximum_width;
+			lcg_state = lcg_state_init(&stream->rng[p], state, 0x51633e2d);
+		}
+
+		stream->hit[p] = scene_intersect(kg, *ray, visibility, &stream->isect[p], &lcg_state, difl, extmax);
+#else
+		stream->hit[p] = scene_intersect(kg, *ray, visibility, &stream->isect[p], NULL, 0.0f, 0.0f);
+#endif  /* __HAIR__ */
+	}
+}
+
+ccl_device void kernel_path_stream_background(KernelGlobals *kg,
+                                              PathStream *stream,
+                                              ShaderData *emission_sd)
+{
+	for(int p = 0; p < stream->num_paths; p++) {
+		if(stream->status[p] != PATH_STREAM_ACTIVE)
+			continue;
+
+		PathState *state = &stream->state[p];
+		PathRadiance *L = &stream->L[p];
+		Ray *ray = &stream->ray[p];
+		float3 throughput = stream->throughput[p];
+
+#ifdef __LAMP_MIS__
+		if(kernel_data.integrator.use_lamp_mis && !(state->flag & PATH_RAY_CAMERA)) {
+			/* ray starting from previous non-transparent bounce */
+			Ray light_ray;
+
+			light_ray.P = ray->P - state->ray_t*ray->D;
+			state->ray_t += stream->isect[p].t;
+			light_ray.D = ray->D;
+			light_ray.t = state->ray_t;
+			light_ray.time = ray->time;
+			light_ray.dD = ray->dD;
+			light_ray.dP = ray->dP;
+
+			/* intersect with lamp */
+			float3 emission;
+
+			if(indirect_lamp_emission(kg, emission_sd, state, &light_ray, &emission))
+				path_radiance_accum_emission(L, throughput, emission, state->bounce);
+		}
+#endif  /* __LAMP_MIS__ */
+
+		if(stream->hit[p])
+			continue;
+
+		stream->status[p] = PATH_STREAM_DONE;
+		stream->num_active--;
+
+		/* eval background shader if nothing hit */
+		if(kernel_data.background.transparent && (state->flag & PATH_RAY_CAMERA)) {
+			stream->L_transparent[p] += average(throughput);
+
+#ifdef __PASSES__
+			if(!(kernel_data.film.pass_flag & PASS_BACKGROUND))
+#endif  /* __PASSES__ */
+				continue;
+		}
+
+#ifdef __BACKGROUND__
+		/* sample background shader */
+		float3 L_background = indirect_background(kg, emission_sd, state, ray);
+		path_radiance_accum_background(L, throughput, L_background, state->bounce);
+#endif  /* __BACKGROUND__ */
+	}
+}
+
+ccl_device_inline int path_stream_isect_shader(KernelGlobals *kg, Intersection *isect)
+{
+	int prim = kernel_tex_fetch(__prim_index, isect->prim);
+	int shader;
+
+#ifdef __HAIR__
+	if(kernel_tex_fetch(__prim_type, isect->prim) & PRIMITIVE_ALL_TRIANGLE) {
+#endif
+		shader = kernel_tex_fetch(__tri_shader, prim);
+#ifdef __HAIR__
+	}
+	else {
+		float4 str = kernel_tex_fetch(__curves, prim);
+		shader = __float_as_int(str.z);
+	}
+#endif
+
+	return shader & SHADER_MASK;
+}
+
+ccl_device int path_stream_hit_compare(const void *a, const void *b)
+{
+	const PathStreamHit *hit_a = (const PathStreamHit*)a;
+	const PathStreamHit *hit_b = (const PathStreamHit*)b;
+
+	if(hit_a->shader != hit_b->shader)
+		return (hit_a->shader < hit_b->shader)? -1: 1;
+
+	return hit_a->path - hit_b->path;
+}
+
+ccl_device void kernel_path_stream_sort(KernelGlobals *kg, PathStream *stream)
+{
+	int num_hits = 0;
+
+	for(int p = 0; p < stream->num_paths; p++) {
+		if(stream->status[p] != PATH_STREAM_ACTIVE)
+			continue;
+
+		stream->hits[num_hits].shader = path_stream_isect_shader(kg, &stream->isect[p]);
+		stream->hits[num_hits].path = p;
+		num_hits++;
+	}
+
+	/* ties are broken by path, for a deterministic shading order */
+	qsort(stream->hits, num_hits, sizeof(PathStreamHit), path_stream_hit_compare);
+
+	stream->num_hits = num_hits;
+}
+
+ccl_device_inline void path_stream_shadow_queue(PathStream *stream, Ray *ray, int path, bool is_ao)
+{
+	PathStreamShadow *shadow = &stream->shadows[stream->num_shadows++];
+
+	shadow->ray = *ray;
+	shadow->path = path;
+	shadow->is_ao = is_ao;
+}
+
+/* Same as kernel_path_ao(), with the shadow ray queued. */
+ccl_device_inline bool kernel_path_stream_ao(KernelGlobals *kg,
+                                             PathStream *stream,
+                                             ShaderData *sd,
+                                             int p)
+{
+	float bsdf_u, bsdf_v;
+
+	path_state_rng_2D(kg, &stream->rng[p], &stream->state[p], PRNG_BSDF_U, &bsdf_u, &bsdf_v);
+
+	float ao_factor = kernel_data.background.ao_factor;
+	float3 ao_N;
+	float3 ao_bsdf = shader_bsdf_ao(kg, sd, ao_factor, &ao_N);
+	float3 ao_D;
+	float ao_pdf;
+
+	sample_cos_hemisphere(ao_N, bsdf_u, bsdf_v, &ao_D, &ao_pdf);
+
+	if(!(dot(sd->Ng, ao_D) > 0.0f && ao_pdf != 0.0f))
+		return false;
+
+	Ray light_ray;
+
+	light_ray.P = ray_offset(sd->P, sd->Ng);
+	light_ray.D = ao_D;
+	light_ray.t = kernel_data.background.ao_distance;
+#ifdef __OBJECT_MOTION__
+	light_ray.time = sd->time;
+#endif  /* __OBJECT_MOTION__ */
+	light_ray.dP = sd->dP;
+	light_ray.dD = differential3_zero();
+
+	stream->ao_alpha[p] = shader_bsdf_alpha(kg, sd);
+	stream->ao_bsdf[p] = ao_bsdf;
+	path_stream_shadow_queue(stream, &light_ray, p, true);
+
+	return true;
+}
+
+/* Same as kernel_path_surface_connect_light(), with the shadow ray queued. */
+ccl_device_inline bool kernel_path_stream_connect_light(KernelGlobals *kg,
+                                                        PathStream *stream,
+                                                        ShaderData *sd,
+                                                        ShaderData *emission_sd,
+                                                        int p)
+{
+#ifdef __EMISSION__
+	if(!(kernel_data.integrator.use_direct_light && (sd->flag & SD_BSDF_HAS_EVAL)))
+		return false;
+
+	RNG *rng = &stream->rng[p];
+	PathState *state = &stream->state[p];
+
+	/* sample illumination from lights to find path contribution */
+	float light_t = path_state_rng_1D(kg, rng, state, PRNG_LIGHT);
+	float light_u, light_v;
+	path_state_rng_2D(kg, rng, state, PRNG_LIGHT_U, &light_u, &light_v);
+
+	Ray light_ray;
+	bool is_lamp;
+
+#ifdef __OBJECT_MOTION__
+	light_ray.time = sd->time;
+#endif
+
+	LightSample ls;
+	if(light_sample(kg, light_t, light_u, light_v, sd->time, sd->P, state->bounce, &ls)) {
+		float terminate = path_state_rng_light_termination(kg, rng, state);
+		if(direct_emission(kg, sd, emission_sd, &ls, state, &light_ray, &stream->L_light[p], &is_lamp, terminate)) {
+			stream->is_lamp[p] = is_lamp;
+			path_stream_shadow_queue(stream, &light_ray, p, false);
+			return true;
+		}
+	}
+#endif
+
+	return false;
+}
+
+ccl_device void kernel_path_stream_shade(KernelGlobals *kg,
+                                         PathStream *stream,
+                                         ShaderData *sd,
+                                         ShaderData *emission_sd,
+                                         ccl_global float *buffer,
+                                         int sample)
+{
+	int pass_stride = kernel_data.film.pass_stride;
+
+	stream->num_shadows = 0;
+
+	for(int i = 0; i < stream->num_hits; i++) {
+		int p = stream->hits[i].path;
+
+		RNG *rng = &stream->rng[p];
+		PathState *state = &stream->state[p];
+		PathRadiance *L = &stream->L[p];
+		Ray *ray = &stream->ray[p];
+		Intersection *isect = &stream->isect[p];
+		float3 *throughput = &stream->throughput[p];
+		ccl_global float *pixel_buffer = buffer + stream->index[p]*pass_stride;
+
+		/* setup shading */
+		shader_setup_from_ray(kg, sd, isect, ray);
+		float rbsdf = path_state_rng_1D_for_decision(kg, rng, state, PRNG_BSDF);
+		shader_eval_surface(kg, sd, rng, state, rbsdf, state->flag, SHADER_CONTEXT_MAIN);
+
+		/* holdout */
+#ifdef __HOLDOUT__
+		if((sd->flag & (SD_HOLDOUT|SD_HOLDOUT_MASK)) && (state->flag & PATH_RAY_CAMERA)) {
+			if(kernel_data.background.transparent) {
+				float3 holdout_weight;
+
+				if(sd->flag & SD_HOLDOUT_MASK)
+					holdout_weight = make_float3(1.0f, 1.0f, 1.0f);
+				else
+					holdout_weight = shader_holdout_eval(kg, sd);
+
+				/* any throughput is ok, should all be identical here */
+				stream->L_transparent[p] += average(holdout_weight*(*throughput));
+			}
+
+			if(sd->flag & SD_HOLDOUT_MASK) {
+				stream->status[p] = PATH_STREAM_DONE;
+				stream->num_active--;
+				continue;
+			}
+		}
+#endif  /* __HOLDOUT__ */
+
+		/* holdout mask objects do not write data passes */
+		kernel_write_data_passes(kg, pixel_buffer, L, sd, sample, state, *throughput);
+
+		/* blurring of bsdf after bounces, for rays that have a small likelihood
+		 * of following this particular path (diffuse, rough glossy) */
+		if(kernel_data.integrator.filter_glossy != FLT_MAX) {
+			float blur_pdf = kernel_data.integrator.filter_glossy*state->min_ray_pdf;
+
+			if(blur_pdf < 1.0f) {
+				float blur_roughness = sqrtf(1.0f - blur_pdf)*0.5f;
+				shader_bsdf_blur(kg, sd, blur_roughness);
+			}
+		}
+
+#ifdef __EMISSION__
+		/* emission */
+		if(sd->flag & SD_EMISSION) {
+			float3 emission = indirect_primitive_emission(kg, sd, isect->t, state->flag, state->ray_pdf);
+			path_radiance_accum_emission(L, *throughput, emission, state->bounce);
+		}
+#endif  /* __EMISSION__ */
+
+		/* path termination */
+		float probability = path_state_terminate_probability(kg, state, *throughput);
+		bool terminate = (probability == 0.0f);
+
+		if(!terminate && probability != 1.0f) {
+			float terminate_rand = path_state_rng_1D_for_decision(kg, rng, state, PRNG_TERMINATE);
+
+			if(terminate_rand >= probability)
+				terminate = true;
+			else
+				*throughput /= probability;
+		}
+
+		if(terminate) {
+			stream->status[p] = PATH_STREAM_DONE;
+			stream->num_active--;
+			continue;
+		}
+
+		bool has_shadow = false;
+
+#ifdef __AO__
+		/* ambient occlusion */
+		if(kernel_data.integrator.use_ambient_occlusion || (sd->flag & SD_AO)) {
+			has_shadow |= kernel_path_stream_ao(kg, stream, sd, p);
+		}
+#endif  /* __AO__ */
+
+		/* direct lighting */
+		has_shadow |= kernel_path_stream_connect_light(kg, stream, sd, emission_sd, p);
+
+		/* the bounce changes throughput and path state, keep what the shadow
+		 * rays need to be traced and accumulated */
+		if(has_shadow) {
+			stream->shadow_state[p] = *state;
+			stream->shadow_throughput[p] = *throughput;
+		}
+
+		/* compute next bounce */
+		if(!kernel_path_surface_bounce(kg, rng, sd, throughput, state, L, ray)) {
+			stream->status[p] = PATH_STREAM_DONE;
+			stream->num_active--;
+		}
+	}
+}
+
+ccl_device void kernel_path_stream_shadow(KernelGlobals *kg,
+                                          PathStream *stream,
+                                          ShaderData *emission_sd)
+{
+	/* shadow rays of a path are queued in the order the megakernel traces
+	 * them, ambient occlusion first, so accumulation order is unchanged */
+	for(int i = 0; i < stream->num_shadows; i++) {
+		PathStreamShadow *shadow = &stream->shadows[i];
+		int p = shadow->path;
+
+		PathState *state = &stream->shadow_state[p];
+		PathRadiance *L = &stream->L[p];
+		float3 throughput = stream->shadow_throughput[p];
+		float3 light_shadow;
+
+		if(shadow_blocked(kg, emission_sd, state, &shadow->ray, &light_shadow))
+			continue;
+
+		if(shadow->is_ao) {
+			path_radiance_accum_ao(L, throughput, stream->ao_alpha[p], stream->ao_bsdf[p],
+			                       light_shadow, state->bounce);
+		}
+		else {
+			path_radiance_accum_light(L, throughput, &stream->L_light[p], light_shadow,
+			                          1.0f, state->bounce, stream->is_lamp[p]);
+		}
+	}
+}
+
+ccl_device void kernel_path_stream_write(KernelGlobals *kg,
+                                         PathStream *stream,
+                                         ccl_global float *buffer,
+                                         ccl_global uint *rng_state,
+                                         int sample)
+{
+	int pass_stride = kernel_data.film.pass_stride;
+
+	for(int p = 0; p < stream->num_paths; p++) {
+		if(stream->status[p] == PATH_STREAM_SKIP)
+			continue;
+
+		int index = stream->index[p];
+		ccl_global float *pixel_buffer = buffer + index*pass_stride;
+		float4 L;
+
+		if(stream->status[p] == PATH_STREAM_DONE) {
+			float3 L_sum = path_radiance_clamp_and_sum(kg, &stream->L[p]);
+
+			kernel_write_light_passes(kg, pixel_buffer, &stream->L[p], sample);
+
+			L = make_float4(L_sum.x, L_sum.y, L_sum.z, 1.0f - stream->L_transparent[p]);
+		}
+		else {
+			L = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+		}
+
+		/* accumulate result in output buffer */
+		kernel_write_pass_float4(pixel_buffer, sample, L);
+		kernel_write_adaptive_passes(kg, pixel_buffer, sample, L);
+		kernel_write_denoising_passes(kg, pixel_buffer, sample, L);
+
+		path_rng_end(kg, rng_state + index, stream->rng[p]);
+	}
+}
+
+/* Trace one sample for every pixel of a tile. */
+
+ccl_device void kernel_path_trace_stream(KernelGlobals *kg,
+	ccl_global float *buffer, ccl_global uint *rng_state,
+	int sample, int x, int y, int w, int h, int offset, int stride)
+{
+	PathStream *stream = path_stream_get(kg);
+
+	/* shader data memory, shared by all paths since they are shaded one by one */
+	ShaderData sd;
+	/* shader data used by emission, shadows, volume stacks */
+	ShaderData emission_sd;
+
+	int num_pixels = w*h;
+
+	for(int first = 0; first < num_pixels; first += PATH_STREAM_SIZE) {
+		int num = min(PATH_STREAM_SIZE, num_pixels - first);
+
+		kernel_path_stream_init(kg, stream, &emission_sd, buffer, rng_state,
+		                        sample, x, y, w, first, num, offset, stride);
+
+		while(stream->num_active > 0) {
+			kernel_path_stream_intersect(kg, stream);
+			kernel_path_stream_background(kg, stream, &emission_sd);
+			kernel_path_stream_sort(kg, stream);
+			kernel_path_stream_shade(kg, stream, &sd, &emission_sd, buffer, sample);
+			kernel_path_stream_shadow(kg, stream, &emission_sd);
+		}
+
+		kernel_path_stream_write(kg, stream, buffer, rng_state, sample);
+	}
+}
+
+CCL_NAMESPACE_END
+
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KERNEL_PROFILING_H__
+#define __KERNEL_PROFILING_H__
+
+/* Profiling counters for rays and shader evaluations, only gathered by the
+ * CPU kernels when the device enabled profiling for the render thread. On
+ * other devices these compile to nothing. */
+
+CCL_NAMESPACE_BEGIN
+
+#ifdef __KERNEL_CPU__
+
+ccl_device_inline void profiling_count_ray(KernelGlobals *kg, uint visibility)
+{
+	if(kg->profiling == NULL) {
+		return;
+	}
+
+	ProfilingRayType type;
+
+	if(visibility & PATH_RAY_SHADOW)
+		type = PROFILING_RAY_SHADOW;
+	else if(visibility & PATH_RAY_CAMERA)
+		type = PROFILING_RAY_CAMERA;
+	else if(visibility & PATH_RAY_REFLECT)
+		type = PROFILING_RAY_REFLECT;
+	else if(visibility & PATH_RAY_TRANSMIT)
+		type = PROFILING_RAY_TRANSMIT;
+	else if(visibility & PATH_RAY_VOLUME_SCATTER)
+		type = PROFILING_RAY_VOLUME;
+	else
+		type = PROFILING_RAY_OTHER;
+
+	kg->profiling->count_ray(type);
+}
+
+ccl_device_inline void profiling_count_ray_type(KernelGlobals *kg, ProfilingRayType type)
+{
+	if(kg->profiling) {
+		kg->profiling->count_ray(type);
+	}
+}
+
+ccl_device_inline void profiling_count_shader_eval(KernelGlobals *kg, int shader)
+{
+	if(kg->profiling) {
+		kg->profiling->count_shader_eval(shader & SHADER_MASK);
+	}
+}
+
+#  define PROFILING_RAY(kg, visibility) profiling_count_ray(kg, visibility)
+#  define PROFILING_RAY_TYPE(kg, type) profiling_count_ray_type(kg, type)
+#  define PROFILING_SHADER_EVAL(kg, shader) profiling_count_shader_eval(kg, shader)
+
+#else  /* __KERNEL_CPU__ */
+
+#  define PROFILING_RAY(kg, visibility)
+#  define PROFILING_RAY_TYPE(kg, type)
+#  define PROFILING_SHADER_EVAL(kg, shader)
+
+#endif  /* __KERNEL_CPU__ */
+
+CCL_NAMESPACE_END
+
+#endif  /* __KERNEL_PROFILING_H__ */
@@ -850,6 +850,8 @@ ccl_device void shader_eval_surface(KernelGlobals *kg, ShaderData *sd, ccl_addr_
 	ccl_fetch(sd, num_closure_extra) = 0;
 	ccl_fetch(sd, randb_closure) = randb;
 
+	PROFILING_SHADER_EVAL(kg, ccl_fetch(sd, shader));
+
 #ifdef __OSL__
 	if(kg->osl)
 		OSLShader::eval_surface(kg, sd, state, path_flag, ctx);
@@ -881,6 +883,8 @@ ccl_device float3 shader_eval_background(KernelGlobals *kg, ShaderData *sd,
 	ccl_fetch(sd, num_closure_extra) = 0;
 	ccl_fetch(sd, randb_closure) = 0.0f;
 
+	PROFILING_SHADER_EVAL(kg, ccl_fetch(sd, shader));
+
 #ifdef __SVM__
 #ifdef __OSL__
 	if(kg->osl) {
@@ -1048,6 +1052,8 @@ ccl_device_inline void shader_eval_volume(KernelGlobals *kg,
 		}
 
 		/* evaluate shader */
+		PROFILING_SHADER_EVAL(kg, sd->shader);
+
 #ifdef __SVM__
 #  ifdef __OSL__
 		if(kg->osl) {
@@ -1076,6 +1082,8 @@ ccl_device void shader_eval_displacement(KernelGlobals *kg, ShaderData *sd, ccl_
 	ccl_fetch(sd, num_closure_extra) = 0;
 	ccl_fetch(sd, randb_closure) = 0.0f;
 
+	PROFILING_SHADER_EVAL(kg, ccl_fetch(sd, shader));
+
 	/* this will modify sd->P */
 #ifdef __SVM__
 #  ifdef __OSL__
@@ -38,6 +38,7 @@ CCL_NAMESPACE_BEGIN
 #define OBJECT_SIZE 		12
 #define OBJECT_VECTOR_SIZE	6
 #define LIGHT_SIZE		11
+#define LIGHT_TREE_NODE_SIZE	3
 #define FILTER_TABLE_SIZE	1024
 #define RAMP_TABLE_SIZE		256
 #define SHUTTER_TABLE_SIZE		256
@@ -61,6 +62,9 @@ CCL_NAMESPACE_BEGIN
 #  ifdef __KERNEL_SSE2__
 #    define __QBVH__
 #  endif
+#  ifdef __KERNEL_AVX2__
+#    define __OBVH__
+#  endif
 #  define __KERNEL_SHADING__
 #  define __KERNEL_ADV_SHADING__
 #  define __BRANCHED_PATH__
@@ -74,6 +78,7 @@ CCL_NAMESPACE_BEGIN
 #  define __VOLUME_SCATTER__
 #  define __SHADOW_RECORD_ALL__
 #  define __VOLUME_RECORD_ALL__
+#  define __DENOISING_FEATURES__
 #endif  /* __KERNEL_CPU__ */
 
 #ifdef __KERNEL_CUDA__
@@ -341,15 +346,41 @@ typedef enum PassType {
 	PASS_SUBSURFACE_INDIRECT = (1 << 23),
 	PASS_SUBSURFACE_COLOR = (1 << 24),
 	PASS_LIGHT = (1 << 25), /* no real pass, used to force use_light_pass */
+	PASS_ADAPTIVE_AUX = (1 << 26), /* no user pass, per pixel statistics for adaptive sampling */
 #ifdef __KERNEL_DEBUG__
-	PASS_BVH_TRAVERSAL_STEPS = (1 << 26),
-	PASS_BVH_TRAVERSED_INSTANCES = (1 << 27),
-	PASS_RAY_BOUNCES = (1 << 28),
+	PASS_BVH_TRAVERSAL_STEPS = (1 << 27),
+	PASS_BVH_TRAVERSED_INSTANCES = (1 << 28),
+	PASS_RAY_BOUNCES = (1 << 29),
+	PASS_SAMPLE_COUNT = (1 << 30),
 #endif
 } PassType;
 
 #define PASS_ALL (~0)
 
+/* Feature data for the denoiser, stored after the regular passes when the
+ * denoiser is used. Each entry is a float4 accumulated over the samples. */
+#define DENOISING_PASS_NORMAL	0	/* normal.xyz, normal squared length */
+#define DENOISING_PASS_ALBEDO	4	/* albedo.rgb, albedo squared length */
+#define DENOISING_PASS_DEPTH	8	/* depth, depth squared, num hits */
+#define DENOISING_PASS_COLOR	12	/* color.rgb, num samples */
+#define DENOISING_PASS_COLOR_SQ	16	/* color squared.rgb */
+#define DENOISING_PASS_SIZE		20
+
+/* Planes of the prefiltered feature buffer the denoise kernel works on, with
+ * a variance and squared gradient plane for every feature. */
+#define DENOISE_PLANE_COLOR			0	/* 3 planes */
+#define DENOISE_PLANE_COLOR_VAR		3	/* 3 planes */
+#define DENOISE_PLANE_NORMAL		6	/* 3 planes */
+#define DENOISE_PLANE_ALBEDO		9	/* 3 planes */
+#define DENOISE_PLANE_DEPTH			12
+#define DENOISE_PLANE_FEATURE_VAR	13	/* normal, albedo, depth */
+#define DENOISE_PLANE_FEATURE_GRAD	16	/* normal, albedo, depth */
+#define DENOISE_NUM_PLANES			19
+#define DENOISE_NUM_FEATURES		3
+
+/* Rows of the planes are padded, so the kernel can process whole vectors. */
+#define DENOISE_ROW_PADDING			8
+
 typedef enum BakePassFilter {
 	BAKE_FILTER_NONE = 0,
 	BAKE_FILTER_DIRECT = (1 << 0),
@@ -1027,18 +1058,21 @@ typedef struct KernelFilm {
 	int pass_shadow;
 	float pass_shadow_scale;
 	int filter_table_offset;
-	int pass_pad2;
+	int pass_adaptive_aux;
 
 	int pass_mist;
 	float mist_start;
 	float mist_inv_depth;
 	float mist_falloff;
 
+	int pass_denoising_data;
+	int pad1, pad2, pad3;
+
 #ifdef __KERNEL_DEBUG__
 	int pass_bvh_traversal_steps;
 	int pass_bvh_traversed_instances;
 	int pass_ray_bounces;
-	int pass_pad3;
+	int pass_sample_count;
 #endif
 } KernelFilm;
 static_assert_align(KernelFilm, 16);
@@ -1125,7 +1159,23 @@ typedef struct KernelIntegrator {
 
 	float light_inv_rr_threshold;
 
-	int pad1;
+	/* adaptive sampling */
+	float adaptive_threshold;
+	int adaptive_min_samples;
+
+	/* light tree, sampled with light_tree_fraction, distant and background
+	 * lamps are picked uniformly from the rest */
+	int use_light_tree;
+	float light_tree_fraction;
+	int light_tree_triangle_root;
+	int light_tree_num_distant;
+	int light_tree_distant_offset;
+
+	/* subsurface scattering, the CPU ray stream kernel does not support it */
+	int use_subsurface;
+
+	/* skip empty space of sparse volume grids */
+	int volume_skip_empty;
 } KernelIntegrator;
 static_assert_align(KernelIntegrator, 16);
 
@@ -1137,7 +1187,8 @@ typedef struct KernelBVH {
 	int have_curves;
 	int have_instancing;
 	int use_qbvh;
-	int pad1, pad2;
+	int use_obvh;
+	int pad1;
 } KernelBVH;
 static_assert_align(KernelBVH, 16);
 
@@ -154,6 +154,126 @@ ccl_device int volume_stack_sampling_method(KernelGlobals *kg, VolumeStack *stac
 	return method;
 }
 
+/* Empty Space Skipping
+ *
+ * Volumes with voxel grids, like smoke, are assumed to be empty where all their
+ * grids are zero. With sparse grids on the CPU, steps that are entirely inside
+ * such empty space are skipped without shader evaluation, giving the same
+ * result as evaluating a shader without coefficients. */
+
+#ifdef __KERNEL_CPU__
+
+#define VOLUME_SKIP_MAX_GRIDS 8
+
+typedef struct VolumeSkip {
+	int num_grids;
+	int slot[VOLUME_SKIP_MAX_GRIDS];
+	/* ray in normalized grid space, as in volume_normalized_position() */
+	float3 P[VOLUME_SKIP_MAX_GRIDS];
+	float3 D[VOLUME_SKIP_MAX_GRIDS];
+	/* distance along the ray up to which the volume is known to be empty */
+	float empty_t;
+} VolumeSkip;
+
+/* gather the voxel grids of all volumes in the stack, returns false when some
+ * volume is not bounded by grids and nothing can be skipped */
+ccl_device bool kernel_volume_skip_init(KernelGlobals *kg, ShaderData *sd, VolumeStack *stack, Ray *ray, VolumeSkip *skip)
+{
+	skip->num_grids = 0;
+	skip->empty_t = 0.0f;
+
+	if(!kernel_data.integrator.volume_skip_empty)
+		return false;
+
+	for(int i = 0; stack[i].shader != SHADER_NONE; i++) {
+		if(stack[i].object == OBJECT_NONE) {
+			skip->num_grids = 0;
+			return false;
+		}
+
+		sd->object = stack[i].object;
+#ifdef __OBJECT_MOTION__
+		shader_setup_object_transforms(kg, sd, sd->time);
+#endif
+
+		float3 P = ray->P;
+		float3 D = ray->D;
+		object_inverse_position_transform(kg, sd, &P);
+		object_inverse_dir_transform(kg, sd, &D);
+
+		const AttributeDescriptor desc = find_attribute(kg, sd, ATTR_STD_GENERATED_TRANSFORM);
+		if(desc.offset != ATTR_STD_NOT_FOUND) {
+			Transform tfm = primitive_attribute_matrix(kg, sd, desc);
+			P = transform_point(&tfm, P);
+			D = transform_direction(&tfm, D);
+		}
+
+		/* all voxel attributes of the object */
+		int num_object_grids = 0;
+		uint attr_offset = sd->object*kernel_data.bvh.attributes_map_stride;
+		attr_offset += attribute_primitive_type(kg, sd);
+		uint4 attr_map = kernel_tex_fetch(__attributes_map, attr_offset);
+
+		while(attr_map.x != ATTR_STD_NONE) {
+			if(attr_map.y == ATTR_ELEMENT_VOXEL) {
+				if(skip->num_grids == VOLUME_SKIP_MAX_GRIDS) {
+					skip->num_grids = 0;
+					return false;
+				}
+
+				skip->slot[skip->num_grids] = attr_map.z;
+				skip->P[skip->num_grids] = P;
+				skip->D[skip->num_grids] = D;
+				skip->num_grids++;
+				num_object_grids++;
+			}
+
+			attr_offset += ATTR_PRIM_TYPES;
+			attr_map = kernel_tex_fetch(__attributes_map, attr_offset);
+		}
+
+		if(num_object_grids == 0) {
+			skip->num_grids = 0;
+			return false;
+		}
+	}
+
+	return (skip->num_grids > 0);
+}
+
+/* distance along the ray from t up to which all grids are in empty space */
+ccl_device float kernel_volume_skip_distance(KernelGlobals *kg, VolumeSkip *skip, float t, float max_t)
+{
+	while(t < max_t) {
+		float dist = FLT_MAX;
+
+		for(int i = 0; i < skip->num_grids && dist > 0.0f; i++) {
+			float3 P = skip->P[i] + skip->D[i]*t;
+			dist = min(dist, kernel_tex_image_empty_distance_3d(skip->slot[i], P, skip->D[i]));
+		}
+
+		/* stop when not empty, or when too small to advance */
+		float next_t = t + dist;
+		if(!(next_t > t))
+			break;
+
+		t = next_t;
+	}
+
+	return t;
+}
+
+/* returns true when the step from t to new_t is in empty space */
+ccl_device_inline bool kernel_volume_skip_step(KernelGlobals *kg, VolumeSkip *skip, float t, float new_t, float max_t)
+{
+	if(skip->empty_t < new_t)
+		skip->empty_t = kernel_volume_skip_distance(kg, skip, max(t, skip->empty_t), max_t);
+
+	return (skip->empty_t >= new_t);
+}
+
+#endif  /* __KERNEL_CPU__ */
+
 /* Volume Shadows
  *
  * These functions are used to attenuate shadow rays to lights. Both absorption
@@ -186,6 +306,11 @@ ccl_device void kernel_volume_shadow_heterogeneous(KernelGlobals *kg, PathState
 
 	float3 sum = make_float3(0.0f, 0.0f, 0.0f);
 
+#ifdef __KERNEL_CPU__
+	VolumeSkip skip;
+	bool use_skip = kernel_volume_skip_init(kg, sd, state->volume_stack, ray, &skip);
+#endif
+
 	for(int i = 0; i < max_steps; i++) {
 		/* advance to new position */
 		float new_t = min(ray->t, (i+1) * step);
@@ -197,9 +322,17 @@ ccl_device void kernel_volume_shadow_heterogeneous(KernelGlobals *kg, PathState
 
 		float3 new_P = ray->P + ray->D * (t + random_jitter_offset);
 		float3 sigma_t;
+		bool has_extinction;
+
+#ifdef __KERNEL_CPU__
+		if(use_skip && kernel_volume_skip_step(kg, &skip, t, new_t, ray->t))
+			has_extinction = false;
+		else
+#endif
+			has_extinction = volume_shader_extinction_sample(kg, sd, state, new_P, &sigma_t);
 
 		/* compute attenuation over segment */
-		if(volume_shader_extinction_sample(kg, sd, state, new_P, &sigma_t)) {
+		if(has_extinction) {
 			/* Compute expf() only for every Nth step, to save some calculations
 			 * because exp(a)*exp(b) = exp(a+b), also do a quick tp_eps check then. */
 
@@ -467,6 +600,11 @@ ccl_device VolumeIntegrateResult kernel_volume_integrate_heterogeneous_distance(
 	sd->randb_closure = rphase*3.0f - channel;
 	bool has_scatter = false;
 
+#ifdef __KERNEL_CPU__
+	VolumeSkip skip;
+	bool use_skip = kernel_volume_skip_init(kg, sd, state->volume_stack, ray, &skip);
+#endif
+
 	for(int i = 0; i < max_steps; i++) {
 		/* advance to new position */
 		float new_t = min(ray->t, (i+1) * step_size);
@@ -478,9 +616,17 @@ ccl_device VolumeIntegrateResult kernel_volume_integrate_heterogeneous_distance(
 
 		float3 new_P = ray->P + ray->D * (t + random_jitter_offset);
 		VolumeShaderCoefficients coeff;
+		bool has_coeff;
+
+#ifdef __KERNEL_CPU__
+		if(use_skip && kernel_volume_skip_step(kg, &skip, t, new_t, ray->t))
+			has_coeff = false;
+		else
+#endif
+			has_coeff = volume_shader_sample(kg, sd, state, new_P, &coeff);
 
 		/* compute segment */
-		if(volume_shader_sample(kg, sd, state, new_P, &coeff)) {
+		if(has_coeff) {
 			int closure_flag = sd->flag;
 			float3 new_tp;
 			float3 transmittance;
@@ -692,6 +838,12 @@ ccl_device void kernel_volume_decoupled_record(KernelGlobals *kg, PathState *sta
 
 	VolumeStep *step = segment->steps;
 
+#ifdef __KERNEL_CPU__
+	VolumeSkip skip;
+	bool use_skip = heterogeneous &&
+	                kernel_volume_skip_init(kg, sd, state->volume_stack, ray, &skip);
+#endif
+
 	for(int i = 0; i < max_steps; i++, step++) {
 		/* advance to new position */
 		float new_t = min(ray->t, (i+1) * step_size);
@@ -703,9 +855,18 @@ ccl_device void kernel_volume_decoupled_record(KernelGlobals *kg, PathState *sta
 
 		float3 new_P = ray->P + ray->D * (t + random_jitter_offset);
 		VolumeShaderCoefficients coeff;
+		bool has_coeff;
+
+#ifdef __KERNEL_CPU__
+		/* steps in empty space are recorded as empty steps */
+		if(use_skip && kernel_volume_skip_step(kg, &skip, t, new_t, ray->t))
+			has_coeff = false;
+		else
+#endif
+			has_coeff = volume_shader_sample(kg, sd, state, new_P, &coeff);
 
 		/* compute segment */
-		if(volume_shader_sample(kg, sd, state, new_P, &coeff)) {
+		if(has_coeff) {
 			int closure_flag = sd->flag;
 			float3 sigma_t = coeff.sigma_a + coeff.sigma_s;
 
@@ -101,11 +101,16 @@ void kernel_tex_copy(KernelGlobals *kg,
 			tex = &kg->texture_float4_images[array_index];
 		}
 
-		if(tex) {
+		if(tex && strstr(name, "_offsets")) {
+			/* tile offsets of a sparse image, allocated after its voxels */
+			tex->sparse_set((int*)mem);
+		}
+		else if(tex) {
 			tex->data = (float4*)mem;
 			tex->dimensions_set(width, height, depth);
 			tex->interpolation = interpolation;
 			tex->extension = extension;
+			tex->sparse_set(NULL);
 		}
 	}
 	else if(strstr(name, "__tex_image_float")) {
@@ -117,11 +122,16 @@ void kernel_tex_copy(KernelGlobals *kg,
 			tex = &kg->texture_float_images[array_index];
 		}
 
-		if(tex) {
+		if(tex && strstr(name, "_offsets")) {
+			/* tile offsets of a sparse image, allocated after its voxels */
+			tex->sparse_set((int*)mem);
+		}
+		else if(tex) {
 			tex->data = (float*)mem;
 			tex->dimensions_set(width, height, depth);
 			tex->interpolation = interpolation;
 			tex->extension = extension;
+			tex->sparse_set(NULL);
 		}
 	}
 	else if(strstr(name, "__tex_image_byte4")) {
@@ -138,6 +148,7 @@ void kernel_tex_copy(KernelGlobals *kg,
 			tex->dimensions_set(width, height, depth);
 			tex->interpolation = interpolation;
 			tex->extension = extension;
+			tex->sparse_set(NULL);
 		}
 	}
 	else if(strstr(name, "__tex_image_byte")) {
@@ -154,6 +165,7 @@ void kernel_tex_copy(KernelGlobals *kg,
 			tex->dimensions_set(width, height, depth);
 			tex->interpolation = interpolation;
 			tex->extension = extension;
+			tex->sparse_set(NULL);
 		}
 	}
 	else if(strstr(name, "__tex_image_half4")) {
@@ -170,6 +182,7 @@ void kernel_tex_copy(KernelGlobals *kg,
 			tex->dimensions_set(width, height, depth);
 			tex->interpolation = interpolation;
 			tex->extension = extension;
+			tex->sparse_set(NULL);
 		}
 	}
 	else if(strstr(name, "__tex_image_half")) {
@@ -186,6 +199,7 @@ void kernel_tex_copy(KernelGlobals *kg,
 			tex->dimensions_set(width, height, depth);
 			tex->interpolation = interpolation;
 			tex->extension = extension;
+			tex->sparse_set(NULL);
 		}
 	}
 	else
@@ -24,6 +24,15 @@ void KERNEL_FUNCTION_FULL_NAME(path_trace)(KernelGlobals *kg,
                                            int offset,
                                            int stride);
 
+void KERNEL_FUNCTION_FULL_NAME(path_trace_stream)(KernelGlobals *kg,
+                                                  float *buffer,
+                                                  unsigned int *rng_state,
+                                                  int sample,
+                                                  int x, int y,
+                                                  int w, int h,
+                                                  int offset,
+                                                  int stride);
+
 void KERNEL_FUNCTION_FULL_NAME(convert_to_byte)(KernelGlobals *kg,
                                                 uchar4 *rgba,
                                                 float *buffer,
@@ -39,6 +48,18 @@ void KERNEL_FUNCTION_FULL_NAME(convert_to_half_float)(KernelGlobals *kg,
                                                       int offset,
                                                       int stride);
 
+void KERNEL_FUNCTION_FULL_NAME(denoise)(const float *buffer,
+                                        float *output,
+                                        float *temp,
+                                        int x, int y,
+                                        int w, int h,
+                                        int stride,
+                                        int height,
+                                        int radius,
+                                        int patch_radius,
+                                        float strength,
+                                        float feature_strength);
+
 void KERNEL_FUNCTION_FULL_NAME(shader)(KernelGlobals *kg,
                                        uint4 *input,
                                        float4 *output,
@@ -21,8 +21,24 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Defined in kernel_texture_cache.cpp, returns false for images which are not
+ * in the texture cache. */
+bool kernel_texture_cache_lookup(KernelGlobals *kg,
+                                 int tex,
+                                 float x, float y,
+                                 float dxdx, float dydx,
+                                 float dxdy, float dydy,
+                                 float4 *result);
+
 ccl_device float4 kernel_tex_image_interp_impl(KernelGlobals *kg, int tex, float x, float y)
 {
+	float4 r;
+	if(UNLIKELY(kg->texture_cache_tdata != NULL) &&
+	   kernel_texture_cache_lookup(kg, tex, x, y, 0.0f, 0.0f, 0.0f, 0.0f, &r))
+	{
+		return r;
+	}
+
 	if(tex >= TEX_START_HALF_CPU)
 		return kg->texture_half_images[tex - TEX_START_HALF_CPU].interp(x, y);
 	else if(tex >= TEX_START_BYTE_CPU)
@@ -37,6 +53,20 @@ ccl_device float4 kernel_tex_image_interp_impl(KernelGlobals *kg, int tex, float
 		return kg->texture_float4_images[tex].interp(x, y);
 }
 
+/* Lookup with texture coordinate derivatives, used by the texture cache to
+ * select the mipmap level. Images in texture slots have no mipmaps. */
+ccl_device float4 kernel_tex_image_interp_d_impl(KernelGlobals *kg, int tex, float x, float y, float2 dx, float2 dy)
+{
+	float4 r;
+	if(UNLIKELY(kg->texture_cache_tdata != NULL) &&
+	   kernel_texture_cache_lookup(kg, tex, x, y, dx.x, dx.y, dy.x, dy.y, &r))
+	{
+		return r;
+	}
+
+	return kernel_tex_image_interp_impl(kg, tex, x, y);
+}
+
 ccl_device float4 kernel_tex_image_interp_3d_impl(KernelGlobals *kg, int tex, float x, float y, float z)
 {
 	if(tex >= TEX_START_HALF_CPU)
@@ -70,6 +100,24 @@ ccl_device float4 kernel_tex_image_interp_3d_ex_impl(KernelGlobals *kg, int tex,
 		return kg->texture_float4_images[tex].interp_3d_ex(x, y, z, interpolation);
 }
 
+/* Distance along D over which lookups from P only see empty space of a sparse
+ * 3D image, used for skipping empty space in volumes. */
+ccl_device float kernel_tex_image_empty_distance_3d_impl(KernelGlobals *kg, int tex, float3 P, float3 D)
+{
+	if(tex >= TEX_START_HALF_CPU)
+		return kg->texture_half_images[tex - TEX_START_HALF_CPU].empty_distance_3d(P, D);
+	else if(tex >= TEX_START_BYTE_CPU)
+		return kg->texture_byte_images[tex - TEX_START_BYTE_CPU].empty_distance_3d(P, D);
+	else if(tex >= TEX_START_FLOAT_CPU)
+		return kg->texture_float_images[tex - TEX_START_FLOAT_CPU].empty_distance_3d(P, D);
+	else if(tex >= TEX_START_HALF4_CPU)
+		return kg->texture_half4_images[tex - TEX_START_HALF4_CPU].empty_distance_3d(P, D);
+	else if(tex >= TEX_START_BYTE4_CPU)
+		return kg->texture_byte4_images[tex - TEX_START_BYTE4_CPU].empty_distance_3d(P, D);
+	else
+		return kg->texture_float4_images[tex].empty_distance_3d(P, D);
+}
+
 CCL_NAMESPACE_END
 
 #endif  // __KERNEL_CPU__
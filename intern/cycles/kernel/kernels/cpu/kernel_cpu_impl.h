@@ -28,6 +28,8 @@
 #include "kernel_film.h"
 #include "kernel_path.h"
 #include "kernel_path_branched.h"
+#include "kernel_path_stream.h"
+#include "kernel_denoise.h"
 #include "kernel_bake.h"
 
 CCL_NAMESPACE_BEGIN
@@ -59,6 +61,40 @@ void KERNEL_FUNCTION_FULL_NAME(path_trace)(KernelGlobals *kg,
 	}
 }
 
+void KERNEL_FUNCTION_FULL_NAME(path_trace_stream)(KernelGlobals *kg,
+                                                  float *buffer,
+                                                  unsigned int *rng_state,
+                                                  int sample,
+                                                  int x, int y,
+                                                  int w, int h,
+                                                  int offset,
+                                                  int stride)
+{
+	if(kernel_path_stream_supported(kg)) {
+		kernel_path_trace_stream(kg,
+		                         buffer,
+		                         rng_state,
+		                         sample,
+		                         x, y,
+		                         w, h,
+		                         offset,
+		                         stride);
+	}
+	else {
+		for(int py = y; py < y + h; py++) {
+			for(int px = x; px < x + w; px++) {
+				KERNEL_FUNCTION_FULL_NAME(path_trace)(kg,
+				                                      buffer,
+				                                      rng_state,
+				                                      sample,
+				                                      px, py,
+				                                      offset,
+				                                      stride);
+			}
+		}
+	}
+}
+
 /* Film */
 
 void KERNEL_FUNCTION_FULL_NAME(convert_to_byte)(KernelGlobals *kg,
@@ -95,6 +131,33 @@ void KERNEL_FUNCTION_FULL_NAME(convert_to_half_float)(KernelGlobals *kg,
 	                                  stride);
 }
 
+/* Denoise */
+
+void KERNEL_FUNCTION_FULL_NAME(denoise)(const float *buffer,
+                                        float *output,
+                                        float *temp,
+                                        int x, int y,
+                                        int w, int h,
+                                        int stride,
+                                        int height,
+                                        int radius,
+                                        int patch_radius,
+                                        float strength,
+                                        float feature_strength)
+{
+	kernel_denoise(buffer,
+	               output,
+	               temp,
+	               x, y,
+	               w, h,
+	               stride,
+	               height,
+	               radius,
+	               patch_radius,
+	               strength,
+	               feature_strength);
+}
+
 /* Shader Evaluate */
 
 void KERNEL_FUNCTION_FULL_NAME(shader)(KernelGlobals *kg,
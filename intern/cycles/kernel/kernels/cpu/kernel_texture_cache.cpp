@@ -0,0 +1,264 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* So ImathMath is included before our kernel_cpu_compat. */
+#include "kernel_texture_cache.h"
+
+#include "kernel_compat_cpu.h"
+#include "kernel_math.h"
+#include "kernel_types.h"
+#include "kernel_globals.h"
+
+#include "util_foreach.h"
+#include "util_logging.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Kernel Lookup */
+
+bool kernel_texture_cache_lookup(KernelGlobals *kg,
+                                 int tex,
+                                 float x, float y,
+                                 float dxdx, float dydx,
+                                 float dxdy, float dydy,
+                                 float4 *result)
+{
+	/* texture system has the origin at the top of the image */
+	return kg->texture_cache->lookup(kg->texture_cache_tdata,
+	                                 tex,
+	                                 x, 1.0f - y,
+	                                 dxdx, -dydx,
+	                                 dxdy, -dydy,
+	                                 result);
+}
+
+/* Texture Cache */
+
+TextureCache::TextureCache()
+: ts(NULL), memory_limit(0)
+{
+}
+
+TextureCache::~TextureCache()
+{
+	foreach(Image *img, images) {
+		delete img;
+	}
+
+	if(ts) {
+		OIIO::TextureSystem::destroy(ts);
+	}
+}
+
+void TextureCache::system_init()
+{
+	if(ts) {
+		return;
+	}
+
+	/* private texture system, the shared one is configured by OSL */
+	ts = OIIO::TextureSystem::create(false);
+
+	ts->attribute("automip", 1);
+	ts->attribute("autotile", 64);
+	ts->attribute("gray_to_rgb", 1);
+
+	if(memory_limit > 0) {
+		ts->attribute("max_memory_MB", (float)memory_limit);
+	}
+}
+
+void TextureCache::set_memory_limit(int limit_mb)
+{
+	thread_scoped_lock lock(ts_mutex);
+
+	if(memory_limit == limit_mb) {
+		return;
+	}
+
+	memory_limit = limit_mb;
+
+	if(ts && memory_limit > 0) {
+		ts->attribute("max_memory_MB", (float)memory_limit);
+	}
+}
+
+void TextureCache::add_image(int flat_slot,
+                             const string& filename,
+                             InterpolationType interpolation,
+                             ExtensionType extension)
+{
+	thread_scoped_lock lock(ts_mutex);
+
+	system_init();
+
+	if(flat_slot >= images.size()) {
+		images.resize(flat_slot + 1, NULL);
+	}
+
+	Image *img = images[flat_slot];
+	if(img == NULL) {
+		img = new Image();
+		images[flat_slot] = img;
+	}
+
+	img->filename = OIIO::ustring(filename);
+	img->handle = ts->get_texture_handle(img->filename);
+
+	OIIO::TextureOpt& options = img->options;
+
+	switch(interpolation) {
+		case INTERPOLATION_CLOSEST:
+			options.interpmode = OIIO::TextureOpt::InterpClosest;
+			break;
+		case INTERPOLATION_CUBIC:
+			options.interpmode = OIIO::TextureOpt::InterpBicubic;
+			break;
+		case INTERPOLATION_SMART:
+			options.interpmode = OIIO::TextureOpt::InterpSmartBicubic;
+			break;
+		case INTERPOLATION_LINEAR:
+		default:
+			options.interpmode = OIIO::TextureOpt::InterpBilinear;
+			break;
+	}
+
+	switch(extension) {
+		case EXTENSION_EXTEND:
+			options.swrap = options.twrap = OIIO::TextureOpt::WrapClamp;
+			break;
+		case EXTENSION_CLIP:
+			options.swrap = options.twrap = OIIO::TextureOpt::WrapBlack;
+			break;
+		case EXTENSION_REPEAT:
+		default:
+			options.swrap = options.twrap = OIIO::TextureOpt::WrapPeriodic;
+			break;
+	}
+
+	/* opaque alpha for images without alpha channel */
+	options.fill = 1.0f;
+}
+
+void TextureCache::remove_image(int flat_slot)
+{
+	thread_scoped_lock lock(ts_mutex);
+
+	if(flat_slot < images.size() && images[flat_slot]) {
+		Image *img = images[flat_slot];
+		ts->invalidate(img->filename);
+		delete img;
+		images[flat_slot] = NULL;
+	}
+}
+
+bool TextureCache::lookup(TextureCacheThreadData *tdata,
+                          int flat_slot,
+                          float s, float t,
+                          float dsdx, float dtdx,
+                          float dsdy, float dtdy,
+                          float4 *result)
+{
+	if(flat_slot >= images.size() || images[flat_slot] == NULL) {
+		return false;
+	}
+
+	Image *img = images[flat_slot];
+	/* texture system may write to the options */
+	OIIO::TextureOpt options = img->options;
+	float rgba[4];
+
+	if(!ts->texture(img->handle, tdata->thread_info, options,
+	                s, t,
+	                dsdx, dtdx,
+	                dsdy, dtdy,
+	                4, rgba))
+	{
+		rgba[0] = TEX_IMAGE_MISSING_R;
+		rgba[1] = TEX_IMAGE_MISSING_G;
+		rgba[2] = TEX_IMAGE_MISSING_B;
+		rgba[3] = TEX_IMAGE_MISSING_A;
+
+		/* clear error, so messages don't accumulate */
+		string err = ts->geterror();
+		(void)err;
+	}
+
+	*result = make_float4(rgba[0], rgba[1], rgba[2], rgba[3]);
+	return true;
+}
+
+void TextureCache::thread_init(KernelGlobals *kg)
+{
+	/* no images in the cache, skip the lookups entirely */
+	if(ts == NULL) {
+		kg->texture_cache = NULL;
+		kg->texture_cache_tdata = NULL;
+		return;
+	}
+
+	TextureCacheThreadData *tdata = new TextureCacheThreadData();
+	tdata->thread_info = ts->get_perthread_info();
+
+	kg->texture_cache = this;
+	kg->texture_cache_tdata = tdata;
+}
+
+void TextureCache::thread_free(KernelGlobals *kg)
+{
+	delete kg->texture_cache_tdata;
+
+	kg->texture_cache = NULL;
+	kg->texture_cache_tdata = NULL;
+}
+
+TextureCache::Stats TextureCache::get_stats()
+{
+	Stats stats;
+
+	if(ts) {
+		int misses = 0;
+
+		ts->getattribute("stat:find_tile_calls", OIIO::TypeDesc::INT64, &stats.lookups);
+		ts->getattribute("stat:find_tile_cache_misses", OIIO::TypeDesc::INT, &misses);
+		ts->getattribute("stat:cache_memory_used", OIIO::TypeDesc::INT64, &stats.memory_used);
+		ts->getattribute("stat:bytes_read", OIIO::TypeDesc::INT64, &stats.bytes_read);
+
+		stats.misses = misses;
+	}
+
+	return stats;
+}
+
+string TextureCache::get_stats_report()
+{
+	Stats stats = get_stats();
+	int64_t hits = stats.lookups - stats.misses;
+
+	return string_printf("  Tile lookups: %lld\n"
+	                     "  Hits: %lld (%.2f%%)\n"
+	                     "  Misses: %lld\n"
+	                     "  Memory used: %s\n"
+	                     "  Read from disk: %s",
+	                     (long long)stats.lookups,
+	                     (long long)hits,
+	                     (stats.lookups)? 100.0*hits/stats.lookups: 0.0,
+	                     (long long)stats.misses,
+	                     string_human_readable_size(stats.memory_used).c_str(),
+	                     string_human_readable_size(stats.bytes_read).c_str());
+}
+
+CCL_NAMESPACE_END
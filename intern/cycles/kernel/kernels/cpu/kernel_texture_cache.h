@@ -0,0 +1,98 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KERNEL_TEXTURE_CACHE_H__
+#define __KERNEL_TEXTURE_CACHE_H__
+
+#include <OpenImageIO/texture.h>
+
+#include "util_string.h"
+#include "util_thread.h"
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+struct KernelGlobals;
+
+/* Texture Cache
+ *
+ * Image textures on the CPU device which are read on demand by an OIIO
+ * texture system, rather than loaded fully into the image texture slots.
+ * Only tiles of the mipmap levels actually used are kept in memory, up to
+ * the configured memory limit. Files without tiles or mipmaps get them
+ * generated on the fly, for best performance they should be converted to
+ * .tx files with maketx. */
+
+struct TextureCacheThreadData {
+	OIIO::TextureSystem::Perthread *thread_info;
+};
+
+class TextureCache {
+public:
+	struct Stats {
+		Stats() : lookups(0), misses(0), memory_used(0), bytes_read(0) {}
+
+		/* tile lookups and lookups which had to read the tile from disk */
+		int64_t lookups;
+		int64_t misses;
+		int64_t memory_used;
+		int64_t bytes_read;
+	};
+
+	TextureCache();
+	~TextureCache();
+
+	/* Memory limit in megabytes, zero for the texture system default. */
+	void set_memory_limit(int limit_mb);
+
+	void add_image(int flat_slot,
+	               const string& filename,
+	               InterpolationType interpolation,
+	               ExtensionType extension);
+	void remove_image(int flat_slot);
+
+	bool lookup(TextureCacheThreadData *tdata,
+	            int flat_slot,
+	            float s, float t,
+	            float dsdx, float dtdx,
+	            float dsdy, float dtdy,
+	            float4 *result);
+
+	void thread_init(KernelGlobals *kg);
+	void thread_free(KernelGlobals *kg);
+
+	Stats get_stats();
+	string get_stats_report();
+
+protected:
+	struct Image {
+		OIIO::ustring filename;
+		OIIO::TextureSystem::TextureHandle *handle;
+		OIIO::TextureOpt options;
+	};
+
+	void system_init();
+
+	OIIO::TextureSystem *ts;
+	thread_mutex ts_mutex;
+	vector<Image*> images;
+	int memory_limit;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __KERNEL_TEXTURE_CACHE_H__ */
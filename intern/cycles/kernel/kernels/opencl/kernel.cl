@@ -35,6 +35,7 @@
 #  include "../../kernel_differential.h"
 #  include "../../kernel_montecarlo.h"
 #  include "../../kernel_projection.h"
+#  include "../../kernel_profiling.h"
 #  include "../../geom/geom.h"
 #  include "../../bvh/bvh.h"
 
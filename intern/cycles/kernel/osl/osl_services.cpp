@@ -46,6 +46,7 @@
 #include "kernel_montecarlo.h"
 #include "kernel_camera.h"
 #include "kernels/cpu/kernel_cpu_image.h"
+#include "kernel_profiling.h"
 #include "geom/geom.h"
 #include "bvh/bvh.h"
 
@@ -221,6 +221,7 @@ ccl_device void kernel_data_init(
 			float4 L_rad = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
 			/* Accumulate result in output buffer. */
 			kernel_write_pass_float4(per_sample_output_buffers, my_sample, L_rad);
+			kernel_write_adaptive_passes(kg, per_sample_output_buffers, my_sample, L_rad);
 			path_rng_end(kg, rng_state, rng_coop[ray_index]);
 			ASSIGN_RAY_STATE(ray_state, ray_index, RAY_TO_REGENERATE);
 		}
@@ -30,6 +30,7 @@
 #include "kernel_montecarlo.h"
 #include "kernel_differential.h"
 #include "kernel_camera.h"
+#include "kernel_profiling.h"
 
 #include "geom/geom.h"
 #include "bvh/bvh.h"
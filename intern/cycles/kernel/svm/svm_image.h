@@ -29,15 +29,17 @@ CCL_NAMESPACE_BEGIN
 #  define TEX_NUM_FLOAT4_IMAGES	TEX_NUM_FLOAT4_OPENCL
 #endif
 
-ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, uint srgb, uint use_alpha)
+/* Derivatives of the texture coordinate are only used by the texture cache
+ * on the CPU, to pick a mipmap level. */
+ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, float2 dx, float2 dy, uint srgb, uint use_alpha)
 {
 #ifdef __KERNEL_CPU__
 #  ifdef __KERNEL_SSE2__
 	ssef r_ssef;
 	float4 &r = (float4 &)r_ssef;
-	r = kernel_tex_image_interp(id, x, y);
+	r = kernel_tex_image_interp_d(id, x, y, dx, dy);
 #  else
-	float4 r = kernel_tex_image_interp(id, x, y);
+	float4 r = kernel_tex_image_interp_d(id, x, y, dx, dy);
 #  endif
 #elif defined(__KERNEL_OPENCL__)
 	float4 r = kernel_tex_image_interp(kg, id, x, y);
@@ -206,28 +208,43 @@ ccl_device_inline float3 texco_remap_square(float3 co)
 	return (co - make_float3(0.5f, 0.5f, 0.5f)) * 2.0f;
 }
 
+ccl_device float2 svm_image_projection(float3 co, uint projection)
+{
+	if(projection == NODE_IMAGE_PROJ_SPHERE) {
+		co = texco_remap_square(co);
+		return map_to_sphere(co);
+	}
+	else if(projection == NODE_IMAGE_PROJ_TUBE) {
+		co = texco_remap_square(co);
+		return map_to_tube(co);
+	}
+	else {
+		return make_float2(co.x, co.y);
+	}
+}
+
 ccl_device void svm_node_tex_image(KernelGlobals *kg, ShaderData *sd, float *stack, uint4 node)
 {
 	uint id = node.y;
 	uint co_offset, out_offset, alpha_offset, srgb;
+	uint projection, dx_offset, dy_offset, unused;
 
 	decode_node_uchar4(node.z, &co_offset, &out_offset, &alpha_offset, &srgb);
+	decode_node_uchar4(node.w, &projection, &dx_offset, &dy_offset, &unused);
 
 	float3 co = stack_load_float3(stack, co_offset);
-	float2 tex_co;
+	float2 tex_co = svm_image_projection(co, projection);
+	float2 tex_dx = make_float2(0.0f, 0.0f);
+	float2 tex_dy = make_float2(0.0f, 0.0f);
 	uint use_alpha = stack_valid(alpha_offset);
-	if(node.w == NODE_IMAGE_PROJ_SPHERE) {
-		co = texco_remap_square(co);
-		tex_co = map_to_sphere(co);
-	}
-	else if(node.w == NODE_IMAGE_PROJ_TUBE) {
-		co = texco_remap_square(co);
-		tex_co = map_to_tube(co);
-	}
-	else {
-		tex_co = make_float2(co.x, co.y);
+
+	/* texture coordinates at positions shifted by ray differentials */
+	if(stack_valid(dx_offset)) {
+		tex_dx = svm_image_projection(stack_load_float3(stack, dx_offset), projection) - tex_co;
+		tex_dy = svm_image_projection(stack_load_float3(stack, dy_offset), projection) - tex_co;
 	}
-	float4 f = svm_image_texture(kg, id, tex_co.x, tex_co.y, srgb, use_alpha);
+
+	float4 f = svm_image_texture(kg, id, tex_co.x, tex_co.y, tex_dx, tex_dy, srgb, use_alpha);
 
 	if(stack_valid(out_offset))
 		stack_store_float3(stack, out_offset, make_float3(f.x, f.y, f.z));
@@ -311,14 +328,15 @@ ccl_device void svm_node_tex_image_box(KernelGlobals *kg, ShaderData *sd, float
 	uint id = node.y;
 
 	float4 f = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+	float2 zero = make_float2(0.0f, 0.0f);
 	uint use_alpha = stack_valid(alpha_offset);
 
 	if(weight.x > 0.0f)
-		f += weight.x*svm_image_texture(kg, id, co.y, co.z, srgb, use_alpha);
+		f += weight.x*svm_image_texture(kg, id, co.y, co.z, zero, zero, srgb, use_alpha);
 	if(weight.y > 0.0f)
-		f += weight.y*svm_image_texture(kg, id, co.x, co.z, srgb, use_alpha);
+		f += weight.y*svm_image_texture(kg, id, co.x, co.z, zero, zero, srgb, use_alpha);
 	if(weight.z > 0.0f)
-		f += weight.z*svm_image_texture(kg, id, co.y, co.x, srgb, use_alpha);
+		f += weight.z*svm_image_texture(kg, id, co.y, co.x, zero, zero, srgb, use_alpha);
 
 	if(stack_valid(out_offset))
 		stack_store_float3(stack, out_offset, make_float3(f.x, f.y, f.z));
@@ -344,8 +362,9 @@ ccl_device void svm_node_tex_environment(KernelGlobals *kg, ShaderData *sd, floa
 	else
 		uv = direction_to_mirrorball(co);
 
+	float2 zero = make_float2(0.0f, 0.0f);
 	uint use_alpha = stack_valid(alpha_offset);
-	float4 f = svm_image_texture(kg, id, uv.x, uv.y, srgb, use_alpha);
+	float4 f = svm_image_texture(kg, id, uv.x, uv.y, zero, zero, srgb, use_alpha);
 
 	if(stack_valid(out_offset))
 		stack_store_float3(stack, out_offset, make_float3(f.x, f.y, f.z));
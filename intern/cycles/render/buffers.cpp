@@ -43,6 +43,7 @@ BufferParams::BufferParams()
 	full_height = 0;
 
 	Pass::add(PASS_COMBINED, passes);
+	denoising_data_pass = false;
 }
 
 void BufferParams::get_offset_stride(int& offset, int& stride)
@@ -59,10 +60,21 @@ bool BufferParams::modified(const BufferParams& params)
 		&& height == params.height
 		&& full_width == params.full_width
 		&& full_height == params.full_height
-		&& Pass::equals(passes, params.passes));
+		&& Pass::equals(passes, params.passes)
+		&& denoising_data_pass == params.denoising_data_pass);
 }
 
 int BufferParams::get_passes_size()
+{
+	int size = get_denoising_offset();
+
+	if(denoising_data_pass)
+		size += DENOISING_PASS_SIZE;
+
+	return size;
+}
+
+int BufferParams::get_denoising_offset()
 {
 	int size = 0;
 
@@ -89,6 +101,9 @@ RenderTile::RenderTile()
 	offset = 0;
 	stride = 0;
 
+	tile_index = 0;
+	converged = false;
+
 	buffer = 0;
 	rng_state = 0;
 
@@ -148,6 +163,36 @@ bool RenderBuffers::copy_from_device()
 	return true;
 }
 
+/* With adaptive sampling pixels stop accumulating samples once converged,
+ * so filtered passes are normalized by the sample count of each pixel. */
+static float *adaptive_sample_count(BufferParams& params, float *buffer)
+{
+	int pass_offset = 0;
+
+	for(size_t j = 0; j < params.passes.size(); j++) {
+		Pass& pass = params.passes[j];
+
+		if(pass.type == PASS_ADAPTIVE_AUX)
+			return buffer + pass_offset + 2;
+
+		pass_offset += pass.components;
+	}
+
+	return NULL;
+}
+
+static inline float pixel_sample_scale(const float *in_count, int i, int pass_stride, float scale)
+{
+	if(in_count) {
+		float num_samples = in_count[i*pass_stride];
+
+		if(num_samples > 0.0f)
+			return 1.0f/num_samples;
+	}
+
+	return scale;
+}
+
 bool RenderBuffers::get_pass_rect(PassType type, float exposure, int sample, int components, float *pixels)
 {
 	int pass_offset = 0;
@@ -164,7 +209,8 @@ bool RenderBuffers::get_pass_rect(PassType type, float exposure, int sample, int
 		int pass_stride = params.get_passes_size();
 
 		float scale = (pass.filter)? 1.0f/(float)sample: 1.0f;
-		float scale_exposure = (pass.exposure)? scale*exposure: scale;
+		float pass_exposure = (pass.exposure)? exposure: 1.0f;
+		float *in_count = (pass.filter)? adaptive_sample_count(params, (float*)buffer.data_pointer): NULL;
 
 		int size = params.width*params.height;
 
@@ -175,33 +221,35 @@ bool RenderBuffers::get_pass_rect(PassType type, float exposure, int sample, int
 			if(type == PASS_DEPTH) {
 				for(int i = 0; i < size; i++, in += pass_stride, pixels++) {
 					float f = *in;
-					pixels[0] = (f == 0.0f)? 1e10f: f*scale_exposure;
+					pixels[0] = (f == 0.0f)? 1e10f: f*scale*pass_exposure;
 				}
 			}
 			else if(type == PASS_MIST) {
 				for(int i = 0; i < size; i++, in += pass_stride, pixels++) {
 					float f = *in;
-					pixels[0] = saturate(f*scale_exposure);
+					float pixel_scale = pixel_sample_scale(in_count, i, pass_stride, scale);
+					pixels[0] = saturate(f*pixel_scale*pass_exposure);
 				}
 			}
 #ifdef WITH_CYCLES_DEBUG
 			else if(type == PASS_BVH_TRAVERSAL_STEPS) {
 				for(int i = 0; i < size; i++, in += pass_stride, pixels++) {
 					float f = *in;
-					pixels[0] = f*scale;
+					pixels[0] = f*pixel_sample_scale(in_count, i, pass_stride, scale);
 				}
 			}
 			else if(type == PASS_RAY_BOUNCES) {
 				for(int i = 0; i < size; i++, in += pass_stride, pixels++) {
 					float f = *in;
-					pixels[0] = f*scale;
+					pixels[0] = f*pixel_sample_scale(in_count, i, pass_stride, scale);
 				}
 			}
 #endif
 			else {
 				for(int i = 0; i < size; i++, in += pass_stride, pixels++) {
 					float f = *in;
-					pixels[0] = f*scale_exposure;
+					float pixel_scale = pixel_sample_scale(in_count, i, pass_stride, scale);
+					pixels[0] = f*pixel_scale*pass_exposure;
 				}
 			}
 		}
@@ -246,10 +294,12 @@ bool RenderBuffers::get_pass_rect(PassType type, float exposure, int sample, int
 				/* RGB/vector */
 				for(int i = 0; i < size; i++, in += pass_stride, pixels += 3) {
 					float3 f = make_float3(in[0], in[1], in[2]);
+					float pixel_scale = pixel_sample_scale(in_count, i, pass_stride, scale);
+					float pixel_scale_exposure = pixel_scale*pass_exposure;
 
-					pixels[0] = f.x*scale_exposure;
-					pixels[1] = f.y*scale_exposure;
-					pixels[2] = f.z*scale_exposure;
+					pixels[0] = f.x*pixel_scale_exposure;
+					pixels[1] = f.y*pixel_scale_exposure;
+					pixels[2] = f.z*pixel_scale_exposure;
 				}
 			}
 		}
@@ -294,13 +344,15 @@ bool RenderBuffers::get_pass_rect(PassType type, float exposure, int sample, int
 			else {
 				for(int i = 0; i < size; i++, in += pass_stride, pixels += 4) {
 					float4 f = make_float4(in[0], in[1], in[2], in[3]);
+					float pixel_scale = pixel_sample_scale(in_count, i, pass_stride, scale);
+					float pixel_scale_exposure = pixel_scale*pass_exposure;
 
-					pixels[0] = f.x*scale_exposure;
-					pixels[1] = f.y*scale_exposure;
-					pixels[2] = f.z*scale_exposure;
+					pixels[0] = f.x*pixel_scale_exposure;
+					pixels[1] = f.y*pixel_scale_exposure;
+					pixels[2] = f.z*pixel_scale_exposure;
 
 					/* clamp since alpha might be > 1.0 due to russian roulette */
-					pixels[3] = saturate(f.w*scale);
+					pixels[3] = saturate(f.w*pixel_scale);
 				}
 			}
 		}
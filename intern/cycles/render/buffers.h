@@ -51,6 +51,8 @@ public:
 
 	/* passes */
 	array<Pass> passes;
+	/* feature data for the denoiser, after the passes */
+	bool denoising_data_pass;
 
 	/* functions */
 	BufferParams();
@@ -59,6 +61,7 @@ public:
 	bool modified(const BufferParams& params);
 	void add_pass(PassType type);
 	int get_passes_size();
+	int get_denoising_offset();
 };
 
 /* Render Buffers */
@@ -139,6 +142,11 @@ public:
 	int offset;
 	int stride;
 
+	/* index of the tile in the tile manager, and whether all of its pixels
+	 * converged with adaptive sampling */
+	int tile_index;
+	bool converged;
+
 	device_ptr buffer;
 	device_ptr rng_state;
 
@@ -0,0 +1,342 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "checkpoint.h"
+
+#include "util_foreach.h"
+#include "util_logging.h"
+#include "util_path.h"
+
+CCL_NAMESPACE_BEGIN
+
+#define CHECKPOINT_MAGIC 0x4b435943  /* "CYCK" */
+#define CHECKPOINT_VERSION 2
+
+/* File Helpers */
+
+static bool write_int(FILE *f, int value)
+{
+	return fwrite(&value, sizeof(value), 1, f) == 1;
+}
+
+static bool read_int(FILE *f, int *value)
+{
+	return fread(value, sizeof(*value), 1, f) == 1;
+}
+
+template<typename T>
+static bool write_array(FILE *f, const T *data, size_t size)
+{
+	return (size == 0) || fwrite(data, sizeof(T), size, f) == size;
+}
+
+template<typename T>
+static bool read_array(FILE *f, T *data, size_t size)
+{
+	return (size == 0) || fread(data, sizeof(T), size, f) == size;
+}
+
+/* Render Checkpoint */
+
+RenderCheckpoint::RenderCheckpoint()
+{
+	tile_size = make_int2(0, 0);
+	start_sample = 0;
+	num_samples = 0;
+	seed = 0;
+	progressive = false;
+	sample = 0;
+
+	file = NULL;
+}
+
+RenderCheckpoint::~RenderCheckpoint()
+{
+	end();
+}
+
+bool RenderCheckpoint::read(const string& filepath)
+{
+	tiles.clear();
+
+	FILE *f = path_fopen(filepath, "rb");
+	if(!f)
+		return false;
+
+	/* header */
+	int magic, version;
+	BufferParams read_params;
+	int2 read_tile_size;
+	int read_start_sample, read_num_samples, read_seed, read_progressive;
+	int read_sample, num_passes, num_converged, read_denoising;
+
+	bool ok = read_int(f, &magic) && read_int(f, &version) &&
+	          magic == CHECKPOINT_MAGIC && version == CHECKPOINT_VERSION &&
+	          read_int(f, &read_params.width) && read_int(f, &read_params.height) &&
+	          read_int(f, &read_params.full_x) && read_int(f, &read_params.full_y) &&
+	          read_int(f, &read_params.full_width) && read_int(f, &read_params.full_height) &&
+	          read_int(f, &num_passes);
+
+	read_params.passes.clear();
+	for(int i = 0; ok && i < num_passes; i++) {
+		int type;
+		ok = read_int(f, &type);
+		if(ok)
+			Pass::add((PassType)type, read_params.passes);
+	}
+
+	ok = ok && read_int(f, &read_denoising);
+	read_params.denoising_data_pass = (read_denoising != 0);
+
+	ok = ok && read_int(f, &read_tile_size.x) && read_int(f, &read_tile_size.y) &&
+	     read_int(f, &read_start_sample) && read_int(f, &read_num_samples) &&
+	     read_int(f, &read_seed) && read_int(f, &read_progressive) &&
+	     read_int(f, &read_sample) && read_int(f, &num_converged);
+
+	if(!ok) {
+		VLOG(1) << "Invalid render checkpoint " << filepath << ".";
+		fclose(f);
+		return false;
+	}
+
+	if(read_params.modified(params) ||
+	   !(read_tile_size == tile_size) ||
+	   read_start_sample != start_sample ||
+	   read_num_samples != num_samples ||
+	   (uint)read_seed != seed ||
+	   (read_progressive != 0) != progressive)
+	{
+		VLOG(1) << "Render checkpoint " << filepath << " is of a different render.";
+		fclose(f);
+		return false;
+	}
+
+	sample = read_sample;
+
+	vector<uchar> converged(max(num_converged, 0));
+	if(!converged.empty() && !read_array(f, &converged[0], converged.size())) {
+		fclose(f);
+		return false;
+	}
+
+	converged_tiles.clear();
+	foreach(uchar c, converged)
+		converged_tiles.push_back(c != 0);
+
+	/* tiles, until the end of the file */
+	int pass_stride = params.get_passes_size();
+
+	while(true) {
+		Tile tile;
+
+		if(!(read_int(f, &tile.index) &&
+		     read_int(f, &tile.x) && read_int(f, &tile.y) &&
+		     read_int(f, &tile.w) && read_int(f, &tile.h) &&
+		     read_int(f, &tile.num_samples)))
+		{
+			break;
+		}
+
+		/* tile must be inside the buffers */
+		if(tile.w <= 0 || tile.h <= 0 ||
+		   tile.x < params.full_x || tile.x + tile.w > params.full_x + params.width ||
+		   tile.y < params.full_y || tile.y + tile.h > params.full_y + params.height)
+		{
+			VLOG(1) << "Invalid tile in render checkpoint " << filepath << ".";
+			break;
+		}
+
+		size_t num_pixels = (size_t)tile.w*tile.h;
+		tile.buffer.resize(num_pixels*pass_stride);
+		tile.rng_state.resize(num_pixels);
+
+		if(!(read_array(f, &tile.buffer[0], tile.buffer.size()) &&
+		     read_array(f, &tile.rng_state[0], tile.rng_state.size())))
+		{
+			/* interrupted while writing this tile */
+			break;
+		}
+
+		tiles.push_back(tile);
+	}
+
+	fclose(f);
+
+	VLOG(1) << "Read render checkpoint " << filepath << " with "
+	        << tiles.size() << " tiles.";
+
+	return true;
+}
+
+bool RenderCheckpoint::begin(const string& filepath_, bool atomic)
+{
+	end();
+
+	filepath = filepath_;
+	write_filepath = (atomic)? filepath + ".tmp": filepath;
+
+	file = path_fopen(write_filepath, "wb");
+	if(!file) {
+		VLOG(1) << "Failed to open render checkpoint " << write_filepath << " for writing.";
+		return false;
+	}
+
+	bool ok = write_int(file, CHECKPOINT_MAGIC) && write_int(file, CHECKPOINT_VERSION) &&
+	          write_int(file, params.width) && write_int(file, params.height) &&
+	          write_int(file, params.full_x) && write_int(file, params.full_y) &&
+	          write_int(file, params.full_width) && write_int(file, params.full_height) &&
+	          write_int(file, params.passes.size());
+
+	for(size_t i = 0; ok && i < params.passes.size(); i++)
+		ok = write_int(file, params.passes[i].type);
+
+	ok = ok && write_int(file, params.denoising_data_pass);
+
+	ok = ok && write_int(file, tile_size.x) && write_int(file, tile_size.y) &&
+	     write_int(file, start_sample) && write_int(file, num_samples) &&
+	     write_int(file, seed) && write_int(file, progressive) &&
+	     write_int(file, sample) && write_int(file, converged_tiles.size());
+
+	vector<uchar> converged;
+	foreach(bool c, converged_tiles)
+		converged.push_back(c);
+
+	ok = ok && (converged.empty() || write_array(file, &converged[0], converged.size()));
+
+	if(!ok || fflush(file) != 0) {
+		VLOG(1) << "Failed to write render checkpoint " << write_filepath << ".";
+		fclose(file);
+		file = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+bool RenderCheckpoint::append(const string& filepath_)
+{
+	end();
+
+	filepath = filepath_;
+	write_filepath = filepath;
+
+	file = path_fopen(write_filepath, "ab");
+	if(!file) {
+		VLOG(1) << "Failed to open render checkpoint " << write_filepath << " for appending.";
+		return false;
+	}
+
+	return true;
+}
+
+bool RenderCheckpoint::add_tile(const Tile& tile)
+{
+	if(!file)
+		return false;
+
+	bool ok = write_int(file, tile.index) &&
+	          write_int(file, tile.x) && write_int(file, tile.y) &&
+	          write_int(file, tile.w) && write_int(file, tile.h) &&
+	          write_int(file, tile.num_samples) &&
+	          write_array(file, &tile.buffer[0], tile.buffer.size()) &&
+	          write_array(file, &tile.rng_state[0], tile.rng_state.size());
+
+	/* finished tiles must survive the process being killed */
+	if(!ok || fflush(file) != 0) {
+		VLOG(1) << "Failed to write render checkpoint " << write_filepath << ".";
+		fclose(file);
+		file = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+bool RenderCheckpoint::add_tile(RenderBuffers *buffers, int index, int x, int y, int w, int h, int num_samples)
+{
+	BufferParams& buffer_params = buffers->params;
+	int pass_stride = buffer_params.get_passes_size();
+
+	Tile tile;
+	tile.index = index;
+	tile.x = x;
+	tile.y = y;
+	tile.w = w;
+	tile.h = h;
+	tile.num_samples = num_samples;
+	tile.buffer.resize((size_t)w*h*pass_stride);
+	tile.rng_state.resize((size_t)w*h);
+
+	const float *buffer = (float*)buffers->buffer.data_pointer;
+	const uint *rng_state = (uint*)buffers->rng_state.data_pointer;
+
+	for(int j = 0; j < h; j++) {
+		size_t in = (size_t)(y - buffer_params.full_y + j)*buffer_params.width + (x - buffer_params.full_x);
+		size_t out = (size_t)j*w;
+
+		memcpy(&tile.buffer[out*pass_stride], buffer + in*pass_stride, sizeof(float)*w*pass_stride);
+		memcpy(&tile.rng_state[out], rng_state + in, sizeof(uint)*w);
+	}
+
+	return add_tile(tile);
+}
+
+bool RenderCheckpoint::end()
+{
+	if(!file)
+		return false;
+
+	fclose(file);
+	file = NULL;
+
+	if(write_filepath != filepath && !path_rename(write_filepath, filepath)) {
+		VLOG(1) << "Failed to replace render checkpoint " << filepath << ".";
+		return false;
+	}
+
+	return true;
+}
+
+void RenderCheckpoint::copy_to_buffers(const Tile& tile, RenderBuffers *buffers)
+{
+	BufferParams& buffer_params = buffers->params;
+	int pass_stride = buffer_params.get_passes_size();
+
+	float *buffer = (float*)buffers->buffer.data_pointer;
+	uint *rng_state = (uint*)buffers->rng_state.data_pointer;
+
+	for(int j = 0; j < tile.h; j++) {
+		size_t out = (size_t)(tile.y - buffer_params.full_y + j)*buffer_params.width + (tile.x - buffer_params.full_x);
+		size_t in = (size_t)j*tile.w;
+
+		memcpy(buffer + out*pass_stride, &tile.buffer[in*pass_stride], sizeof(float)*tile.w*pass_stride);
+		memcpy(rng_state + out, &tile.rng_state[in], sizeof(uint)*tile.w);
+	}
+}
+
+const RenderCheckpoint::Tile *RenderCheckpoint::find_tile(int index) const
+{
+	foreach(const Tile& tile, tiles) {
+		if(tile.index == index)
+			return &tile;
+	}
+
+	return NULL;
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <stdio.h>
+
+#include "buffers.h"
+
+#include "util_string.h"
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Render Checkpoint
+ *
+ * Accumulated render buffers and random number generator state written to
+ * disk, so an interrupted background render can continue where it stopped.
+ *
+ * Without progressive rendering, every finished tile is appended to the file
+ * as soon as it is done. With progressive rendering the whole image is written
+ * after a number of samples, replacing the previous checkpoint. Since the
+ * buffers hold the exact sums and RNG state, resuming gives the same result as
+ * an uninterrupted render. */
+
+class RenderCheckpoint {
+public:
+	struct Tile {
+		/* index in the tile manager, -1 for part of a full frame buffer */
+		int index;
+		int x, y, w, h;
+		/* number of samples accumulated in the buffer */
+		int num_samples;
+
+		vector<float> buffer;
+		vector<uint> rng_state;
+	};
+
+	/* Identification of the render, a checkpoint is only resumed when all of
+	 * these match the current render. */
+	BufferParams params;
+	int2 tile_size;
+	int start_sample;
+	int num_samples;
+	uint seed;
+	bool progressive;
+
+	/* progressive: first sample that still needs to be rendered, and tiles
+	 * that converged with adaptive sampling */
+	int sample;
+	vector<bool> converged_tiles;
+
+	/* tiles read from the file */
+	vector<Tile> tiles;
+
+	RenderCheckpoint();
+	~RenderCheckpoint();
+
+	/* Read a checkpoint of the same render, returns false if the file does not
+	 * exist, is of a different render or damaged. A trailing tile that was only
+	 * partially written is ignored. */
+	bool read(const string& filepath);
+
+	/* Write the header, followed by tiles. With atomic the file is written to a
+	 * temporary path and only replaces the previous checkpoint in end(). */
+	bool begin(const string& filepath, bool atomic);
+	/* Continue adding tiles at the end of a complete checkpoint written before. */
+	bool append(const string& filepath);
+	bool add_tile(const Tile& tile);
+	bool add_tile(RenderBuffers *buffers, int index, int x, int y, int w, int h, int num_samples);
+	bool end();
+
+	/* Restore a tile into the host memory of the buffers, the caller copies the
+	 * buffers to the device. */
+	static void copy_to_buffers(const Tile& tile, RenderBuffers *buffers);
+
+	const Tile *find_tile(int index) const;
+
+protected:
+	FILE *file;
+	string filepath;
+	string write_filepath;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __CHECKPOINT_H__ */
@@ -0,0 +1,302 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "denoising.h"
+
+#include "buffers.h"
+#include "device.h"
+
+#include "util_foreach.h"
+#include "util_math.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Color of pixels without data, far away from any rendered color so they get
+ * no weight in the filter. */
+#define DENOISE_MISSING_COLOR 1e6f
+
+/* Prefilter */
+
+static bool pixel_missing(const float *color, int p)
+{
+	return color[p] == DENOISE_MISSING_COLOR;
+}
+
+/* Mean and variance of the mean of a feature with three channels, where the
+ * fourth component of the data holds the sum of the squared lengths. */
+static void prefilter_feature3(const float *in, float inv_hits, float var_scale,
+                               float *feature, float *variance, int pass_stride)
+{
+	float3 mean = make_float3(in[0], in[1], in[2])*inv_hits;
+	float var = max(in[3]*inv_hits - dot(mean, mean), 0.0f)*(1.0f/3.0f);
+
+	feature[0] = mean.x;
+	feature[pass_stride] = mean.y;
+	feature[2*pass_stride] = mean.z;
+	*variance = var*var_scale;
+}
+
+static void prefilter_pixel(const float *in, float *out, int pass_stride)
+{
+	float num_samples = in[DENOISING_PASS_COLOR + 3];
+
+	if(num_samples <= 0.0f)
+		return;
+
+	/* variance of the mean, from the sample variance */
+	float inv_samples = 1.0f/num_samples;
+	float var_scale = 1.0f/max(num_samples - 1.0f, 1.0f);
+
+	for(int c = 0; c < 3; c++) {
+		float mean = in[DENOISING_PASS_COLOR + c]*inv_samples;
+		float var = max(in[DENOISING_PASS_COLOR_SQ + c]*inv_samples - mean*mean, 0.0f);
+
+		out[(DENOISE_PLANE_COLOR + c)*pass_stride] = mean;
+		out[(DENOISE_PLANE_COLOR_VAR + c)*pass_stride] = var*var_scale;
+	}
+
+	/* features are left zero for pixels that only see the background */
+	float num_hits = in[DENOISING_PASS_DEPTH + 2];
+
+	if(num_hits <= 0.0f)
+		return;
+
+	float inv_hits = 1.0f/num_hits;
+	float hit_var_scale = 1.0f/max(num_hits - 1.0f, 1.0f);
+
+	prefilter_feature3(in + DENOISING_PASS_NORMAL, inv_hits, hit_var_scale,
+	                   out + DENOISE_PLANE_NORMAL*pass_stride,
+	                   out + DENOISE_PLANE_FEATURE_VAR*pass_stride,
+	                   pass_stride);
+	prefilter_feature3(in + DENOISING_PASS_ALBEDO, inv_hits, hit_var_scale,
+	                   out + DENOISE_PLANE_ALBEDO*pass_stride,
+	                   out + (DENOISE_PLANE_FEATURE_VAR + 1)*pass_stride,
+	                   pass_stride);
+
+	float depth = in[DENOISING_PASS_DEPTH]*inv_hits;
+	float depth_var = max(in[DENOISING_PASS_DEPTH + 1]*inv_hits - depth*depth, 0.0f);
+
+	out[DENOISE_PLANE_DEPTH*pass_stride] = depth;
+	out[(DENOISE_PLANE_FEATURE_VAR + 2)*pass_stride] = depth_var*hit_var_scale;
+}
+
+/* Squared gradient of a feature with central differences, one sided next to
+ * pixels without data. */
+static float feature_gradient(const float *feature, int channels, const float *color,
+                              int x, int y, int width, int height, int stride, int pass_stride)
+{
+	int p = y*stride + x;
+	int x0 = (x > 0 && !pixel_missing(color, p - 1))? x - 1: x;
+	int x1 = (x < width - 1 && !pixel_missing(color, p + 1))? x + 1: x;
+	int y0 = (y > 0 && !pixel_missing(color, p - stride))? y - 1: y;
+	int y1 = (y < height - 1 && !pixel_missing(color, p + stride))? y + 1: y;
+
+	float gradient = 0.0f;
+
+	for(int c = 0; c < channels; c++) {
+		const float *f = feature + c*pass_stride;
+		float dx = (x1 > x0)? (f[y*stride + x1] - f[y*stride + x0])/(x1 - x0): 0.0f;
+		float dy = (y1 > y0)? (f[y1*stride + x] - f[y0*stride + x])/(y1 - y0): 0.0f;
+
+		gradient += dx*dx + dy*dy;
+	}
+
+	return gradient/channels;
+}
+
+/* Denoiser */
+
+Denoiser::Denoiser(Device *device_, const DenoiseParams& params_)
+: device(device_), params(params_)
+{
+}
+
+void Denoiser::prefilter(float *planes, int4 window, int stride, const vector<RenderBuffers*>& buffers)
+{
+	const int pass_stride = stride*window.w;
+	float *color = planes + DENOISE_PLANE_COLOR*pass_stride;
+
+	for(int c = 0; c < 3; c++) {
+		float *color_c = color + c*pass_stride;
+
+		for(int i = 0; i < pass_stride; i++)
+			color_c[i] = DENOISE_MISSING_COLOR;
+	}
+
+	/* mean and variance from the accumulated feature data */
+	foreach(RenderBuffers *render_buffers, buffers) {
+		BufferParams& buffer_params = render_buffers->params;
+
+		if(!buffer_params.denoising_data_pass)
+			continue;
+
+		int x0 = max(window.x, buffer_params.full_x);
+		int y0 = max(window.y, buffer_params.full_y);
+		int x1 = min(window.x + window.z, buffer_params.full_x + buffer_params.width);
+		int y1 = min(window.y + window.w, buffer_params.full_y + buffer_params.height);
+
+		int buffer_stride = buffer_params.get_passes_size();
+		int data_offset = buffer_params.get_denoising_offset();
+		const float *data = (const float*)render_buffers->buffer.data_pointer;
+
+		for(int y = y0; y < y1; y++) {
+			for(int x = x0; x < x1; x++) {
+				int index = (y - buffer_params.full_y)*buffer_params.width + (x - buffer_params.full_x);
+				int p = (y - window.y)*stride + (x - window.x);
+
+				prefilter_pixel(data + index*buffer_stride + data_offset, planes + p, pass_stride);
+			}
+		}
+	}
+
+	/* variance estimates from few samples are noisy, average them over the
+	 * neighboring pixels */
+	vector<float> variance(pass_stride);
+
+	for(int c = 0; c < 3; c++) {
+		float *color_var = planes + (DENOISE_PLANE_COLOR_VAR + c)*pass_stride;
+
+		memcpy(&variance[0], color_var, sizeof(float)*pass_stride);
+
+		for(int y = 0; y < window.w; y++) {
+			for(int x = 0; x < window.z; x++) {
+				int p = y*stride + x;
+
+				if(pixel_missing(color, p))
+					continue;
+
+				float sum = 0.0f;
+				int num = 0;
+
+				for(int ny = max(y - 1, 0); ny <= min(y + 1, window.w - 1); ny++) {
+					for(int nx = max(x - 1, 0); nx <= min(x + 1, window.z - 1); nx++) {
+						int q = ny*stride + nx;
+
+						if(!pixel_missing(color, q)) {
+							sum += variance[q];
+							num++;
+						}
+					}
+				}
+
+				color_var[p] = sum/num;
+			}
+		}
+	}
+
+	/* squared gradients of the features */
+	const int feature_plane[DENOISE_NUM_FEATURES] = {DENOISE_PLANE_NORMAL,
+	                                                 DENOISE_PLANE_ALBEDO,
+	                                                 DENOISE_PLANE_DEPTH};
+	const int feature_channels[DENOISE_NUM_FEATURES] = {3, 3, 1};
+
+	for(int j = 0; j < DENOISE_NUM_FEATURES; j++) {
+		const float *feature = planes + feature_plane[j]*pass_stride;
+		float *gradient = planes + (DENOISE_PLANE_FEATURE_GRAD + j)*pass_stride;
+
+		for(int y = 0; y < window.w; y++) {
+			for(int x = 0; x < window.z; x++) {
+				int p = y*stride + x;
+
+				if(!pixel_missing(color, p)) {
+					gradient[p] = feature_gradient(feature, feature_channels[j], color,
+					                               x, y, window.z, window.w,
+					                               stride, pass_stride);
+				}
+			}
+		}
+	}
+}
+
+void Denoiser::write_combined(RenderBuffers *target, int4 rect, const float *output, int4 window, int stride)
+{
+	BufferParams& buffer_params = target->params;
+	const int pass_stride = stride*window.w;
+
+	int combined_offset = 0;
+	for(size_t i = 0; i < buffer_params.passes.size(); i++) {
+		if(buffer_params.passes[i].type == PASS_COMBINED)
+			break;
+		combined_offset += buffer_params.passes[i].components;
+	}
+
+	int buffer_stride = buffer_params.get_passes_size();
+	int data_offset = buffer_params.get_denoising_offset();
+	float *data = (float*)target->buffer.data_pointer;
+
+	int x0 = max(rect.x, buffer_params.full_x);
+	int y0 = max(rect.y, buffer_params.full_y);
+	int x1 = min(rect.x + rect.z, buffer_params.full_x + buffer_params.width);
+	int y1 = min(rect.y + rect.w, buffer_params.full_y + buffer_params.height);
+
+	for(int y = y0; y < y1; y++) {
+		for(int x = x0; x < x1; x++) {
+			int index = (y - buffer_params.full_y)*buffer_params.width + (x - buffer_params.full_x);
+			int p = (y - window.y)*stride + (x - window.x);
+			float *pixel = data + index*buffer_stride;
+
+			/* the combined pass is a sum over the samples of the pixel */
+			float num_samples = pixel[data_offset + DENOISING_PASS_COLOR + 3];
+
+			if(num_samples <= 0.0f)
+				continue;
+
+			for(int c = 0; c < 3; c++)
+				pixel[combined_offset + c] = output[c*pass_stride + p]*num_samples;
+		}
+	}
+}
+
+bool Denoiser::denoise(RenderBuffers *target, int4 rect, const vector<RenderBuffers*>& buffers)
+{
+	if(!target->params.denoising_data_pass)
+		return false;
+
+	/* window with the pixels needed for the search window and the patches */
+	int border = params.radius + params.patch_radius;
+	int4 window = make_int4(rect.x - border, rect.y - border,
+	                        rect.z + 2*border, rect.w + 2*border);
+	int stride = align_up(window.z + DENOISE_ROW_PADDING, DENOISE_ROW_PADDING);
+	size_t pass_stride = (size_t)stride*window.w;
+
+	vector<float> planes(DENOISE_NUM_PLANES*pass_stride, 0.0f);
+	vector<float> output(4*pass_stride, 0.0f);
+
+	prefilter(&planes[0], window, stride, buffers);
+
+	DeviceDenoiseTask task;
+	task.buffer = (device_ptr)&planes[0];
+	task.output = (device_ptr)&output[0];
+	task.x = border;
+	task.y = border;
+	task.w = rect.z;
+	task.h = rect.w;
+	task.stride = stride;
+	task.height = window.w;
+	task.radius = params.radius;
+	task.patch_radius = params.patch_radius;
+	task.strength = params.strength;
+	task.feature_strength = params.feature_strength;
+
+	if(!device->denoise(task))
+		return false;
+
+	write_combined(target, rect, &output[0], window, stride);
+
+	return true;
+}
+
+CCL_NAMESPACE_END
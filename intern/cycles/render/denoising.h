@@ -0,0 +1,75 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DENOISING_H__
+#define __DENOISING_H__
+
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+class Device;
+class RenderBuffers;
+
+/* Denoising Parameters */
+
+class DenoiseParams {
+public:
+	/* radius of the search window and of the compared patches, in pixels */
+	int radius;
+	int patch_radius;
+	/* how much differences in color and features are tolerated */
+	float strength;
+	float feature_strength;
+
+	DenoiseParams()
+	{
+		radius = 8;
+		patch_radius = 3;
+		strength = 0.5f;
+		feature_strength = 0.5f;
+	}
+};
+
+/* Denoiser
+ *
+ * Filters the combined pass of render buffers with a feature guided non-local
+ * means filter, using the denoising data written by the kernel. The pixels
+ * around a tile are taken from the render buffers of the neighboring tiles,
+ * so tiles can be denoised while the rest of the image is rendered. */
+
+class Denoiser {
+public:
+	Denoiser(Device *device, const DenoiseParams& params);
+
+	/* Denoise rect (x, y, w, h) in full image coordinates of the target
+	 * buffers, with the feature data of the given buffers, which include the
+	 * target. Buffers are read on the host, as rendered by the CPU device.
+	 * Safe to call from multiple threads for different targets. */
+	bool denoise(RenderBuffers *target, int4 rect, const vector<RenderBuffers*>& buffers);
+
+protected:
+	void prefilter(float *planes, int4 window, int stride, const vector<RenderBuffers*>& buffers);
+	void write_combined(RenderBuffers *target, int4 rect, const float *output, int4 window, int stride);
+
+	Device *device;
+	DenoiseParams params;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __DENOISING_H__ */
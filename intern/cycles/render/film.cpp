@@ -153,6 +153,10 @@ void Pass::add(PassType type, array<Pass>& passes)
 			 */
 			pass.components = 0;
 			break;
+		case PASS_ADAPTIVE_AUX:
+			pass.components = 4;
+			pass.filter = false;
+			break;
 #ifdef WITH_CYCLES_DEBUG
 		case PASS_BVH_TRAVERSAL_STEPS:
 			pass.components = 1;
@@ -166,6 +170,11 @@ void Pass::add(PassType type, array<Pass>& passes)
 			pass.components = 1;
 			pass.exposure = false;
 			break;
+		case PASS_SAMPLE_COUNT:
+			pass.components = 1;
+			pass.filter = false;
+			pass.exposure = false;
+			break;
 #endif
 	}
 
@@ -283,6 +292,8 @@ NODE_DEFINE(Film)
 	SOCKET_FLOAT(mist_falloff, "Mist Falloff", 1.0f);
 
 	SOCKET_BOOLEAN(use_sample_clamp, "Use Sample Clamp", false);
+	SOCKET_BOOLEAN(use_adaptive_sampling, "Use Adaptive Sampling", false);
+	SOCKET_BOOLEAN(use_denoising_data, "Use Denoising Data", false);
 
 	return type;
 }
@@ -317,8 +328,15 @@ void Film::device_update(Device *device, DeviceScene *dscene, Scene *scene)
 	kfilm->pass_stride = 0;
 	kfilm->use_light_pass = use_light_visibility || use_sample_clamp;
 
-	for(size_t i = 0; i < passes.size(); i++) {
-		Pass& pass = passes[i];
+	/* passes used internally by the kernel, the session adds the same ones
+	 * to the render buffers so the layout matches */
+	array<Pass> kpasses = passes;
+
+	if(use_adaptive_sampling)
+		Pass::add(PASS_ADAPTIVE_AUX, kpasses);
+
+	for(size_t i = 0; i < kpasses.size(); i++) {
+		Pass& pass = kpasses[i];
 		kfilm->pass_flag |= pass.type;
 
 		switch(pass.type) {
@@ -420,6 +438,10 @@ void Film::device_update(Device *device, DeviceScene *dscene, Scene *scene)
 				kfilm->use_light_pass = 1;
 				break;
 
+			case PASS_ADAPTIVE_AUX:
+				kfilm->pass_adaptive_aux = kfilm->pass_stride;
+				break;
+
 #ifdef WITH_CYCLES_DEBUG
 			case PASS_BVH_TRAVERSAL_STEPS:
 				kfilm->pass_bvh_traversal_steps = kfilm->pass_stride;
@@ -430,6 +452,9 @@ void Film::device_update(Device *device, DeviceScene *dscene, Scene *scene)
 			case PASS_RAY_BOUNCES:
 				kfilm->pass_ray_bounces = kfilm->pass_stride;
 				break;
+			case PASS_SAMPLE_COUNT:
+				kfilm->pass_sample_count = kfilm->pass_stride;
+				break;
 #endif
 
 			case PASS_NONE:
@@ -440,6 +465,16 @@ void Film::device_update(Device *device, DeviceScene *dscene, Scene *scene)
 	}
 
 	kfilm->pass_stride = align_up(kfilm->pass_stride, 4);
+
+	/* feature data for the denoiser follows the aligned passes */
+	if(use_denoising_data) {
+		kfilm->pass_denoising_data = kfilm->pass_stride;
+		kfilm->pass_stride += DENOISING_PASS_SIZE;
+	}
+	else {
+		kfilm->pass_denoising_data = 0;
+	}
+
 	kfilm->pass_alpha_threshold = pass_alpha_threshold;
 
 	/* update filter table */
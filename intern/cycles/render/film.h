@@ -69,6 +69,8 @@ public:
 
 	bool use_light_visibility;
 	bool use_sample_clamp;
+	bool use_adaptive_sampling;
+	bool use_denoising_data;
 
 	bool need_update;
 
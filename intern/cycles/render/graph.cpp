@@ -16,13 +16,16 @@
 
 #include "attribute.h"
 #include "graph.h"
+#include "image.h"
 #include "nodes.h"
+#include "scene.h"
 #include "shader.h"
 #include "constant_fold.h"
 
 #include "util_algorithm.h"
 #include "util_debug.h"
 #include "util_foreach.h"
+#include "util_md5.h"
 #include "util_queue.h"
 #include "util_logging.h"
 
@@ -329,6 +332,9 @@ void ShaderGraph::finalize(Scene *scene,
 		if(do_bump)
 			bump_from_displacement(bump_in_object_space);
 
+		if(!do_osl && scene && scene->image_manager->use_texture_cache())
+			image_texture_differentials();
+
 		ShaderInput *surface_in = output()->input("Surface");
 		ShaderInput *volume_in = output()->input("Volume");
 
@@ -753,6 +759,65 @@ void ShaderGraph::default_inputs(bool do_osl)
 		add(texco);
 }
 
+void ShaderGraph::image_texture_differentials()
+{
+	/* the texture cache selects the mipmap level from the texture coordinate
+	 * differentials. like for bump nodes, we copy the sub-graph of the vector
+	 * input and shift it by dx/dy, so the image node can compute them. */
+
+	vector<ImageTextureNode*> image_nodes;
+
+	foreach(ShaderNode *node, nodes) {
+		if(node->type != ImageTextureNode::node_type)
+			continue;
+
+		ImageTextureNode *image_node = (ImageTextureNode*)node;
+
+		/* builtin images are not in the cache. nodes used for bump mapping
+		 * all sample the finest level, so the center and shifted lookups
+		 * stay consistent */
+		if(image_node->builtin_data != NULL ||
+		   image_node->projection != NODE_IMAGE_PROJ_FLAT ||
+		   image_node->bump != SHADER_BUMP_NONE ||
+		   !image_node->input("Vector")->link)
+		{
+			continue;
+		}
+
+		image_nodes.push_back(image_node);
+	}
+
+	foreach(ImageTextureNode *node, image_nodes) {
+		ShaderInput *vector_input = node->input("Vector");
+		ShaderNodeSet nodes_vector;
+
+		ShaderNodeMap nodes_dx;
+		ShaderNodeMap nodes_dy;
+
+		find_dependencies(nodes_vector, vector_input);
+
+		copy_nodes(nodes_vector, nodes_dx);
+		copy_nodes(nodes_vector, nodes_dy);
+
+		foreach(NodePair& pair, nodes_dx)
+			pair.second->bump = SHADER_BUMP_DX;
+		foreach(NodePair& pair, nodes_dy)
+			pair.second->bump = SHADER_BUMP_DY;
+
+		ShaderOutput *out = vector_input->link;
+		ShaderOutput *out_dx = nodes_dx[out->parent]->output(out->name());
+		ShaderOutput *out_dy = nodes_dy[out->parent]->output(out->name());
+
+		connect(out_dx, node->input("VectorDX"));
+		connect(out_dy, node->input("VectorDY"));
+
+		foreach(NodePair& pair, nodes_dx)
+			add(pair.second);
+		foreach(NodePair& pair, nodes_dy)
+			add(pair.second);
+	}
+}
+
 void ShaderGraph::refine_bump_nodes()
 {
 	/* we transverse the node graph looking for bump nodes, when we find them,
@@ -987,6 +1052,44 @@ int ShaderGraph::get_num_closures()
 	return num_closures;
 }
 
+void ShaderGraph::hash(MD5Hash& md5)
+{
+	/* nodes are identified by their position in the list, which is also the
+	 * order their ids were assigned in and so the order they compile in */
+	map<ShaderNode*, int> node_index;
+	int index = 0;
+
+	foreach(ShaderNode *node, nodes) {
+		node_index[node] = index++;
+	}
+
+	foreach(ShaderNode *node, nodes) {
+		node->hash(md5);
+		md5.append((const uint8_t*)&node->bump, sizeof(node->bump));
+
+		/* image slots are assigned when the node is first compiled */
+		if(node->special_type == SHADER_SPECIAL_TYPE_IMAGE_SLOT) {
+			int slot = ((ImageSlotTextureNode*)node)->slot;
+			md5.append((const uint8_t*)&slot, sizeof(slot));
+		}
+
+		foreach(ShaderInput *input, node->inputs) {
+			int link[2] = {-1, -1};
+
+			if(input->link) {
+				ShaderNode *from = input->link->parent;
+				link[0] = node_index[from];
+				for(size_t i = 0; i < from->outputs.size(); i++) {
+					if(from->outputs[i] == input->link)
+						link[1] = (int)i;
+				}
+			}
+
+			md5.append((const uint8_t*)link, sizeof(link));
+		}
+	}
+}
+
 void ShaderGraph::dump_graph(const char *filename)
 {
 	FILE *fd = fopen(filename, "w");
@@ -32,6 +32,7 @@
 CCL_NAMESPACE_BEGIN
 
 class AttributeRequestSet;
+class MD5Hash;
 class Scene;
 class Shader;
 class ShaderInput;
@@ -263,6 +264,10 @@ public:
 
 	int get_num_closures();
 
+	/* hash of nodes, their settings and links, used to find compiled shaders
+	 * of unmodified graphs */
+	void hash(MD5Hash& md5);
+
 	void dump_graph(const char *filename);
 
 protected:
@@ -275,6 +280,7 @@ protected:
 	void break_cycles(ShaderNode *node, vector<bool>& visited, vector<bool>& on_stack);
 	void bump_from_displacement(bool use_object_space);
 	void refine_bump_nodes();
+	void image_texture_differentials();
 	void default_inputs(bool do_osl);
 	void transform_multi_closure(ShaderNode *node, ShaderOutput *weight_out, bool volume);
 
@@ -18,12 +18,15 @@
 #include "image.h"
 #include "scene.h"
 
+#include "util_debug.h"
 #include "util_foreach.h"
 #include "util_logging.h"
 #include "util_path.h"
 #include "util_progress.h"
 #include "util_texture.h"
 
+#include "kernels/cpu/kernel_texture_cache.h"
+
 #ifdef WITH_OSL
 #include <OSL/oslexec.h>
 #endif
@@ -35,6 +38,7 @@ ImageManager::ImageManager(const DeviceInfo& info)
 	need_update = true;
 	pack_images = false;
 	osl_texture_system = NULL;
+	texture_cache = NULL;
 	animation_frame = 0;
 
 	/* In case of multiple devices used we need to know type of an actual
@@ -48,6 +52,9 @@ ImageManager::ImageManager(const DeviceInfo& info)
 		device_type = info.multi_devices[0].type;
 	}
 
+	/* Only the CPU kernel can look up images through tile offsets. */
+	use_sparse_images = (info.type == DEVICE_CPU);
+
 	/* Set image limits */
 #define SET_TEX_IMAGES_LIMITS(ARCH) \
 	{ \
@@ -117,6 +124,14 @@ void ImageManager::set_osl_texture_system(void *texture_system)
 	osl_texture_system = texture_system;
 }
 
+void ImageManager::set_texture_cache(TextureCache *texture_cache_, int memory_limit)
+{
+	texture_cache = texture_cache_;
+
+	if(texture_cache)
+		texture_cache->set_memory_limit(memory_limit);
+}
+
 bool ImageManager::set_animation_frame_update(int frame)
 {
 	if(frame != animation_frame) {
@@ -348,6 +363,8 @@ int ImageManager::add_image(const string& filename,
 	img->extension = extension;
 	img->users = 1;
 	img->use_alpha = use_alpha;
+	img->volume_dense_size = 0;
+	img->volume_size = 0;
 
 	images[type][slot] = img;
 
@@ -622,6 +639,179 @@ bool ImageManager::file_load_image(Image *img,
 	return true;
 }
 
+template<typename T>
+static bool image_tile_is_background(const T *voxels,
+                                     int width, int height, int depth,
+                                     int tile_x, int tile_y, int tile_z,
+                                     const T& background)
+{
+	const int x_begin = tile_x*TEX_SPARSE_TILE_SIZE;
+	const int y_begin = tile_y*TEX_SPARSE_TILE_SIZE;
+	const int z_begin = tile_z*TEX_SPARSE_TILE_SIZE;
+	const int x_end = min(x_begin + TEX_SPARSE_TILE_SIZE, width);
+	const int y_end = min(y_begin + TEX_SPARSE_TILE_SIZE, height);
+	const int z_end = min(z_begin + TEX_SPARSE_TILE_SIZE, depth);
+
+	for(int z = z_begin; z < z_end; z++) {
+		for(int y = y_begin; y < y_end; y++) {
+			const T *row = voxels + ((size_t)z*height + y)*width;
+			for(int x = x_begin; x < x_end; x++) {
+				if(memcmp(&row[x], &background, sizeof(T)) != 0)
+					return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/* Convert a loaded 3d image to tiles of TEX_SPARSE_TILE_SIZE^3 voxels, where
+ * all tiles with only background voxels share the first tile. Smoke domains
+ * are mostly empty, so this typically takes a fraction of the memory. Returns
+ * false when the image stays dense. */
+template<typename DeviceType>
+bool ImageManager::make_sparse_image(Image *img,
+                                     device_vector<DeviceType>& tex_img,
+                                     device_vector<int>& tex_offsets)
+{
+	const int width = tex_img.data_width;
+	const int height = tex_img.data_height;
+	const int depth = tex_img.data_depth;
+	const size_t num_voxels = ((size_t)width)*height*depth;
+
+	tex_offsets.clear();
+
+	if(depth <= 1) {
+		img->volume_dense_size = 0;
+		img->volume_size = 0;
+		return false;
+	}
+
+	img->volume_dense_size = tex_img.memory_size();
+	img->volume_size = tex_img.memory_size();
+
+	if(!use_sparse_images || pack_images || !DebugFlags().cpu.sparse_volumes)
+		return false;
+
+	const int tiles_x = (width + TEX_SPARSE_TILE_SIZE - 1) >> TEX_SPARSE_TILE_SHIFT;
+	const int tiles_y = (height + TEX_SPARSE_TILE_SIZE - 1) >> TEX_SPARSE_TILE_SHIFT;
+	const int tiles_z = (depth + TEX_SPARSE_TILE_SIZE - 1) >> TEX_SPARSE_TILE_SHIFT;
+	const size_t num_tiles = ((size_t)tiles_x)*tiles_y*tiles_z;
+
+	/* Corners of smoke domains are practically always empty. */
+	const DeviceType *voxels = tex_img.get_data();
+	const DeviceType background = voxels[0];
+
+	/* Empty space skipping assumes no density where the grid is zero, a grid
+	 * with any other background value is only stored sparse. */
+	DeviceType zero;
+	memset(&zero, 0, sizeof(zero));
+	const bool background_is_zero = (memcmp(&background, &zero, sizeof(DeviceType)) == 0);
+
+	vector<bool> tile_used(num_tiles, false);
+	size_t num_used_tiles = 0;
+
+	for(int tz = 0, tile = 0; tz < tiles_z; tz++) {
+		for(int ty = 0; ty < tiles_y; ty++) {
+			for(int tx = 0; tx < tiles_x; tx++, tile++) {
+				if(!image_tile_is_background(voxels, width, height, depth, tx, ty, tz, background)) {
+					tile_used[tile] = true;
+					num_used_tiles++;
+				}
+			}
+		}
+	}
+
+	/* Dense lookups are faster, only go sparse when it saves at least half
+	 * of the memory. */
+	const size_t num_sparse_voxels = (num_used_tiles + 1)*TEX_SPARSE_TILE_VOXELS;
+	if(num_sparse_voxels*2 > num_voxels || num_sparse_voxels > INT_MAX)
+		return false;
+
+	int *offsets = tex_offsets.resize(TEX_SPARSE_HEADER_SIZE + num_tiles*2);
+	if(offsets == NULL)
+		return false;
+
+	offsets[0] = width;
+	offsets[1] = height;
+	offsets[2] = depth;
+	offsets[3] = 0;
+
+	int *tile_offsets = offsets + TEX_SPARSE_HEADER_SIZE;
+	int *tile_occupied = tile_offsets + num_tiles;
+
+	array<DeviceType> sparse_voxels(num_sparse_voxels);
+	for(size_t i = 0; i < num_sparse_voxels; i++)
+		sparse_voxels[i] = background;
+
+	int offset = TEX_SPARSE_TILE_VOXELS;
+
+	for(int tz = 0, tile = 0; tz < tiles_z; tz++) {
+		for(int ty = 0; ty < tiles_y; ty++) {
+			for(int tx = 0; tx < tiles_x; tx++, tile++) {
+				if(!tile_used[tile]) {
+					tile_offsets[tile] = 0;
+					continue;
+				}
+
+				tile_offsets[tile] = offset;
+
+				const int x_begin = tx*TEX_SPARSE_TILE_SIZE;
+				const int y_begin = ty*TEX_SPARSE_TILE_SIZE;
+				const int z_begin = tz*TEX_SPARSE_TILE_SIZE;
+				const int x_num = min(TEX_SPARSE_TILE_SIZE, width - x_begin);
+				const int y_end = min(y_begin + TEX_SPARSE_TILE_SIZE, height);
+				const int z_end = min(z_begin + TEX_SPARSE_TILE_SIZE, depth);
+
+				for(int z = z_begin; z < z_end; z++) {
+					for(int y = y_begin; y < y_end; y++) {
+						memcpy(&sparse_voxels[offset +
+						                      ((z - z_begin)*TEX_SPARSE_TILE_SIZE + (y - y_begin))*TEX_SPARSE_TILE_SIZE],
+						       voxels + ((size_t)z*height + y)*width + x_begin,
+						       sizeof(DeviceType)*x_num);
+					}
+				}
+
+				offset += TEX_SPARSE_TILE_VOXELS;
+			}
+		}
+	}
+
+	/* Tiles are occupied for empty space skipping when they or any of their
+	 * neighbours are used, interpolation reads into neighbouring tiles. With a
+	 * nonzero background no tile can be skipped. */
+	for(int tz = 0, tile = 0; tz < tiles_z; tz++) {
+		for(int ty = 0; ty < tiles_y; ty++) {
+			for(int tx = 0; tx < tiles_x; tx++, tile++) {
+				bool occupied = !background_is_zero;
+
+				for(int nz = max(tz - 1, 0); nz <= min(tz + 1, tiles_z - 1) && !occupied; nz++) {
+					for(int ny = max(ty - 1, 0); ny <= min(ty + 1, tiles_y - 1) && !occupied; ny++) {
+						for(int nx = max(tx - 1, 0); nx <= min(tx + 1, tiles_x - 1) && !occupied; nx++) {
+							occupied = tile_used[nx + tiles_x*(ny + (size_t)tiles_y*nz)];
+						}
+					}
+				}
+
+				tile_occupied[tile] = occupied;
+			}
+		}
+	}
+
+	/* Free the dense voxels before allocating the sparse ones. */
+	tex_img.clear();
+	tex_img.copy(sparse_voxels.data(), num_sparse_voxels);
+
+	img->volume_size = tex_img.memory_size() + tex_offsets.memory_size();
+
+	VLOG(1) << "Sparse image " << img->filename << ", "
+	        << num_used_tiles << " of " << num_tiles << " tiles used, "
+	        << string_human_readable_size(img->volume_size) << " instead of "
+	        << string_human_readable_size(img->volume_dense_size) << ".";
+
+	return true;
+}
+
 void ImageManager::device_load_image(Device *device,
                                      DeviceScene *dscene,
                                      Scene *scene,
@@ -637,14 +827,24 @@ void ImageManager::device_load_image(Device *device,
 	if(osl_texture_system && !img->builtin_data)
 		return;
 
+	/* Slot assignment */
+	int flat_slot = type_index_to_flattened_slot(slot, type);
+
+	if(texture_cache && !img->builtin_data) {
+		/* pixels are read from the file on demand */
+		texture_cache->add_image(flat_slot,
+		                         img->filename,
+		                         img->interpolation,
+		                         img->extension);
+		img->need_load = false;
+		return;
+	}
+
 	string filename = path_filename(images[type][slot]->filename);
 	progress->set_status("Updating Images", "Loading " + filename);
 
 	const int texture_limit = scene->params.texture_limit;
 
-	/* Slot assignment */
-	int flat_slot = type_index_to_flattened_slot(slot, type);
-
 	string name;
 	if(flat_slot >= 100)
 		name = string_printf("__tex_image_%s_%d", name_from_type(type).c_str(), flat_slot);
@@ -655,12 +855,18 @@ void ImageManager::device_load_image(Device *device,
 
 	if(type == IMAGE_DATA_TYPE_FLOAT4) {
 		device_vector<float4>& tex_img = dscene->tex_float4_image[slot];
+		device_vector<int>& tex_offsets = dscene->tex_float4_image_offsets[slot];
 
 		if(tex_img.device_pointer) {
 			thread_scoped_lock device_lock(device_mutex);
 			device->tex_free(tex_img);
 		}
 
+		if(tex_offsets.device_pointer) {
+			thread_scoped_lock device_lock(device_mutex);
+			device->tex_free(tex_offsets);
+		}
+
 		if(!file_load_image<TypeDesc::FLOAT, float>(img,
 		                                            type,
 		                                            texture_limit,
@@ -675,22 +881,36 @@ void ImageManager::device_load_image(Device *device,
 			pixels[3] = TEX_IMAGE_MISSING_A;
 		}
 
+		bool is_sparse = make_sparse_image(img, tex_img, tex_offsets);
+
 		if(!pack_images) {
 			thread_scoped_lock device_lock(device_mutex);
 			device->tex_alloc(name.c_str(),
 			                  tex_img,
 			                  img->interpolation,
 			                  img->extension);
+			if(is_sparse) {
+				device->tex_alloc((name + "_offsets").c_str(),
+				                  tex_offsets,
+				                  img->interpolation,
+				                  img->extension);
+			}
 		}
 	}
 	else if(type == IMAGE_DATA_TYPE_FLOAT) {
 		device_vector<float>& tex_img = dscene->tex_float_image[slot];
+		device_vector<int>& tex_offsets = dscene->tex_float_image_offsets[slot];
 
 		if(tex_img.device_pointer) {
 			thread_scoped_lock device_lock(device_mutex);
 			device->tex_free(tex_img);
 		}
 
+		if(tex_offsets.device_pointer) {
+			thread_scoped_lock device_lock(device_mutex);
+			device->tex_free(tex_offsets);
+		}
+
 		if(!file_load_image<TypeDesc::FLOAT, float>(img,
 		                                            type,
 		                                            texture_limit,
@@ -702,12 +922,20 @@ void ImageManager::device_load_image(Device *device,
 			pixels[0] = TEX_IMAGE_MISSING_R;
 		}
 
+		bool is_sparse = make_sparse_image(img, tex_img, tex_offsets);
+
 		if(!pack_images) {
 			thread_scoped_lock device_lock(device_mutex);
 			device->tex_alloc(name.c_str(),
 			                  tex_img,
 			                  img->interpolation,
 			                  img->extension);
+			if(is_sparse) {
+				device->tex_alloc((name + "_offsets").c_str(),
+				                  tex_offsets,
+				                  img->interpolation,
+				                  img->extension);
+			}
 		}
 	}
 	else if(type == IMAGE_DATA_TYPE_BYTE4) {
@@ -836,25 +1064,42 @@ void ImageManager::device_free_image(Device *device, DeviceScene *dscene, ImageD
 			((OSL::TextureSystem*)osl_texture_system)->invalidate(filename);
 #endif
 		}
+		else if(texture_cache && !img->builtin_data) {
+			texture_cache->remove_image(type_index_to_flattened_slot(slot, type));
+		}
 		else if(type == IMAGE_DATA_TYPE_FLOAT4) {
 			device_vector<float4>& tex_img = dscene->tex_float4_image[slot];
+			device_vector<int>& tex_offsets = dscene->tex_float4_image_offsets[slot];
 
 			if(tex_img.device_pointer) {
 				thread_scoped_lock device_lock(device_mutex);
 				device->tex_free(tex_img);
 			}
 
+			if(tex_offsets.device_pointer) {
+				thread_scoped_lock device_lock(device_mutex);
+				device->tex_free(tex_offsets);
+			}
+
 			tex_img.clear();
+			tex_offsets.clear();
 		}
 		else if(type == IMAGE_DATA_TYPE_FLOAT) {
 			device_vector<float>& tex_img = dscene->tex_float_image[slot];
+			device_vector<int>& tex_offsets = dscene->tex_float_image_offsets[slot];
 
 			if(tex_img.device_pointer) {
 				thread_scoped_lock device_lock(device_mutex);
 				device->tex_free(tex_img);
 			}
 
+			if(tex_offsets.device_pointer) {
+				thread_scoped_lock device_lock(device_mutex);
+				device->tex_free(tex_offsets);
+			}
+
 			tex_img.clear();
+			tex_offsets.clear();
 		}
 		else if(type == IMAGE_DATA_TYPE_BYTE4) {
 			device_vector<uchar4>& tex_img = dscene->tex_byte4_image[slot];
@@ -939,6 +1184,27 @@ void ImageManager::device_update(Device *device,
 	if(pack_images)
 		device_pack_images(device, dscene, progress);
 
+	/* memory of 3d images, to compare sparse and dense storage */
+	SceneUpdateStats& stats = scene->update_stats;
+	stats.volume_images = 0;
+	stats.volume_sparse_images = 0;
+	stats.volume_dense_size = 0;
+	stats.volume_size = 0;
+	stats.volume_sparse = use_sparse_images && !pack_images && DebugFlags().cpu.sparse_volumes;
+
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		foreach(Image *img, images[type]) {
+			if(!img || img->volume_dense_size == 0)
+				continue;
+
+			stats.volume_images++;
+			if(img->volume_size != img->volume_dense_size)
+				stats.volume_sparse_images++;
+			stats.volume_dense_size += img->volume_dense_size;
+			stats.volume_size += img->volume_size;
+		}
+	}
+
 	need_update = false;
 }
 
@@ -1173,6 +1439,11 @@ void ImageManager::device_free_builtin(Device *device, DeviceScene *dscene)
 
 void ImageManager::device_free(Device *device, DeviceScene *dscene)
 {
+	if(texture_cache) {
+		VLOG(1) << "Texture cache statistics:\n"
+		        << texture_cache->get_stats_report();
+	}
+
 	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
 		for(size_t slot = 0; slot < images[type].size(); slot++) {
 			device_free_image(device, dscene, (ImageDataType)type, slot);
@@ -31,6 +31,7 @@ class Device;
 class DeviceScene;
 class Progress;
 class Scene;
+class TextureCache;
 
 class ImageManager {
 public:
@@ -81,6 +82,8 @@ public:
 	void device_free_builtin(Device *device, DeviceScene *dscene);
 
 	void set_osl_texture_system(void *texture_system);
+	void set_texture_cache(TextureCache *texture_cache, int memory_limit);
+	bool use_texture_cache() const { return texture_cache != NULL; }
 	void set_pack_images(bool pack_images_);
 	bool set_animation_frame_update(int frame);
 
@@ -118,6 +121,11 @@ public:
 		ExtensionType extension;
 
 		int users;
+
+		/* memory of 3d images as dense voxels and as stored, which is less
+		 * for sparse images */
+		size_t volume_dense_size;
+		size_t volume_size;
 	};
 
 private:
@@ -129,7 +137,9 @@ private:
 
 	vector<Image*> images[IMAGE_DATA_NUM_TYPES];
 	void *osl_texture_system;
+	TextureCache *texture_cache;
 	bool pack_images;
+	bool use_sparse_images;
 
 	bool file_load_image_generic(Image *img, ImageInput **in, int &width, int &height, int &depth, int &components);
 
@@ -141,6 +151,11 @@ private:
 	                     int texture_limit,
 	                     device_vector<DeviceType>& tex_img);
 
+	template<typename DeviceType>
+	bool make_sparse_image(Image *img,
+	                       device_vector<DeviceType>& tex_img,
+	                       device_vector<int>& tex_offsets);
+
 	int type_index_to_flattened_slot(int slot, ImageDataType type);
 	int flattened_slot_to_type_index(int flat_slot, ImageDataType *type);
 	string name_from_type(int type);
@@ -45,6 +45,7 @@ NODE_DEFINE(Integrator)
 
 	SOCKET_INT(volume_max_steps, "Volume Max Steps", 1024);
 	SOCKET_FLOAT(volume_step_size, "Volume Step Size", 0.1f);
+	SOCKET_BOOLEAN(volume_skip_empty, "Volume Skip Empty", false);
 
 	SOCKET_BOOLEAN(caustics_reflective, "Reflective Caustics", true);
 	SOCKET_BOOLEAN(caustics_refractive, "Refractive Caustics", true);
@@ -66,6 +67,10 @@ NODE_DEFINE(Integrator)
 	SOCKET_BOOLEAN(sample_all_lights_direct, "Sample All Lights Direct", true);
 	SOCKET_BOOLEAN(sample_all_lights_indirect, "Sample All Lights Indirect", true);
 	SOCKET_FLOAT(light_sampling_threshold, "Light Sampling Threshold", 0.05f);
+	SOCKET_BOOLEAN(use_light_tree, "Use Light Tree", false);
+
+	SOCKET_FLOAT(adaptive_threshold, "Adaptive Threshold", 0.0f);
+	SOCKET_INT(adaptive_min_samples, "Adaptive Min Samples", 16);
 
 	static NodeEnum method_enum;
 	method_enum.insert("path", PATH);
@@ -131,6 +136,8 @@ void Integrator::device_update(Device *device, DeviceScene *dscene, Scene *scene
 
 	kintegrator->volume_max_steps = volume_max_steps;
 	kintegrator->volume_step_size = volume_step_size;
+	kintegrator->volume_skip_empty = volume_skip_empty;
+	scene->update_stats.volume_skip_empty = volume_skip_empty;
 
 	kintegrator->caustics_reflective = caustics_reflective;
 	kintegrator->caustics_refractive = caustics_refractive;
@@ -172,6 +179,10 @@ void Integrator::device_update(Device *device, DeviceScene *dscene, Scene *scene
 		kintegrator->light_inv_rr_threshold = 0.0f;
 	}
 
+	/* at least two samples are needed to estimate the pixel variance */
+	kintegrator->adaptive_threshold = adaptive_threshold;
+	kintegrator->adaptive_min_samples = max(adaptive_min_samples, 2);
+
 	/* sobol directions table */
 	int max_samples = 1;
 
@@ -203,6 +214,13 @@ void Integrator::device_update(Device *device, DeviceScene *dscene, Scene *scene
 		scene->film->tag_update(scene);
 	}
 
+	/* Adaptive sampling. */
+	bool use_adaptive_sampling = (adaptive_threshold > 0.0f);
+	if(use_adaptive_sampling != scene->film->use_adaptive_sampling) {
+		scene->film->use_adaptive_sampling = use_adaptive_sampling;
+		scene->film->tag_update(scene);
+	}
+
 	need_update = false;
 }
 
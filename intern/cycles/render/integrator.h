@@ -45,6 +45,7 @@ public:
 
 	int volume_max_steps;
 	float volume_step_size;
+	bool volume_skip_empty;
 
 	bool caustics_reflective;
 	bool caustics_refractive;
@@ -68,6 +69,10 @@ public:
 	bool sample_all_lights_direct;
 	bool sample_all_lights_indirect;
 	float light_sampling_threshold;
+	bool use_light_tree;
+
+	float adaptive_threshold;
+	int adaptive_min_samples;
 
 	enum Method {
 		BRANCHED_PATH = 0,
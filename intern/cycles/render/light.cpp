@@ -19,6 +19,7 @@
 #include "integrator.h"
 #include "film.h"
 #include "light.h"
+#include "light_tree.h"
 #include "mesh.h"
 #include "object.h"
 #include "scene.h"
@@ -245,6 +246,19 @@ bool LightManager::object_usable_as_light(Object *object) {
 	return false;
 }
 
+/* Emitted power of a shader for the light tree, from its constant emission
+ * when the graph has one. Textured emission isn't known before shader
+ * evaluation, unit strength is assumed then. */
+static float light_tree_emission_estimate(Shader *shader)
+{
+	float3 emission;
+
+	if(shader->is_constant_emission(&emission)) {
+		return max(average(emission), 0.0f);
+	}
+	return 1.0f;
+}
+
 void LightManager::device_update_distribution(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
 {
 	progress.set_status("Updating Lights", "Computing distribution");
@@ -254,12 +268,19 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 	size_t num_portals = 0;
 	size_t num_background_lights = 0;
 	size_t num_triangles = 0;
+	size_t num_tree_emitters = 0;
+	size_t num_distant_lights = 0;
 
 	bool background_mis = false;
+	bool use_light_tree = scene->integrator->use_light_tree;
 
 	foreach(Light *light, scene->lights) {
 		if(light->is_enabled) {
 			num_lights++;
+
+			if(light->type == LIGHT_DISTANT || light->type == LIGHT_BACKGROUND) {
+				num_distant_lights++;
+			}
 		}
 		if(light->is_portal) {
 			num_portals++;
@@ -275,6 +296,7 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 		/* Count triangles. */
 		Mesh *mesh = object->mesh;
 		size_t mesh_num_triangles = mesh->num_triangles();
+		num_tree_emitters += mesh_num_triangles;
 		for(size_t i = 0; i < mesh_num_triangles; i++) {
 			int shader_index = mesh->shader[i];
 			Shader *shader = (shader_index < mesh->used_shaders.size())
@@ -294,6 +316,21 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 	float4 *distribution = dscene->light_distribution.resize(num_distribution + 1);
 	float totarea = 0.0f;
 
+	/* light tree primitives, and lookup table from object and triangle to
+	 * tree leaf, needed for MIS: two entries per object followed by one entry
+	 * for every triangle of objects usable as light, then the distribution
+	 * index of distant and background lamps, which are not in the tree */
+	vector<LightTree::Primitive> tree_primitives;
+	vector<uint> tree_emitter_slots;
+	uint *tree_emitters = NULL;
+	size_t tree_emitter_offset = 2*scene->objects.size();
+
+	if(use_light_tree) {
+		tree_primitives.reserve(num_triangles + num_lights);
+		tree_emitter_slots.reserve(num_triangles);
+		tree_emitters = dscene->light_tree_emitters.resize(tree_emitter_offset + num_tree_emitters + num_distant_lights);
+	}
+
 	/* triangles */
 	size_t offset = 0;
 	int j = 0;
@@ -302,6 +339,10 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 		if(progress.get_cancel()) return;
 
 		if(!object_usable_as_light(object)) {
+			if(use_light_tree) {
+				tree_emitters[j*2 + 0] = (uint)-1;
+				tree_emitters[j*2 + 1] = 0;
+			}
 			j++;
 			continue;
 		}
@@ -330,12 +371,31 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 		}
 
 		size_t mesh_num_triangles = mesh->num_triangles();
+
+		/* emission estimate of every shader of the mesh */
+		vector<float> shader_emission;
+
+		if(use_light_tree) {
+			tree_emitters[j*2 + 0] = tree_emitter_offset;
+			tree_emitters[j*2 + 1] = mesh->tri_offset;
+
+			shader_emission.resize(mesh->used_shaders.size() + 1);
+			for(size_t i = 0; i < mesh->used_shaders.size(); i++) {
+				shader_emission[i] = light_tree_emission_estimate(mesh->used_shaders[i]);
+			}
+			shader_emission[mesh->used_shaders.size()] = light_tree_emission_estimate(scene->default_surface);
+		}
+
 		for(size_t i = 0; i < mesh_num_triangles; i++) {
 			int shader_index = mesh->shader[i];
 			Shader *shader = (shader_index < mesh->used_shaders.size())
 			                         ? mesh->used_shaders[shader_index]
 			                         : scene->default_surface;
 
+			if(use_light_tree) {
+				tree_emitters[tree_emitter_offset + i] = (uint)-1;
+			}
+
 			if(shader->use_mis && shader->has_surface_emission) {
 				distribution[offset].x = totarea;
 				distribution[offset].y = __int_as_float(i + mesh->tri_offset);
@@ -354,14 +414,40 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 					p3 = transform_point(&tfm, p3);
 				}
 
-				totarea += triangle_area(p1, p2, p3);
+				float area = triangle_area(p1, p2, p3);
+				totarea += area;
+
+				/* degenerate triangles are never sampled, keep them out
+				 * of the tree so leaves always have a non-zero area */
+				if(use_light_tree && area > 0.0f) {
+					LightTree::Primitive prim;
+					prim.bounds = BoundBox::empty;
+					prim.bounds.grow(p1);
+					prim.bounds.grow(p2);
+					prim.bounds.grow(p3);
+					prim.centroid = (p1 + p2 + p3)*(1.0f/3.0f);
+					prim.normal = normalize(cross(p2 - p1, p3 - p1));
+					prim.theta_o = 0.0f;
+					prim.energy = area*shader_emission[min(shader_index, (int)mesh->used_shaders.size())];
+					prim.area = area;
+					prim.index = offset - 1;
+
+					tree_primitives.push_back(prim);
+					tree_emitter_slots.push_back(tree_emitter_offset + i);
+				}
 			}
 		}
 
+		if(use_light_tree) {
+			tree_emitter_offset += mesh_num_triangles;
+		}
+
 		j++;
 	}
 
 	float trianglearea = totarea;
+	size_t num_tree_triangles = tree_primitives.size();
+	size_t tree_distant_offset = tree_emitter_offset;
 
 	/* point lights */
 	float lightarea = (totarea > 0.0f) ? totarea / num_lights : 1.0f;
@@ -385,6 +471,47 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 			background_mis = light->use_mis;
 		}
 
+		if(use_light_tree) {
+			if(light->type == LIGHT_DISTANT || light->type == LIGHT_BACKGROUND) {
+				/* no position to estimate the contribution from */
+				tree_emitters[tree_emitter_offset++] = offset;
+			}
+			else {
+				/* power emitted in a direction, relative to triangles of
+				 * the same strength and unit area, see lamp_light_sample */
+				Shader *shader = (light->shader) ? light->shader : scene->default_light;
+				float strength = light_tree_emission_estimate(shader);
+				LightTree::Primitive prim;
+
+				prim.bounds = BoundBox::empty;
+				prim.centroid = light->co;
+				prim.area = 0.0f;
+				prim.index = offset;
+
+				if(light->type == LIGHT_AREA) {
+					float3 axisu = light->axisu*(light->sizeu*light->size);
+					float3 axisv = light->axisv*(light->sizev*light->size);
+
+					prim.bounds.grow(light->co - 0.5f*axisu - 0.5f*axisv);
+					prim.bounds.grow(light->co + 0.5f*axisu - 0.5f*axisv);
+					prim.bounds.grow(light->co - 0.5f*axisu + 0.5f*axisv);
+					prim.bounds.grow(light->co + 0.5f*axisu + 0.5f*axisv);
+					prim.normal = safe_normalize(light->dir);
+					prim.theta_o = 0.0f;
+					prim.energy = 0.25f*strength;
+				}
+				else {
+					/* point and spot lamps, spot cones are not taken into account */
+					prim.bounds.grow(light->co, light->size);
+					prim.normal = make_float3(0.0f, 0.0f, 1.0f);
+					prim.theta_o = M_PI_2_F;
+					prim.energy = 0.25f*M_1_PI_F*strength;
+				}
+
+				tree_primitives.push_back(prim);
+			}
+		}
+
 		light_index++;
 		offset++;
 	}
@@ -449,6 +576,39 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 		/* CDF */
 		device->tex_alloc("__light_distribution", dscene->light_distribution);
 
+		/* Light tree over the triangles and lamps. Distant and background
+		 * lamps keep the same probability as in the distribution, the tree
+		 * gets the remaining samples. */
+		kintegrator->use_light_tree = false;
+
+		if(tree_primitives.size()) {
+			LightTree tree(tree_primitives, num_tree_triangles);
+
+			float4 *nodes = dscene->light_tree_nodes.resize(tree.num_nodes()*LIGHT_TREE_NODE_SIZE);
+			tree.pack(nodes);
+
+			const vector<int>& leaves = tree.get_primitive_leaves();
+			for(size_t i = 0; i < num_tree_triangles; i++) {
+				tree_emitters[tree_emitter_slots[i]] = leaves[i];
+			}
+
+			VLOG(1) << "Light tree built with " << tree.num_nodes() << " nodes, "
+			        << num_tree_triangles << " triangles and "
+			        << (tree_primitives.size() - num_tree_triangles) << " lamps.";
+
+			device->tex_alloc("__light_tree_nodes", dscene->light_tree_nodes);
+			device->tex_alloc("__light_tree_emitters", dscene->light_tree_emitters);
+
+			kintegrator->use_light_tree = true;
+			kintegrator->light_tree_fraction = 1.0f - num_distant_lights*kintegrator->pdf_lights;
+			kintegrator->light_tree_triangle_root = tree.get_triangle_root();
+			kintegrator->light_tree_num_distant = num_distant_lights;
+			kintegrator->light_tree_distant_offset = tree_distant_offset;
+		}
+		else {
+			dscene->light_tree_emitters.clear();
+		}
+
 		/* Portals */
 		if(num_portals > 0) {
 			kintegrator->portal_offset = light_index;
@@ -463,6 +623,7 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 	}
 	else {
 		dscene->light_distribution.clear();
+		dscene->light_tree_emitters.clear();
 
 		kintegrator->num_distribution = 0;
 		kintegrator->num_all_lights = 0;
@@ -473,6 +634,7 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 		kintegrator->num_portals = 0;
 		kintegrator->portal_offset = 0;
 		kintegrator->portal_pdf = 0.0f;
+		kintegrator->use_light_tree = false;
 
 		kfilm->pass_shadow_scale = 1.0f;
 	}
@@ -846,11 +1008,15 @@ void LightManager::device_free(Device *device, DeviceScene *dscene)
 {
 	device->tex_free(dscene->light_distribution);
 	device->tex_free(dscene->light_data);
+	device->tex_free(dscene->light_tree_nodes);
+	device->tex_free(dscene->light_tree_emitters);
 	device->tex_free(dscene->light_background_marginal_cdf);
 	device->tex_free(dscene->light_background_conditional_cdf);
 
 	dscene->light_distribution.clear();
 	dscene->light_data.clear();
+	dscene->light_tree_nodes.clear();
+	dscene->light_tree_emitters.clear();
 	dscene->light_background_marginal_cdf.clear();
 	dscene->light_background_conditional_cdf.clear();
 }
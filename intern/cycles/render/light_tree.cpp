@@ -0,0 +1,202 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "light_tree.h"
+
+#include "kernel_types.h"
+
+#include "util_algorithm.h"
+#include "util_math.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Smallest cone around both cones, normals are treated as two-sided so the
+ * second cone is flipped to the hemisphere of the first one. Half angles of
+ * M_PI_2_F or more cover all directions. */
+static void light_tree_cone_union(float3 axis_a, float theta_a,
+                                  float3 axis_b, float theta_b,
+                                  float3 *r_axis, float *r_theta)
+{
+	if(dot(axis_a, axis_b) < 0.0f) {
+		axis_b = -axis_b;
+	}
+	if(theta_b > theta_a) {
+		swap(axis_a, axis_b);
+		swap(theta_a, theta_b);
+	}
+
+	float theta_d = safe_acosf(dot(axis_a, axis_b));
+
+	if(min(theta_d + theta_b, M_PI_F) <= theta_a) {
+		/* b is inside a */
+		*r_axis = axis_a;
+		*r_theta = theta_a;
+		return;
+	}
+
+	float theta_o = 0.5f*(theta_a + theta_d + theta_b);
+	if(theta_o >= M_PI_2_F) {
+		*r_axis = axis_a;
+		*r_theta = M_PI_2_F;
+		return;
+	}
+
+	/* rotate axis a towards b */
+	float theta_r = theta_o - theta_a;
+	float3 ortho = axis_b - dot(axis_a, axis_b)*axis_a;
+	float ortho_len = len(ortho);
+
+	if(ortho_len > 0.0f) {
+		*r_axis = normalize(cosf(theta_r)*axis_a + sinf(theta_r)*(ortho/ortho_len));
+	}
+	else {
+		*r_axis = axis_a;
+	}
+	*r_theta = theta_o;
+}
+
+struct LightTreeCentroidCompare {
+	const vector<LightTree::Primitive>& primitives;
+	int axis;
+
+	LightTreeCentroidCompare(const vector<LightTree::Primitive>& primitives_, int axis_)
+	: primitives(primitives_), axis(axis_)
+	{
+	}
+
+	bool operator()(int a, int b) const
+	{
+		return primitives[a].centroid[axis] < primitives[b].centroid[axis];
+	}
+};
+
+LightTree::LightTree(const vector<Primitive>& primitives_, size_t num_triangles)
+: primitives(primitives_), triangle_root(-1)
+{
+	size_t num_primitives = primitives.size();
+
+	if(num_primitives == 0) {
+		return;
+	}
+
+	order.resize(num_primitives);
+	for(size_t i = 0; i < num_primitives; i++) {
+		order[i] = i;
+	}
+
+	primitive_leaf.resize(num_primitives);
+	nodes.reserve(2*num_primitives - 1);
+
+	if(num_triangles > 0 && num_triangles < num_primitives) {
+		/* root splitting triangles from lamps */
+		nodes.push_back(Node());
+		triangle_root = recursive_build(0, 0, num_triangles);
+		int lamp_root = recursive_build(0, num_triangles, num_primitives);
+		init_inner_node(0, -1, triangle_root, lamp_root);
+	}
+	else {
+		recursive_build(-1, 0, num_primitives);
+		triangle_root = (num_triangles > 0)? 0: -1;
+	}
+
+	order.clear();
+}
+
+int LightTree::recursive_build(int parent, int start, int end)
+{
+	int index = nodes.size();
+	nodes.push_back(Node());
+
+	if(end - start == 1) {
+		const Primitive& prim = primitives[order[start]];
+		Node& leaf = nodes[index];
+
+		leaf.center = prim.bounds.center();
+		leaf.radius = 0.5f*len(prim.bounds.size());
+		leaf.axis = prim.normal;
+		leaf.theta_o = prim.theta_o;
+		leaf.energy = prim.energy;
+		leaf.area = prim.area;
+		leaf.parent = parent;
+		leaf.child = ~prim.index;
+
+		primitive_leaf[order[start]] = index;
+		return index;
+	}
+
+	/* median split along the largest axis of the centroid bounds */
+	BoundBox centroid_bounds = BoundBox::empty;
+	for(int i = start; i < end; i++) {
+		centroid_bounds.grow(primitives[order[i]].centroid);
+	}
+
+	float3 size = centroid_bounds.size();
+	int axis = (size.x >= size.y && size.x >= size.z)? 0: (size.y >= size.z)? 1: 2;
+	int middle = (start + end)/2;
+
+	nth_element(order.begin() + start,
+	            order.begin() + middle,
+	            order.begin() + end,
+	            LightTreeCentroidCompare(primitives, axis));
+
+	int left = recursive_build(index, start, middle);
+	int right = recursive_build(index, middle, end);
+
+	init_inner_node(index, parent, left, right);
+
+	return index;
+}
+
+void LightTree::init_inner_node(int index, int parent, int left, int right)
+{
+	/* children are built already, fetch them now as building may have
+	 * reallocated the nodes */
+	const Node& left_node = nodes[left];
+	const Node& right_node = nodes[right];
+	Node& node = nodes[index];
+
+	BoundBox bounds = BoundBox::empty;
+	bounds.grow(left_node.center, left_node.radius);
+	bounds.grow(right_node.center, right_node.radius);
+
+	node.center = bounds.center();
+	node.radius = max(len(left_node.center - node.center) + left_node.radius,
+	                  len(right_node.center - node.center) + right_node.radius);
+	light_tree_cone_union(left_node.axis, left_node.theta_o,
+	                      right_node.axis, right_node.theta_o,
+	                      &node.axis, &node.theta_o);
+	node.energy = left_node.energy + right_node.energy;
+	node.area = 0.0f;
+	node.parent = parent;
+	node.child = right;
+}
+
+void LightTree::pack(float4 *data) const
+{
+	for(size_t i = 0; i < nodes.size(); i++) {
+		const Node& node = nodes[i];
+		float4 *d = data + i*LIGHT_TREE_NODE_SIZE;
+
+		d[0] = make_float4(node.center.x, node.center.y, node.center.z, node.radius);
+		d[1] = make_float4(node.axis.x, node.axis.y, node.axis.z, node.theta_o);
+		d[2] = make_float4(node.energy,
+		                   __int_as_float(node.parent),
+		                   __int_as_float(node.child),
+		                   node.area);
+	}
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LIGHT_TREE_H__
+#define __LIGHT_TREE_H__
+
+#include "util_boundbox.h"
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Light Tree
+ *
+ * Binary hierarchy over emissive triangles and lamps, used to pick a light
+ * with a probability proportional to an estimate of its contribution to the
+ * shading point, rather than proportional to its area only. Every node
+ * stores a bounding sphere, the total emitted power and a cone bounding the
+ * emitter normals. Emitters are treated as two-sided, so the cone bounds the
+ * normals up to their sign.
+ *
+ * Triangles come first in the primitives, when there are also lamps the root
+ * splits them from the lamps, so triangles alone can be sampled starting from
+ * the triangle subtree. */
+
+class LightTree {
+public:
+	struct Primitive {
+		BoundBox bounds;
+		float3 centroid;
+		float3 normal;
+		/* half angle of the normal cone, M_PI_2_F for omni-directional lamps */
+		float theta_o;
+		float energy;
+		/* area of triangles, zero for lamps */
+		float area;
+		/* index stored in the leaf, opaque to the tree */
+		int index;
+	};
+
+	struct Node {
+		float3 center;
+		float radius;
+		float3 axis;
+		float theta_o;
+		float energy;
+		float area;
+		int parent;
+		/* right child for inner nodes, the left one directly follows its
+		 * parent, ~Primitive.index for leaves */
+		int child;
+	};
+
+	LightTree(const vector<Primitive>& primitives, size_t num_triangles);
+
+	size_t num_nodes() const { return nodes.size(); }
+
+	/* Root node of the triangles, -1 when there are none. */
+	int get_triangle_root() const { return triangle_root; }
+
+	/* Leaf node of every primitive, in the order they were passed in. */
+	const vector<int>& get_primitive_leaves() const { return primitive_leaf; }
+
+	/* Fill LIGHT_TREE_NODE_SIZE float4 per node. */
+	void pack(float4 *data) const;
+
+protected:
+	int recursive_build(int parent, int start, int end);
+	void init_inner_node(int index, int parent, int left, int right);
+
+	const vector<Primitive>& primitives;
+	vector<int> order;
+	vector<int> primitive_leaf;
+	vector<Node> nodes;
+	int triangle_root;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __LIGHT_TREE_H__ */
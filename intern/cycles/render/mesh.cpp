@@ -37,6 +37,7 @@
 #include "util_logging.h"
 #include "util_progress.h"
 #include "util_set.h"
+#include "util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -141,7 +142,8 @@ Mesh::Mesh()
 : Node(node_type)
 {
 	need_update = true;
-	need_update_rebuild = false;
+	/* no BVH was built yet */
+	need_update_rebuild = true;
 	transform_applied = false;
 	transform_negative_scaled = false;
 	transform_normal = transform_identity();
@@ -783,19 +785,24 @@ void Mesh::compute_bvh(DeviceScene *dscene,
 		vector<Object*> objects;
 		objects.push_back(&object);
 
+		/* Topology did not change, only update the bounds. */
+		bool refitted = false;
 		if(bvh && !need_update_rebuild) {
 			progress->set_status(msg, "Refitting BVH");
 			bvh->objects = objects;
-			bvh->refit(*progress);
+			refitted = bvh->refit(*progress);
 		}
-		else {
+
+		if(!refitted) {
 			progress->set_status(msg, "Building BVH");
 
 			BVHParams bparams;
 			bparams.use_spatial_split = params->use_bvh_spatial_split;
 			bparams.use_qbvh = params->use_qbvh;
+			bparams.use_obvh = params->use_obvh;
 			bparams.use_unaligned_nodes = dscene->data.bvh.have_curves &&
 			                              params->use_bvh_unaligned_nodes;
+			bparams.refit_rebuild_threshold = params->bvh_refit_threshold;
 
 			delete bvh;
 			bvh = BVH::create(bparams, objects);
@@ -865,6 +872,7 @@ MeshManager::MeshManager()
 	bvh = NULL;
 	need_update = true;
 	need_flags_update = true;
+	need_bvh_rebuild = true;
 }
 
 MeshManager::~MeshManager()
@@ -1233,6 +1241,51 @@ static void update_attribute_element_offset(Mesh *mesh,
 	}
 }
 
+static void update_mesh_attributes(Mesh *mesh,
+                                   AttributeRequestSet *attributes,
+                                   vector<float> *attr_float,
+                                   size_t attr_float_offset,
+                                   vector<float4> *attr_float3,
+                                   size_t attr_float3_offset,
+                                   vector<uchar4> *attr_uchar4,
+                                   size_t attr_uchar4_offset)
+{
+	/* todo: we now store std and name attributes from requests even if
+	 * they actually refer to the same mesh attributes, optimize */
+	foreach(AttributeRequest& req, attributes->requests) {
+		Attribute *triangle_mattr = mesh->attributes.find(req);
+		Attribute *curve_mattr = mesh->curve_attributes.find(req);
+		Attribute *subd_mattr = mesh->subd_attributes.find(req);
+
+		update_attribute_element_offset(mesh,
+		                                *attr_float, attr_float_offset,
+		                                *attr_float3, attr_float3_offset,
+		                                *attr_uchar4, attr_uchar4_offset,
+		                                triangle_mattr,
+		                                ATTR_PRIM_TRIANGLE,
+		                                req.triangle_type,
+		                                req.triangle_desc);
+
+		update_attribute_element_offset(mesh,
+		                                *attr_float, attr_float_offset,
+		                                *attr_float3, attr_float3_offset,
+		                                *attr_uchar4, attr_uchar4_offset,
+		                                curve_mattr,
+		                                ATTR_PRIM_CURVE,
+		                                req.curve_type,
+		                                req.curve_desc);
+
+		update_attribute_element_offset(mesh,
+		                                *attr_float, attr_float_offset,
+		                                *attr_float3, attr_float3_offset,
+		                                *attr_uchar4, attr_uchar4_offset,
+		                                subd_mattr,
+		                                ATTR_PRIM_SUBD,
+		                                req.subd_type,
+		                                req.subd_desc);
+	}
+}
+
 void MeshManager::device_update_attributes(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
 {
 	progress.set_status("Updating Mesh", "Computing attributes");
@@ -1262,9 +1315,16 @@ void MeshManager::device_update_attributes(Device *device, DeviceScene *dscene,
 	size_t attr_float_size = 0;
 	size_t attr_float3_size = 0;
 	size_t attr_uchar4_size = 0;
+	/* Start of each mesh's attributes in the arrays. */
+	vector<size_t> mesh_attr_float_offset(scene->meshes.size());
+	vector<size_t> mesh_attr_float3_offset(scene->meshes.size());
+	vector<size_t> mesh_attr_uchar4_offset(scene->meshes.size());
 	for(size_t i = 0; i < scene->meshes.size(); i++) {
 		Mesh *mesh = scene->meshes[i];
 		AttributeRequestSet& attributes = mesh_attributes[i];
+		mesh_attr_float_offset[i] = attr_float_size;
+		mesh_attr_float3_offset[i] = attr_float3_size;
+		mesh_attr_uchar4_offset[i] = attr_uchar4_size;
 		foreach(AttributeRequest& req, attributes.requests) {
 			Attribute *triangle_mattr = mesh->attributes.find(req);
 			Attribute *curve_mattr = mesh->curve_attributes.find(req);
@@ -1295,52 +1355,22 @@ void MeshManager::device_update_attributes(Device *device, DeviceScene *dscene,
 	vector<float4> attr_float3(attr_float3_size);
 	vector<uchar4> attr_uchar4(attr_uchar4_size);
 
-	size_t attr_float_offset = 0;
-	size_t attr_float3_offset = 0;
-	size_t attr_uchar4_offset = 0;
+	/* Fill in attributes, every mesh writes to its own range of the arrays
+	 * so they can be filled in parallel. */
+	TaskPool pool;
 
-	/* Fill in attributes. */
 	for(size_t i = 0; i < scene->meshes.size(); i++) {
-		Mesh *mesh = scene->meshes[i];
-		AttributeRequestSet& attributes = mesh_attributes[i];
-
-		/* todo: we now store std and name attributes from requests even if
-		 * they actually refer to the same mesh attributes, optimize */
-		foreach(AttributeRequest& req, attributes.requests) {
-			Attribute *triangle_mattr = mesh->attributes.find(req);
-			Attribute *curve_mattr = mesh->curve_attributes.find(req);
-			Attribute *subd_mattr = mesh->subd_attributes.find(req);
+		pool.push(function_bind(&update_mesh_attributes,
+		                        scene->meshes[i],
+		                        &mesh_attributes[i],
+		                        &attr_float, mesh_attr_float_offset[i],
+		                        &attr_float3, mesh_attr_float3_offset[i],
+		                        &attr_uchar4, mesh_attr_uchar4_offset[i]));
+	}
 
-			update_attribute_element_offset(mesh,
-			                                attr_float, attr_float_offset,
-			                                attr_float3, attr_float3_offset,
-			                                attr_uchar4, attr_uchar4_offset,
-			                                triangle_mattr,
-			                                ATTR_PRIM_TRIANGLE,
-			                                req.triangle_type,
-			                                req.triangle_desc);
-
-			update_attribute_element_offset(mesh,
-			                                attr_float, attr_float_offset,
-			                                attr_float3, attr_float3_offset,
-			                                attr_uchar4, attr_uchar4_offset,
-			                                curve_mattr,
-			                                ATTR_PRIM_CURVE,
-			                                req.curve_type,
-			                                req.curve_desc);
-
-			update_attribute_element_offset(mesh,
-			                                attr_float, attr_float_offset,
-			                                attr_float3, attr_float3_offset,
-			                                attr_uchar4, attr_uchar4_offset,
-			                                subd_mattr,
-			                                ATTR_PRIM_SUBD,
-			                                req.subd_type,
-			                                req.subd_desc);
+	pool.wait_work();
 
-			if(progress.get_cancel()) return;
-		}
-	}
+	if(progress.get_cancel()) return;
 
 	/* create attribute lookup maps */
 	if(scene->shader_manager->use_osl())
@@ -1411,6 +1441,49 @@ void MeshManager::mesh_calc_offset(Scene *scene)
 	}
 }
 
+/* Per mesh packing tasks, writing to the ranges of the device arrays given
+ * by the offsets from mesh_calc_offset(). */
+
+static void mesh_pack_triangles(Scene *scene,
+                                Mesh *mesh,
+                                const vector<uint> *tri_prim_index,
+                                uint *tri_shader,
+                                float4 *vnormal,
+                                uint4 *tri_vindex,
+                                uint *tri_patch,
+                                float2 *tri_patch_uv)
+{
+	mesh->pack_normals(scene,
+	                   &tri_shader[mesh->tri_offset],
+	                   &vnormal[mesh->vert_offset]);
+	mesh->pack_verts(*tri_prim_index,
+	                 &tri_vindex[mesh->tri_offset],
+	                 &tri_patch[mesh->tri_offset],
+	                 &tri_patch_uv[mesh->vert_offset],
+	                 mesh->vert_offset,
+	                 mesh->tri_offset);
+}
+
+static void mesh_pack_patches(Mesh *mesh, uint *patch_data)
+{
+	mesh->pack_patches(&patch_data[mesh->patch_offset], mesh->vert_offset, mesh->face_offset, mesh->corner_offset);
+
+	if(mesh->patch_table) {
+		mesh->patch_table->copy_adjusting_offsets(&patch_data[mesh->patch_table_offset], mesh->patch_table_offset);
+	}
+}
+
+static void mesh_pack_prim_tri_verts(Mesh *mesh, float4 *prim_tri_verts)
+{
+	for(size_t i = 0; i < mesh->num_triangles(); ++i) {
+		Mesh::Triangle t = mesh->get_triangle(i);
+		size_t offset = 3 * (i + mesh->tri_offset);
+		prim_tri_verts[offset + 0] = float3_to_float4(mesh->verts[t.v[0]]);
+		prim_tri_verts[offset + 1] = float3_to_float4(mesh->verts[t.v[1]]);
+		prim_tri_verts[offset + 2] = float3_to_float4(mesh->verts[t.v[2]]);
+	}
+}
+
 void MeshManager::device_update_mesh(Device *device,
                                      DeviceScene *dscene,
                                      Scene *scene,
@@ -1479,19 +1552,24 @@ void MeshManager::device_update_mesh(Device *device,
 		uint *tri_patch = dscene->tri_patch.resize(tri_size);
 		float2 *tri_patch_uv = dscene->tri_patch_uv.resize(vert_size);
 
+		TaskPool pool;
+
 		foreach(Mesh *mesh, scene->meshes) {
-			mesh->pack_normals(scene,
-			                   &tri_shader[mesh->tri_offset],
-			                   &vnormal[mesh->vert_offset]);
-			mesh->pack_verts(tri_prim_index,
-			                 &tri_vindex[mesh->tri_offset],
-			                 &tri_patch[mesh->tri_offset],
-			                 &tri_patch_uv[mesh->vert_offset],
-			                 mesh->vert_offset,
-			                 mesh->tri_offset);
-			if(progress.get_cancel()) return;
+			pool.push(function_bind(&mesh_pack_triangles,
+			                        scene,
+			                        mesh,
+			                        &tri_prim_index,
+			                        tri_shader,
+			                        vnormal,
+			                        tri_vindex,
+			                        tri_patch,
+			                        tri_patch_uv));
 		}
 
+		pool.wait_work();
+
+		if(progress.get_cancel()) return;
+
 		/* vertex coordinates */
 		progress.set_status("Updating Mesh", "Copying Mesh to device");
 
@@ -1508,11 +1586,21 @@ void MeshManager::device_update_mesh(Device *device,
 		float4 *curve_keys = dscene->curve_keys.resize(curve_key_size);
 		float4 *curves = dscene->curves.resize(curve_size);
 
+		TaskPool pool;
+
 		foreach(Mesh *mesh, scene->meshes) {
-			mesh->pack_curves(scene, &curve_keys[mesh->curvekey_offset], &curves[mesh->curve_offset], mesh->curvekey_offset);
-			if(progress.get_cancel()) return;
+			pool.push(function_bind(&Mesh::pack_curves,
+			                        mesh,
+			                        scene,
+			                        &curve_keys[mesh->curvekey_offset],
+			                        &curves[mesh->curve_offset],
+			                        mesh->curvekey_offset));
 		}
 
+		pool.wait_work();
+
+		if(progress.get_cancel()) return;
+
 		device->tex_alloc("__curve_keys", dscene->curve_keys);
 		device->tex_alloc("__curves", dscene->curves);
 	}
@@ -1522,30 +1610,29 @@ void MeshManager::device_update_mesh(Device *device,
 
 		uint *patch_data = dscene->patches.resize(patch_size);
 
+		TaskPool pool;
+
 		foreach(Mesh *mesh, scene->meshes) {
-			mesh->pack_patches(&patch_data[mesh->patch_offset], mesh->vert_offset, mesh->face_offset, mesh->corner_offset);
+			pool.push(function_bind(&mesh_pack_patches, mesh, patch_data));
+		}
 
-			if(mesh->patch_table) {
-				mesh->patch_table->copy_adjusting_offsets(&patch_data[mesh->patch_table_offset], mesh->patch_table_offset);
-			}
+		pool.wait_work();
 
-			if(progress.get_cancel()) return;
-		}
+		if(progress.get_cancel()) return;
 
 		device->tex_alloc("__patches", dscene->patches);
 	}
 
 	if(for_displacement) {
 		float4 *prim_tri_verts = dscene->prim_tri_verts.resize(tri_size * 3);
+		TaskPool pool;
+
 		foreach(Mesh *mesh, scene->meshes) {
-			for(size_t i = 0; i < mesh->num_triangles(); ++i) {
-				Mesh::Triangle t = mesh->get_triangle(i);
-				size_t offset = 3 * (i + mesh->tri_offset);
-				prim_tri_verts[offset + 0] = float3_to_float4(mesh->verts[t.v[0]]);
-				prim_tri_verts[offset + 1] = float3_to_float4(mesh->verts[t.v[1]]);
-				prim_tri_verts[offset + 2] = float3_to_float4(mesh->verts[t.v[2]]);
-			}
+			pool.push(function_bind(&mesh_pack_prim_tri_verts, mesh, prim_tri_verts));
 		}
+
+		pool.wait_work();
+
 		device->tex_alloc("__prim_tri_verts", dscene->prim_tri_verts);
 	}
 }
@@ -1553,23 +1640,67 @@ void MeshManager::device_update_mesh(Device *device,
 void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
 {
 	/* bvh build */
-	progress.set_status("Updating Scene BVH", "Building");
-
-	VLOG(1) << (scene->params.use_qbvh ? "Using QBVH optimization structure"
-	                                   : "Using regular BVH optimization structure");
+	if(scene->params.use_obvh) {
+		VLOG(1) << "Using OBVH optimization structure";
+	}
+	else {
+		VLOG(1) << (scene->params.use_qbvh ? "Using QBVH optimization structure"
+		                                   : "Using regular BVH optimization structure");
+	}
 
 	BVHParams bparams;
 	bparams.top_level = true;
 	bparams.use_qbvh = scene->params.use_qbvh;
+	bparams.use_obvh = scene->params.use_obvh;
 	bparams.use_spatial_split = scene->params.use_bvh_spatial_split;
 	bparams.use_unaligned_nodes = dscene->data.bvh.have_curves &&
 	                              scene->params.use_bvh_unaligned_nodes;
+	bparams.refit_rebuild_threshold = scene->params.bvh_refit_threshold;
+
+	double bvh_start_time = time_dt();
+
+	/* Keep the BVH and only refit it when objects and mesh topology are
+	 * the same as in the previous update, typical for deforming meshes in
+	 * animation renders with persistent data. */
+	bool refitted = false;
+	if(bvh &&
+	   scene->params.use_bvh_refit &&
+	   !need_bvh_rebuild &&
+	   bvh->objects == scene->objects &&
+	   bvh->params.use_unaligned_nodes == bparams.use_unaligned_nodes)
+	{
+		progress.set_status("Updating Scene BVH", "Refitting");
+		refitted = bvh->refit(progress);
+		VLOG(1) << (refitted ? "Refitted scene BVH"
+		                     : "Scene BVH can not be refitted, rebuilding");
+	}
+
+	if(!refitted) {
+		progress.set_status("Updating Scene BVH", "Building");
+
+		delete bvh;
+		bvh = BVH::create(bparams, scene->objects);
+		bvh->build(progress);
+
+		if(progress.get_cancel()) {
+			/* BVH is incomplete, it can't be refitted later. */
+			delete bvh;
+			bvh = NULL;
+			return;
+		}
+	}
 
-	delete bvh;
-	bvh = BVH::create(bparams, scene->objects);
-	bvh->build(progress);
+	need_bvh_rebuild = false;
 
-	if(progress.get_cancel()) return;
+	SceneUpdateStats& stats = scene->update_stats;
+	stats.bvh_layout = (bparams.use_obvh)? "OBVH": (bparams.use_qbvh)? "QBVH": "BVH2";
+	stats.bvh_refitted = refitted;
+	stats.bvh_time = time_dt() - bvh_start_time;
+	stats.bvh_nodes = bvh->num_nodes;
+	stats.bvh_leaf_nodes = bvh->num_leaf_nodes;
+	stats.bvh_primitives = bvh->pack.prim_index.size();
+	stats.bvh_objects = bvh->objects.size();
+	stats.bvh_area_ratio = bvh->area_ratio;
 
 	/* copy to device */
 	progress.set_status("Updating Scene BVH", "Copying BVH to device");
@@ -1615,6 +1746,7 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 
 	dscene->data.bvh.root = pack.root_index;
 	dscene->data.bvh.use_qbvh = scene->params.use_qbvh;
+	dscene->data.bvh.use_obvh = scene->params.use_obvh;
 }
 
 void MeshManager::device_update_flags(Device * /*device*/,
@@ -1745,6 +1877,8 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 
 			DiagSplit dsplit(*mesh->subd_params);
 			mesh->tessellate(&dsplit);
+			/* dicing may change with the camera */
+			mesh->need_update_rebuild = true;
 
 			i++;
 
@@ -1817,6 +1951,10 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 		if(mesh->need_update && mesh->need_build_bvh()) {
 			num_bvh++;
 		}
+		/* Scene BVH can only be refitted when no topology changed. */
+		if(mesh->need_update && mesh->need_update_rebuild) {
+			need_bvh_rebuild = true;
+		}
 	}
 
 	TaskPool pool;
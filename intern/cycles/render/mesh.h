@@ -265,6 +265,9 @@ public:
 
 	bool need_update;
 	bool need_flags_update;
+	/* Mesh topology changed since the scene BVH was built, so it can not be
+	 * refitted. */
+	bool need_bvh_rebuild;
 
 	MeshManager();
 	~MeshManager();
@@ -239,6 +239,8 @@ NODE_DEFINE(ImageTextureNode)
 	SOCKET_FLOAT(projection_blend, "Projection Blend", 0.0f);
 
 	SOCKET_IN_POINT(vector, "Vector", make_float3(0.0f, 0.0f, 0.0f), SocketType::LINK_TEXTURE_UV);
+	SOCKET_IN_POINT(vector_dx, "VectorDX", make_float3(0.0f, 0.0f, 0.0f), SocketType::SVM_INTERNAL);
+	SOCKET_IN_POINT(vector_dy, "VectorDY", make_float3(0.0f, 0.0f, 0.0f), SocketType::SVM_INTERNAL);
 
 	SOCKET_OUT_COLOR(color, "Color");
 	SOCKET_OUT_FLOAT(alpha, "Alpha");
@@ -318,6 +320,17 @@ void ImageTextureNode::compile(SVMCompiler& compiler)
 		int vector_offset = tex_mapping.compile_begin(compiler, vector_in);
 
 		if(projection != NODE_IMAGE_PROJ_BOX) {
+			/* shifted texture coordinates for the texture cache */
+			ShaderInput *vector_dx_in = input("VectorDX");
+			ShaderInput *vector_dy_in = input("VectorDY");
+			int vector_dx_offset = SVM_STACK_INVALID;
+			int vector_dy_offset = SVM_STACK_INVALID;
+
+			if(vector_dx_in->link && vector_dy_in->link) {
+				vector_dx_offset = tex_mapping.compile_begin(compiler, vector_dx_in);
+				vector_dy_offset = tex_mapping.compile_begin(compiler, vector_dy_in);
+			}
+
 			compiler.add_node(NODE_TEX_IMAGE,
 				slot,
 				compiler.encode_uchar4(
@@ -325,7 +338,16 @@ void ImageTextureNode::compile(SVMCompiler& compiler)
 					compiler.stack_assign_if_linked(color_out),
 					compiler.stack_assign_if_linked(alpha_out),
 					srgb),
-				projection);
+				compiler.encode_uchar4(
+					projection,
+					vector_dx_offset,
+					vector_dy_offset,
+					0));
+
+			if(vector_dx_in->link && vector_dy_in->link) {
+				tex_mapping.compile_end(compiler, vector_dx_in, vector_dx_offset);
+				tex_mapping.compile_end(compiler, vector_dy_in, vector_dy_offset);
+			}
 		}
 		else {
 			compiler.add_node(NODE_TEX_IMAGE_BOX,
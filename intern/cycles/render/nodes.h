@@ -96,6 +96,8 @@ public:
 	float projection_blend;
 	bool animated;
 	float3 vector;
+	float3 vector_dx;
+	float3 vector_dy;
 
 	virtual bool equals(const ShaderNode& other)
 	{
@@ -37,6 +37,7 @@
 #include "util_guarded_allocator.h"
 #include "util_logging.h"
 #include "util_progress.h"
+#include "util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -131,6 +132,19 @@ void Scene::free_memory(bool final)
 	}
 }
 
+/* Record the time spent in a device update stage, and restart the timer for
+ * the next one. */
+static void log_update_time(SceneUpdateStats *stats,
+                            const char *stage,
+                            double *update_time)
+{
+	double time = time_dt();
+	VLOG(1) << "Scene update stage " << stage << " took "
+	        << time - *update_time << " seconds";
+	stats->add_stage_time(stage, time - *update_time);
+	*update_time = time;
+}
+
 void Scene::device_update(Device *device_, Progress& progress)
 {
 	if(!device)
@@ -150,89 +164,111 @@ void Scene::device_update(Device *device_, Progress& progress)
 	 */
 	
 	image_manager->set_pack_images(device->info.pack_images);
+	image_manager->set_texture_cache((params.use_texture_cache)? device->get_texture_cache(): NULL,
+	                                 params.texture_cache_size);
+
+	double start_time = time_dt();
+	double update_time = start_time;
 
 	progress.set_status("Updating Shaders");
 	shader_manager->device_update(device, &dscene, this, progress);
+	log_update_time(&update_stats, "Shaders", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Background");
 	background->device_update(device, &dscene, this);
+	log_update_time(&update_stats, "Background", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Camera");
 	camera->device_update(device, &dscene, this);
+	log_update_time(&update_stats, "Camera", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Meshes Flags");
 	mesh_manager->device_update_flags(device, &dscene, this, progress);
+	log_update_time(&update_stats, "Meshes Flags", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Objects");
 	object_manager->device_update(device, &dscene, this, progress);
+	log_update_time(&update_stats, "Objects", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Meshes");
 	mesh_manager->device_update(device, &dscene, this, progress);
+	log_update_time(&update_stats, "Meshes", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Objects Flags");
 	object_manager->device_update_flags(device, &dscene, this, progress);
+	log_update_time(&update_stats, "Objects Flags", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Images");
 	image_manager->device_update(device, &dscene, this, progress);
+	log_update_time(&update_stats, "Images", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Camera Volume");
 	camera->device_update_volume(device, &dscene, this);
+	log_update_time(&update_stats, "Camera Volume", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Hair Systems");
 	curve_system_manager->device_update(device, &dscene, this, progress);
+	log_update_time(&update_stats, "Hair Systems", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Lookup Tables");
 	lookup_tables->device_update(device, &dscene);
+	log_update_time(&update_stats, "Lookup Tables", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Lights");
 	light_manager->device_update(device, &dscene, this, progress);
+	log_update_time(&update_stats, "Lights", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Particle Systems");
 	particle_system_manager->device_update(device, &dscene, this, progress);
+	log_update_time(&update_stats, "Particle Systems", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Integrator");
 	integrator->device_update(device, &dscene, this);
+	log_update_time(&update_stats, "Integrator", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Film");
 	film->device_update(device, &dscene, this);
+	log_update_time(&update_stats, "Film", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Lookup Tables");
 	lookup_tables->device_update(device, &dscene);
+	log_update_time(&update_stats, "Lookup Tables", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	progress.set_status("Updating Baking");
 	bake_manager->device_update(device, &dscene, this, progress);
+	log_update_time(&update_stats, "Baking", &update_time);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
@@ -241,6 +277,12 @@ void Scene::device_update(Device *device_, Progress& progress)
 		device->const_copy_to("__data", &dscene.data, sizeof(dscene.data));
 	}
 
+	update_stats.num_updates++;
+	update_stats.total_time += time_dt() - start_time;
+
+	VLOG(1) << "Total time spent updating scene on device: "
+	        << time_dt() - start_time << " seconds";
+
 	if(print_stats) {
 		size_t mem_used = util_guarded_get_mem_used();
 		size_t mem_peak = util_guarded_get_mem_peak();
@@ -19,6 +19,7 @@
 
 #include "image.h"
 #include "shader.h"
+#include "stats.h"
 
 #include "device_memory.h"
 
@@ -95,6 +96,8 @@ public:
 	/* lights */
 	device_vector<float4> light_distribution;
 	device_vector<float4> light_data;
+	device_vector<float4> light_tree_nodes;
+	device_vector<uint> light_tree_emitters;
 	device_vector<float2> light_background_marginal_cdf;
 	device_vector<float2> light_background_conditional_cdf;
 
@@ -120,6 +123,10 @@ public:
 	device_vector<half4> tex_half4_image[TEX_NUM_HALF4_CPU];
 	device_vector<half> tex_half_image[TEX_NUM_HALF_CPU];
 
+	/* tile offsets of sparse cpu 3d images */
+	device_vector<int> tex_float4_image_offsets[TEX_NUM_FLOAT4_CPU];
+	device_vector<int> tex_float_image_offsets[TEX_NUM_FLOAT_CPU];
+
 	/* opencl images */
 	device_vector<uchar4> tex_image_byte4_packed;
 	device_vector<float4> tex_image_float4_packed;
@@ -144,8 +151,14 @@ public:
 	bool use_bvh_spatial_split;
 	bool use_bvh_unaligned_nodes;
 	bool use_qbvh;
+	bool use_obvh;
+	bool use_bvh_refit;
+	float bvh_refit_threshold;
 	bool persistent_data;
+	bool persistent_scene;
 	int texture_limit;
+	bool use_texture_cache;
+	int texture_cache_size;
 
 	SceneParams()
 	{
@@ -154,8 +167,14 @@ public:
 		use_bvh_spatial_split = false;
 		use_bvh_unaligned_nodes = true;
 		use_qbvh = false;
+		use_obvh = false;
+		use_bvh_refit = false;
+		bvh_refit_threshold = 0.0f;
 		persistent_data = false;
+		persistent_scene = false;
 		texture_limit = 0;
+		use_texture_cache = false;
+		texture_cache_size = 0;
 	}
 
 	bool modified(const SceneParams& params)
@@ -164,8 +183,14 @@ public:
 		&& use_bvh_spatial_split == params.use_bvh_spatial_split
 		&& use_bvh_unaligned_nodes == params.use_bvh_unaligned_nodes
 		&& use_qbvh == params.use_qbvh
+		&& use_obvh == params.use_obvh
+		&& use_bvh_refit == params.use_bvh_refit
+		&& bvh_refit_threshold == params.bvh_refit_threshold
 		&& persistent_data == params.persistent_data
-		&& texture_limit == params.texture_limit); }
+		&& persistent_scene == params.persistent_scene
+		&& texture_limit == params.texture_limit
+		&& use_texture_cache == params.use_texture_cache
+		&& texture_cache_size == params.texture_cache_size); }
 };
 
 /* Scene */
@@ -209,6 +234,9 @@ public:
 	/* parameters */
 	SceneParams params;
 
+	/* timing of device updates */
+	SceneUpdateStats update_stats;
+
 	/* mutex must be locked manually by callers */
 	thread_mutex mutex;
 
@@ -20,19 +20,25 @@
 #include "buffers.h"
 #include "camera.h"
 #include "device.h"
+#include "film.h"
 #include "graph.h"
 #include "integrator.h"
 #include "mesh.h"
 #include "object.h"
 #include "scene.h"
 #include "session.h"
+#include "shader.h"
+#include "stats.h"
 #include "bake.h"
 
+#include "kernels/cpu/kernel_texture_cache.h"
+
 #include "util_foreach.h"
 #include "util_function.h"
 #include "util_logging.h"
 #include "util_math.h"
 #include "util_opengl.h"
+#include "util_path.h"
 #include "util_task.h"
 #include "util_time.h"
 
@@ -54,6 +60,7 @@ Session::Session(const SessionParams& params_)
 	TaskScheduler::init(params.threads);
 
 	device = Device::create(params.device, stats, params.background);
+	device->set_profiling(params.use_profiling);
 
 	if(params.background && params.output_path.empty()) {
 		buffers = NULL;
@@ -79,6 +86,14 @@ Session::Session(const SessionParams& params_)
 	pause = false;
 	kernels_loaded = false;
 
+	use_checkpoint = false;
+	checkpoint_write_pending = false;
+	last_checkpoint_time = 0.0;
+
+	denoise_params.radius = params.denoising_radius;
+	denoise_params.strength = params.denoising_strength;
+	denoise_params.feature_strength = params.denoising_feature_strength;
+
 	/* TODO(sergey): Check if it's indeed optimal value for the split kernel. */
 	max_closure_global = 1;
 }
@@ -117,6 +132,8 @@ Session::~Session()
 	foreach(RenderBuffers *buffers, tile_buffers)
 		delete buffers;
 
+	denoise_free_tiles(false);
+
 	delete buffers;
 	delete display;
 	delete scene;
@@ -266,6 +283,9 @@ void Session::run_gpu()
 			/* update status and timing */
 			update_status_time();
 
+			/* write out tiles restored from a checkpoint */
+			checkpoint_write_tiles();
+
 			/* path trace */
 			path_trace();
 
@@ -344,6 +364,11 @@ bool Session::draw_cpu(BufferParams& buffer_params, DeviceDrawParams& draw_param
 	return false;
 }
 
+static size_t render_buffers_size(RenderBuffers *buffers)
+{
+	return buffers->buffer.memory_size() + buffers->rng_state.memory_size();
+}
+
 bool Session::acquire_tile(Device *tile_device, RenderTile& rtile)
 {
 	if(progress.get_cancel()) {
@@ -370,6 +395,8 @@ bool Session::acquire_tile(Device *tile_device, RenderTile& rtile)
 	rtile.start_sample = tile_manager.state.sample;
 	rtile.num_samples = tile_manager.state.num_samples;
 	rtile.resolution = tile_manager.state.resolution_divider;
+	rtile.tile_index = tile.index;
+	rtile.converged = false;
 
 	tile_lock.unlock();
 
@@ -416,6 +443,15 @@ bool Session::acquire_tile(Device *tile_device, RenderTile& rtile)
 			tile_buffers[tile.index] = tilebuffers;
 
 			tilebuffers->reset(tile_device, buffer_params);
+			film_stats.mem_alloc(render_buffers_size(tilebuffers));
+
+			/* continue from the samples in the checkpoint */
+			const RenderCheckpoint::Tile *checkpoint_tile = checkpoint.find_tile(tile.index);
+			if(checkpoint_tile) {
+				RenderCheckpoint::copy_to_buffers(*checkpoint_tile, tilebuffers);
+				tile_device->mem_copy_to(tilebuffers->buffer);
+				tile_device->mem_copy_to(tilebuffers->rng_state);
+			}
 		}
 
 		tile_lock.unlock();
@@ -424,6 +460,7 @@ bool Session::acquire_tile(Device *tile_device, RenderTile& rtile)
 		tilebuffers = new RenderBuffers(tile_device);
 
 		tilebuffers->reset(tile_device, buffer_params);
+		film_stats.mem_alloc(render_buffers_size(tilebuffers));
 	}
 
 	rtile.buffer = tilebuffers->buffer.device_pointer;
@@ -458,11 +495,26 @@ void Session::release_tile(RenderTile& rtile)
 {
 	thread_scoped_lock tile_lock(tile_mutex);
 
+	if(rtile.converged && tile_manager.set_tile_converged(rtile.tile_index)) {
+		/* retired tile is skipped for the remaining samples, account for them */
+		int end_sample = tile_manager.range_start_sample + tile_manager.get_num_effective_samples();
+		int num_samples = end_sample - (rtile.start_sample + rtile.num_samples);
+
+		if(tile_manager.num_samples != INT_MAX && num_samples > 0)
+			progress.add_samples((uint64_t)num_samples*rtile.w*rtile.h, rtile.sample);
+	}
+
+	checkpoint_add_tile(rtile);
+
 	if(write_render_tile_cb) {
-		if(params.progressive_refine == false) {
+		if(params.progressive_refine == false && use_denoising()) {
+			denoise_release_tile(rtile, tile_lock);
+		}
+		else if(params.progressive_refine == false) {
 			/* todo: optimize this by making it thread safe and removing lock */
 			write_render_tile_cb(rtile);
 
+			film_stats.mem_free(render_buffers_size(rtile.buffers));
 			delete rtile.buffers;
 		}
 	}
@@ -552,6 +604,9 @@ void Session::run_cpu()
 			/* update status and timing */
 			update_status_time();
 
+			/* write out tiles restored from a checkpoint */
+			checkpoint_write_tiles();
+
 			/* path trace */
 			path_trace();
 
@@ -594,6 +649,14 @@ void Session::run_cpu()
 
 	if(!tiles_written)
 		update_progressive_refine(true);
+
+	if(use_denoising()) {
+		if(buffers && !progress.get_cancel())
+			denoise_full_buffers();
+
+		/* write out tiles still waiting for their neighbors after canceling */
+		denoise_free_tiles(true);
+	}
 }
 
 DeviceRequestedFeatures Session::get_requested_device_features()
@@ -681,6 +744,8 @@ void Session::run()
 			run_gpu();
 		else
 			run_cpu();
+
+		checkpoint_end(progress.get_cancel());
 	}
 
 	/* progress update */
@@ -700,15 +765,23 @@ bool Session::draw(BufferParams& buffer_params, DeviceDrawParams &draw_params)
 
 void Session::reset_(BufferParams& buffer_params, int samples)
 {
+	/* add passes used internally by the kernel, matching Film::device_update */
+	BufferParams render_params = buffer_params;
+
+	if(scene->integrator->adaptive_threshold > 0.0f)
+		Pass::add(PASS_ADAPTIVE_AUX, render_params.passes);
+
+	render_params.denoising_data_pass = use_denoising();
+
 	if(buffers) {
-		if(buffer_params.modified(buffers->params)) {
+		if(render_params.modified(buffers->params)) {
 			gpu_draw_ready = false;
-			buffers->reset(device, buffer_params);
+			buffers->reset(device, render_params);
 			display->reset(device, buffer_params);
 		}
 	}
 
-	tile_manager.reset(buffer_params, samples);
+	tile_manager.reset(render_params, samples);
 	progress.reset_sample();
 
 	bool show_progress = params.background || tile_manager.get_num_effective_samples() != INT_MAX;
@@ -717,6 +790,12 @@ void Session::reset_(BufferParams& buffer_params, int samples)
 	if(!params.background)
 		progress.set_start_time();
 	progress.set_render_start_time();
+
+	/* counters are for the render since the last reset */
+	if(params.use_profiling)
+		device->set_profiling(true);
+
+	checkpoint_reset(render_params);
 }
 
 void Session::reset(BufferParams& buffer_params, int samples)
@@ -729,11 +808,20 @@ void Session::reset(BufferParams& buffer_params, int samples)
 	if(params.progressive_refine) {
 		thread_scoped_lock buffers_lock(buffers_mutex);
 
-		foreach(RenderBuffers *buffers, tile_buffers)
-			delete buffers;
+		foreach(RenderBuffers *buffers, tile_buffers) {
+			if(buffers) {
+				film_stats.mem_free(render_buffers_size(buffers));
+				delete buffers;
+			}
+		}
 
 		tile_buffers.clear();
 	}
+
+	if(!denoise_tiles.empty()) {
+		thread_scoped_lock buffers_lock(buffers_mutex);
+		denoise_free_tiles(false);
+	}
 }
 
 void Session::set_samples(int samples)
@@ -749,6 +837,11 @@ void Session::set_samples(int samples)
 	}
 }
 
+void Session::set_checkpoint_path(const string& filepath)
+{
+	params.checkpoint_path = filepath;
+}
+
 void Session::set_pause(bool pause_)
 {
 	bool notify = false;
@@ -809,6 +902,15 @@ void Session::update_scene()
 		}
 	}
 
+	/* feature data for the denoiser */
+	Film *film = scene->film;
+	bool use_denoising_data = use_denoising();
+
+	if(use_denoising_data != film->use_denoising_data) {
+		film->use_denoising_data = use_denoising_data;
+		film->tag_update(scene);
+	}
+
 	/* update scene */
 	if(scene->need_update()) {
 		progress.set_status("Updating Scene");
@@ -915,6 +1017,10 @@ bool Session::update_progressive_refine(bool cancel)
 	int sample = tile_manager.state.sample + 1;
 	bool write = sample == tile_manager.num_samples || cancel;
 
+	/* all tiles finished this sample, unless canceled */
+	if(!cancel)
+		checkpoint_samples(sample);
+
 	double current_time = time_dt();
 
 	if(current_time - last_update_time < params.progressive_update_timeout) {
@@ -924,6 +1030,9 @@ bool Session::update_progressive_refine(bool cancel)
 	}
 
 	if(params.progressive_refine) {
+		if(write && !cancel && use_denoising())
+			denoise_tile_buffers();
+
 		foreach(RenderBuffers *buffers, tile_buffers) {
 			RenderTile rtile;
 			rtile.buffers = buffers;
@@ -945,20 +1054,556 @@ bool Session::update_progressive_refine(bool cancel)
 	return write;
 }
 
+/* Checkpoint */
+
+void Session::checkpoint_reset(BufferParams& buffer_params)
+{
+	checkpoint.end();
+	checkpoint.tiles.clear();
+	checkpoint_write_pending = false;
+	last_checkpoint_time = time_dt();
+
+	/* only background renders with a known number of samples, and progressive
+	 * rendering only when the buffers stay around between samples */
+	use_checkpoint = params.background &&
+	                 !params.checkpoint_path.empty() &&
+	                 tile_manager.get_num_effective_samples() != INT_MAX &&
+	                 !(params.progressive && !buffers && !params.progressive_refine);
+
+	if(!use_checkpoint)
+		return;
+
+	checkpoint.params = buffer_params;
+	checkpoint.tile_size = params.tile_size;
+	checkpoint.start_sample = tile_manager.range_start_sample;
+	checkpoint.num_samples = tile_manager.get_num_effective_samples();
+	checkpoint.seed = scene->integrator->seed;
+	checkpoint.progressive = params.progressive;
+	checkpoint.sample = tile_manager.range_start_sample;
+	checkpoint.converged_tiles.clear();
+
+	if(params.checkpoint_resume && checkpoint.read(params.checkpoint_path)) {
+		uint64_t pixel_samples = 0;
+		uint64_t num_pixels = 0;
+
+		foreach(const RenderCheckpoint::Tile& tile, checkpoint.tiles) {
+			pixel_samples += (uint64_t)tile.num_samples*tile.w*tile.h;
+			num_pixels += (uint64_t)tile.w*tile.h;
+		}
+
+		if(params.progressive) {
+			/* all pixels must be there, the tiles are at the same sample */
+			if(num_pixels != (uint64_t)buffer_params.width*buffer_params.height) {
+				VLOG(1) << "Incomplete render checkpoint " << params.checkpoint_path << ".";
+				checkpoint.tiles.clear();
+				checkpoint.sample = tile_manager.range_start_sample;
+				checkpoint.converged_tiles.clear();
+				pixel_samples = 0;
+			}
+			else {
+				tile_manager.resume(checkpoint.sample, checkpoint.converged_tiles);
+			}
+		}
+		else {
+			/* finished tiles are not rendered again */
+			vector<bool> done_tiles;
+
+			foreach(const RenderCheckpoint::Tile& tile, checkpoint.tiles) {
+				if(tile.index >= done_tiles.size())
+					done_tiles.resize(tile.index + 1, false);
+				done_tiles[tile.index] = true;
+			}
+
+			tile_manager.resume(checkpoint.sample, done_tiles);
+		}
+
+		if(!checkpoint.tiles.empty()) {
+			progress.add_samples(pixel_samples, checkpoint.sample);
+
+			/* full frame buffers are restored right away, tile buffers once they
+			 * are allocated or by the session thread */
+			if(buffers) {
+				foreach(const RenderCheckpoint::Tile& tile, checkpoint.tiles)
+					RenderCheckpoint::copy_to_buffers(tile, buffers);
+
+				device->mem_copy_to(buffers->buffer);
+				device->mem_copy_to(buffers->rng_state);
+			}
+			else {
+				checkpoint_write_pending = true;
+			}
+
+			VLOG(1) << "Resuming render from checkpoint " << params.checkpoint_path
+			        << " with " << checkpoint.tiles.size() << " tiles.";
+		}
+	}
+
+	/* without progressive rendering, finished tiles are appended as they come */
+	if(!params.progressive) {
+		if(checkpoint.tiles.empty()) {
+			checkpoint.begin(params.checkpoint_path, false);
+		}
+		else {
+			/* restored tiles are written to a temporary file replacing the
+			 * checkpoint once complete, so being killed meanwhile loses nothing,
+			 * and this also drops a partially written trailing tile */
+			bool ok = checkpoint.begin(params.checkpoint_path, true);
+
+			foreach(const RenderCheckpoint::Tile& tile, checkpoint.tiles)
+				ok = ok && checkpoint.add_tile(tile);
+
+			if(checkpoint.end() && ok)
+				checkpoint.append(params.checkpoint_path);
+		}
+	}
+}
+
+void Session::checkpoint_write_tiles()
+{
+	if(!checkpoint_write_pending)
+		return;
+
+	checkpoint_write_pending = false;
+
+	/* after resuming, tiles that are not rendered again are written out when
+	 * finished, or kept for progressive refine when converged */
+	const vector<bool>& converged_tiles = tile_manager.state.converged_tiles;
+
+	foreach(const RenderCheckpoint::Tile& tile, checkpoint.tiles) {
+		if(params.progressive &&
+		   !(tile.index < converged_tiles.size() && converged_tiles[tile.index]))
+		{
+			continue;
+		}
+
+		BufferParams buffer_params = tile_manager.params;
+		buffer_params.full_x = tile.x;
+		buffer_params.full_y = tile.y;
+		buffer_params.width = tile.w;
+		buffer_params.height = tile.h;
+
+		RenderBuffers *tilebuffers = new RenderBuffers(device);
+		tilebuffers->reset(device, buffer_params);
+		film_stats.mem_alloc(render_buffers_size(tilebuffers));
+
+		RenderCheckpoint::copy_to_buffers(tile, tilebuffers);
+		device->mem_copy_to(tilebuffers->buffer);
+		device->mem_copy_to(tilebuffers->rng_state);
+
+		if(params.progressive) {
+			thread_scoped_lock tile_lock(tile_mutex);
+
+			if(tile_buffers.size() == 0)
+				tile_buffers.resize(tile_manager.state.num_tiles, NULL);
+
+			tile_buffers[tile.index] = tilebuffers;
+			continue;
+		}
+
+		RenderTile rtile;
+		rtile.x = tile.x;
+		rtile.y = tile.y;
+		rtile.w = tile.w;
+		rtile.h = tile.h;
+		rtile.start_sample = checkpoint.start_sample;
+		rtile.num_samples = tile.num_samples;
+		rtile.sample = checkpoint.start_sample + tile.num_samples;
+		rtile.resolution = 1;
+		rtile.tile_index = tile.index;
+		rtile.buffer = tilebuffers->buffer.device_pointer;
+		rtile.rng_state = tilebuffers->rng_state.device_pointer;
+		rtile.buffers = tilebuffers;
+		buffer_params.get_offset_stride(rtile.offset, rtile.stride);
+
+		if(write_render_tile_cb && use_denoising()) {
+			thread_scoped_lock tile_lock(tile_mutex);
+			denoise_release_tile(rtile, tile_lock);
+			continue;
+		}
+
+		if(write_render_tile_cb)
+			write_render_tile_cb(rtile);
+
+		film_stats.mem_free(render_buffers_size(tilebuffers));
+		delete tilebuffers;
+	}
+}
+
+void Session::checkpoint_add_tile(RenderTile& rtile)
+{
+	if(!use_checkpoint || params.progressive)
+		return;
+
+	/* canceled tiles are rendered again when resuming */
+	if(rtile.sample != rtile.start_sample + rtile.num_samples)
+		return;
+
+	rtile.buffers->copy_from_device();
+	checkpoint.add_tile(rtile.buffers, rtile.tile_index,
+	                    rtile.x, rtile.y, rtile.w, rtile.h,
+	                    rtile.sample - rtile.start_sample);
+}
+
+void Session::checkpoint_samples(int sample)
+{
+	if(!use_checkpoint || !params.progressive)
+		return;
+
+	/* no need for a checkpoint when the render is about to finish */
+	if(sample >= checkpoint.start_sample + checkpoint.num_samples)
+		return;
+
+	double current_time = time_dt();
+
+	if(current_time - last_checkpoint_time < params.checkpoint_interval)
+		return;
+
+	checkpoint.sample = sample;
+	checkpoint.converged_tiles = tile_manager.state.converged_tiles;
+
+	int num_samples = sample - checkpoint.start_sample;
+
+	if(checkpoint.begin(params.checkpoint_path, true)) {
+		if(buffers) {
+			/* split the full frame, to avoid copying it at once */
+			BufferParams& buffer_params = buffers->params;
+			int2 tile_size = params.tile_size;
+
+			buffers->copy_from_device();
+
+			for(int y = 0; y < buffer_params.height; y += tile_size.y) {
+				for(int x = 0; x < buffer_params.width; x += tile_size.x) {
+					checkpoint.add_tile(buffers, -1,
+					                    buffer_params.full_x + x, buffer_params.full_y + y,
+					                    min(tile_size.x, buffer_params.width - x),
+					                    min(tile_size.y, buffer_params.height - y),
+					                    num_samples);
+				}
+			}
+		}
+		else {
+			for(size_t i = 0; i < tile_buffers.size(); i++) {
+				RenderBuffers *tilebuffers = tile_buffers[i];
+
+				if(tilebuffers) {
+					BufferParams& buffer_params = tilebuffers->params;
+
+					tilebuffers->copy_from_device();
+					checkpoint.add_tile(tilebuffers, i,
+					                    buffer_params.full_x, buffer_params.full_y,
+					                    buffer_params.width, buffer_params.height,
+					                    num_samples);
+				}
+			}
+		}
+
+		if(checkpoint.end())
+			VLOG(1) << "Wrote render checkpoint " << params.checkpoint_path << " at sample " << sample << ".";
+	}
+
+	last_checkpoint_time = current_time;
+}
+
+void Session::checkpoint_end(bool cancel)
+{
+	if(!use_checkpoint)
+		return;
+
+	checkpoint.end();
+	checkpoint.tiles.clear();
+
+	/* a finished render needs no checkpoint anymore */
+	if(!cancel)
+		path_remove(params.checkpoint_path);
+}
+
 void Session::device_free()
 {
 	scene->device_free();
 
-	foreach(RenderBuffers *buffers, tile_buffers)
-		delete buffers;
+	foreach(RenderBuffers *buffers, tile_buffers) {
+		if(buffers) {
+			film_stats.mem_free(render_buffers_size(buffers));
+			delete buffers;
+		}
+	}
 
 	tile_buffers.clear();
 
+	denoise_free_tiles(false);
+
 	/* used from background render only, so no need to
 	 * re-create render/display buffers here
 	 */
 }
 
+/* Denoising */
+
+bool Session::use_denoising()
+{
+	/* the denoiser reads the render buffers on the host */
+	return params.use_denoising && params.background && params.device.type == DEVICE_CPU;
+}
+
+static void denoise_task(Denoiser *denoiser,
+                         RenderBuffers *target,
+                         int4 rect,
+                         vector<RenderBuffers*> buffers)
+{
+	denoiser->denoise(target, rect, buffers);
+}
+
+void Session::denoise_release_tile(RenderTile& rtile, thread_scoped_lock& tile_lock)
+{
+	if(denoise_tiles.size() == 0)
+		denoise_tiles.resize(tile_manager.state.num_tiles);
+
+	denoise_tiles[rtile.tile_index] = rtile;
+
+	/* denoise the tiles of which all neighbors are rendered now */
+	vector<int> ready_tiles;
+	tile_manager.set_tile_rendered(rtile.tile_index, ready_tiles);
+
+	foreach(int index, ready_tiles) {
+		RenderTile tile = denoise_tiles[index];
+
+		vector<int> neighbors;
+		vector<RenderBuffers*> neighbor_buffers;
+		tile_manager.get_tile_neighbors(index, neighbors);
+
+		foreach(int neighbor, neighbors) {
+			if(denoise_tiles[neighbor].buffers)
+				neighbor_buffers.push_back(denoise_tiles[neighbor].buffers);
+		}
+
+		/* neighbors are not freed before this tile is denoised, so other
+		 * threads can acquire and release tiles meanwhile */
+		tile_lock.unlock();
+
+		if(!progress.get_cancel()) {
+			Denoiser denoiser(device, denoise_params);
+			denoiser.denoise(tile.buffers,
+			                 make_int4(tile.x, tile.y, tile.w, tile.h),
+			                 neighbor_buffers);
+		}
+
+		tile_lock.lock();
+
+		write_render_tile_cb(tile);
+
+		vector<int> free_tiles;
+		tile_manager.set_tile_denoised(index, free_tiles);
+
+		foreach(int free_index, free_tiles) {
+			RenderBuffers *tilebuffers = denoise_tiles[free_index].buffers;
+
+			film_stats.mem_free(render_buffers_size(tilebuffers));
+			delete tilebuffers;
+			denoise_tiles[free_index].buffers = NULL;
+		}
+	}
+}
+
+void Session::denoise_tile_buffers()
+{
+	Denoiser denoiser(device, denoise_params);
+	TaskPool pool;
+
+	for(size_t i = 0; i < tile_buffers.size(); i++) {
+		RenderBuffers *target = tile_buffers[i];
+
+		if(!target)
+			continue;
+
+		vector<int> neighbors;
+		vector<RenderBuffers*> neighbor_buffers;
+		tile_manager.get_tile_neighbors(i, neighbors);
+
+		foreach(int neighbor, neighbors) {
+			if(neighbor < tile_buffers.size() && tile_buffers[neighbor])
+				neighbor_buffers.push_back(tile_buffers[neighbor]);
+		}
+
+		BufferParams& buffer_params = target->params;
+		int4 rect = make_int4(buffer_params.full_x, buffer_params.full_y,
+		                      buffer_params.width, buffer_params.height);
+
+		pool.push(function_bind(&denoise_task, &denoiser, target, rect, neighbor_buffers));
+	}
+
+	pool.wait_work();
+}
+
+void Session::denoise_full_buffers()
+{
+	Denoiser denoiser(device, denoise_params);
+	TaskPool pool;
+
+	BufferParams& buffer_params = buffers->params;
+	vector<RenderBuffers*> all_buffers(1, buffers);
+	int2 tile_size = params.tile_size;
+
+	/* split the full frame into tiles, for threading */
+	for(int y = 0; y < buffer_params.height; y += tile_size.y) {
+		for(int x = 0; x < buffer_params.width; x += tile_size.x) {
+			int4 rect = make_int4(buffer_params.full_x + x, buffer_params.full_y + y,
+			                      min(tile_size.x, buffer_params.width - x),
+			                      min(tile_size.y, buffer_params.height - y));
+
+			pool.push(function_bind(&denoise_task, &denoiser, buffers, rect, all_buffers));
+		}
+	}
+
+	pool.wait_work();
+}
+
+void Session::denoise_free_tiles(bool write)
+{
+	thread_scoped_lock tile_lock(tile_mutex);
+
+	const vector<TileManager::DenoiseState>& denoise_states = tile_manager.state.denoise_states;
+
+	foreach(RenderTile& rtile, denoise_tiles) {
+		if(!rtile.buffers)
+			continue;
+
+		bool written = rtile.tile_index < denoise_states.size() &&
+		               denoise_states[rtile.tile_index] == TileManager::DENOISE_DONE;
+
+		if(write && !written && write_render_tile_cb)
+			write_render_tile_cb(rtile);
+
+		film_stats.mem_free(render_buffers_size(rtile.buffers));
+		delete rtile.buffers;
+	}
+
+	denoise_tiles.clear();
+}
+
+/* Statistics */
+
+template<typename T>
+static size_t device_vector_size(device_vector<T> *mem, int num)
+{
+	size_t size = 0;
+	for(int i = 0; i < num; i++)
+		size += mem[i].memory_size();
+	return size;
+}
+
+static void collect_memory_statistics(DeviceScene *dscene,
+                                      vector<RenderStats::MemoryCategory>& memory)
+{
+	RenderStats::MemoryCategory bvh;
+	bvh.name = "bvh";
+	bvh.size = dscene->bvh_nodes.memory_size() +
+	           dscene->bvh_leaf_nodes.memory_size() +
+	           dscene->object_node.memory_size() +
+	           dscene->prim_tri_index.memory_size() +
+	           dscene->prim_tri_verts.memory_size() +
+	           dscene->prim_type.memory_size() +
+	           dscene->prim_visibility.memory_size() +
+	           dscene->prim_index.memory_size() +
+	           dscene->prim_object.memory_size();
+	memory.push_back(bvh);
+
+	RenderStats::MemoryCategory meshes;
+	meshes.name = "meshes";
+	meshes.size = dscene->tri_shader.memory_size() +
+	              dscene->tri_vnormal.memory_size() +
+	              dscene->tri_vindex.memory_size() +
+	              dscene->tri_patch.memory_size() +
+	              dscene->tri_patch_uv.memory_size() +
+	              dscene->curves.memory_size() +
+	              dscene->curve_keys.memory_size() +
+	              dscene->patches.memory_size() +
+	              dscene->attributes_map.memory_size() +
+	              dscene->attributes_float.memory_size() +
+	              dscene->attributes_float3.memory_size() +
+	              dscene->attributes_uchar4.memory_size();
+	memory.push_back(meshes);
+
+	RenderStats::MemoryCategory textures;
+	textures.name = "textures";
+	textures.size = device_vector_size(dscene->tex_byte4_image, TEX_NUM_BYTE4_CPU) +
+	                device_vector_size(dscene->tex_float4_image, TEX_NUM_FLOAT4_CPU) +
+	                device_vector_size(dscene->tex_float_image, TEX_NUM_FLOAT_CPU) +
+	                device_vector_size(dscene->tex_byte_image, TEX_NUM_BYTE_CPU) +
+	                device_vector_size(dscene->tex_half4_image, TEX_NUM_HALF4_CPU) +
+	                device_vector_size(dscene->tex_half_image, TEX_NUM_HALF_CPU) +
+	                device_vector_size(dscene->tex_float4_image_offsets, TEX_NUM_FLOAT4_CPU) +
+	                device_vector_size(dscene->tex_float_image_offsets, TEX_NUM_FLOAT_CPU) +
+	                dscene->tex_image_byte4_packed.memory_size() +
+	                dscene->tex_image_float4_packed.memory_size() +
+	                dscene->tex_image_byte_packed.memory_size() +
+	                dscene->tex_image_float_packed.memory_size() +
+	                dscene->tex_image_packed_info.memory_size();
+	memory.push_back(textures);
+
+	RenderStats::MemoryCategory other;
+	other.name = "scene_other";
+	other.size = dscene->objects.memory_size() +
+	             dscene->objects_vector.memory_size() +
+	             dscene->light_distribution.memory_size() +
+	             dscene->light_data.memory_size() +
+	             dscene->light_tree_nodes.memory_size() +
+	             dscene->light_tree_emitters.memory_size() +
+	             dscene->light_background_marginal_cdf.memory_size() +
+	             dscene->light_background_conditional_cdf.memory_size() +
+	             dscene->particles.memory_size() +
+	             dscene->svm_nodes.memory_size() +
+	             dscene->shader_flag.memory_size() +
+	             dscene->object_flag.memory_size() +
+	             dscene->lookup_table.memory_size() +
+	             dscene->sobol_directions.memory_size();
+	memory.push_back(other);
+}
+
+void Session::collect_statistics(RenderStats *render_stats)
+{
+	progress.get_time(render_stats->total_time, render_stats->render_time);
+	render_stats->pixel_samples = progress.get_pixel_samples();
+
+	render_stats->use_profiling = params.use_profiling;
+	render_stats->kernel.clear();
+	device->get_profiling_counters(render_stats->kernel);
+
+	render_stats->servers.clear();
+	device->get_network_stats(render_stats->servers);
+
+	render_stats->mem_used = stats.mem_used;
+	render_stats->mem_peak = stats.mem_peak;
+	render_stats->memory.clear();
+	render_stats->shader_names.clear();
+
+	if(scene) {
+		thread_scoped_lock scene_lock(scene->mutex);
+
+		render_stats->scene_update = scene->update_stats;
+
+		/* shader id is the index in the scene shaders */
+		foreach(Shader *shader, scene->shaders)
+			render_stats->shader_names.push_back(shader->name.string());
+
+		collect_memory_statistics(&scene->dscene, render_stats->memory);
+	}
+
+	RenderStats::MemoryCategory texture_cache;
+	texture_cache.name = "texture_cache";
+	texture_cache.size = 0;
+	if(device->get_texture_cache())
+		texture_cache.size = device->get_texture_cache()->get_stats().memory_used;
+	render_stats->memory.push_back(texture_cache);
+
+	/* peak of the tile buffers, and the full frame buffers if any */
+	RenderStats::MemoryCategory film;
+	film.name = "film";
+	film.size = film_stats.mem_peak;
+	if(buffers)
+		film.size += render_buffers_size(buffers);
+	render_stats->memory.push_back(film);
+}
+
 int Session::get_max_closure_count()
 {
 	int max_closures = 0;
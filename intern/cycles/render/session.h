@@ -18,6 +18,8 @@
 #define __SESSION_H__
 
 #include "buffers.h"
+#include "checkpoint.h"
+#include "denoising.h"
 #include "device.h"
 #include "shader.h"
 #include "tile.h"
@@ -36,6 +38,7 @@ class DeviceRequestedFeatures;
 class DisplayBuffer;
 class Progress;
 class RenderBuffers;
+class RenderStats;
 class Scene;
 
 /* Session Parameters */
@@ -64,6 +67,22 @@ public:
 
 	ShadingSystem shadingsystem;
 
+	/* gather kernel ray and shader evaluation counters */
+	bool use_profiling;
+
+	/* write accumulated buffers to this file during background render, and
+	 * continue from it when resuming */
+	string checkpoint_path;
+	double checkpoint_interval;
+	bool checkpoint_resume;
+
+	/* denoise the combined pass of background renders on the CPU, see
+	 * denoising.h */
+	bool use_denoising;
+	int denoising_radius;
+	float denoising_strength;
+	float denoising_feature_strength;
+
 	SessionParams()
 	{
 		background = false;
@@ -86,6 +105,17 @@ public:
 
 		shadingsystem = SHADINGSYSTEM_SVM;
 		tile_order = TILE_CENTER;
+
+		use_profiling = false;
+
+		checkpoint_path = "";
+		checkpoint_interval = 60.0;
+		checkpoint_resume = false;
+
+		use_denoising = false;
+		denoising_radius = 8;
+		denoising_strength = 0.5f;
+		denoising_feature_strength = 0.5f;
 	}
 
 	bool modified(const SessionParams& params)
@@ -105,7 +135,15 @@ public:
 		&& text_timeout == params.text_timeout
 		&& progressive_update_timeout == params.progressive_update_timeout
 		&& tile_order == params.tile_order
-		&& shadingsystem == params.shadingsystem); }
+		&& shadingsystem == params.shadingsystem
+		&& use_profiling == params.use_profiling
+		&& checkpoint_path == params.checkpoint_path
+		&& checkpoint_interval == params.checkpoint_interval
+		&& checkpoint_resume == params.checkpoint_resume
+		&& use_denoising == params.use_denoising
+		&& denoising_radius == params.denoising_radius
+		&& denoising_strength == params.denoising_strength
+		&& denoising_feature_strength == params.denoising_feature_strength); }
 
 };
 
@@ -139,6 +177,8 @@ public:
 	void reset(BufferParams& params, int samples);
 	void set_samples(int samples);
 	void set_pause(bool pause);
+	/* checkpoint file for the next reset, e.g. one per render layer */
+	void set_checkpoint_path(const string& filepath);
 
 	void update_scene();
 	void load_kernels();
@@ -149,6 +189,9 @@ public:
 	 * (for example, when rendering with unlimited samples). */
 	float get_progress();
 
+	/* Statistics of the render so far, see stats.h. */
+	void collect_statistics(RenderStats *render_stats);
+
 protected:
 	struct DelayedReset {
 		thread_mutex mutex;
@@ -204,6 +247,31 @@ protected:
 
 	vector<RenderBuffers *> tile_buffers;
 
+	/* memory of render buffers */
+	Stats film_stats;
+
+	/* checkpoint for resuming, see checkpoint.h */
+	RenderCheckpoint checkpoint;
+	bool use_checkpoint;
+	bool checkpoint_write_pending;
+	double last_checkpoint_time;
+
+	void checkpoint_reset(BufferParams& buffer_params);
+	void checkpoint_write_tiles();
+	void checkpoint_add_tile(RenderTile& rtile);
+	void checkpoint_samples(int sample);
+	void checkpoint_end(bool cancel);
+
+	/* denoising, tiles are kept until their neighbors are rendered */
+	DenoiseParams denoise_params;
+	vector<RenderTile> denoise_tiles;
+
+	bool use_denoising();
+	void denoise_release_tile(RenderTile& rtile, thread_scoped_lock& tile_lock);
+	void denoise_tile_buffers();
+	void denoise_full_buffers();
+	void denoise_free_tiles(bool write);
+
 	DeviceRequestedFeatures get_requested_device_features();
 
 	/* ** Split kernel routines ** */
@@ -405,6 +405,7 @@ void ShaderManager::device_update_common(Device *device,
 	uint *shader_flag = dscene->shader_flag.resize(shader_flag_size);
 	uint i = 0;
 	bool has_volumes = false;
+	bool has_subsurface = false;
 	bool has_transparent_shadow = false;
 
 	foreach(Shader *shader, scene->shaders) {
@@ -459,6 +460,7 @@ void ShaderManager::device_update_common(Device *device,
 		shader_flag[i++] = __float_as_int(constant_emission.z);
 
 		has_transparent_shadow |= (flag & SD_HAS_TRANSPARENT_SHADOW) != 0;
+		has_subsurface |= shader->has_surface_bssrdf;
 	}
 
 	device->tex_alloc("__shader_flag", dscene->shader_flag);
@@ -481,6 +483,7 @@ void ShaderManager::device_update_common(Device *device,
 	/* integrator */
 	KernelIntegrator *kintegrator = &dscene->data.integrator;
 	kintegrator->use_volumes = has_volumes;
+	kintegrator->use_subsurface = has_subsurface;
 	/* TODO(sergey): De-duplicate with flags set in integrator.cpp. */
 	if(scene->integrator->transparent_shadows) {
 		kintegrator->transparent_shadows = has_transparent_shadow;
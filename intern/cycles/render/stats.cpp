@@ -0,0 +1,248 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stats.h"
+
+#include "util_foreach.h"
+
+CCL_NAMESPACE_BEGIN
+
+static const char *ray_type_names[PROFILING_RAY_NUM_TYPES] = {
+	"camera",
+	"reflect",
+	"transmit",
+	"shadow",
+	"subsurface",
+	"volume",
+	"other",
+};
+
+/* JSON Helpers */
+
+string json_string(const string& str)
+{
+	string result = "\"";
+
+	foreach(char c, str) {
+		switch(c) {
+			case '"': result += "\\\""; break;
+			case '\\': result += "\\\\"; break;
+			case '\n': result += "\\n"; break;
+			case '\r': result += "\\r"; break;
+			case '\t': result += "\\t"; break;
+			default:
+				if((unsigned char)c < 0x20)
+					result += string_printf("\\u%04x", (int)c);
+				else
+					result += c;
+				break;
+		}
+	}
+
+	return result + "\"";
+}
+
+static string json_number(uint64_t value)
+{
+	return string_printf("%llu", (unsigned long long)value);
+}
+
+static string json_number(double value)
+{
+	return string_printf("%.6f", value);
+}
+
+static const char *json_bool(bool value)
+{
+	return (value)? "true": "false";
+}
+
+/* Scene Update Statistics */
+
+SceneUpdateStats::SceneUpdateStats()
+{
+	clear();
+}
+
+void SceneUpdateStats::clear()
+{
+	stages.clear();
+	num_updates = 0;
+	total_time = 0.0;
+
+	shader_cache_hits = 0;
+	shader_cache_misses = 0;
+
+	volume_images = 0;
+	volume_sparse_images = 0;
+	volume_dense_size = 0;
+	volume_size = 0;
+	volume_sparse = false;
+	volume_skip_empty = false;
+
+	bvh_layout = "";
+	bvh_refitted = false;
+	bvh_time = 0.0;
+	bvh_nodes = 0;
+	bvh_leaf_nodes = 0;
+	bvh_primitives = 0;
+	bvh_objects = 0;
+	bvh_area_ratio = 0.0f;
+}
+
+void SceneUpdateStats::add_stage_time(const string& name, double time)
+{
+	foreach(Stage& stage, stages) {
+		if(stage.name == name) {
+			stage.time += time;
+			stage.count++;
+			return;
+		}
+	}
+
+	Stage stage;
+	stage.name = name;
+	stage.time = time;
+	stage.count = 1;
+	stages.push_back(stage);
+}
+
+/* Render Statistics */
+
+RenderStats::RenderStats()
+{
+	total_time = 0.0;
+	render_time = 0.0;
+	pixel_samples = 0;
+	use_profiling = false;
+	mem_used = 0;
+	mem_peak = 0;
+}
+
+string RenderStats::to_json() const
+{
+	string json = "{\n";
+
+	/* render */
+	json += "  \"render\": {\n";
+	json += "    \"total_time\": " + json_number(total_time) + ",\n";
+	json += "    \"render_time\": " + json_number(render_time) + ",\n";
+	json += "    \"pixel_samples\": " + json_number(pixel_samples) + ",\n";
+	json += "    \"pixel_samples_per_second\": " +
+	        json_number((render_time > 0.0)? pixel_samples / render_time: 0.0) + "\n";
+	json += "  },\n";
+
+	/* scene update */
+	json += "  \"scene_update\": {\n";
+	json += "    \"updates\": " + json_number((uint64_t)scene_update.num_updates) + ",\n";
+	json += "    \"total_time\": " + json_number(scene_update.total_time) + ",\n";
+	json += "    \"shader_cache_hits\": " + json_number((uint64_t)scene_update.shader_cache_hits) + ",\n";
+	json += "    \"shader_cache_misses\": " + json_number((uint64_t)scene_update.shader_cache_misses) + ",\n";
+	json += "    \"stages\": [";
+	for(size_t i = 0; i < scene_update.stages.size(); i++) {
+		const SceneUpdateStats::Stage& stage = scene_update.stages[i];
+		json += (i == 0)? "\n": ",\n";
+		json += "      {\"name\": " + json_string(stage.name) +
+		        ", \"time\": " + json_number(stage.time) +
+		        ", \"count\": " + json_number((uint64_t)stage.count) + "}";
+	}
+	json += "\n    ]\n";
+	json += "  },\n";
+
+	/* bvh */
+	json += "  \"bvh\": {\n";
+	json += "    \"layout\": " + json_string(scene_update.bvh_layout) + ",\n";
+	json += string("    \"refitted\": ") + json_bool(scene_update.bvh_refitted) + ",\n";
+	json += "    \"time\": " + json_number(scene_update.bvh_time) + ",\n";
+	json += "    \"nodes\": " + json_number((uint64_t)scene_update.bvh_nodes) + ",\n";
+	json += "    \"leaf_nodes\": " + json_number((uint64_t)scene_update.bvh_leaf_nodes) + ",\n";
+	json += "    \"primitives\": " + json_number((uint64_t)scene_update.bvh_primitives) + ",\n";
+	json += "    \"objects\": " + json_number((uint64_t)scene_update.bvh_objects) + ",\n";
+	json += "    \"area_ratio\": " + json_number((double)scene_update.bvh_area_ratio) + "\n";
+	json += "  },\n";
+
+	/* volumes */
+	json += "  \"volumes\": {\n";
+	json += "    \"images\": " + json_number((uint64_t)scene_update.volume_images) + ",\n";
+	json += "    \"sparse_images\": " + json_number((uint64_t)scene_update.volume_sparse_images) + ",\n";
+	json += "    \"dense_size\": " + json_number((uint64_t)scene_update.volume_dense_size) + ",\n";
+	json += "    \"size\": " + json_number((uint64_t)scene_update.volume_size) + ",\n";
+	json += string("    \"sparse\": ") + json_bool(scene_update.volume_sparse) + ",\n";
+	json += string("    \"skip_empty\": ") + json_bool(scene_update.volume_skip_empty) + "\n";
+	json += "  },\n";
+
+	/* kernel counters */
+	json += string("  \"profiling\": ") + json_bool(use_profiling) + ",\n";
+
+	uint64_t total_rays = 0;
+	json += "  \"rays\": {\n";
+	for(int i = 0; i < PROFILING_RAY_NUM_TYPES; i++) {
+		json += string("    \"") + ray_type_names[i] + "\": " + json_number(kernel.rays[i]) + ",\n";
+		total_rays += kernel.rays[i];
+	}
+	json += "    \"total\": " + json_number(total_rays) + "\n";
+	json += "  },\n";
+
+	json += "  \"shaders\": [";
+	bool first = true;
+	for(size_t i = 0; i < kernel.shader_evals.size(); i++) {
+		if(kernel.shader_evals[i] == 0)
+			continue;
+
+		string name = (i < shader_names.size())? shader_names[i]: string_printf("shader%d", (int)i);
+		json += (first)? "\n": ",\n";
+		json += "    {\"name\": " + json_string(name) +
+		        ", \"evaluations\": " + json_number(kernel.shader_evals[i]) + "}";
+		first = false;
+	}
+	json += "\n  ],\n";
+
+	/* memory */
+	json += "  \"memory\": {\n";
+	json += "    \"used\": " + json_number((uint64_t)mem_used) + ",\n";
+	json += "    \"peak\": " + json_number((uint64_t)mem_peak) + ",\n";
+	json += "    \"categories\": {";
+	for(size_t i = 0; i < memory.size(); i++) {
+		json += (i == 0)? "\n": ",\n";
+		json += "      " + json_string(memory[i].name) + ": " + json_number((uint64_t)memory[i].size);
+	}
+	json += "\n    }\n";
+	json += "  },\n";
+
+	/* network render servers */
+	json += "  \"servers\": [";
+	for(size_t i = 0; i < servers.size(); i++) {
+		const NetworkServerStats& server = servers[i];
+		double samples_per_second = (server.render_time > 0.0)?
+		        server.pixel_samples / server.render_time: 0.0;
+
+		json += (i == 0)? "\n": ",\n";
+		json += "    {\"address\": " + json_string(server.address) +
+		        ", \"tiles\": " + json_number((uint64_t)server.num_tiles) +
+		        ", \"pixel_samples\": " + json_number((uint64_t)server.pixel_samples) +
+		        ", \"render_time\": " + json_number(server.render_time) +
+		        ", \"pixel_samples_per_second\": " + json_number(samples_per_second) +
+		        ", \"memory_sent\": " + json_number((uint64_t)server.mem_sent) +
+		        ", \"memory_skipped\": " + json_number((uint64_t)server.mem_skipped) + "}";
+	}
+	json += "\n  ]\n";
+
+	json += "}\n";
+
+	return json;
+}
+
+CCL_NAMESPACE_END
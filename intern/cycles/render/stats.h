@@ -0,0 +1,116 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RENDER_STATS_H__
+#define __RENDER_STATS_H__
+
+#include "device.h"
+
+#include "util_profiling.h"
+#include "util_string.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Quoted JSON string, with quotes, backslashes and control characters escaped. */
+string json_string(const string& str);
+
+/* Scene Update Statistics
+ *
+ * Wall time of every Scene::device_update stage, accumulated over all updates
+ * of the scene, and information about the last scene BVH update. */
+
+class SceneUpdateStats {
+public:
+	struct Stage {
+		string name;
+		double time;
+		int count;
+	};
+
+	SceneUpdateStats();
+
+	void clear();
+	void add_stage_time(const string& name, double time);
+
+	vector<Stage> stages;
+	int num_updates;
+	double total_time;
+
+	/* SVM shaders found in the program cache, and compiled */
+	int shader_cache_hits;
+	int shader_cache_misses;
+
+	/* 3d images, with the memory they would take as dense voxels */
+	int volume_images;
+	int volume_sparse_images;
+	size_t volume_dense_size;
+	size_t volume_size;
+	bool volume_sparse;
+	bool volume_skip_empty;
+
+	/* scene BVH */
+	string bvh_layout;
+	bool bvh_refitted;
+	double bvh_time;
+	size_t bvh_nodes;
+	size_t bvh_leaf_nodes;
+	size_t bvh_primitives;
+	size_t bvh_objects;
+	float bvh_area_ratio;
+};
+
+/* Render Statistics
+ *
+ * Everything gathered for a session by Session::collect_statistics(), for
+ * tuning render settings and comparing builds. Kernel counters are only
+ * available when the session was created with profiling enabled. */
+
+class RenderStats {
+public:
+	struct MemoryCategory {
+		string name;
+		size_t size;
+	};
+
+	RenderStats();
+
+	string to_json() const;
+
+	/* render progress */
+	double total_time;
+	double render_time;
+	uint64_t pixel_samples;
+
+	SceneUpdateStats scene_update;
+
+	/* kernel counters, shader evaluations are indexed by shader id */
+	bool use_profiling;
+	ProfilingCounters kernel;
+	vector<string> shader_names;
+
+	/* memory */
+	vector<MemoryCategory> memory;
+	size_t mem_used;
+	size_t mem_peak;
+
+	/* network render servers */
+	vector<NetworkServerStats> servers;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __RENDER_STATS_H__ */
@@ -26,6 +26,7 @@
 #include "util_debug.h"
 #include "util_logging.h"
 #include "util_foreach.h"
+#include "util_md5.h"
 #include "util_progress.h"
 #include "util_task.h"
 
@@ -33,8 +34,15 @@ CCL_NAMESPACE_BEGIN
 
 /* Shader Manager */
 
+/* Programs no shader used for this many updates are removed from the cache.
+ * Keeping them a while makes toggling a material back and forth cheap. */
+#define SVM_PROGRAM_CACHE_MAX_AGE 16
+
 SVMShaderManager::SVMShaderManager()
 {
+	num_updates_ = 0;
+	num_cache_hits_ = 0;
+	num_cache_misses_ = 0;
 }
 
 SVMShaderManager::~SVMShaderManager()
@@ -45,22 +53,95 @@ void SVMShaderManager::reset(Scene * /*scene*/)
 {
 }
 
+static bool shader_graph_images_assigned(ShaderGraph *graph)
+{
+	if(graph == NULL)
+		return true;
+
+	foreach(ShaderNode *node, graph->nodes) {
+		if(node->special_type == SHADER_SPECIAL_TYPE_IMAGE_SLOT &&
+		   ((ImageSlotTextureNode*)node)->slot == -1)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static string shader_program_hash(Shader *shader, bool background)
+{
+	MD5Hash md5;
+
+	/* settings of the shader that change the generated program */
+	md5.append((const uint8_t*)&background, sizeof(background));
+	md5.append((const uint8_t*)&shader->used, sizeof(shader->used));
+	md5.append((const uint8_t*)&shader->displacement_method, sizeof(shader->displacement_method));
+
+	shader->graph->hash(md5);
+
+	bool has_bump = (shader->graph_bump != NULL);
+	md5.append((const uint8_t*)&has_bump, sizeof(has_bump));
+	if(has_bump) {
+		shader->graph_bump->hash(md5);
+	}
+
+	return md5.get_hex();
+}
+
 void SVMShaderManager::device_update_shader(Scene *scene,
                                             Shader *shader,
                                             Progress *progress,
-                                            vector<int4> *global_svm_nodes)
+                                            string *hash)
 {
 	if(progress->get_cancel()) {
 		return;
 	}
 	assert(shader->graph);
 
-	vector<int4> svm_nodes;
-	svm_nodes.push_back(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
-
 	SVMCompiler::Summary summary;
 	SVMCompiler compiler(scene->shader_manager, scene->image_manager);
 	compiler.background = (shader == scene->default_background);
+	compiler.finalize(scene, shader, &summary);
+
+	/* graphs with images that were never loaded must be compiled to assign
+	 * their slots, otherwise look for the program of an identical graph */
+	if(shader_graph_images_assigned(shader->graph) &&
+	   shader_graph_images_assigned(shader->graph_bump))
+	{
+		*hash = shader_program_hash(shader, compiler.background);
+
+		thread_scoped_lock cache_lock(program_cache_mutex_);
+		map<string, CachedProgram>::iterator it = program_cache_.find(*hash);
+
+		if(it != program_cache_.end()) {
+			CachedProgram& program = it->second;
+
+			shader->has_surface = program.has_surface;
+			shader->has_surface_emission = program.has_surface_emission;
+			shader->has_surface_transparent = program.has_surface_transparent;
+			shader->has_surface_bssrdf = program.has_surface_bssrdf;
+			shader->has_bssrdf_bump = program.has_bssrdf_bump;
+			shader->has_volume = program.has_volume;
+			shader->has_displacement = program.has_displacement;
+			shader->has_surface_spatial_varying = program.has_surface_spatial_varying;
+			shader->has_volume_spatial_varying = program.has_volume_spatial_varying;
+			shader->has_object_dependency = program.has_object_dependency;
+			shader->has_integrator_dependency = program.has_integrator_dependency;
+
+			if(shader->use_mis && shader->has_surface_emission) {
+				scene->light_manager->need_update = true;
+			}
+
+			program.last_used = num_updates_;
+			num_cache_hits_++;
+			return;
+		}
+	}
+
+	vector<int4> svm_nodes;
+	svm_nodes.push_back(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
+
 	compiler.compile(scene, shader, svm_nodes, 0, &summary);
 
 	VLOG(2) << "Compilation summary:\n"
@@ -71,23 +152,107 @@ void SVMShaderManager::device_update_shader(Scene *scene,
 		scene->light_manager->need_update = true;
 	}
 
-	/* The copy needs to be done inside the lock, if another thread resizes the array 
-	 * while memcpy is running, it'll be copying into possibly invalid/freed ram. 
-	 */
-	nodes_lock_.lock();
-	size_t global_nodes_size = global_svm_nodes->size();
-	global_svm_nodes->resize(global_nodes_size + svm_nodes.size());
-	
-	/* Offset local SVM nodes to a global address space. */
-	int4& jump_node = global_svm_nodes->at(shader->id);
-	jump_node.y = svm_nodes[0].y + global_nodes_size - 1;
-	jump_node.z = svm_nodes[0].z + global_nodes_size - 1;
-	jump_node.w = svm_nodes[0].w + global_nodes_size - 1;
-	/* Copy new nodes to global storage. */
-	memcpy(&global_svm_nodes->at(global_nodes_size),
-	       &svm_nodes[1],
-	       sizeof(int4) * (svm_nodes.size() - 1));
-	nodes_lock_.unlock();
+	/* image slots are assigned now */
+	*hash = shader_program_hash(shader, compiler.background);
+
+	thread_scoped_lock cache_lock(program_cache_mutex_);
+	CachedProgram& program = program_cache_[*hash];
+
+	program.svm_nodes.swap(svm_nodes);
+	program.has_surface = shader->has_surface;
+	program.has_surface_emission = shader->has_surface_emission;
+	program.has_surface_transparent = shader->has_surface_transparent;
+	program.has_surface_bssrdf = shader->has_surface_bssrdf;
+	program.has_bssrdf_bump = shader->has_bssrdf_bump;
+	program.has_volume = shader->has_volume;
+	program.has_displacement = shader->has_displacement;
+	program.has_surface_spatial_varying = shader->has_surface_spatial_varying;
+	program.has_volume_spatial_varying = shader->has_volume_spatial_varying;
+	program.has_object_dependency = shader->has_object_dependency;
+	program.has_integrator_dependency = shader->has_integrator_dependency;
+	program.last_used = num_updates_;
+
+	num_cache_misses_++;
+}
+
+/* Offset local SVM nodes of a program to the global address space. */
+static int4 shader_program_jump_node(const vector<int4>& svm_nodes, size_t offset)
+{
+	const int4& jump_node = svm_nodes[0];
+	return make_int4(NODE_SHADER_JUMP,
+	                 jump_node.y + offset - 1,
+	                 jump_node.z + offset - 1,
+	                 jump_node.w + offset - 1);
+}
+
+bool SVMShaderManager::device_update_nodes(DeviceScene *dscene, const vector<string>& hashes)
+{
+	size_t num_shaders = hashes.size();
+	bool rebuild = (dscene->svm_nodes.size() == 0 || programs_.size() != num_shaders);
+	bool modified = false;
+
+	/* modified programs are patched in place in the host array if their size
+	 * did not change, this avoids rebuilding it but the device still gets the
+	 * whole array again */
+	for(size_t i = 0; i < num_shaders && !rebuild; i++) {
+		if(programs_[i].hash != hashes[i]) {
+			const CachedProgram& program = program_cache_[hashes[i]];
+			rebuild = (program.svm_nodes.size() - 1 != programs_[i].size);
+			modified = true;
+		}
+	}
+
+	if(rebuild) {
+		vector<int4> svm_nodes;
+		svm_nodes.resize(num_shaders, make_int4(NODE_SHADER_JUMP, 0, 0, 0));
+		programs_.resize(num_shaders);
+
+		for(size_t i = 0; i < num_shaders; i++) {
+			const CachedProgram& program = program_cache_[hashes[i]];
+			size_t offset = svm_nodes.size();
+
+			svm_nodes[i] = shader_program_jump_node(program.svm_nodes, offset);
+			svm_nodes.insert(svm_nodes.end(),
+			                 program.svm_nodes.begin() + 1,
+			                 program.svm_nodes.end());
+
+			programs_[i].hash = hashes[i];
+			programs_[i].offset = offset;
+			programs_[i].size = program.svm_nodes.size() - 1;
+		}
+
+		dscene->svm_nodes.copy((uint4*)&svm_nodes[0], svm_nodes.size());
+		return true;
+	}
+
+	for(size_t i = 0; i < num_shaders && modified; i++) {
+		if(programs_[i].hash == hashes[i])
+			continue;
+
+		const CachedProgram& program = program_cache_[hashes[i]];
+		int4 jump_node = shader_program_jump_node(program.svm_nodes, programs_[i].offset);
+
+		dscene->svm_nodes.copy_at((uint4*)&jump_node, i, 1);
+		dscene->svm_nodes.copy_at((uint4*)&program.svm_nodes[1],
+		                          programs_[i].offset,
+		                          programs_[i].size);
+
+		programs_[i].hash = hashes[i];
+	}
+
+	return modified;
+}
+
+void SVMShaderManager::program_cache_prune()
+{
+	map<string, CachedProgram>::iterator it = program_cache_.begin();
+
+	while(it != program_cache_.end()) {
+		if(num_updates_ - it->second.last_used > SVM_PROGRAM_CACHE_MAX_AGE)
+			program_cache_.erase(it++);
+		else
+			++it;
+	}
 }
 
 void SVMShaderManager::device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
@@ -99,19 +264,16 @@ void SVMShaderManager::device_update(Device *device, DeviceScene *dscene, Scene
 
 	double start_time = time_dt();
 
-	/* test if we need to update */
-	device_free(device, dscene, scene);
-
 	/* determine which shaders are in use */
 	device_update_shaders_used(scene);
 
-	/* svm_nodes */
-	vector<int4> svm_nodes;
+	/* compile shaders, or find their programs in the cache */
+	vector<string> hashes(scene->shaders.size());
 	size_t i;
 
-	for(i = 0; i < scene->shaders.size(); i++) {
-		svm_nodes.push_back(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
-	}
+	num_updates_++;
+	num_cache_hits_ = 0;
+	num_cache_misses_ = 0;
 
 	TaskPool task_pool;
 	foreach(Shader *shader, scene->shaders) {
@@ -120,7 +282,7 @@ void SVMShaderManager::device_update(Device *device, DeviceScene *dscene, Scene
 		                             scene,
 		                             shader,
 		                             &progress,
-		                             &svm_nodes),
+		                             &hashes[shader->id]),
 		               false);
 	}
 	task_pool.wait_work();
@@ -129,8 +291,14 @@ void SVMShaderManager::device_update(Device *device, DeviceScene *dscene, Scene
 		return;
 	}
 
-	dscene->svm_nodes.copy((uint4*)&svm_nodes[0], svm_nodes.size());
-	device->tex_alloc("__svm_nodes", dscene->svm_nodes);
+	/* svm_nodes, there is no partial texture upload so any change sends all
+	 * nodes (the CPU device uses the host array directly) */
+	if(device_update_nodes(dscene, hashes)) {
+		device->tex_free(dscene->svm_nodes);
+		device->tex_alloc("__svm_nodes", dscene->svm_nodes);
+	}
+
+	program_cache_prune();
 
 	for(i = 0; i < scene->shaders.size(); i++) {
 		Shader *shader = scene->shaders[i];
@@ -139,11 +307,16 @@ void SVMShaderManager::device_update(Device *device, DeviceScene *dscene, Scene
 
 	device_update_common(device, dscene, scene, progress);
 
+	scene->update_stats.shader_cache_hits += num_cache_hits_;
+	scene->update_stats.shader_cache_misses += num_cache_misses_;
+
 	need_update = false;
 
 	VLOG(1) << "Shader manager updated "
 	        << scene->shaders.size() << " shaders in "
-	        << time_dt() - start_time << " seconds.";
+	        << time_dt() - start_time << " seconds, "
+	        << num_cache_misses_ << " compiled, "
+	        << num_cache_hits_ << " cached.";
 }
 
 void SVMShaderManager::device_free(Device *device, DeviceScene *dscene, Scene *scene)
@@ -152,6 +325,9 @@ void SVMShaderManager::device_free(Device *device, DeviceScene *dscene, Scene *s
 
 	device->tex_free(dscene->svm_nodes);
 	dscene->svm_nodes.clear();
+
+	/* compiled programs stay cached, only their location is lost */
+	programs_.clear();
 }
 
 /* Graph Compiler */
@@ -792,17 +968,12 @@ void SVMCompiler::compile_type(Shader *shader, ShaderGraph *graph, ShaderType ty
 	}
 }
 
-void SVMCompiler::compile(Scene *scene,
-                          Shader *shader,
-                          vector<int4>& svm_nodes,
-                          int index,
-                          Summary *summary)
+void SVMCompiler::finalize(Scene *scene,
+                           Shader *shader,
+                           Summary *summary)
 {
 	/* copy graph for shader with bump mapping */
 	ShaderNode *node = shader->graph->output();
-	int start_num_svm_nodes = svm_nodes.size();
-
-	const double time_start = time_dt();
 
 	if(node->input("Surface")->link && node->input("Displacement")->link)
 		if(!shader->graph_bump)
@@ -825,6 +996,18 @@ void SVMCompiler::compile(Scene *scene,
 		                             shader->has_integrator_dependency,
 		                             shader->displacement_method == DISPLACE_BOTH);
 	}
+}
+
+void SVMCompiler::compile(Scene * /*scene*/,
+                          Shader *shader,
+                          vector<int4>& svm_nodes,
+                          int index,
+                          Summary *summary)
+{
+	/* graphs must be finalized already, see finalize() */
+	int start_num_svm_nodes = svm_nodes.size();
+
+	const double time_start = time_dt();
 
 	current_shader = shader;
 
@@ -49,13 +49,52 @@ public:
 	void device_free(Device *device, DeviceScene *dscene, Scene *scene);
 
 protected:
-	/* Lock used to synchronize threaded nodes compilation. */
-	thread_spin_lock nodes_lock_;
+	/* Compiled program of a shader graph. Programs are cached by graph hash,
+	 * so only modified shaders are compiled again, and shaders with identical
+	 * graphs share the compilation. Jump offsets of the first node are local
+	 * to the program. */
+	struct CachedProgram {
+		vector<int4> svm_nodes;
+
+		/* shader flags set by compilation */
+		bool has_surface;
+		bool has_surface_emission;
+		bool has_surface_transparent;
+		bool has_surface_bssrdf;
+		bool has_bssrdf_bump;
+		bool has_volume;
+		bool has_displacement;
+		bool has_surface_spatial_varying;
+		bool has_volume_spatial_varying;
+		bool has_object_dependency;
+		bool has_integrator_dependency;
+
+		/* last update the program was used in */
+		int last_used;
+	};
+
+	/* Location of the program of a shader in the device SVM nodes. */
+	struct ProgramLocation {
+		string hash;
+		size_t offset;
+		size_t size;
+	};
+
+	map<string, CachedProgram> program_cache_;
+	thread_mutex program_cache_mutex_;
+	vector<ProgramLocation> programs_;
+	int num_updates_;
+
+	/* Statistics of the last update. */
+	int num_cache_hits_;
+	int num_cache_misses_;
 
 	void device_update_shader(Scene *scene,
 	                          Shader *shader,
 	                          Progress *progress,
-	                          vector<int4> *global_svm_nodes);
+	                          string *hash);
+	bool device_update_nodes(DeviceScene *dscene, const vector<string>& hashes);
+	void program_cache_prune();
 };
 
 /* Graph Compiler */
@@ -99,6 +138,9 @@ public:
 	};
 
 	SVMCompiler(ShaderManager *shader_manager, ImageManager *image_manager);
+	void finalize(Scene *scene,
+	              Shader *shader,
+	              Summary *summary = NULL);
 	void compile(Scene *scene,
 	             Shader *shader,
 	             vector<int4>& svm_nodes,
@@ -17,6 +17,7 @@
 #include "tile.h"
 
 #include "util_algorithm.h"
+#include "util_foreach.h"
 #include "util_types.h"
 
 CCL_NAMESPACE_BEGIN
@@ -135,6 +136,12 @@ void TileManager::reset(BufferParams& params_, int num_samples_)
 	state.num_samples = 0;
 	state.resolution_divider = get_divider(params.width, params.height, start_resolution);
 	state.tiles.clear();
+	state.converged_tiles.clear();
+	state.grid_size = make_int2(0, 0);
+	state.tile_grid.clear();
+	state.tile_cells.clear();
+	state.denoise_states.clear();
+	state.tile_devices.clear();
 }
 
 void TileManager::set_samples(int num_samples_)
@@ -332,21 +339,265 @@ void TileManager::set_tiles()
 	state.buffer.full_y = params.full_y/resolution;
 	state.buffer.full_width = max(1, params.full_width/resolution);
 	state.buffer.full_height = max(1, params.full_height/resolution);
+
+	if(background)
+		set_tile_grid();
+
+	if(background && preserve_tile_device)
+		set_tile_devices();
+}
+
+/* Move tiles to the lists of the devices that rendered them before, for
+ * progressive refine after tiles were stolen. */
+void TileManager::set_tile_devices()
+{
+	if(state.tile_devices.size() != state.num_tiles) {
+		state.tile_devices.clear();
+		state.tile_devices.resize(state.num_tiles, -1);
+		return;
+	}
+
+	vector<list<Tile> > device_tiles(state.tiles.size());
+
+	for(size_t i = 0; i < state.tiles.size(); i++) {
+		foreach(Tile& tile, state.tiles[i]) {
+			int device = state.tile_devices[tile.index];
+
+			if(device == -1)
+				device = i;
+			if(device >= device_tiles.size())
+				device_tiles.resize(device + 1);
+
+			tile.device = device;
+			device_tiles[device].push_back(tile);
+		}
+	}
+
+	state.tiles.swap(device_tiles);
+}
+
+/* Take a tile that no device rendered yet from the device with the most
+ * tiles left, from the end of its list so it does not collide with the tiles
+ * that device renders next. Devices that are not known when generating the
+ * tiles, like network servers, only get tiles this way. */
+bool TileManager::steal_tile(Tile& tile, int device)
+{
+	list<Tile> *victim_tiles = NULL;
+	list<Tile>::iterator victim_tile;
+
+	for(size_t i = 0; i < state.tiles.size(); i++) {
+		if(i == device || state.tiles[i].empty())
+			continue;
+		if(victim_tiles && victim_tiles->size() >= state.tiles[i].size())
+			continue;
+
+		list<Tile>::iterator it = state.tiles[i].end();
+
+		while(it != state.tiles[i].begin()) {
+			--it;
+
+			if(state.tile_devices[it->index] == -1) {
+				victim_tiles = &state.tiles[i];
+				victim_tile = it;
+				break;
+			}
+		}
+	}
+
+	if(!victim_tiles)
+		return false;
+
+	tile = *victim_tile;
+	tile.device = device;
+	victim_tiles->erase(victim_tile);
+
+	return true;
+}
+
+/* Tiles are at multiples of the tile size when the image is not sliced, for
+ * every tile order. */
+void TileManager::set_tile_grid()
+{
+	int image_w = state.buffer.width;
+	int image_h = state.buffer.height;
+
+	state.grid_size = make_int2((image_w + tile_size.x - 1)/tile_size.x,
+	                            (image_h + tile_size.y - 1)/tile_size.y);
+	state.tile_grid.clear();
+	state.tile_grid.resize(state.grid_size.x*state.grid_size.y, -1);
+	state.tile_cells.clear();
+	state.tile_cells.resize(state.num_tiles, -1);
+	state.denoise_states.clear();
+	state.denoise_states.resize(state.num_tiles, DENOISE_PENDING);
+
+	foreach(list<Tile>& tiles, state.tiles) {
+		foreach(Tile& tile, tiles) {
+			int cell = (tile.y/tile_size.y)*state.grid_size.x + tile.x/tile_size.x;
+
+			state.tile_grid[cell] = tile.index;
+			state.tile_cells[tile.index] = cell;
+
+			/* tiles that are not rendered again when resuming */
+			if(tile.index < state.converged_tiles.size() && state.converged_tiles[tile.index])
+				state.denoise_states[tile.index] = DENOISE_SKIPPED;
+		}
+	}
 }
 
 bool TileManager::next_tile(Tile& tile, int device)
 {
 	int logical_device = preserve_tile_device? device: 0;
+	/* in the viewport, tiles are always sliced per device */
+	bool use_stealing = preserve_tile_device && background;
+
+	for(;;) {
+		if(logical_device < state.tiles.size() && !state.tiles[logical_device].empty()) {
+			tile = Tile(state.tiles[logical_device].front());
+			state.tiles[logical_device].pop_front();
+		}
+		else if(!(use_stealing && steal_tile(tile, logical_device))) {
+			return false;
+		}
+
+		if(tile.index < state.converged_tiles.size() && state.converged_tiles[tile.index])
+			continue;
 
-	if((logical_device >= state.tiles.size()) || state.tiles[logical_device].empty())
+		if(use_stealing && state.tile_devices[tile.index] == -1)
+			state.tile_devices[tile.index] = logical_device;
+
+		state.num_rendered_tiles++;
+		return true;
+	}
+}
+
+bool TileManager::set_tile_converged(int index)
+{
+	/* tile indices only stay the same once the full resolution is reached */
+	if(state.resolution_divider != 1)
+		return false;
+
+	if(state.converged_tiles.size() < state.num_tiles)
+		state.converged_tiles.resize(state.num_tiles, false);
+
+	if(state.converged_tiles[index])
 		return false;
 
-	tile = Tile(state.tiles[logical_device].front());
-	state.tiles[logical_device].pop_front();
-	state.num_rendered_tiles++;
+	state.converged_tiles[index] = true;
 	return true;
 }
 
+void TileManager::resume(int sample, const vector<bool>& done_tiles)
+{
+	state.sample = sample - 1;
+	state.converged_tiles = done_tiles;
+
+	foreach(bool done, done_tiles) {
+		if(done)
+			state.num_rendered_tiles++;
+	}
+}
+
+void TileManager::get_tile_neighbors(int index, vector<int>& neighbors)
+{
+	neighbors.clear();
+
+	if(index >= state.tile_cells.size() || state.tile_cells[index] == -1) {
+		neighbors.push_back(index);
+		return;
+	}
+
+	int cell = state.tile_cells[index];
+	int cell_x = cell % state.grid_size.x;
+	int cell_y = cell / state.grid_size.x;
+
+	for(int y = max(cell_y - 1, 0); y <= min(cell_y + 1, state.grid_size.y - 1); y++) {
+		for(int x = max(cell_x - 1, 0); x <= min(cell_x + 1, state.grid_size.x - 1); x++) {
+			int neighbor = state.tile_grid[y*state.grid_size.x + x];
+
+			if(neighbor != -1)
+				neighbors.push_back(neighbor);
+		}
+	}
+}
+
+bool TileManager::tile_denoise_ready(int index)
+{
+	if(state.denoise_states[index] != DENOISE_RENDERED)
+		return false;
+
+	vector<int> neighbors;
+	get_tile_neighbors(index, neighbors);
+
+	foreach(int neighbor, neighbors) {
+		if(state.denoise_states[neighbor] == DENOISE_PENDING)
+			return false;
+	}
+
+	return true;
+}
+
+bool TileManager::tile_free_ready(int index)
+{
+	if(state.denoise_states[index] != DENOISE_DONE)
+		return false;
+
+	vector<int> neighbors;
+	get_tile_neighbors(index, neighbors);
+
+	foreach(int neighbor, neighbors) {
+		DenoiseState neighbor_state = state.denoise_states[neighbor];
+
+		if(!(neighbor_state == DENOISE_SKIPPED ||
+		     neighbor_state == DENOISE_DONE ||
+		     neighbor_state == DENOISE_FREED))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void TileManager::set_tile_rendered(int index, vector<int>& denoise_tiles)
+{
+	denoise_tiles.clear();
+
+	if(index >= state.denoise_states.size())
+		return;
+
+	state.denoise_states[index] = DENOISE_RENDERED;
+
+	vector<int> neighbors;
+	get_tile_neighbors(index, neighbors);
+
+	foreach(int neighbor, neighbors) {
+		if(tile_denoise_ready(neighbor)) {
+			state.denoise_states[neighbor] = DENOISE_IN_PROGRESS;
+			denoise_tiles.push_back(neighbor);
+		}
+	}
+}
+
+void TileManager::set_tile_denoised(int index, vector<int>& free_tiles)
+{
+	free_tiles.clear();
+
+	if(index >= state.denoise_states.size())
+		return;
+
+	state.denoise_states[index] = DENOISE_DONE;
+
+	vector<int> neighbors;
+	get_tile_neighbors(index, neighbors);
+
+	foreach(int neighbor, neighbors) {
+		if(tile_free_ready(neighbor)) {
+			state.denoise_states[neighbor] = DENOISE_FREED;
+			free_tiles.push_back(neighbor);
+		}
+	}
+}
+
 bool TileManager::done()
 {
 	int end_sample = (range_num_samples == -1)
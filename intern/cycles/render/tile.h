@@ -57,6 +57,17 @@ class TileManager {
 public:
 	BufferParams params;
 
+	/* Progress of a tile for denoising, which needs the buffers of the
+	 * neighboring tiles. Skipped tiles are not rendered in this session. */
+	enum DenoiseState {
+		DENOISE_PENDING,
+		DENOISE_SKIPPED,
+		DENOISE_RENDERED,
+		DENOISE_IN_PROGRESS,
+		DENOISE_DONE,
+		DENOISE_FREED,
+	};
+
 	struct State {
 		BufferParams buffer;
 		int sample;
@@ -71,6 +82,18 @@ public:
 		/* This vector contains a list of tiles for every logical device in the session.
 		 * In each list, the tiles are sorted according to the tile order setting. */
 		vector<list<Tile> > tiles;
+		/* Tiles of which all pixels converged with adaptive sampling, these are not
+		 * handed out again for the following progressive samples. */
+		vector<bool> converged_tiles;
+		/* Tile index by position in the grid of tiles, and denoising state
+		 * by tile index, for background rendering. */
+		int2 grid_size;
+		vector<int> tile_grid;
+		vector<int> tile_cells;
+		vector<DenoiseState> denoise_states;
+		/* Device that rendered each tile first, or -1. With progressive refine
+		 * the tile stays on that device, since its buffers are there. */
+		vector<int> tile_devices;
 	} state;
 
 	int num_samples;
@@ -85,8 +108,23 @@ public:
 	bool next_tile(Tile& tile, int device = 0);
 	bool done();
 
+	/* Returns false if the tile was already retired. */
+	bool set_tile_converged(int index);
+
+	/* Continue a render from a checkpoint, at the given sample and without the
+	 * tiles that need no more samples. Must be called right after reset(). */
+	void resume(int sample, const vector<bool>& done_tiles);
+
 	void set_tile_order(TileOrder tile_order_) { tile_order = tile_order_; }
 
+	/* Denoising. Tiles are denoised once their neighbors are rendered, and
+	 * their buffers can be freed once their neighbors are denoised as well.
+	 * Both functions return tiles for which that became possible. */
+	void set_tile_rendered(int index, vector<int>& denoise_tiles);
+	void set_tile_denoised(int index, vector<int>& free_tiles);
+	/* Tile and its neighbors in the grid of tiles. */
+	void get_tile_neighbors(int index, vector<int>& neighbors);
+
 	/* ** Sample range rendering. ** */
 
 	/* Start sample in the range. */
@@ -100,6 +138,11 @@ public:
 protected:
 
 	void set_tiles();
+	void set_tile_grid();
+	void set_tile_devices();
+	bool steal_tile(Tile& tile, int device);
+	bool tile_denoise_ready(int index);
+	bool tile_free_ready(int index);
 
 	bool progressive;
 	int2 tile_size;
@@ -25,6 +25,7 @@ using std::sort;
 using std::swap;
 using std::max;
 using std::min;
+using std::nth_element;
 using std::remove;
 
 CCL_NAMESPACE_END
@@ -73,6 +73,8 @@ struct avxf
 		m256 = _mm256_insertf128_ps(foo, b, 1);
 	}
 
+	__forceinline const float& operator [](const size_t i) const { assert(i < 8); return f[i]; }
+	__forceinline       float& operator [](const size_t i)       { assert(i < 8); return f[i]; }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -107,6 +109,17 @@ __forceinline const avxf operator^(const avxf& a, const avxf& b) { return _mm256
 
 __forceinline const avxf operator&(const avxf& a, const avxf& b) { return _mm256_and_ps(a.m256,b.m256); }
 
+__forceinline const avxf min(const avxf& a, const avxf& b) { return _mm256_min_ps(a.m256,b.m256); }
+__forceinline const avxf max(const avxf& a, const avxf& b) { return _mm256_max_ps(a.m256,b.m256); }
+
+////////////////////////////////////////////////////////////////////////////////
+/// Comparison Operators
+////////////////////////////////////////////////////////////////////////////////
+
+__forceinline const avxf operator <=(const avxf& a, const avxf& b) { return _mm256_cmp_ps(a.m256, b.m256, _CMP_LE_OS); }
+
+__forceinline int movemask(const avxf& a) { return _mm256_movemask_ps(a); }
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Movement/Shifting/Shuffling Functions
 ////////////////////////////////////////////////////////////////////////////////
@@ -171,6 +184,14 @@ __forceinline const avxf madd (const avxf& a, const avxf& b, const avxf& c) {
 #endif
 }
 
+__forceinline const avxf msub(const avxf& a, const avxf& b, const avxf& c) {
+#ifdef __KERNEL_AVX2__
+	return _mm256_fmsub_ps(a, b, c);
+#else
+	return (a*b)-c;
+#endif
+}
+
 __forceinline const avxf nmadd(const avxf& a, const avxf& b, const avxf& c) {
 #ifdef __KERNEL_AVX2__
 	return _mm256_fnmadd_ps(a, b, c);
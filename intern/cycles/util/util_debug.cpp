@@ -29,7 +29,10 @@ DebugFlags::CPU::CPU()
     sse41(true),
     sse3(true),
     sse2(true),
-    qbvh(true)
+    qbvh(true),
+    obvh(true),
+    stream(false),
+    sparse_volumes(true)
 {
 	reset();
 }
@@ -55,6 +58,9 @@ void DebugFlags::CPU::reset()
 #undef CHECK_CPU_FLAGS
 
 	qbvh = true;
+	obvh = true;
+	stream = (getenv("CYCLES_CPU_STREAM") != NULL);
+	sparse_volumes = (getenv("CYCLES_CPU_NO_SPARSE_VOLUMES") == NULL);
 }
 
 DebugFlags::CUDA::CUDA()
@@ -133,7 +139,9 @@ std::ostream& operator <<(std::ostream &os,
 	   << "  AVX    : " << string_from_bool(debug_flags.cpu.avx)   << "\n"
 	   << "  SSE4.1 : " << string_from_bool(debug_flags.cpu.sse41) << "\n"
 	   << "  SSE3   : " << string_from_bool(debug_flags.cpu.sse3)  << "\n"
-	   << "  SSE2   : " << string_from_bool(debug_flags.cpu.sse2)  << "\n";
+	   << "  SSE2   : " << string_from_bool(debug_flags.cpu.sse2)  << "\n"
+	   << "  Stream : " << string_from_bool(debug_flags.cpu.stream) << "\n"
+	   << "  Sparse volumes : " << string_from_bool(debug_flags.cpu.sparse_volumes) << "\n";
 
 	os << "CUDA flags:\n"
 	   << " Adaptive Compile: " << string_from_bool(debug_flags.cuda.adaptive_compile) << "\n";
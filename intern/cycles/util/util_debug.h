@@ -46,6 +46,17 @@ public:
 
 		/* Whether QBVH usage is allowed or not. */
 		bool qbvh;
+
+		/* Whether OBVH usage is allowed or not, only used by AVX2 kernel. */
+		bool obvh;
+
+		/* Whether to trace tiles as ray streams sorted by shader instead of
+		 * one path at a time, see kernel_path_stream.h. */
+		bool stream;
+
+		/* Whether mostly empty 3D images, like smoke, are stored as sparse
+		 * tiles, see ImageManager::make_sparse_image(). */
+		bool sparse_volumes;
 	};
 
 	/* Descriptor of CUDA feature-set to be used. */
@@ -767,6 +767,15 @@ bool path_remove(const string& path)
 	return remove(path.c_str()) == 0;
 }
 
+bool path_rename(const string& from, const string& to)
+{
+#ifdef _WIN32
+	/* rename does not replace existing files on Windows */
+	path_remove(to);
+#endif
+	return rename(from.c_str(), to.c_str()) == 0;
+}
+
 static string line_directive(const string& path, int line)
 {
 	string escaped_path = path;
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTIL_PROFILING_H__
+#define __UTIL_PROFILING_H__
+
+#include <string.h>
+
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Ray types counted by the kernel profiling. */
+
+enum ProfilingRayType {
+	PROFILING_RAY_CAMERA = 0,
+	PROFILING_RAY_REFLECT,
+	PROFILING_RAY_TRANSMIT,
+	PROFILING_RAY_SHADOW,
+	PROFILING_RAY_SUBSURFACE,
+	PROFILING_RAY_VOLUME,
+	PROFILING_RAY_OTHER,
+
+	PROFILING_RAY_NUM_TYPES,
+};
+
+/* Kernel Profiling Counters
+ *
+ * Gathered by the CPU kernels of a single render thread, without any locking,
+ * and merged into the device totals when the thread is done. */
+
+class ProfilingCounters {
+public:
+	ProfilingCounters()
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		memset(rays, 0, sizeof(rays));
+		shader_evals.clear();
+	}
+
+	void count_ray(ProfilingRayType type)
+	{
+		rays[type]++;
+	}
+
+	void count_shader_eval(int shader)
+	{
+		if(shader >= shader_evals.size()) {
+			shader_evals.resize(shader + 1, 0);
+		}
+		shader_evals[shader]++;
+	}
+
+	void add(const ProfilingCounters& other)
+	{
+		for(int i = 0; i < PROFILING_RAY_NUM_TYPES; i++) {
+			rays[i] += other.rays[i];
+		}
+
+		if(other.shader_evals.size() > shader_evals.size()) {
+			shader_evals.resize(other.shader_evals.size(), 0);
+		}
+		for(size_t i = 0; i < other.shader_evals.size(); i++) {
+			shader_evals[i] += other.shader_evals[i];
+		}
+	}
+
+	/* Rays traced, indexed by ProfilingRayType. */
+	uint64_t rays[PROFILING_RAY_NUM_TYPES];
+	/* Shader evaluations, indexed by shader id. */
+	vector<uint64_t> shader_evals;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_PROFILING_H__ */
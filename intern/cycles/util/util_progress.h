@@ -216,6 +216,13 @@ public:
 		finished_tiles++;
 	}
 
+	uint64_t get_pixel_samples()
+	{
+		thread_scoped_lock lock(progress_mutex);
+
+		return pixel_samples;
+	}
+
 	int get_current_sample()
 	{
 		/* Note that the value here always belongs to the last tile that updated,
@@ -84,6 +84,14 @@ CCL_NAMESPACE_BEGIN
 #define TEX_IMAGE_MISSING_B 1
 #define TEX_IMAGE_MISSING_A 1
 
+/* Sparse 3D images on the CPU are stored as tiles of 8x8x8 voxels, where only
+ * tiles with voxels different from the background value are allocated. The
+ * tile offsets are preceded by a header with the image resolution. */
+#define TEX_SPARSE_TILE_SHIFT	3
+#define TEX_SPARSE_TILE_SIZE	(1 << TEX_SPARSE_TILE_SHIFT)
+#define TEX_SPARSE_TILE_VOXELS	(TEX_SPARSE_TILE_SIZE*TEX_SPARSE_TILE_SIZE*TEX_SPARSE_TILE_SIZE)
+#define TEX_SPARSE_HEADER_SIZE	4
+
 CCL_NAMESPACE_END
 
 #endif /* __UTIL_TEXTURE_H__ */
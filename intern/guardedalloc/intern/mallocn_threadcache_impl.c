@@ -0,0 +1,887 @@
+/*
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+/** \file guardedalloc/intern/mallocn_threadcache_impl.c
+ *  \ingroup MEM
+ *
+ * Memory allocation with per-thread caches of small blocks.
+ *
+ * Same memory layout as the lock-free allocator, but small blocks are
+ * taken from size-classes: each thread keeps free-lists of blocks for every
+ * size-class, and exchanges them in batches with global free-lists.
+ * The memory for small blocks is allocated in chunks which are never returned
+ * to the system, so freed small blocks can be reused by any thread.
+ *
+ * Memory counters of small blocks are accumulated per thread as well,
+ * and only merged into the global counters from time to time,
+ * so the peak memory is approximate.
+ */
+
+#include <stdlib.h>
+#include <string.h> /* memcpy */
+#include <stdarg.h>
+#include <sys/types.h>
+
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#endif
+
+#include "MEM_guardedalloc.h"
+
+/* to ensure strict conversions */
+#include "../../source/blender/blenlib/BLI_strict_flags.h"
+
+#include "atomic_ops.h"
+#include "mallocn_intern.h"
+
+typedef struct MemHead {
+	/* Length of allocated memory block. */
+	size_t len;
+} MemHead;
+
+typedef struct MemHeadAligned {
+	short alignment;
+	size_t len;
+} MemHeadAligned;
+
+static unsigned int totblock = 0;
+static size_t mem_in_use = 0, mmap_in_use = 0, peak_mem = 0;
+static size_t chunk_mem_in_use = 0;
+static bool malloc_debug_memset = false;
+
+static void (*error_callback)(const char *) = NULL;
+static void (*thread_lock_callback)(void) = NULL;
+static void (*thread_unlock_callback)(void) = NULL;
+
+enum {
+	MEMHEAD_MMAP_FLAG = 1,
+	MEMHEAD_ALIGN_FLAG = 2,
+};
+
+#define MEMHEAD_FROM_PTR(ptr) (((MemHead*) vmemh) - 1)
+#define PTR_FROM_MEMHEAD(memhead) (memhead + 1)
+#define MEMHEAD_ALIGNED_FROM_PTR(ptr) (((MemHeadAligned*) vmemh) - 1)
+#define MEMHEAD_IS_MMAP(memhead) ((memhead)->len & (size_t) MEMHEAD_MMAP_FLAG)
+#define MEMHEAD_IS_ALIGNED(memhead) ((memhead)->len & (size_t) MEMHEAD_ALIGN_FLAG)
+
+/* Size-classes are multiples of 16 bytes (MemHead included), up to 1024 bytes. */
+#define SIZE_CLASS_SHIFT 4
+#define SIZE_CLASS_NUM 64
+#define SIZE_CLASS_LEN_MAX (((size_t)SIZE_CLASS_NUM << SIZE_CLASS_SHIFT) - sizeof(MemHead))
+
+/* Number of blocks moved at once between thread and global free-lists,
+ * a thread keeps at most twice as many free blocks per size-class. */
+#define FREE_BATCH_NUM 64
+
+/* Small blocks are carved from chunks of this size. */
+#define CHUNK_SIZE (64 * 1024)
+
+/* Number of small allocations/frees after which a thread merges its counters. */
+#define COUNTERS_MERGE_NUM 256
+
+#if defined(_MSC_VER)
+#  define MEM_THREAD_LOCAL __declspec(thread)
+#else
+#  define MEM_THREAD_LOCAL __thread
+#endif
+
+typedef struct FreeBlock {
+	struct FreeBlock *next;
+} FreeBlock;
+
+typedef struct ThreadCache {
+	struct ThreadCache *next;
+
+	FreeBlock *free_blocks[SIZE_CLASS_NUM];
+	unsigned int free_num[SIZE_CLASS_NUM];
+
+	/* Changes not merged into the global counters yet (wrapping around on free). */
+	size_t mem_in_use;
+	unsigned int totblock;
+	unsigned int counters_ops;
+} ThreadCache;
+
+typedef struct FreeList {
+	unsigned int lock;
+	FreeBlock *blocks;
+} FreeList;
+
+static FreeList global_free_lists[SIZE_CLASS_NUM];
+
+/* All thread caches, to sum their counters. */
+static ThreadCache *thread_caches = NULL;
+static unsigned int thread_caches_lock = 0;
+
+static MEM_THREAD_LOCAL ThreadCache *thread_cache = NULL;
+
+/* Used to free the cache on thread exit. */
+#ifdef WIN32
+static DWORD thread_cache_fls_index = FLS_OUT_OF_INDEXES;
+static unsigned int thread_cache_fls_lock = 0;
+#else
+static pthread_key_t thread_cache_key;
+static pthread_once_t thread_cache_key_once = PTHREAD_ONCE_INIT;
+#endif
+
+/* Uncomment this to have proper peak counter. */
+#define USE_ATOMIC_MAX
+
+MEM_INLINE void update_maximum(size_t *maximum_value, size_t value)
+{
+#ifdef USE_ATOMIC_MAX
+	size_t prev_value = *maximum_value;
+	while (prev_value < value) {
+		if (atomic_cas_z(maximum_value, prev_value, value) != prev_value) {
+			break;
+		}
+	}
+#else
+	*maximum_value = value > *maximum_value ? value : *maximum_value;
+#endif
+}
+
+#ifdef __GNUC__
+__attribute__ ((format(printf, 1, 2)))
+#endif
+static void print_error(const char *str, ...)
+{
+	char buf[512];
+	va_list ap;
+
+	va_start(ap, str);
+	vsnprintf(buf, sizeof(buf), str, ap);
+	va_end(ap);
+	buf[sizeof(buf) - 1] = '\0';
+
+	if (error_callback) {
+		error_callback(buf);
+	}
+}
+
+#if defined(WIN32)
+static void mem_lock_thread(void)
+{
+	if (thread_lock_callback)
+		thread_lock_callback();
+}
+
+static void mem_unlock_thread(void)
+{
+	if (thread_unlock_callback)
+		thread_unlock_callback();
+}
+#endif
+
+MEM_INLINE void spin_lock(unsigned int *lock)
+{
+	while (atomic_cas_u(lock, 0, 1) != 0) {
+		/* pass */
+	}
+}
+
+MEM_INLINE void spin_unlock(unsigned int *lock)
+{
+	atomic_cas_u(lock, 1, 0);
+}
+
+MEM_INLINE unsigned int size_class_from_len(size_t len)
+{
+	return (unsigned int)((len + sizeof(MemHead) - 1) >> SIZE_CLASS_SHIFT);
+}
+
+MEM_INLINE size_t size_class_block_size(unsigned int size_class)
+{
+	return (size_t)(size_class + 1) << SIZE_CLASS_SHIFT;
+}
+
+/* -------------------------------------------------------------------- */
+/* Global free-lists */
+
+/* Push a linked list of blocks, from \a first to \a last. */
+static void global_free_list_push(unsigned int size_class, FreeBlock *first, FreeBlock *last)
+{
+	FreeList *free_list = &global_free_lists[size_class];
+
+	spin_lock(&free_list->lock);
+	last->next = free_list->blocks;
+	free_list->blocks = first;
+	spin_unlock(&free_list->lock);
+}
+
+/* Pop up to \a num blocks, returned as a NULL terminated linked list. */
+static FreeBlock *global_free_list_pop(unsigned int size_class, unsigned int num, unsigned int *r_num)
+{
+	FreeList *free_list = &global_free_lists[size_class];
+	FreeBlock *first, *last;
+	unsigned int i = 0;
+
+	spin_lock(&free_list->lock);
+	first = last = free_list->blocks;
+	if (first) {
+		for (i = 1; i < num && last->next; i++) {
+			last = last->next;
+		}
+		free_list->blocks = last->next;
+		last->next = NULL;
+	}
+	spin_unlock(&free_list->lock);
+
+	*r_num = i;
+	return first;
+}
+
+/* Carve a new chunk into blocks, returned as a NULL terminated linked list. */
+static FreeBlock *chunk_alloc(unsigned int size_class, unsigned int *r_num)
+{
+	const size_t block_size = size_class_block_size(size_class);
+	const unsigned int num = (unsigned int)(CHUNK_SIZE / block_size);
+	char *chunk = malloc(CHUNK_SIZE);
+	unsigned int i;
+
+	if (UNLIKELY(chunk == NULL)) {
+		*r_num = 0;
+		return NULL;
+	}
+
+	atomic_add_and_fetch_z(&chunk_mem_in_use, CHUNK_SIZE);
+
+	for (i = 0; i < num - 1; i++) {
+		((FreeBlock *)(chunk + i * block_size))->next = (FreeBlock *)(chunk + (i + 1) * block_size);
+	}
+	((FreeBlock *)(chunk + i * block_size))->next = NULL;
+
+	*r_num = num;
+	return (FreeBlock *)chunk;
+}
+
+/* -------------------------------------------------------------------- */
+/* Thread caches */
+
+static void thread_cache_counters_merge(ThreadCache *cache)
+{
+	atomic_add_and_fetch_z(&mem_in_use, cache->mem_in_use);
+	atomic_add_and_fetch_u(&totblock, cache->totblock);
+	update_maximum(&peak_mem, mem_in_use);
+
+	cache->mem_in_use = 0;
+	cache->totblock = 0;
+	cache->counters_ops = 0;
+}
+
+/* Called on thread exit, give everything back. */
+static void thread_cache_free(void *data)
+{
+	ThreadCache *cache = data;
+	ThreadCache **cache_p;
+	unsigned int size_class;
+
+	thread_cache_counters_merge(cache);
+
+	for (size_class = 0; size_class < SIZE_CLASS_NUM; size_class++) {
+		FreeBlock *first = cache->free_blocks[size_class], *last = first;
+		if (first) {
+			while (last->next) {
+				last = last->next;
+			}
+			global_free_list_push(size_class, first, last);
+		}
+	}
+
+	spin_lock(&thread_caches_lock);
+	for (cache_p = &thread_caches; *cache_p != cache; cache_p = &(*cache_p)->next) {
+		/* pass */
+	}
+	*cache_p = cache->next;
+	spin_unlock(&thread_caches_lock);
+
+	free(cache);
+	thread_cache = NULL;
+}
+
+#ifdef WIN32
+/* Windows has no destructor for thread-local storage,
+ * but fiber-local storage callbacks also run when a thread exits. */
+static void NTAPI thread_cache_fls_free(void *data)
+{
+	if (data) {
+		thread_cache_free(data);
+	}
+}
+
+static void thread_cache_fls_set(ThreadCache *cache)
+{
+	if (UNLIKELY(thread_cache_fls_index == FLS_OUT_OF_INDEXES)) {
+		spin_lock(&thread_cache_fls_lock);
+		if (thread_cache_fls_index == FLS_OUT_OF_INDEXES) {
+			thread_cache_fls_index = FlsAlloc(thread_cache_fls_free);
+		}
+		spin_unlock(&thread_cache_fls_lock);
+	}
+	if (thread_cache_fls_index != FLS_OUT_OF_INDEXES) {
+		FlsSetValue(thread_cache_fls_index, cache);
+	}
+}
+#else
+static void thread_cache_key_create(void)
+{
+	pthread_key_create(&thread_cache_key, thread_cache_free);
+}
+#endif
+
+static ThreadCache *thread_cache_create(void)
+{
+	ThreadCache *cache = calloc(1, sizeof(ThreadCache));
+
+	if (UNLIKELY(cache == NULL)) {
+		return NULL;
+	}
+
+	spin_lock(&thread_caches_lock);
+	cache->next = thread_caches;
+	thread_caches = cache;
+	spin_unlock(&thread_caches_lock);
+
+#ifdef WIN32
+	thread_cache_fls_set(cache);
+#else
+	pthread_once(&thread_cache_key_once, thread_cache_key_create);
+	pthread_setspecific(thread_cache_key, cache);
+#endif
+
+	thread_cache = cache;
+	return cache;
+}
+
+MEM_INLINE ThreadCache *thread_cache_get(void)
+{
+	ThreadCache *cache = thread_cache;
+	if (UNLIKELY(cache == NULL)) {
+		cache = thread_cache_create();
+	}
+	return cache;
+}
+
+MEM_INLINE void thread_cache_counters_update(ThreadCache *cache, size_t len, unsigned int blocks)
+{
+	cache->mem_in_use += len;
+	cache->totblock += blocks;
+	if (UNLIKELY(++cache->counters_ops == COUNTERS_MERGE_NUM)) {
+		thread_cache_counters_merge(cache);
+	}
+}
+
+/* Allocate a small block, \a len must not exceed #SIZE_CLASS_LEN_MAX. */
+static MemHead *thread_cache_block_alloc(size_t len)
+{
+	ThreadCache *cache = thread_cache_get();
+	const unsigned int size_class = size_class_from_len(len);
+	FreeBlock *block;
+
+	if (UNLIKELY(cache == NULL)) {
+		return NULL;
+	}
+
+	block = cache->free_blocks[size_class];
+	if (UNLIKELY(block == NULL)) {
+		unsigned int num;
+		block = global_free_list_pop(size_class, FREE_BATCH_NUM, &num);
+		if (block == NULL) {
+			block = chunk_alloc(size_class, &num);
+			if (UNLIKELY(block == NULL)) {
+				return NULL;
+			}
+		}
+		cache->free_num[size_class] = num;
+	}
+
+	cache->free_blocks[size_class] = block->next;
+	cache->free_num[size_class]--;
+
+	thread_cache_counters_update(cache, len, 1);
+
+	return (MemHead *)block;
+}
+
+static void thread_cache_block_free(MemHead *memh, size_t len)
+{
+	ThreadCache *cache = thread_cache_get();
+	const unsigned int size_class = size_class_from_len(len);
+	FreeBlock *block = (FreeBlock *)memh;
+
+	if (UNLIKELY(cache == NULL)) {
+		atomic_sub_and_fetch_u(&totblock, 1);
+		atomic_sub_and_fetch_z(&mem_in_use, len);
+		global_free_list_push(size_class, block, block);
+		return;
+	}
+
+	block->next = cache->free_blocks[size_class];
+	cache->free_blocks[size_class] = block;
+
+	if (UNLIKELY(++cache->free_num[size_class] > 2 * FREE_BATCH_NUM)) {
+		/* give a batch back, so blocks freed by other threads than the ones
+		 * which allocated them don't pile up */
+		FreeBlock *last = block;
+		unsigned int i;
+		for (i = 1; i < FREE_BATCH_NUM; i++) {
+			last = last->next;
+		}
+		cache->free_blocks[size_class] = last->next;
+		cache->free_num[size_class] -= FREE_BATCH_NUM;
+		global_free_list_push(size_class, block, last);
+	}
+
+	thread_cache_counters_update(cache, (size_t)0 - len, (unsigned int)-1);
+}
+
+/* -------------------------------------------------------------------- */
+/* API */
+
+size_t MEM_threadcache_allocN_len(const void *vmemh)
+{
+	if (vmemh) {
+		return MEMHEAD_FROM_PTR(vmemh)->len & ~((size_t) (MEMHEAD_MMAP_FLAG | MEMHEAD_ALIGN_FLAG));
+	}
+	else {
+		return 0;
+	}
+}
+
+void MEM_threadcache_freeN(void *vmemh)
+{
+	MemHead *memh = MEMHEAD_FROM_PTR(vmemh);
+	size_t len = MEM_threadcache_allocN_len(vmemh);
+
+	if (vmemh == NULL) {
+		print_error("Attempt to free NULL pointer\n");
+#ifdef WITH_ASSERT_ABORT
+		abort();
+#endif
+		return;
+	}
+
+	if (UNLIKELY(malloc_debug_memset && len && !MEMHEAD_IS_MMAP(memh))) {
+		memset(memh + 1, 255, len);
+	}
+
+	/* mapped and aligned blocks are tagged, whatever their size they never come from a size class */
+	if (LIKELY(!MEMHEAD_IS_MMAP(memh) && !MEMHEAD_IS_ALIGNED(memh) && len <= SIZE_CLASS_LEN_MAX)) {
+		thread_cache_block_free(memh, len);
+		return;
+	}
+
+	atomic_sub_and_fetch_u(&totblock, 1);
+	atomic_sub_and_fetch_z(&mem_in_use, len);
+
+	if (MEMHEAD_IS_MMAP(memh)) {
+		atomic_sub_and_fetch_z(&mmap_in_use, len);
+#if defined(WIN32)
+		/* our windows mmap implementation is not thread safe */
+		mem_lock_thread();
+#endif
+		if (munmap(memh, len + sizeof(MemHead)))
+			printf("Couldn't unmap memory\n");
+#if defined(WIN32)
+		mem_unlock_thread();
+#endif
+	}
+	else {
+		if (UNLIKELY(MEMHEAD_IS_ALIGNED(memh))) {
+			MemHeadAligned *memh_aligned = MEMHEAD_ALIGNED_FROM_PTR(vmemh);
+			aligned_free(MEMHEAD_REAL_PTR(memh_aligned));
+		}
+		else {
+			free(memh);
+		}
+	}
+}
+
+void *MEM_threadcache_dupallocN(const void *vmemh)
+{
+	void *newp = NULL;
+	if (vmemh) {
+		MemHead *memh = MEMHEAD_FROM_PTR(vmemh);
+		const size_t prev_size = MEM_allocN_len(vmemh);
+		if (UNLIKELY(MEMHEAD_IS_MMAP(memh))) {
+			newp = MEM_threadcache_mapallocN(prev_size, "dupli_mapalloc");
+		}
+		else if (UNLIKELY(MEMHEAD_IS_ALIGNED(memh))) {
+			MemHeadAligned *memh_aligned = MEMHEAD_ALIGNED_FROM_PTR(vmemh);
+			newp = MEM_threadcache_mallocN_aligned(
+				prev_size,
+				(size_t)memh_aligned->alignment,
+				"dupli_malloc");
+		}
+		else {
+			newp = MEM_threadcache_mallocN(prev_size, "dupli_malloc");
+		}
+		memcpy(newp, vmemh, prev_size);
+	}
+	return newp;
+}
+
+void *MEM_threadcache_reallocN_id(void *vmemh, size_t len, const char *str)
+{
+	void *newp = NULL;
+
+	if (vmemh) {
+		MemHead *memh = MEMHEAD_FROM_PTR(vmemh);
+		size_t old_len = MEM_allocN_len(vmemh);
+
+		if (LIKELY(!MEMHEAD_IS_ALIGNED(memh))) {
+			newp = MEM_threadcache_mallocN(len, "realloc");
+		}
+		else {
+			MemHeadAligned *memh_aligned = MEMHEAD_ALIGNED_FROM_PTR(vmemh);
+			newp = MEM_threadcache_mallocN_aligned(
+				len,
+				(size_t)memh_aligned->alignment,
+				"realloc");
+		}
+
+		if (newp) {
+			if (len < old_len) {
+				/* shrink */
+				memcpy(newp, vmemh, len);
+			}
+			else {
+				/* grow (or remain same size) */
+				memcpy(newp, vmemh, old_len);
+			}
+		}
+
+		MEM_threadcache_freeN(vmemh);
+	}
+	else {
+		newp = MEM_threadcache_mallocN(len, str);
+	}
+
+	return newp;
+}
+
+void *MEM_threadcache_recallocN_id(void *vmemh, size_t len, const char *str)
+{
+	void *newp = NULL;
+
+	if (vmemh) {
+		MemHead *memh = MEMHEAD_FROM_PTR(vmemh);
+		size_t old_len = MEM_allocN_len(vmemh);
+
+		if (LIKELY(!MEMHEAD_IS_ALIGNED(memh))) {
+			newp = MEM_threadcache_mallocN(len, "recalloc");
+		}
+		else {
+			MemHeadAligned *memh_aligned = MEMHEAD_ALIGNED_FROM_PTR(vmemh);
+			newp = MEM_threadcache_mallocN_aligned(len,
+			                                       (size_t)memh_aligned->alignment,
+			                                       "recalloc");
+		}
+
+		if (newp) {
+			if (len < old_len) {
+				/* shrink */
+				memcpy(newp, vmemh, len);
+			}
+			else {
+				memcpy(newp, vmemh, old_len);
+
+				if (len > old_len) {
+					/* grow */
+					/* zero new bytes */
+					memset(((char *)newp) + old_len, 0, len - old_len);
+				}
+			}
+		}
+
+		MEM_threadcache_freeN(vmemh);
+	}
+	else {
+		newp = MEM_threadcache_callocN(len, str);
+	}
+
+	return newp;
+}
+
+void *MEM_threadcache_callocN(size_t len, const char *str)
+{
+	MemHead *memh;
+
+	len = SIZET_ALIGN_4(len);
+
+	if (len <= SIZE_CLASS_LEN_MAX) {
+		memh = thread_cache_block_alloc(len);
+		if (LIKELY(memh)) {
+			memh->len = len;
+			memset(memh + 1, 0, len);
+			return PTR_FROM_MEMHEAD(memh);
+		}
+	}
+	else {
+		memh = (MemHead *)calloc(1, len + sizeof(MemHead));
+		if (LIKELY(memh)) {
+			memh->len = len;
+			atomic_add_and_fetch_u(&totblock, 1);
+			atomic_add_and_fetch_z(&mem_in_use, len);
+			update_maximum(&peak_mem, mem_in_use);
+
+			return PTR_FROM_MEMHEAD(memh);
+		}
+	}
+	print_error("Calloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
+	            SIZET_ARG(len), str, (unsigned int) mem_in_use);
+	return NULL;
+}
+
+void *MEM_threadcache_mallocN(size_t len, const char *str)
+{
+	MemHead *memh;
+
+	len = SIZET_ALIGN_4(len);
+
+	if (len <= SIZE_CLASS_LEN_MAX) {
+		memh = thread_cache_block_alloc(len);
+	}
+	else {
+		memh = (MemHead *)malloc(len + sizeof(MemHead));
+		if (LIKELY(memh)) {
+			atomic_add_and_fetch_u(&totblock, 1);
+			atomic_add_and_fetch_z(&mem_in_use, len);
+			update_maximum(&peak_mem, mem_in_use);
+		}
+	}
+
+	if (LIKELY(memh)) {
+		if (UNLIKELY(malloc_debug_memset && len)) {
+			memset(memh + 1, 255, len);
+		}
+
+		memh->len = len;
+
+		return PTR_FROM_MEMHEAD(memh);
+	}
+	print_error("Malloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
+	            SIZET_ARG(len), str, (unsigned int) mem_in_use);
+	return NULL;
+}
+
+void *MEM_threadcache_mallocN_aligned(size_t len, size_t alignment, const char *str)
+{
+	MemHeadAligned *memh;
+
+	/* It's possible that MemHead's size is not properly aligned,
+	 * do extra padding to deal with this.
+	 *
+	 * We only support small alignments which fits into short in
+	 * order to save some bits in MemHead structure.
+	 */
+	size_t extra_padding = MEMHEAD_ALIGN_PADDING(alignment);
+
+	/* Huge alignment values doesn't make sense and they
+	 * wouldn't fit into 'short' used in the MemHead.
+	 */
+	assert(alignment < 1024);
+
+	/* We only support alignment to a power of two. */
+	assert(IS_POW2(alignment));
+
+	len = SIZET_ALIGN_4(len);
+
+	memh = (MemHeadAligned *)aligned_malloc(
+		len + extra_padding + sizeof(MemHeadAligned), alignment);
+
+	if (LIKELY(memh)) {
+		/* We keep padding in the beginning of MemHead,
+		 * this way it's always possible to get MemHead
+		 * from the data pointer.
+		 */
+		memh = (MemHeadAligned *)((char *)memh + extra_padding);
+
+		if (UNLIKELY(malloc_debug_memset && len)) {
+			memset(memh + 1, 255, len);
+		}
+
+		/* the flag also keeps aligned blocks out of the size-classes on free */
+		memh->len = len | (size_t) MEMHEAD_ALIGN_FLAG;
+		memh->alignment = (short) alignment;
+		atomic_add_and_fetch_u(&totblock, 1);
+		atomic_add_and_fetch_z(&mem_in_use, len);
+		update_maximum(&peak_mem, mem_in_use);
+
+		return PTR_FROM_MEMHEAD(memh);
+	}
+	print_error("Malloc returns null: len=" SIZET_FORMAT " in %s, total %u\n",
+	            SIZET_ARG(len), str, (unsigned int) mem_in_use);
+	return NULL;
+}
+
+void *MEM_threadcache_mapallocN(size_t len, const char *str)
+{
+	MemHead *memh;
+
+	/* on 64 bit, simply use calloc instead, as mmap does not support
+	 * allocating > 4 GB on Windows. the only reason mapalloc exists
+	 * is to get around address space limitations in 32 bit OSes. */
+	if (sizeof(void *) >= 8)
+		return MEM_threadcache_callocN(len, str);
+
+	len = SIZET_ALIGN_4(len);
+
+#if defined(WIN32)
+	/* our windows mmap implementation is not thread safe */
+	mem_lock_thread();
+#endif
+	memh = mmap(NULL, len + sizeof(MemHead),
+	            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+#if defined(WIN32)
+	mem_unlock_thread();
+#endif
+
+	if (memh != (MemHead *)-1) {
+		memh->len = len | (size_t) MEMHEAD_MMAP_FLAG;
+		atomic_add_and_fetch_u(&totblock, 1);
+		atomic_add_and_fetch_z(&mem_in_use, len);
+		atomic_add_and_fetch_z(&mmap_in_use, len);
+
+		update_maximum(&peak_mem, mem_in_use);
+		update_maximum(&peak_mem, mmap_in_use);
+
+		return PTR_FROM_MEMHEAD(memh);
+	}
+	print_error("Mapalloc returns null, fallback to regular malloc: "
+	            "len=" SIZET_FORMAT " in %s, total %u\n",
+	            SIZET_ARG(len), str, (unsigned int) mmap_in_use);
+	return MEM_threadcache_callocN(len, str);
+}
+
+/* Blocks are not kept in a list, only the guarded allocator (--debug-memory) can list them. */
+
+void MEM_threadcache_printmemlist_pydict(void)
+{
+	print_error("Listing memory blocks is not supported by the thread cache allocator, "
+	            "use --debug-memory\n");
+}
+
+void MEM_threadcache_printmemlist(void)
+{
+	print_error("Listing memory blocks is not supported by the thread cache allocator, "
+	            "use --debug-memory\n");
+}
+
+/* unused */
+void MEM_threadcache_callbackmemlist(void (*func)(void *))
+{
+	(void) func;  /* Ignored. */
+}
+
+void MEM_threadcache_printmemlist_stats(void)
+{
+	printf("\ntotal memory len: %.3f MB\n",
+	       (double)MEM_threadcache_get_memory_in_use() / (double)(1024 * 1024));
+	printf("peak memory len: %.3f MB\n",
+	       (double)peak_mem / (double)(1024 * 1024));
+	printf("small blocks chunks len: %.3f MB\n",
+	       (double)chunk_mem_in_use / (double)(1024 * 1024));
+	printf("\nFor more detailed per-block statistics run Blender with memory debugging command line argument.\n");
+
+#ifdef HAVE_MALLOC_STATS
+	printf("System Statistics:\n");
+	malloc_stats();
+#endif
+}
+
+void MEM_threadcache_set_error_callback(void (*func)(const char *))
+{
+	error_callback = func;
+}
+
+bool MEM_threadcache_check_memory_integrity(void)
+{
+	return true;
+}
+
+void MEM_threadcache_set_lock_callback(void (*lock)(void), void (*unlock)(void))
+{
+	thread_lock_callback = lock;
+	thread_unlock_callback = unlock;
+}
+
+void MEM_threadcache_set_memory_debug(void)
+{
+	malloc_debug_memset = true;
+}
+
+size_t MEM_threadcache_get_memory_in_use(void)
+{
+	size_t len = atomic_load_z(&mem_in_use);
+	ThreadCache *cache;
+
+	/* other threads update their own counters while we read them */
+	spin_lock(&thread_caches_lock);
+	for (cache = thread_caches; cache; cache = cache->next) {
+		len += atomic_load_z(&cache->mem_in_use);
+	}
+	spin_unlock(&thread_caches_lock);
+
+	return len;
+}
+
+size_t MEM_threadcache_get_mapped_memory_in_use(void)
+{
+	return mmap_in_use;
+}
+
+unsigned int MEM_threadcache_get_memory_blocks_in_use(void)
+{
+	unsigned int blocks = atomic_load_u(&totblock);
+	ThreadCache *cache;
+
+	spin_lock(&thread_caches_lock);
+	for (cache = thread_caches; cache; cache = cache->next) {
+		blocks += atomic_load_u(&cache->totblock);
+	}
+	spin_unlock(&thread_caches_lock);
+
+	return blocks;
+}
+
+/* dummy */
+void MEM_threadcache_reset_peak_memory(void)
+{
+	peak_mem = MEM_threadcache_get_memory_in_use();
+}
+
+size_t MEM_threadcache_get_peak_memory(void)
+{
+	return peak_mem;
+}
+
+#ifndef NDEBUG
+const char *MEM_threadcache_name_ptr(void *vmemh)
+{
+	if (vmemh) {
+		return "unknown block name ptr";
+	}
+	else {
+		return "MEM_threadcache_name_ptr(NULL)";
+	}
+}
+#endif  /* NDEBUG */
@@ -194,6 +194,9 @@ typedef struct PTCacheBaker {
 
 	void (*update_progress)(void *data, float progress, int *cancel);
 	void *bake_job;
+
+	/* frames that couldn't be written to the disk cache, set when baking ends */
+	int write_failed;
 } PTCacheBaker;
 
 /* PTCacheEditKey->flag */
@@ -280,6 +283,7 @@ void BKE_ptcache_ids_from_object(struct ListBase *lb, struct Object *ob, struct
 
 /***************** Global funcs ****************************/
 void BKE_ptcache_remove(void);
+int  BKE_ptcache_write_queue_flush(void);
 
 /************ ID specific functions ************************/
 void    BKE_ptcache_id_clear(PTCacheID *id, int mode, unsigned int cfra);
@@ -57,6 +57,7 @@
 #include "BKE_image.h"
 #include "BKE_library.h"
 #include "BKE_node.h"
+#include "BKE_pointcache.h"
 #include "BKE_report.h"
 #include "BKE_scene.h"
 #include "BKE_screen.h"
@@ -78,6 +79,9 @@ char versionstr[48] = "";
 /* only to be called on exit blender */
 void BKE_blender_free(void)
 {
+	/* finish point cache frames still being written to disk */
+	BKE_ptcache_write_queue_flush();
+
 	/* samples are in a global list..., also sets G.main->sound->sample NULL */
 	BKE_main_free(G.main);
 	G.main = NULL;
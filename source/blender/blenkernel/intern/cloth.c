@@ -170,6 +170,9 @@ static BVHTree *bvhselftree_build_from_cloth (ClothModifierData *clmd, float eps
 	
 	/* balance tree */
 	BLI_bvhtree_balance(bvhtree);
+
+	/* rebuild parts of the tree which degrade under large deformation */
+	BLI_bvhtree_refit_policy_set(bvhtree, BVH_REFIT_REBUILD_THRESHOLD);
 	
 	return bvhtree;
 }
@@ -213,6 +216,9 @@ static BVHTree *bvhtree_build_from_cloth (ClothModifierData *clmd, float epsilon
 
 	/* balance tree */
 	BLI_bvhtree_balance(bvhtree);
+
+	/* rebuild parts of the tree which degrade under large deformation */
+	BLI_bvhtree_refit_policy_set(bvhtree, BVH_REFIT_REBUILD_THRESHOLD);
 	
 	return bvhtree;
 }
@@ -345,6 +351,40 @@ static int do_init_cloth(Object *ob, ClothModifierData *clmd, DerivedMesh *resul
 	return 1;
 }
 
+/* Refit statistics of the collision and self collision trees. */
+static void cloth_bvh_stats_get(Cloth *cloth, BVHTreeRefitStats r_stats[2])
+{
+	BVHTree *trees[2] = {cloth->bvhtree, cloth->bvhselftree};
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (trees[i] == NULL || !BLI_bvhtree_refit_stats_get(trees[i], &r_stats[i])) {
+			memset(&r_stats[i], 0, sizeof(r_stats[i]));
+		}
+	}
+}
+
+/* Print the BVH rebuilds since \a stats_prev were stored. */
+static void cloth_bvh_stats_print(Cloth *cloth, const BVHTreeRefitStats stats_prev[2], int framenr)
+{
+	const char *names[2] = {"collision", "self collision"};
+	BVHTreeRefitStats stats[2];
+	int i;
+
+	cloth_bvh_stats_get(cloth, stats);
+
+	for (i = 0; i < 2; i++) {
+		if (stats[i].refit_num != stats_prev[i].refit_num) {
+			printf("cloth %s BVH, frame %d: %d refits, %d subtrees (%d leafs) rebuilt, quality %.3f\n",
+			       names[i], framenr,
+			       stats[i].refit_num - stats_prev[i].refit_num,
+			       stats[i].subtree_rebuild_num - stats_prev[i].subtree_rebuild_num,
+			       stats[i].leaf_rebuild_num - stats_prev[i].leaf_rebuild_num,
+			       stats[i].quality);
+		}
+	}
+}
+
 static int do_step_cloth(Object *ob, ClothModifierData *clmd, DerivedMesh *result, int framenr)
 {
 	ClothVertex *verts = NULL;
@@ -353,6 +393,7 @@ static int do_step_cloth(Object *ob, ClothModifierData *clmd, DerivedMesh *resul
 	MVert *mvert;
 	unsigned int i = 0;
 	int ret = 0;
+	BVHTreeRefitStats bvh_stats[2];
 
 	/* simulate 1 frame forward */
 	cloth = clmd->clothObject;
@@ -385,9 +426,17 @@ static int do_step_cloth(Object *ob, ClothModifierData *clmd, DerivedMesh *resul
 	
 	// TIMEIT_START(cloth_step)
 
+	if (G.debug & G_DEBUG_SIMDATA) {
+		cloth_bvh_stats_get(cloth, bvh_stats);
+	}
+
 	/* call the solver. */
 	ret = BPH_cloth_solve(ob, framenr, clmd, effectors);
 
+	if (G.debug & G_DEBUG_SIMDATA) {
+		cloth_bvh_stats_print(cloth, bvh_stats, framenr);
+	}
+
 	// TIMEIT_END(cloth_step)
 
 	pdEndEffectors(&effectors);
@@ -117,6 +117,9 @@ BVHTree *bvhtree_build_from_mvert(
 	/* balance tree */
 	BLI_bvhtree_balance(tree);
 
+	/* rebuild parts of the tree which degrade under large deformation */
+	BLI_bvhtree_refit_policy_set(tree, BVH_REFIT_REBUILD_THRESHOLD);
+
 	return tree;
 }
 
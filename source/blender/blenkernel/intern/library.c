@@ -1202,6 +1202,8 @@ void BKE_library_free(Library *lib)
 {
 	if (lib->packedfile)
 		freePackedFile(lib->packedfile);
+	if (lib->deferred_ids)
+		BLI_ghash_free(lib->deferred_ids, NULL, NULL);
 }
 
 Main *BKE_main_new(void)
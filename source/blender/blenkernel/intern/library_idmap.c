@@ -137,7 +137,8 @@ ID *BKE_main_idmap_lookup(struct IDNameLib_Map *id_map, short id_type, const cha
 		if (lb_len == 0) {
 			return NULL;
 		}
-		type_map->map = BLI_ghash_new_ex(idkey_hash, idkey_cmp, __func__, lb_len);
+		/* only insertions then lookups, entries are stored inline for faster lookups */
+		type_map->map = BLI_ghash_new_flag_ex(idkey_hash, idkey_cmp, __func__, lb_len, GHASH_FLAG_OPEN_ADDRESSING);
 		type_map->keys = MEM_mallocN(sizeof(struct IDNameLib_Key) * lb_len, __func__);
 
 		GHash *map = type_map->map;
@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -138,6 +139,8 @@ static int ptcache_extra_datasize[] = {
 
 /* forward declerations */
 static int ptcache_file_compressed_read(PTCacheFile *pf, unsigned char *result, unsigned int len);
+static void ptcache_write_queue_wait(const PointCache *cache, int cfra);
+static bool ptcache_write_queue_is_pending(const PointCache *cache, int cfra);
 static int ptcache_file_compressed_write(PTCacheFile *pf, unsigned char *in, unsigned int in_len, unsigned char *out, int mode);
 static int ptcache_file_write(PTCacheFile *pf, const void *f, unsigned int tot, unsigned int size);
 static int ptcache_file_read(PTCacheFile *pf, void *f, unsigned int tot, unsigned int size);
@@ -1866,22 +1869,28 @@ static int ptcache_filename(PTCacheID *pid, char *filename, int cfra, short do_p
 	return len; /* make sure the above string is always 16 chars */
 }
 
-/* youll need to close yourself after! */
-static PTCacheFile *ptcache_file_open(PTCacheID *pid, int mode, int cfra)
+/* full path of the cache file of a frame, returns false when the disk cache can't be used */
+static bool ptcache_file_path(PTCacheID *pid, int mode, int cfra, char *filename)
 {
-	PTCacheFile *pf;
-	FILE *fp = NULL;
-	char filename[FILE_MAX * 2];
-
 #ifndef DURIAN_POINTCACHE_LIB_OK
 	/* don't allow writing for linked objects */
 	if (pid->ob->id.lib && mode == PTCACHE_FILE_WRITE)
-		return NULL;
+		return false;
+#else
+	UNUSED_VARS(mode);
 #endif
-	if (!G.relbase_valid && (pid->cache->flag & PTCACHE_EXTERNAL)==0) return NULL; /* save blend file before using disk pointcache */
+	if (!G.relbase_valid && (pid->cache->flag & PTCACHE_EXTERNAL)==0) return false; /* save blend file before using disk pointcache */
 	
 	ptcache_filename(pid, filename, cfra, 1, 1);
 
+	return true;
+}
+/* youll need to close yourself after! */
+static PTCacheFile *ptcache_file_open_path(const char *filename, int mode, int cfra)
+{
+	PTCacheFile *pf;
+	FILE *fp = NULL;
+
 	if (mode==PTCACHE_FILE_READ) {
 		fp = BLI_fopen(filename, "rb");
 	}
@@ -1904,6 +1913,19 @@ static PTCacheFile *ptcache_file_open(PTCacheID *pid, int mode, int cfra)
 
 	return pf;
 }
+static PTCacheFile *ptcache_file_open(PTCacheID *pid, int mode, int cfra)
+{
+	char filename[FILE_MAX * 2];
+
+	if (!ptcache_file_path(pid, mode, cfra, filename))
+		return NULL;
+
+	/* the frame may still be in the asynchronous write queue */
+	if (mode != PTCACHE_FILE_WRITE)
+		ptcache_write_queue_wait(pid->cache, cfra);
+
+	return ptcache_file_open_path(filename, mode, cfra);
+}
 static void ptcache_file_close(PTCacheFile *pf)
 {
 	if (pf) {
@@ -2363,14 +2385,14 @@ static PTCacheMem *ptcache_disk_frame_to_mem(PTCacheID *pid, int cfra)
 	
 	return pm;
 }
-static int ptcache_mem_frame_to_disk(PTCacheID *pid, PTCacheMem *pm)
+/* only uses data passed in (no PTCacheID), so it can run on the cache writer threads */
+static int ptcache_mem_frame_to_file(
+        const char *filename, PTCacheMem *pm, int type, int compression, int (*write_header)(PTCacheFile *pf))
 {
 	PTCacheFile *pf = NULL;
 	unsigned int i, error = 0;
-	
-	BKE_ptcache_id_clear(pid, PTCACHE_CLEAR_FRAME, pm->frame);
 
-	pf = ptcache_file_open(pid, PTCACHE_FILE_WRITE, pm->frame);
+	pf = ptcache_file_open_path(filename, PTCACHE_FILE_WRITE, pm->frame);
 
 	if (pf==NULL) {
 		if (G.debug & G_DEBUG)
@@ -2380,25 +2402,25 @@ static int ptcache_mem_frame_to_disk(PTCacheID *pid, PTCacheMem *pm)
 
 	pf->data_types = pm->data_types;
 	pf->totpoint = pm->totpoint;
-	pf->type = pid->type;
+	pf->type = type;
 	pf->flag = 0;
 	
 	if (pm->extradata.first)
 		pf->flag |= PTCACHE_TYPEFLAG_EXTRADATA;
 	
-	if (pid->cache->compression)
+	if (compression)
 		pf->flag |= PTCACHE_TYPEFLAG_COMPRESS;
 
-	if (!ptcache_file_header_begin_write(pf) || !pid->write_header(pf))
+	if (!ptcache_file_header_begin_write(pf) || !write_header(pf))
 		error = 1;
 
 	if (!error) {
-		if (pid->cache->compression) {
+		if (compression) {
 			for (i=0; i<BPHYS_TOT_DATA; i++) {
 				if (pm->data[i]) {
 					unsigned int in_len = pm->totpoint*ptcache_data_size[i];
 					unsigned char *out = (unsigned char *)MEM_callocN(LZO_OUT_LEN(in_len) * 4, "pointcache_lzo_buffer");
-					ptcache_file_compressed_write(pf, (unsigned char *)(pm->data[i]), in_len, out, pid->cache->compression);
+					ptcache_file_compressed_write(pf, (unsigned char *)(pm->data[i]), in_len, out, compression);
 					MEM_freeN(out);
 				}
 			}
@@ -2428,10 +2450,10 @@ static int ptcache_mem_frame_to_disk(PTCacheID *pid, PTCacheMem *pm)
 			ptcache_file_write(pf, &extra->type, 1, sizeof(unsigned int));
 			ptcache_file_write(pf, &extra->totdata, 1, sizeof(unsigned int));
 
-			if (pid->cache->compression) {
+			if (compression) {
 				unsigned int in_len = extra->totdata * ptcache_extra_datasize[extra->type];
 				unsigned char *out = (unsigned char *)MEM_callocN(LZO_OUT_LEN(in_len) * 4, "pointcache_lzo_buffer");
-				ptcache_file_compressed_write(pf, (unsigned char *)(extra->data), in_len, out, pid->cache->compression);
+				ptcache_file_compressed_write(pf, (unsigned char *)(extra->data), in_len, out, compression);
 				MEM_freeN(out);
 			}
 			else {
@@ -2447,6 +2469,245 @@ static int ptcache_mem_frame_to_disk(PTCacheID *pid, PTCacheMem *pm)
 
 	return error==0;
 }
+static int ptcache_mem_frame_to_disk(PTCacheID *pid, PTCacheMem *pm)
+{
+	char filename[FILE_MAX * 2];
+
+	BKE_ptcache_id_clear(pid, PTCACHE_CLEAR_FRAME, pm->frame);
+
+	if (!ptcache_file_path(pid, PTCACHE_FILE_WRITE, pm->frame, filename)) {
+		if (G.debug & G_DEBUG)
+			printf("Error opening disk cache file for writing\n");
+		return 0;
+	}
+
+	return ptcache_mem_frame_to_file(filename, pm, pid->type, pid->cache->compression, pid->write_header);
+}
+
+/* -------------------------------------------------------------------- */
+/** \name Asynchronous Disk Cache Writing
+ *
+ * Frames of PTCacheMem based caches (particles, cloth, soft body, ...) are compressed and written
+ * by writer threads while the simulation continues with the next frame.
+ * The queue takes ownership of the frame data, everything else needed is copied from the PTCacheID.
+ *
+ * Reading, checking or clearing frames of a cache waits for its pending writes,
+ * #BKE_ptcache_write_queue_flush finishes all of them (end of baking, exit).
+ * \{ */
+
+#define PTCACHE_WRITE_QUEUE_THREADS_MAX 4
+/* Frame argument to wait for or find all pending frames of a cache, frames can be negative. */
+#define PTCACHE_WRITE_QUEUE_ALL_FRAMES INT_MIN
+/* Backpressure, the simulation waits when it gets too far ahead of the disk. */
+#define PTCACHE_WRITE_QUEUE_JOBS_MAX 16
+#define PTCACHE_WRITE_QUEUE_SIZE_MAX ((size_t)256 * 1024 * 1024)
+
+typedef struct PTCacheWriteJob {
+	struct PTCacheWriteJob *next, *prev;
+
+	/* Only used to find the pending frames of a cache. */
+	const PointCache *cache;
+	PTCacheMem *pm;
+	size_t size;
+
+	int type, compression;
+	int (*write_header)(PTCacheFile *pf);
+	char filename[FILE_MAX * 2];
+} PTCacheWriteJob;
+
+static ThreadMutex ptcache_write_queue_lock = BLI_MUTEX_INITIALIZER;
+static ThreadCondition ptcache_write_queue_cond = PTHREAD_COND_INITIALIZER;
+static ThreadQueue *ptcache_write_queue = NULL;
+static ListBase ptcache_write_queue_threads = {NULL, NULL};
+
+/* Jobs queued or being written, protected by ptcache_write_queue_lock. */
+static ListBase ptcache_write_queue_jobs = {NULL, NULL};
+static int ptcache_write_queue_jobs_num = 0;
+static size_t ptcache_write_queue_jobs_size = 0;
+/* Writes that failed since the last flush, protected by ptcache_write_queue_lock. */
+static int ptcache_write_queue_failed = 0;
+
+static void ptcache_mem_free(PTCacheMem *pm)
+{
+	ptcache_data_free(pm);
+	ptcache_extra_free(pm);
+	MEM_freeN(pm);
+}
+
+static size_t ptcache_mem_size(PTCacheMem *pm)
+{
+	PTCacheExtra *extra;
+	size_t size = sizeof(PTCacheMem);
+	int i;
+
+	for (i = 0; i < BPHYS_TOT_DATA; i++) {
+		if (pm->data[i])
+			size += (size_t)pm->totpoint * ptcache_data_size[i];
+	}
+	for (extra = pm->extradata.first; extra; extra = extra->next) {
+		size += (size_t)extra->totdata * ptcache_extra_datasize[extra->type];
+	}
+
+	return size;
+}
+
+static void *ptcache_write_queue_thread(void *data)
+{
+	ThreadQueue *queue = data;
+	PTCacheWriteJob *job;
+
+	while ((job = BLI_thread_queue_pop(queue))) {
+		const bool ok = ptcache_mem_frame_to_file(
+		        job->filename, job->pm, job->type, job->compression, job->write_header) != 0;
+		ptcache_mem_free(job->pm);
+
+		BLI_mutex_lock(&ptcache_write_queue_lock);
+		if (!ok) {
+			ptcache_write_queue_failed++;
+		}
+		BLI_remlink(&ptcache_write_queue_jobs, job);
+		ptcache_write_queue_jobs_num--;
+		ptcache_write_queue_jobs_size -= job->size;
+		BLI_condition_notify_all(&ptcache_write_queue_cond);
+		BLI_mutex_unlock(&ptcache_write_queue_lock);
+
+		MEM_freeN(job);
+	}
+
+	return NULL;
+}
+
+/* cfra can be #PTCACHE_WRITE_QUEUE_ALL_FRAMES, lock must be held */
+static bool ptcache_write_queue_find(const PointCache *cache, int cfra)
+{
+	PTCacheWriteJob *job;
+
+	for (job = ptcache_write_queue_jobs.first; job; job = job->next) {
+		if (job->cache == cache && (cfra == PTCACHE_WRITE_QUEUE_ALL_FRAMES || job->pm->frame == (unsigned int)cfra)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool ptcache_write_queue_is_pending(const PointCache *cache, int cfra)
+{
+	bool is_pending;
+
+	BLI_mutex_lock(&ptcache_write_queue_lock);
+	is_pending = ptcache_write_queue_find(cache, cfra);
+	BLI_mutex_unlock(&ptcache_write_queue_lock);
+
+	return is_pending;
+}
+
+/* wait for the pending writes of a cache frame, or #PTCACHE_WRITE_QUEUE_ALL_FRAMES */
+static void ptcache_write_queue_wait(const PointCache *cache, int cfra)
+{
+	BLI_mutex_lock(&ptcache_write_queue_lock);
+	while (ptcache_write_queue_find(cache, cfra)) {
+		BLI_condition_wait(&ptcache_write_queue_cond, &ptcache_write_queue_lock);
+	}
+	BLI_mutex_unlock(&ptcache_write_queue_lock);
+}
+
+static void ptcache_write_queue_push(PTCacheWriteJob *job)
+{
+	BLI_mutex_lock(&ptcache_write_queue_lock);
+
+	while (ptcache_write_queue_jobs_num >= PTCACHE_WRITE_QUEUE_JOBS_MAX ||
+	       (ptcache_write_queue_jobs_num > 0 &&
+	        ptcache_write_queue_jobs_size + job->size > PTCACHE_WRITE_QUEUE_SIZE_MAX))
+	{
+		BLI_condition_wait(&ptcache_write_queue_cond, &ptcache_write_queue_lock);
+	}
+
+	if (ptcache_write_queue == NULL) {
+		const int tot = max_ii(1, min_ii(BLI_system_thread_count() - 1, PTCACHE_WRITE_QUEUE_THREADS_MAX));
+		int i;
+
+		ptcache_write_queue = BLI_thread_queue_init();
+		BLI_init_threads(&ptcache_write_queue_threads, ptcache_write_queue_thread, tot);
+		for (i = 0; i < tot; i++) {
+			BLI_insert_thread(&ptcache_write_queue_threads, ptcache_write_queue);
+		}
+	}
+
+	BLI_addtail(&ptcache_write_queue_jobs, job);
+	ptcache_write_queue_jobs_num++;
+	ptcache_write_queue_jobs_size += job->size;
+	BLI_thread_queue_push(ptcache_write_queue, job);
+
+	BLI_mutex_unlock(&ptcache_write_queue_lock);
+}
+
+/* takes ownership of pm */
+static int ptcache_mem_frame_to_disk_async(PTCacheID *pid, PTCacheMem *pm)
+{
+	PTCacheWriteJob *job;
+
+	BKE_ptcache_id_clear(pid, PTCACHE_CLEAR_FRAME, pm->frame);
+
+	job = MEM_callocN(sizeof(PTCacheWriteJob), "PTCacheWriteJob");
+
+	if (!ptcache_file_path(pid, PTCACHE_FILE_WRITE, pm->frame, job->filename)) {
+		if (G.debug & G_DEBUG)
+			printf("Error opening disk cache file for writing\n");
+		ptcache_mem_free(pm);
+		MEM_freeN(job);
+		return 0;
+	}
+
+	job->cache = pid->cache;
+	job->pm = pm;
+	job->size = ptcache_mem_size(pm);
+	job->type = pid->type;
+	job->compression = pid->cache->compression;
+	job->write_header = pid->write_header;
+
+	ptcache_write_queue_push(job);
+
+	return 1;
+}
+
+/**
+ * Finish all pending asynchronous disk cache writes, and stop the writer threads.
+ *
+ * \return the number of frames that failed to be written since the previous flush.
+ */
+int BKE_ptcache_write_queue_flush(void)
+{
+	ThreadQueue *queue;
+	ListBase threads;
+	int failed;
+
+	BLI_mutex_lock(&ptcache_write_queue_lock);
+	while (ptcache_write_queue_jobs_num != 0) {
+		BLI_condition_wait(&ptcache_write_queue_cond, &ptcache_write_queue_lock);
+	}
+	failed = ptcache_write_queue_failed;
+	ptcache_write_queue_failed = 0;
+	queue = ptcache_write_queue;
+	threads = ptcache_write_queue_threads;
+	ptcache_write_queue = NULL;
+	BLI_listbase_clear(&ptcache_write_queue_threads);
+	BLI_mutex_unlock(&ptcache_write_queue_lock);
+
+	if (queue) {
+		BLI_thread_queue_nowait(queue);
+		BLI_end_threads(&threads);
+		BLI_thread_queue_free(queue);
+	}
+
+	if (failed) {
+		printf("Error: %d point cache frame(s) could not be written to disk\n", failed);
+	}
+
+	return failed;
+}
+
+/** \} */
+
 
 static int ptcache_read_stream(PTCacheID *pid, int cfra)
 {
@@ -2825,20 +3086,11 @@ static int ptcache_write(PTCacheID *pid, int cfra, int overwrite)
 	pm->frame = cfra;
 
 	if (cache->flag & PTCACHE_DISK_CACHE) {
-		error += !ptcache_mem_frame_to_disk(pid, pm);
-
-		// if (pm) /* pm is always set */
-		{
-			ptcache_data_free(pm);
-			ptcache_extra_free(pm);
-			MEM_freeN(pm);
-		}
+		/* frames are owned by the write queue from now on */
+		error += !ptcache_mem_frame_to_disk_async(pid, pm);
 
 		if (pm2) {
-			error += !ptcache_mem_frame_to_disk(pid, pm2);
-			ptcache_data_free(pm2);
-			ptcache_extra_free(pm2);
-			MEM_freeN(pm2);
+			error += !ptcache_mem_frame_to_disk_async(pid, pm2);
 		}
 	}
 	else {
@@ -2960,6 +3212,9 @@ void BKE_ptcache_id_clear(PTCacheID *pid, int mode, unsigned int cfra)
 	if (pid->cache->flag & PTCACHE_IGNORE_CLEAR)
 		return;
 
+	/* pending writes would bring cleared files back */
+	ptcache_write_queue_wait(pid->cache, (mode == PTCACHE_CLEAR_FRAME) ? (int)cfra : PTCACHE_WRITE_QUEUE_ALL_FRAMES);
+
 	sta = pid->cache->startframe;
 	end = pid->cache->endframe;
 
@@ -3104,6 +3359,9 @@ int  BKE_ptcache_id_exist(PTCacheID *pid, int cfra)
 	if (pid->cache->flag & PTCACHE_DISK_CACHE) {
 		char filename[MAX_PTCACHE_FILE];
 		
+		if (ptcache_write_queue_is_pending(pid->cache, cfra))
+			return 1;
+
 		ptcache_filename(pid, filename, cfra, 1, 1);
 
 		return BLI_exists(filename);
@@ -3188,6 +3446,8 @@ void BKE_ptcache_id_time(PTCacheID *pid, Scene *scene, float cfra, int *startfra
 			char ext[MAX_PTCACHE_PATH];
 			unsigned int len; /* store the length of the string */
 
+			ptcache_write_queue_wait(cache, PTCACHE_WRITE_QUEUE_ALL_FRAMES);
+
 			ptcache_path(pid, path);
 			
 			len = ptcache_filename(pid, filename, (int)cfra, 0, 0); /* no path */
@@ -3365,6 +3625,8 @@ void BKE_ptcache_remove(void)
 	char path_full[MAX_PTCACHE_PATH];
 	int rmdir = 1;
 	
+	BKE_ptcache_write_queue_flush();
+
 	ptcache_path(NULL, path);
 
 	if (BLI_exists(path)) {
@@ -3433,6 +3695,7 @@ void BKE_ptcache_free_mem(ListBase *mem_cache)
 }
 void BKE_ptcache_free(PointCache *cache)
 {
+	ptcache_write_queue_wait(cache, PTCACHE_WRITE_QUEUE_ALL_FRAMES);
 	BKE_ptcache_free_mem(&cache->mem_cache);
 	if (cache->edit && cache->free_edit)
 		cache->free_edit(cache->edit);
@@ -3736,6 +3999,9 @@ void BKE_ptcache_bake(PTCacheBaker *baker)
 		}
 	}
 
+	/* all baked frames are on disk when baking ends */
+	baker->write_failed = BKE_ptcache_write_queue_flush();
+
 	scene->r.framelen = frameleno;
 	CFRA = cfrao;
 	
@@ -3848,6 +4114,8 @@ void BKE_ptcache_disk_cache_rename(PTCacheID *pid, const char *name_src, const c
 	char old_path_full[MAX_PTCACHE_FILE];
 	char ext[MAX_PTCACHE_PATH];
 
+	ptcache_write_queue_wait(pid->cache, PTCACHE_WRITE_QUEUE_ALL_FRAMES);
+
 	/* save old name */
 	BLI_strncpy(old_name, pid->cache->name, sizeof(old_name));
 
@@ -3908,6 +4176,8 @@ void BKE_ptcache_load_external(PTCacheID *pid)
 	if (!cache)
 		return;
 
+	ptcache_write_queue_wait(cache, PTCACHE_WRITE_QUEUE_ALL_FRAMES);
+
 	ptcache_path(pid, path);
 	
 	len = ptcache_filename(pid, filename, 1, 0, 0); /* no path */
@@ -42,6 +42,7 @@
 #include "DNA_mesh_types.h"
 #include "DNA_node_types.h"
 #include "DNA_object_types.h"
+#include "DNA_particle_types.h"
 #include "DNA_rigidbody_types.h"
 #include "DNA_scene_types.h"
 #include "DNA_screen_types.h"
@@ -61,6 +62,8 @@
 
 #include "BLT_translation.h"
 
+#include "BLO_readfile.h"
+
 #include "BKE_anim.h"
 #include "BKE_animsys.h"
 #include "BKE_action.h"
@@ -78,6 +81,7 @@
 #include "BKE_idprop.h"
 #include "BKE_image.h"
 #include "BKE_library.h"
+#include "BKE_library_query.h"
 #include "BKE_linestyle.h"
 #include "BKE_main.h"
 #include "BKE_mask.h"
@@ -1760,6 +1764,109 @@ static void prepare_mesh_for_viewport_render(Main *bmain, Scene *scene)
 	}
 }
 
+static void scene_tag_deferred_id(ID *id);
+
+static int scene_tag_deferred_cb(void *UNUSED(user_data), ID *UNUSED(id_self), ID **id_pointer, int UNUSED(cd_flag))
+{
+	if (*id_pointer) {
+		scene_tag_deferred_id(*id_pointer);
+	}
+	return IDWALK_RET_NOP;
+}
+
+/* Tag \a id and all data-blocks it depends on with LIB_TAG_DOIT, including the deferred place-holders
+ * to load: object data, modifier and constraint targets, dupli-groups, particle duplicators... */
+static void scene_tag_deferred_id(ID *id)
+{
+	if (id->tag & LIB_TAG_DOIT) {
+		return;
+	}
+	id->tag |= LIB_TAG_DOIT;
+
+	switch (GS(id->name)) {
+		case ID_SCE:
+		case ID_LI:
+			/* Scenes only depend on other scenes through their sets, handled by the caller. */
+			break;
+		case ID_GR:
+		{
+			/* Only the objects on the group layers are instanced. */
+			Group *group = (Group *)id;
+			GroupObject *go;
+
+			for (go = group->gobject.first; go; go = go->next) {
+				if (go->ob && (go->ob->lay & group->layer)) {
+					scene_tag_deferred_id(&go->ob->id);
+				}
+			}
+			break;
+		}
+		default:
+			BKE_library_foreach_ID_link(id, scene_tag_deferred_cb, NULL, IDWALK_READONLY);
+			break;
+	}
+}
+
+/**
+ * With deferred library loading, read the real data of linked meshes used by visible objects
+ * and everything they depend on (modifier and constraint targets, dupli-groups, particle duplicators...).
+ *
+ * \warning Reads files and changes \a bmain, only call from the main thread,
+ * never from frame updates which may run in a render thread.
+ */
+void BKE_scene_load_deferred_library_data(Main *bmain, Scene *scene, unsigned int lay)
+{
+	Scene *sce_iter;
+	Base *base;
+	ID *id;
+
+	if (!BLO_library_deferred_loading_get()) {
+		return;
+	}
+
+	for (id = bmain->mesh.first; id; id = id->next) {
+		if (id->tag & LIB_TAG_DEFERRED) {
+			break;
+		}
+	}
+	if (id == NULL) {
+		return;
+	}
+
+	BKE_main_id_tag_all(bmain, LIB_TAG_DOIT, false);
+
+	for (SETLOOPER(scene, sce_iter, base)) {
+		if (base->lay & lay) {
+			scene_tag_deferred_id(&base->object->id);
+		}
+	}
+
+	/* All tagged place-holders at once, reading each library file only once. */
+	if (BLO_library_deferred_load_tagged(bmain, LIB_TAG_DOIT, NULL)) {
+		DAG_relations_tag_update(bmain);
+	}
+
+	BKE_main_id_tag_all(bmain, LIB_TAG_DOIT, false);
+}
+
+/* Layers visible in the 3D views showing \a scene (including local views), or the scene layers without any. */
+static unsigned int scene_visible_layers(Main *bmain, Scene *scene)
+{
+	wmWindowManager *wm = bmain->wm.first;
+	wmWindow *win;
+	unsigned int lay = 0;
+
+	if (wm) {
+		for (win = wm->windows.first; win; win = win->next) {
+			if (win->screen && win->screen->scene == scene) {
+				lay |= BKE_screen_visible_layers(win->screen, scene);
+			}
+		}
+	}
+
+	return lay ? lay : scene->lay;
+}
+
 void BKE_scene_update_tagged(EvaluationContext *eval_ctx, Main *bmain, Scene *scene)
 {
 	Scene *sce_iter;
@@ -1770,6 +1877,8 @@ void BKE_scene_update_tagged(EvaluationContext *eval_ctx, Main *bmain, Scene *sc
 	/* keep this first */
 	BLI_callback_exec(bmain, &scene->id, BLI_CB_EVT_SCENE_UPDATE_PRE);
 
+	BKE_scene_load_deferred_library_data(bmain, scene, scene_visible_layers(bmain, scene));
+
 	/* (re-)build dependency graph if needed */
 	for (sce_iter = scene; sce_iter; sce_iter = sce_iter->set) {
 		DAG_scene_relations_update(bmain, sce_iter);
@@ -1877,7 +1986,8 @@ void BKE_scene_update_for_newframe(EvaluationContext *eval_ctx, Main *bmain, Sce
 	BKE_scene_update_for_newframe_ex(eval_ctx, bmain, sce, lay, false);
 }
 
-void BKE_scene_update_for_newframe_ex(EvaluationContext *eval_ctx, Main *bmain, Scene *sce, unsigned int lay, bool do_invisible_flush)
+static void scene_update_for_newframe(EvaluationContext *eval_ctx, Main *bmain, Scene *sce, unsigned int lay,
+                                      bool do_invisible_flush, bool do_clear_recalc)
 {
 	float ctime = BKE_scene_frame_get(sce);
 	Scene *sce_iter;
@@ -1997,13 +2107,27 @@ void BKE_scene_update_for_newframe_ex(EvaluationContext *eval_ctx, Main *bmain,
 	DAG_ids_check_recalc(bmain, sce, true);
 
 	/* clear recalc flags */
-	DAG_ids_clear_recalc(bmain);
+	if (do_clear_recalc)
+		DAG_ids_clear_recalc(bmain);
 
 #ifdef DETAILED_ANALYSIS_OUTPUT
 	fprintf(stderr, "frame update start_time %f duration %f\n", start_time, PIL_check_seconds_timer() - start_time);
 #endif
 }
 
+void BKE_scene_update_for_newframe_ex(EvaluationContext *eval_ctx, Main *bmain, Scene *sce, unsigned int lay, bool do_invisible_flush)
+{
+	scene_update_for_newframe(eval_ctx, bmain, sce, lay, do_invisible_flush, true);
+}
+
+/* Same as above, but leaves the recalc flags set, so render engines with persistent
+ * data can only sync the datablocks that changed. Caller must clear them with
+ * DAG_ids_clear_recalc() afterwards. */
+void BKE_scene_update_for_newframe_keep_recalc(EvaluationContext *eval_ctx, Main *bmain, Scene *sce, unsigned int lay, bool do_invisible_flush)
+{
+	scene_update_for_newframe(eval_ctx, bmain, sce, lay, do_invisible_flush, false);
+}
+
 /* return default layer, also used to patch old files */
 SceneRenderLayer *BKE_scene_add_render_layer(Scene *sce, const char *name)
 {
@@ -60,6 +60,8 @@ typedef struct GHash GHash;
 typedef struct GHashIterator {
 	GHash *gh;
 	struct Entry *curEntry;
+	/* Key and value of the current entry in either storage, NULL when done (value always NULL for GSet). */
+	void **curKey, **curVal;
 	unsigned int curBucket;
 } GHashIterator;
 
@@ -72,6 +74,7 @@ typedef struct GHashIterState {
 enum {
 	GHASH_FLAG_ALLOW_DUPES  = (1 << 0),  /* Only checked for in debug mode */
 	GHASH_FLAG_ALLOW_SHRINK = (1 << 1),  /* Allow to shrink buckets' size. */
+	GHASH_FLAG_OPEN_ADDRESSING = (1 << 2),  /* Store entries inline in an open addressing table (see BLI_ghash.c). */
 
 #ifdef GHASH_INTERNAL_API
 	/* Internal usage only */
@@ -84,6 +87,8 @@ enum {
 GHash *BLI_ghash_new_ex(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
                         const unsigned int nentries_reserve) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
 GHash *BLI_ghash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+GHash *BLI_ghash_new_flag_ex(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+                             const unsigned int nentries_reserve, const unsigned int flag) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
 GHash *BLI_ghash_copy(GHash *gh, GHashKeyCopyFP keycopyfp,
                       GHashValCopyFP valcopyfp) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
 void   BLI_ghash_free(GHash *gh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp);
@@ -119,17 +124,10 @@ BLI_INLINE void  *BLI_ghashIterator_getValue(GHashIterator *ghi) ATTR_WARN_UNUSE
 BLI_INLINE void **BLI_ghashIterator_getValue_p(GHashIterator *ghi) ATTR_WARN_UNUSED_RESULT;
 BLI_INLINE bool   BLI_ghashIterator_done(GHashIterator *ghi) ATTR_WARN_UNUSED_RESULT;
 
-struct _gh_Entry { void *next, *key, *val; };
-BLI_INLINE void  *BLI_ghashIterator_getKey(GHashIterator *ghi)     { return  ((struct _gh_Entry *)ghi->curEntry)->key; }
-BLI_INLINE void  *BLI_ghashIterator_getValue(GHashIterator *ghi)   { return  ((struct _gh_Entry *)ghi->curEntry)->val; }
-BLI_INLINE void **BLI_ghashIterator_getValue_p(GHashIterator *ghi) { return &((struct _gh_Entry *)ghi->curEntry)->val; }
-BLI_INLINE bool   BLI_ghashIterator_done(GHashIterator *ghi)       { return !ghi->curEntry; }
-/* disallow further access */
-#ifdef __GNUC__
-#  pragma GCC poison _gh_Entry
-#else
-#  define _gh_Entry void
-#endif
+BLI_INLINE void  *BLI_ghashIterator_getKey(GHashIterator *ghi)     { return *ghi->curKey; }
+BLI_INLINE void  *BLI_ghashIterator_getValue(GHashIterator *ghi)   { return *ghi->curVal; }
+BLI_INLINE void **BLI_ghashIterator_getValue_p(GHashIterator *ghi) { return  ghi->curVal; }
+BLI_INLINE bool   BLI_ghashIterator_done(GHashIterator *ghi)       { return !ghi->curKey; }
 
 #define GHASH_ITER(gh_iter_, ghash_) \
 	for (BLI_ghashIterator_init(&gh_iter_, ghash_); \
@@ -237,6 +235,8 @@ typedef struct GSetIterator {
 GSet  *BLI_gset_new_ex(GSetHashFP hashfp, GSetCmpFP cmpfp, const char *info,
                        const unsigned int nentries_reserve) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
 GSet  *BLI_gset_new(GSetHashFP hashfp, GSetCmpFP cmpfp, const char *info) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+GSet  *BLI_gset_new_flag_ex(GSetHashFP hashfp, GSetCmpFP cmpfp, const char *info,
+                            const unsigned int nentries_reserve, const unsigned int flag) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
 GSet  *BLI_gset_copy(GSet *gs, GSetKeyCopyFP keycopyfp) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
 unsigned int BLI_gset_size(GSet *gs) ATTR_WARN_UNUSED_RESULT;
 void   BLI_gset_flag_set(GSet *gs, unsigned int flag);
@@ -82,6 +82,17 @@ typedef struct BVHTreeRayHit {
 	float dist;         /* distance to the hit point */
 } BVHTreeRayHit;
 
+typedef struct BVHTreeRefitStats {
+	int refit_num;            /* number of BLI_bvhtree_update_tree calls */
+	int rebuild_num;          /* number of refits which rebuilt subtrees */
+	int subtree_rebuild_num;  /* total number of rebuilt subtrees */
+	int leaf_rebuild_num;     /* total number of leafs in rebuilt subtrees */
+	float quality;            /* on the last refit (before rebuilding), SAH cost after building / current cost */
+} BVHTreeRefitStats;
+
+/* default for BLI_bvhtree_refit_policy_set */
+#define BVH_REFIT_REBUILD_THRESHOLD 1.5f
+
 enum {
 	/* calculate IsectRayPrecalc data */
 	BVH_RAYCAST_WATERTIGHT		= (1 << 0),
@@ -126,6 +137,10 @@ void BLI_bvhtree_balance(BVHTree *tree);
 bool BLI_bvhtree_update_node(BVHTree *tree, int index, const float co[3], const float co_moving[3], int numpoints);
 void BLI_bvhtree_update_tree(BVHTree *tree);
 
+/* refit: optionally rebuild degraded subtrees on update */
+void BLI_bvhtree_refit_policy_set(BVHTree *tree, float rebuild_threshold);
+bool BLI_bvhtree_refit_stats_get(const BVHTree *tree, BVHTreeRefitStats *r_stats);
+
 int BLI_bvhtree_overlap_thread_num(const BVHTree *tree);
 
 /* collision/overlap: check two trees if they overlap, alloc's *overlap with length of the int return value */
@@ -171,6 +186,17 @@ void BLI_bvhtree_ray_cast_all(
         BVHTree *tree, const float co[3], const float dir[3], float radius, float hit_dist,
         BVHTree_RayCastCallback callback, void *userdata);
 
+/* batched queries, callbacks must be thread-safe */
+void BLI_bvhtree_ray_cast_batch(
+        BVHTree *tree, const float (*co)[3], const float (*dir)[3], float radius,
+        BVHTreeRayHit *hit, const int rays_num,
+        BVHTree_RayCastCallback callback, void *userdata,
+        int flag);
+
+void BLI_bvhtree_find_nearest_batch(
+        BVHTree *tree, const float (*co)[3], BVHTreeNearest *nearest, const int co_num,
+        BVHTree_NearestPointCallback callback, void *userdata);
+
 float BLI_bvhtree_bb_raycast(const float bv[6], const float light_start[3], const float light_end[3], float pos[3]);
 
 /* range query */
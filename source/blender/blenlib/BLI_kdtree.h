@@ -52,6 +52,9 @@ void BLI_kdtree_insert(
 int BLI_kdtree_find_nearest(
         const KDTree *tree, const float co[3],
         KDTreeNearest *r_nearest) ATTR_NONNULL(1, 2);
+void BLI_kdtree_find_nearest_batch(
+        const KDTree *tree, const float (*co)[3], const unsigned int co_num,
+        int *r_index, KDTreeNearest *r_nearest) ATTR_NONNULL(1, 2);
 
 #define BLI_kdtree_find_nearest_n(tree, co, r_nearest, n) \
         BLI_kdtree_find_nearest_n__normal(tree, co, NULL, r_nearest, n)
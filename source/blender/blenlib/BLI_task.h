@@ -37,8 +37,10 @@ extern "C" {
 
 /* Task Scheduler
  * 
- * Central scheduler that holds running threads ready to execute tasks. A single
- * queue holds the task from all pools.
+ * Central scheduler that holds running threads ready to execute tasks. Every
+ * worker thread has its own queue of tasks, idle workers steal tasks from the
+ * queues of other workers. A scheduler with a single queue shared by all
+ * workers can be created for comparison.
  *
  * Init/exit must be called before/after any task pools are created/freed, and
  * must be called from the main threads. All other scheduler and pool functions
@@ -52,6 +54,7 @@ enum {
 };
 
 TaskScheduler *BLI_task_scheduler_create(int num_threads);
+TaskScheduler *BLI_task_scheduler_create_ex(int num_threads, const bool use_global_queue);
 void BLI_task_scheduler_free(TaskScheduler *scheduler);
 
 int BLI_task_scheduler_num_threads(TaskScheduler *scheduler);
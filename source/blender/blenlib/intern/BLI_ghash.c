@@ -31,6 +31,9 @@
  * A general (pointer -> pointer) chaining hash table
  * for 'Abstract Data Types' (known as an ADT Hash Table).
  *
+ * An open addressing storage can be used instead of chaining,
+ * see #GHASH_FLAG_OPEN_ADDRESSING.
+ *
  * \note edgehash.c is based on this, make sure they stay in sync.
  */
 
@@ -39,6 +42,10 @@
 #include <stdarg.h>
 #include <limits.h>
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 #include "MEM_guardedalloc.h"
 
 #include "BLI_sys_types.h"  /* for intptr_t support */
@@ -97,6 +104,15 @@ typedef Entry GSetEntry;
 #define GHASH_ENTRY_SIZE(_is_gset) \
 	((_is_gset) ? sizeof(GSetEntry) : sizeof(GHashEntry))
 
+/* Slot of the open addressing storage, GSet slots only hold the key. */
+typedef struct GHashSlot {
+	void *key;
+	void *val;
+} GHashSlot;
+
+#define GHASH_SLOT_SIZE(_is_gset) \
+	((_is_gset) ? sizeof(void *) : sizeof(GHashSlot))
+
 struct GHash {
 	GHashHashFP hashfp;
 	GHashCmpFP cmpfp;
@@ -113,6 +129,13 @@ struct GHash {
 
 	unsigned int nentries;
 	unsigned int flag;
+
+	/* Open addressing storage (#GHASH_FLAG_OPEN_ADDRESSING), 'nbuckets' is then the number of slots. */
+	unsigned char *oa_ctrl;
+	void *oa_slots;
+	unsigned int oa_group_mask;
+	unsigned int oa_slot_bit, oa_slot_bit_min;
+	unsigned int oa_ndeleted;
 };
 
 
@@ -132,6 +155,560 @@ BLI_INLINE void ghash_entry_copy(
 	}
 }
 
+/* -------------------------------------------------------------------- */
+/* Open Addressing Storage */
+
+/** \name Open Addressing Storage
+ *
+ * Alternative storage used when #GHASH_FLAG_OPEN_ADDRESSING is set.
+ *
+ * Entries are stored inline in a single array of slots, so there is no per-entry allocation and no pointer
+ * chasing on lookup. A separate array holds one control byte per slot, either #GHASH_OA_CTRL_EMPTY,
+ * #GHASH_OA_CTRL_DELETED or the 7 highest bits of the hash of the slot's key. Slots are probed by groups of
+ * #GHASH_OA_GROUP_SIZE, testing all control bytes of a group at once (with SSE2 when available),
+ * so most mismatching keys are rejected without calling the comparison callback.
+ *
+ * Slots (#GHashSlot) only hold the key and value, GSet slots only the key.
+ *
+ * \note Unlike chained storage, inserting may move existing entries,
+ * so pointers returned by #BLI_ghash_lookup_p and friends are only valid until next insertion.
+ * \{ */
+
+#define GHASH_OA_GROUP_SIZE 16
+#define GHASH_OA_SLOT_BIT_MIN 4  /* A single group. */
+#define GHASH_OA_SLOT_BIT_MAX 31  /* Largest power of two 'nbuckets' can hold. */
+
+#define GHASH_OA_CTRL_EMPTY   0x80
+#define GHASH_OA_CTRL_DELETED 0xfe
+
+/**
+ * Max load (deleted slots included) is 7/8, there must always remain empty slots for lookups to stop.
+ * Written so they don't overflow for the largest tables.
+ */
+#define GHASH_OA_LIMIT_GROW(_nslots)   ((_nslots) - ((_nslots) / 8))
+#define GHASH_OA_LIMIT_SHRINK(_nslots) (((_nslots) / 32) * 7)
+
+BLI_INLINE bool ghash_is_open_addressing(GHash *gh)
+{
+	return (gh->flag & GHASH_FLAG_OPEN_ADDRESSING) != 0;
+}
+
+/**
+ * Get the full hash for a key, mixed so that both its lowest bits (group index)
+ * and highest bits (control byte) are well distributed, even for weak hashes like plain integers.
+ */
+BLI_INLINE unsigned int ghash_oa_keyhash(GHash *gh, const void *key)
+{
+	unsigned int hash = gh->hashfp(key);
+
+	/* murmur3 finalizer */
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+BLI_INLINE unsigned char ghash_oa_ctrl_from_hash(const unsigned int hash)
+{
+	return (unsigned char)(hash >> 25);
+}
+
+BLI_INLINE bool ghash_oa_ctrl_is_used(const unsigned char ctrl)
+{
+	return (ctrl & 0x80) == 0;
+}
+
+BLI_INLINE GHashSlot *ghash_oa_slot(GHash *gh, const unsigned int index)
+{
+	return (GHashSlot *)((char *)gh->oa_slots + (size_t)index * GHASH_SLOT_SIZE(gh->flag & GHASH_FLAG_IS_GSET));
+}
+
+/**
+ * \return a bit-mask of the slots of the group which control byte is \a ctrl.
+ */
+BLI_INLINE unsigned int ghash_oa_group_match(const unsigned char *group, const unsigned char ctrl)
+{
+#ifdef __SSE2__
+	const __m128i group_ctrl = _mm_loadu_si128((const __m128i *)group);
+	return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(group_ctrl, _mm_set1_epi8((char)ctrl)));
+#else
+	unsigned int mask = 0;
+	unsigned int i;
+	for (i = 0; i < GHASH_OA_GROUP_SIZE; i++) {
+		if (group[i] == ctrl) {
+			mask |= 1u << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+/**
+ * \return a bit-mask of the slots of the group that are empty or deleted.
+ */
+BLI_INLINE unsigned int ghash_oa_group_match_unused(const unsigned char *group)
+{
+#ifdef __SSE2__
+	return (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+	unsigned int mask = 0;
+	unsigned int i;
+	for (i = 0; i < GHASH_OA_GROUP_SIZE; i++) {
+		if (!ghash_oa_ctrl_is_used(group[i])) {
+			mask |= 1u << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+/**
+ * \return index of the lowest set bit of \a mask (which must not be zero).
+ */
+BLI_INLINE unsigned int ghash_oa_mask_first(const unsigned int mask)
+{
+	BLI_assert(mask != 0);
+#ifdef __GNUC__
+	return (unsigned int)__builtin_ctz(mask);
+#else
+	unsigned int i = 0;
+	while (!(mask & (1u << i))) {
+		i++;
+	}
+	return i;
+#endif
+}
+
+/**
+ * Internal lookup function, groups are visited with triangular probing,
+ * which covers all groups since their number is a power of two.
+ *
+ * \return the slot index of \a key, or UINT_MAX if not found.
+ */
+BLI_INLINE unsigned int ghash_oa_lookup_index(GHash *gh, const void *key, const unsigned int hash)
+{
+	const unsigned char ctrl = ghash_oa_ctrl_from_hash(hash);
+	unsigned int group_index = hash & gh->oa_group_mask;
+	unsigned int step = 0;
+
+	while (true) {
+		const unsigned char *group = &gh->oa_ctrl[group_index * GHASH_OA_GROUP_SIZE];
+		unsigned int match;
+
+		for (match = ghash_oa_group_match(group, ctrl); match; match &= match - 1) {
+			const unsigned int index = group_index * GHASH_OA_GROUP_SIZE + ghash_oa_mask_first(match);
+			if (gh->cmpfp(key, ghash_oa_slot(gh, index)->key) == false) {
+				return index;
+			}
+		}
+		/* An empty slot means the key would have been stored in this group,
+		 * once all groups were visited the key can't be anywhere else. */
+		if (ghash_oa_group_match(group, GHASH_OA_CTRL_EMPTY) || (step == gh->oa_group_mask)) {
+			return UINT_MAX;
+		}
+
+		group_index = (group_index + ++step) & gh->oa_group_mask;
+	}
+}
+
+BLI_INLINE GHashSlot *ghash_oa_lookup_slot(GHash *gh, const void *key)
+{
+	const unsigned int index = ghash_oa_lookup_index(gh, key, ghash_oa_keyhash(gh, key));
+	return (index != UINT_MAX) ? ghash_oa_slot(gh, index) : NULL;
+}
+
+/**
+ * \return the index of the first empty or deleted slot in the probing sequence of \a hash.
+ *
+ * \note The probing sequence visits every group once within 'oa_group_mask + 1' steps,
+ * so a table without unused slots (only possible once #GHASH_OA_SLOT_BIT_MAX is reached) is fatal.
+ */
+BLI_INLINE unsigned int ghash_oa_find_unused_index(GHash *gh, const unsigned int hash)
+{
+	unsigned int group_index = hash & gh->oa_group_mask;
+	unsigned int step = 0;
+
+	while (true) {
+		const unsigned int match = ghash_oa_group_match_unused(&gh->oa_ctrl[group_index * GHASH_OA_GROUP_SIZE]);
+		if (match) {
+			return group_index * GHASH_OA_GROUP_SIZE + ghash_oa_mask_first(match);
+		}
+
+		if (UNLIKELY(step == gh->oa_group_mask)) {
+			BLI_assert(!"GHash open addressing table is full");
+			abort();
+		}
+		group_index = (group_index + ++step) & gh->oa_group_mask;
+	}
+}
+
+/**
+ * Find the index of next used slot, starting from \a index, or nbuckets if there are none.
+ */
+BLI_INLINE unsigned int ghash_oa_find_next_used_index(GHash *gh, unsigned int index)
+{
+	for (; index < gh->nbuckets; index++) {
+		if (ghash_oa_ctrl_is_used(gh->oa_ctrl[index])) {
+			break;
+		}
+	}
+	return index;
+}
+
+/**
+ * Reallocate slots to the given size, re-inserting all entries (which also purges deleted slots).
+ */
+static void ghash_oa_resize(GHash *gh, const unsigned int slot_bit)
+{
+	unsigned char *ctrl_old = gh->oa_ctrl;
+	char *slots_old = gh->oa_slots;
+	const unsigned int nslots_old = gh->nbuckets;
+	const unsigned int nslots = 1u << slot_bit;
+	const size_t slot_size = GHASH_SLOT_SIZE(gh->flag & GHASH_FLAG_IS_GSET);
+	unsigned int i;
+
+	gh->oa_slot_bit = slot_bit;
+	gh->oa_group_mask = (nslots / GHASH_OA_GROUP_SIZE) - 1;
+	gh->oa_ndeleted = 0;
+	gh->nbuckets = nslots;
+	gh->limit_grow   = GHASH_OA_LIMIT_GROW(nslots);
+	gh->limit_shrink = GHASH_OA_LIMIT_SHRINK(nslots);
+
+	gh->oa_ctrl = MEM_mallocN(sizeof(*gh->oa_ctrl) * nslots, __func__);
+	memset(gh->oa_ctrl, GHASH_OA_CTRL_EMPTY, sizeof(*gh->oa_ctrl) * nslots);
+	gh->oa_slots = MEM_mallocN(slot_size * nslots, __func__);
+
+	if (ctrl_old) {
+		for (i = 0; i < nslots_old; i++) {
+			if (ghash_oa_ctrl_is_used(ctrl_old[i])) {
+				const GHashSlot *slot = (const GHashSlot *)(slots_old + (size_t)i * slot_size);
+				const unsigned int hash = ghash_oa_keyhash(gh, slot->key);
+				const unsigned int index = ghash_oa_find_unused_index(gh, hash);
+
+				gh->oa_ctrl[index] = ghash_oa_ctrl_from_hash(hash);
+				memcpy(ghash_oa_slot(gh, index), slot, slot_size);
+			}
+		}
+		MEM_freeN(ctrl_old);
+		MEM_freeN(slots_old);
+	}
+}
+
+/**
+ * Open addressing counterpart of #ghash_buckets_expand,
+ * also takes care of purging deleted slots once they fill the table.
+ */
+static void ghash_oa_expand(GHash *gh, const unsigned int nentries, const bool user_defined)
+{
+	unsigned int new_slot_bit;
+
+	if (LIKELY(gh->oa_ctrl && (nentries + gh->oa_ndeleted <= gh->limit_grow))) {
+		return;
+	}
+
+	new_slot_bit = gh->oa_slot_bit;
+	while ((nentries > GHASH_OA_LIMIT_GROW(1u << new_slot_bit)) &&
+	       (new_slot_bit < GHASH_OA_SLOT_BIT_MAX))
+	{
+		new_slot_bit++;
+	}
+
+	if (user_defined) {
+		gh->oa_slot_bit_min = new_slot_bit;
+	}
+
+	if ((new_slot_bit == gh->oa_slot_bit) && gh->oa_ctrl) {
+		if (nentries + gh->oa_ndeleted <= gh->limit_grow) {
+			return;
+		}
+		/* Only deleted slots are to be purged, but when the table is also quite full,
+		 * grow it instead to avoid purging again after a few more insertions. */
+		if ((nentries > gh->limit_grow / 2) && (new_slot_bit < GHASH_OA_SLOT_BIT_MAX)) {
+			new_slot_bit++;
+		}
+	}
+
+	ghash_oa_resize(gh, new_slot_bit);
+}
+
+/**
+ * Open addressing counterpart of #ghash_buckets_contract.
+ */
+static void ghash_oa_contract(
+        GHash *gh, const unsigned int nentries, const bool user_defined, const bool force_shrink)
+{
+	unsigned int new_slot_bit;
+
+	if (!(force_shrink || (gh->flag & GHASH_FLAG_ALLOW_SHRINK))) {
+		return;
+	}
+
+	if (LIKELY(gh->oa_ctrl && (nentries > gh->limit_shrink))) {
+		return;
+	}
+
+	new_slot_bit = gh->oa_slot_bit;
+	while ((nentries < GHASH_OA_LIMIT_SHRINK(1u << new_slot_bit)) &&
+	       (new_slot_bit > gh->oa_slot_bit_min))
+	{
+		new_slot_bit--;
+	}
+
+	if (user_defined) {
+		gh->oa_slot_bit_min = new_slot_bit;
+	}
+
+	if ((new_slot_bit == gh->oa_slot_bit) && gh->oa_ctrl) {
+		return;
+	}
+
+	ghash_oa_resize(gh, new_slot_bit);
+}
+
+/**
+ * Clear and reset \a gh slots, reserve again slots for given number of entries.
+ */
+BLI_INLINE void ghash_oa_reset(GHash *gh, const unsigned int nentries)
+{
+	MEM_SAFE_FREE(gh->oa_ctrl);
+	MEM_SAFE_FREE(gh->oa_slots);
+
+	gh->oa_slot_bit = GHASH_OA_SLOT_BIT_MIN;
+	gh->oa_slot_bit_min = GHASH_OA_SLOT_BIT_MIN;
+	gh->oa_ndeleted = 0;
+	gh->nbuckets = 0;
+
+	gh->nentries = 0;
+
+	ghash_oa_expand(gh, nentries, (nentries != 0));
+}
+
+/**
+ * Add a new entry for \a key, growing the storage first if needed.
+ * Caller is responsible for setting the value.
+ */
+BLI_INLINE GHashSlot *ghash_oa_insert_keyonly(GHash *gh, void *key, const unsigned int hash)
+{
+	unsigned int index;
+	GHashSlot *slot;
+
+	BLI_assert((gh->flag & GHASH_FLAG_ALLOW_DUPES) || (BLI_ghash_haskey(gh, key) == 0));
+
+	ghash_oa_expand(gh, gh->nentries + 1, false);
+
+	index = ghash_oa_find_unused_index(gh, hash);
+	if (gh->oa_ctrl[index] == GHASH_OA_CTRL_DELETED) {
+		gh->oa_ndeleted--;
+	}
+	gh->oa_ctrl[index] = ghash_oa_ctrl_from_hash(hash);
+	gh->nentries++;
+
+	slot = ghash_oa_slot(gh, index);
+	slot->key = key;
+	return slot;
+}
+
+/**
+ * Look for \a key, adding a new entry for it if not found.
+ */
+BLI_INLINE GHashSlot *ghash_oa_ensure_slot(GHash *gh, void *key, bool *r_haskey)
+{
+	const unsigned int hash = ghash_oa_keyhash(gh, key);
+	const unsigned int index = ghash_oa_lookup_index(gh, key, hash);
+
+	*r_haskey = (index != UINT_MAX);
+	if (*r_haskey) {
+		return ghash_oa_slot(gh, index);
+	}
+	return ghash_oa_insert_keyonly(gh, key, hash);
+}
+
+BLI_INLINE bool ghash_oa_insert_safe(
+        GHash *gh, void *key, void *val, const bool override,
+        GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	bool haskey;
+	GHashSlot *slot = ghash_oa_ensure_slot(gh, key, &haskey);
+	const bool is_gset = (gh->flag & GHASH_FLAG_IS_GSET) != 0;
+
+	BLI_assert(!valfreefp || !is_gset);
+
+	if (haskey) {
+		if (override) {
+			if (keyfreefp) {
+				keyfreefp(slot->key);
+			}
+			if (valfreefp) {
+				valfreefp(slot->val);
+			}
+			slot->key = key;
+			if (!is_gset) {
+				slot->val = val;
+			}
+		}
+		return false;
+	}
+	else {
+		if (!is_gset) {
+			slot->val = val;
+		}
+		return true;
+	}
+}
+
+/**
+ * Remove the entry at \a index.
+ *
+ * A slot can be marked empty again when its group already has empty slots,
+ * since no probing sequence can have gone past such a group.
+ */
+BLI_INLINE void ghash_oa_remove_index(GHash *gh, const unsigned int index)
+{
+	const unsigned char *group = &gh->oa_ctrl[(index / GHASH_OA_GROUP_SIZE) * GHASH_OA_GROUP_SIZE];
+
+	if (ghash_oa_group_match(group, GHASH_OA_CTRL_EMPTY)) {
+		gh->oa_ctrl[index] = GHASH_OA_CTRL_EMPTY;
+	}
+	else {
+		gh->oa_ctrl[index] = GHASH_OA_CTRL_DELETED;
+		gh->oa_ndeleted++;
+	}
+	gh->nentries--;
+}
+
+/**
+ * Remove \a key, returning its value in \a r_val (if given).
+ */
+static bool ghash_oa_remove(
+        GHash *gh, const void *key,
+        GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp, void **r_val)
+{
+	const unsigned int index = ghash_oa_lookup_index(gh, key, ghash_oa_keyhash(gh, key));
+	GHashSlot *slot;
+
+	BLI_assert(!(valfreefp || r_val) || !(gh->flag & GHASH_FLAG_IS_GSET));
+
+	if (index == UINT_MAX) {
+		return false;
+	}
+
+	slot = ghash_oa_slot(gh, index);
+	if (keyfreefp) {
+		keyfreefp(slot->key);
+	}
+	if (valfreefp) {
+		valfreefp(slot->val);
+	}
+	if (r_val) {
+		*r_val = slot->val;
+	}
+
+	ghash_oa_remove_index(gh, index);
+	ghash_oa_contract(gh, gh->nentries, false, false);
+
+	return true;
+}
+
+/**
+ * Open addressing counterpart of #ghash_pop, \a r_val may be NULL.
+ */
+static bool ghash_oa_pop(GHash *gh, GHashIterState *state, void **r_key, void **r_val)
+{
+	unsigned int index;
+	GHashSlot *slot;
+
+	BLI_assert(!r_val || !(gh->flag & GHASH_FLAG_IS_GSET));
+
+	if (gh->nentries == 0) {
+		return false;
+	}
+
+	index = ghash_oa_find_next_used_index(gh, state->curr_bucket);
+	if (index >= gh->nbuckets) {
+		index = ghash_oa_find_next_used_index(gh, 0);
+	}
+	BLI_assert(index < gh->nbuckets);
+
+	slot = ghash_oa_slot(gh, index);
+	*r_key = slot->key;
+	if (r_val) {
+		*r_val = slot->val;
+	}
+
+	ghash_oa_remove_index(gh, index);
+	ghash_oa_contract(gh, gh->nentries, false, false);
+
+	state->curr_bucket = index;
+	return true;
+}
+
+/**
+ * Open addressing counterpart of #ghash_free_cb.
+ */
+static void ghash_oa_free_cb(
+        GHash *gh,
+        GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	unsigned int i;
+
+	BLI_assert(keyfreefp  || valfreefp);
+	BLI_assert(!valfreefp || !(gh->flag & GHASH_FLAG_IS_GSET));
+
+	for (i = 0; i < gh->nbuckets; i++) {
+		if (ghash_oa_ctrl_is_used(gh->oa_ctrl[i])) {
+			GHashSlot *slot = ghash_oa_slot(gh, i);
+			if (keyfreefp) {
+				keyfreefp(slot->key);
+			}
+			if (valfreefp) {
+				valfreefp(slot->val);
+			}
+		}
+	}
+}
+
+/**
+ * Copy slots of \a gh into \a gh_new, which must have the same number of slots.
+ * Entries keep their index, so control bytes can be copied as-is.
+ */
+static void ghash_oa_copy(
+        GHash *gh_new, GHash *gh, GHashKeyCopyFP keycopyfp, GHashValCopyFP valcopyfp)
+{
+	const bool is_gset = (gh->flag & GHASH_FLAG_IS_GSET) != 0;
+
+	BLI_assert(gh_new->nbuckets == gh->nbuckets);
+	BLI_assert((gh_new->flag & GHASH_FLAG_IS_GSET) == (gh->flag & GHASH_FLAG_IS_GSET));
+
+	memcpy(gh_new->oa_ctrl, gh->oa_ctrl, sizeof(*gh->oa_ctrl) * gh->nbuckets);
+
+	if (keycopyfp || valcopyfp) {
+		unsigned int i;
+		for (i = 0; i < gh->nbuckets; i++) {
+			if (ghash_oa_ctrl_is_used(gh->oa_ctrl[i])) {
+				GHashSlot *slot_new = ghash_oa_slot(gh_new, i);
+				const GHashSlot *slot = ghash_oa_slot(gh, i);
+
+				slot_new->key = (keycopyfp) ? keycopyfp(slot->key) : slot->key;
+				if (!is_gset) {
+					slot_new->val = (valcopyfp) ? valcopyfp(slot->val) : slot->val;
+				}
+			}
+		}
+	}
+	else {
+		memcpy(gh_new->oa_slots, gh->oa_slots, GHASH_SLOT_SIZE(is_gset) * gh->nbuckets);
+	}
+
+	gh_new->nentries = gh->nentries;
+	gh_new->oa_ndeleted = gh->oa_ndeleted;
+}
+
+/** \} */
+
+
 /* -------------------------------------------------------------------- */
 /* GHash API */
 
@@ -420,15 +997,44 @@ BLI_INLINE Entry *ghash_lookup_entry_prev_ex(
 }
 
 /**
- * Internal lookup function. Only wraps #ghash_lookup_entry_ex
+ * Internal lookup function. Only wraps #ghash_lookup_entry_ex, chained storage only.
  */
 BLI_INLINE Entry *ghash_lookup_entry(GHash *gh, const void *key)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
+	unsigned int hash, bucket_index;
+
+	BLI_assert(!ghash_is_open_addressing(gh));
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
 	return ghash_lookup_entry_ex(gh, key, bucket_index);
 }
 
+/**
+ * Internal lookup of the value of \a key for both storages, NULL if not found.
+ */
+BLI_INLINE void **ghash_lookup_val_p(GHash *gh, const void *key)
+{
+	BLI_assert(!(gh->flag & GHASH_FLAG_IS_GSET));
+
+	if (ghash_is_open_addressing(gh)) {
+		GHashSlot *slot = ghash_oa_lookup_slot(gh, key);
+		return slot ? &slot->val : NULL;
+	}
+	else {
+		GHashEntry *e = (GHashEntry *)ghash_lookup_entry(gh, key);
+		return e ? &e->val : NULL;
+	}
+}
+
+BLI_INLINE bool ghash_haskey(GHash *gh, const void *key)
+{
+	if (ghash_is_open_addressing(gh)) {
+		return (ghash_oa_lookup_index(gh, key, ghash_oa_keyhash(gh, key)) != UINT_MAX);
+	}
+	return (ghash_lookup_entry(gh, key) != NULL);
+}
+
 static GHash *ghash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
                         const unsigned int nentries_reserve, const unsigned int flag)
 {
@@ -438,10 +1044,18 @@ static GHash *ghash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
 	gh->cmpfp = cmpfp;
 
 	gh->buckets = NULL;
+	gh->entrypool = NULL;
+	gh->oa_ctrl = NULL;
+	gh->oa_slots = NULL;
 	gh->flag = flag;
 
-	ghash_buckets_reset(gh, nentries_reserve);
-	gh->entrypool = BLI_mempool_create(GHASH_ENTRY_SIZE(flag & GHASH_FLAG_IS_GSET), 64, 64, BLI_MEMPOOL_NOP);
+	if (ghash_is_open_addressing(gh)) {
+		ghash_oa_reset(gh, nentries_reserve);
+	}
+	else {
+		ghash_buckets_reset(gh, nentries_reserve);
+		gh->entrypool = BLI_mempool_create(GHASH_ENTRY_SIZE(flag & GHASH_FLAG_IS_GSET), 64, 64, BLI_MEMPOOL_NOP);
+	}
 
 	return gh;
 }
@@ -502,8 +1116,17 @@ BLI_INLINE void ghash_insert_ex_keyonly(
 
 BLI_INLINE void ghash_insert(GHash *gh, void *key, void *val)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
+	unsigned int hash, bucket_index;
+
+	if (ghash_is_open_addressing(gh)) {
+		GHashSlot *slot = ghash_oa_insert_keyonly(gh, key, ghash_oa_keyhash(gh, key));
+		BLI_assert(!(gh->flag & GHASH_FLAG_IS_GSET));
+		slot->val = val;
+		return;
+	}
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
 
 	ghash_insert_ex(gh, key, val, bucket_index);
 }
@@ -512,12 +1135,19 @@ BLI_INLINE bool ghash_insert_safe(
         GHash *gh, void *key, void *val, const bool override,
         GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
-	GHashEntry *e = (GHashEntry *)ghash_lookup_entry_ex(gh, key, bucket_index);
+	unsigned int hash, bucket_index;
+	GHashEntry *e;
 
 	BLI_assert(!(gh->flag & GHASH_FLAG_IS_GSET));
 
+	if (ghash_is_open_addressing(gh)) {
+		return ghash_oa_insert_safe(gh, key, val, override, keyfreefp, valfreefp);
+	}
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
+	e = (GHashEntry *)ghash_lookup_entry_ex(gh, key, bucket_index);
+
 	if (e) {
 		if (override) {
 			if (keyfreefp) {
@@ -541,12 +1171,19 @@ BLI_INLINE bool ghash_insert_safe_keyonly(
         GHash *gh, void *key, const bool override,
         GHashKeyFreeFP keyfreefp)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
-	Entry *e = ghash_lookup_entry_ex(gh, key, bucket_index);
+	unsigned int hash, bucket_index;
+	Entry *e;
 
 	BLI_assert((gh->flag & GHASH_FLAG_IS_GSET) != 0);
 
+	if (ghash_is_open_addressing(gh)) {
+		return ghash_oa_insert_safe(gh, key, NULL, override, keyfreefp, NULL);
+	}
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
+	e = ghash_lookup_entry_ex(gh, key, bucket_index);
+
 	if (e) {
 		if (override) {
 			if (keyfreefp) {
@@ -628,6 +1265,11 @@ static void ghash_free_cb(
 {
 	unsigned int i;
 
+	if (ghash_is_open_addressing(gh)) {
+		ghash_oa_free_cb(gh, keyfreefp, valfreefp);
+		return;
+	}
+
 	BLI_assert(keyfreefp  || valfreefp);
 	BLI_assert(!valfreefp || !(gh->flag & GHASH_FLAG_IS_GSET));
 
@@ -651,13 +1293,25 @@ static void ghash_free_cb(
 static GHash *ghash_copy(GHash *gh, GHashKeyCopyFP keycopyfp, GHashValCopyFP valcopyfp)
 {
 	GHash *gh_new;
+	unsigned int reserve_nentries_new;
 	unsigned int i;
-	/* This allows us to be sure to get the same number of buckets in gh_new as in ghash. */
-	const unsigned int reserve_nentries_new = MAX2(GHASH_LIMIT_GROW(gh->nbuckets) - 1, gh->nentries);
 
 	BLI_assert(!valcopyfp || !(gh->flag & GHASH_FLAG_IS_GSET));
 
 	gh_new = ghash_new(gh->hashfp, gh->cmpfp, __func__, 0, gh->flag);
+
+	if (ghash_is_open_addressing(gh)) {
+		if (gh_new->oa_slot_bit != gh->oa_slot_bit) {
+			ghash_oa_resize(gh_new, gh->oa_slot_bit);
+		}
+		gh_new->oa_slot_bit_min = gh->oa_slot_bit_min;
+		ghash_oa_copy(gh_new, gh, keycopyfp, valcopyfp);
+		return gh_new;
+	}
+
+	/* This allows us to be sure to get the same number of buckets in gh_new as in ghash. */
+	reserve_nentries_new = MAX2(GHASH_LIMIT_GROW(gh->nbuckets) - 1, gh->nentries);
+
 	ghash_buckets_expand(gh_new, reserve_nentries_new, false);
 
 	BLI_assert(gh_new->nbuckets == gh->nbuckets);
@@ -683,6 +1337,57 @@ static GHash *ghash_copy(GHash *gh, GHashKeyCopyFP keycopyfp, GHashValCopyFP val
 	return gh_new;
 }
 
+/**
+ * Free the storage of \a gh (not its entries' keys or values).
+ */
+static void ghash_storage_free(GHash *gh)
+{
+	if (ghash_is_open_addressing(gh)) {
+		MEM_SAFE_FREE(gh->oa_ctrl);
+		MEM_SAFE_FREE(gh->oa_slots);
+	}
+	else {
+		MEM_SAFE_FREE(gh->buckets);
+		BLI_mempool_destroy(gh->entrypool);
+		gh->entrypool = NULL;
+	}
+}
+
+/**
+ * Move all entries of \a gh to the storage matching \a flag
+ * (switching between chaining and open addressing).
+ */
+static void ghash_storage_convert(GHash *gh, const unsigned int flag)
+{
+	GHash *gh_new = ghash_new(gh->hashfp, gh->cmpfp, __func__, 0, flag | GHASH_FLAG_ALLOW_DUPES);
+	const bool is_gset = (gh->flag & GHASH_FLAG_IS_GSET) != 0;
+	GHashIterator ghi;
+
+	BLI_assert((flag & GHASH_FLAG_IS_GSET) == (gh->flag & GHASH_FLAG_IS_GSET));
+
+	if (ghash_is_open_addressing(gh_new)) {
+		ghash_oa_expand(gh_new, gh->nentries, false);
+	}
+	else {
+		ghash_buckets_expand(gh_new, gh->nentries, false);
+	}
+
+	/* Keys are known to be unique, no need to check (hence #GHASH_FLAG_ALLOW_DUPES above). */
+	GHASH_ITER (ghi, gh) {
+		if (is_gset) {
+			BLI_gset_insert((GSet *)gh_new, BLI_ghashIterator_getKey(&ghi));
+		}
+		else {
+			ghash_insert(gh_new, BLI_ghashIterator_getKey(&ghi), BLI_ghashIterator_getValue(&ghi));
+		}
+	}
+
+	ghash_storage_free(gh);
+	gh_new->flag = flag;
+	*gh = *gh_new;
+	MEM_freeN(gh_new);
+}
+
 /** \} */
 
 
@@ -705,6 +1410,17 @@ GHash *BLI_ghash_new_ex(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
 	return ghash_new(hashfp, cmpfp, info, nentries_reserve, 0);
 }
 
+/**
+ * A version of #BLI_ghash_new_ex which also sets \a flag,
+ * so a GHash using #GHASH_FLAG_OPEN_ADDRESSING never allocates chained storage.
+ */
+GHash *BLI_ghash_new_flag_ex(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+                             const unsigned int nentries_reserve, const unsigned int flag)
+{
+	BLI_assert((flag & GHASH_FLAG_IS_GSET) == 0);
+	return ghash_new(hashfp, cmpfp, info, nentries_reserve, flag);
+}
+
 /**
  * Wraps #BLI_ghash_new_ex with zero entries reserved.
  */
@@ -726,6 +1442,12 @@ GHash *BLI_ghash_copy(GHash *gh, GHashKeyCopyFP keycopyfp, GHashValCopyFP valcop
  */
 void BLI_ghash_reserve(GHash *gh, const unsigned int nentries_reserve)
 {
+	if (ghash_is_open_addressing(gh)) {
+		ghash_oa_expand(gh, nentries_reserve, true);
+		ghash_oa_contract(gh, nentries_reserve, true, false);
+		return;
+	}
+
 	ghash_buckets_expand(gh, nentries_reserve, true);
 	ghash_buckets_contract(gh, nentries_reserve, true, false);
 }
@@ -773,9 +1495,8 @@ bool BLI_ghash_reinsert(GHash *gh, void *key, void *val, GHashKeyFreeFP keyfreef
  */
 void *BLI_ghash_lookup(GHash *gh, const void *key)
 {
-	GHashEntry *e = (GHashEntry *)ghash_lookup_entry(gh, key);
-	BLI_assert(!(gh->flag & GHASH_FLAG_IS_GSET));
-	return e ? e->val : NULL;
+	void **val_p = ghash_lookup_val_p(gh, key);
+	return val_p ? *val_p : NULL;
 }
 
 /**
@@ -783,9 +1504,8 @@ void *BLI_ghash_lookup(GHash *gh, const void *key)
  */
 void *BLI_ghash_lookup_default(GHash *gh, const void *key, void *val_default)
 {
-	GHashEntry *e = (GHashEntry *)ghash_lookup_entry(gh, key);
-	BLI_assert(!(gh->flag & GHASH_FLAG_IS_GSET));
-	return e ? e->val : val_default;
+	void **val_p = ghash_lookup_val_p(gh, key);
+	return val_p ? *val_p : val_default;
 }
 
 /**
@@ -800,9 +1520,7 @@ void *BLI_ghash_lookup_default(GHash *gh, const void *key, void *val_default)
  */
 void **BLI_ghash_lookup_p(GHash *gh, const void *key)
 {
-	GHashEntry *e = (GHashEntry *)ghash_lookup_entry(gh, key);
-	BLI_assert(!(gh->flag & GHASH_FLAG_IS_GSET));
-	return e ? &e->val : NULL;
+	return ghash_lookup_val_p(gh, key);
 }
 
 /**
@@ -821,10 +1539,20 @@ void **BLI_ghash_lookup_p(GHash *gh, const void *key)
  */
 bool BLI_ghash_ensure_p(GHash *gh, void *key, void ***r_val)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
-	GHashEntry *e = (GHashEntry *)ghash_lookup_entry_ex(gh, key, bucket_index);
-	const bool haskey = (e != NULL);
+	unsigned int hash, bucket_index;
+	GHashEntry *e;
+	bool haskey;
+
+	if (ghash_is_open_addressing(gh)) {
+		GHashSlot *slot = ghash_oa_ensure_slot(gh, key, &haskey);
+		*r_val = &slot->val;
+		return haskey;
+	}
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
+	e = (GHashEntry *)ghash_lookup_entry_ex(gh, key, bucket_index);
+	haskey = (e != NULL);
 
 	if (!haskey) {
 		e = BLI_mempool_alloc(gh->entrypool);
@@ -844,10 +1572,24 @@ bool BLI_ghash_ensure_p(GHash *gh, void *key, void ***r_val)
 bool BLI_ghash_ensure_p_ex(
         GHash *gh, const void *key, void ***r_key, void ***r_val)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
-	GHashEntry *e = (GHashEntry *)ghash_lookup_entry_ex(gh, key, bucket_index);
-	const bool haskey = (e != NULL);
+	unsigned int hash, bucket_index;
+	GHashEntry *e;
+	bool haskey;
+
+	if (ghash_is_open_addressing(gh)) {
+		GHashSlot *slot = ghash_oa_ensure_slot(gh, (void *)key, &haskey);
+		if (!haskey) {
+			slot->key = NULL;  /* caller must re-assign */
+		}
+		*r_key = &slot->key;
+		*r_val = &slot->val;
+		return haskey;
+	}
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
+	e = (GHashEntry *)ghash_lookup_entry_ex(gh, key, bucket_index);
+	haskey = (e != NULL);
 
 	if (!haskey) {
 		/* pass 'key' incase we resize */
@@ -871,9 +1613,16 @@ bool BLI_ghash_ensure_p_ex(
  */
 bool BLI_ghash_remove(GHash *gh, const void *key, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
-	Entry *e = ghash_remove_ex(gh, key, keyfreefp, valfreefp, bucket_index);
+	unsigned int hash, bucket_index;
+	Entry *e;
+
+	if (ghash_is_open_addressing(gh)) {
+		return ghash_oa_remove(gh, key, keyfreefp, valfreefp, NULL);
+	}
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
+	e = ghash_remove_ex(gh, key, keyfreefp, valfreefp, bucket_index);
 	if (e) {
 		BLI_mempool_free(gh->entrypool, e);
 		return true;
@@ -894,9 +1643,18 @@ bool BLI_ghash_remove(GHash *gh, const void *key, GHashKeyFreeFP keyfreefp, GHas
  */
 void *BLI_ghash_popkey(GHash *gh, const void *key, GHashKeyFreeFP keyfreefp)
 {
-	const unsigned int hash = ghash_keyhash(gh, key);
-	const unsigned int bucket_index = ghash_bucket_index(gh, hash);
-	GHashEntry *e = (GHashEntry *)ghash_remove_ex(gh, key, keyfreefp, NULL, bucket_index);
+	unsigned int hash, bucket_index;
+	GHashEntry *e;
+
+	if (ghash_is_open_addressing(gh)) {
+		void *val;
+		BLI_assert(!(gh->flag & GHASH_FLAG_IS_GSET));
+		return ghash_oa_remove(gh, key, keyfreefp, NULL, &val) ? val : NULL;
+	}
+
+	hash = ghash_keyhash(gh, key);
+	bucket_index = ghash_bucket_index(gh, hash);
+	e = (GHashEntry *)ghash_remove_ex(gh, key, keyfreefp, NULL, bucket_index);
 	BLI_assert(!(gh->flag & GHASH_FLAG_IS_GSET));
 	if (e) {
 		void *val = e->val;
@@ -913,7 +1671,7 @@ void *BLI_ghash_popkey(GHash *gh, const void *key, GHashKeyFreeFP keyfreefp)
  */
 bool BLI_ghash_haskey(GHash *gh, const void *key)
 {
-	return (ghash_lookup_entry(gh, key) != NULL);
+	return ghash_haskey(gh, key);
 }
 
 /**
@@ -928,10 +1686,20 @@ bool BLI_ghash_pop(
         GHash *gh, GHashIterState *state,
         void **r_key, void **r_val)
 {
-	GHashEntry *e = (GHashEntry *)ghash_pop(gh, state);
+	GHashEntry *e;
 
 	BLI_assert(!(gh->flag & GHASH_FLAG_IS_GSET));
 
+	if (ghash_is_open_addressing(gh)) {
+		if (ghash_oa_pop(gh, state, r_key, r_val)) {
+			return true;
+		}
+		*r_key = *r_val = NULL;
+		return false;
+	}
+
+	e = (GHashEntry *)ghash_pop(gh, state);
+
 	if (e) {
 		*r_key = e->e.key;
 		*r_val = e->val;
@@ -958,6 +1726,11 @@ void BLI_ghash_clear_ex(GHash *gh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valf
 	if (keyfreefp || valfreefp)
 		ghash_free_cb(gh, keyfreefp, valfreefp);
 
+	if (ghash_is_open_addressing(gh)) {
+		ghash_oa_reset(gh, nentries_reserve);
+		return;
+	}
+
 	ghash_buckets_reset(gh, nentries_reserve);
 	BLI_mempool_clear_ex(gh->entrypool, nentries_reserve ? (int)nentries_reserve : -1);
 }
@@ -979,20 +1752,25 @@ void BLI_ghash_clear(GHash *gh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfree
  */
 void BLI_ghash_free(GHash *gh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
 {
-	BLI_assert((int)gh->nentries == BLI_mempool_count(gh->entrypool));
+	BLI_assert(ghash_is_open_addressing(gh) || ((int)gh->nentries == BLI_mempool_count(gh->entrypool)));
 	if (keyfreefp || valfreefp)
 		ghash_free_cb(gh, keyfreefp, valfreefp);
 
-	MEM_freeN(gh->buckets);
-	BLI_mempool_destroy(gh->entrypool);
+	ghash_storage_free(gh);
 	MEM_freeN(gh);
 }
 
 /**
  * Sets a GHash flag.
+ *
+ * \note Setting #GHASH_FLAG_OPEN_ADDRESSING moves all entries to the new storage,
+ * it's cheapest to do it right after creating \a gh.
  */
 void BLI_ghash_flag_set(GHash *gh, unsigned int flag)
 {
+	if ((flag & GHASH_FLAG_OPEN_ADDRESSING) && !ghash_is_open_addressing(gh)) {
+		ghash_storage_convert(gh, gh->flag | GHASH_FLAG_OPEN_ADDRESSING);
+	}
 	gh->flag |= flag;
 }
 
@@ -1001,6 +1779,9 @@ void BLI_ghash_flag_set(GHash *gh, unsigned int flag)
  */
 void BLI_ghash_flag_clear(GHash *gh, unsigned int flag)
 {
+	if ((flag & GHASH_FLAG_OPEN_ADDRESSING) && ghash_is_open_addressing(gh)) {
+		ghash_storage_convert(gh, gh->flag & ~(unsigned int)GHASH_FLAG_OPEN_ADDRESSING);
+	}
 	gh->flag &= ~flag;
 }
 
@@ -1013,6 +1794,35 @@ void BLI_ghash_flag_clear(GHash *gh, unsigned int flag)
 /** \name Iterator API
  * \{ */
 
+/**
+ * Point the key and value of \a ghi to its current chained entry.
+ */
+BLI_INLINE void ghash_iterator_set_entry(GHashIterator *ghi)
+{
+	if (ghi->curEntry) {
+		ghi->curKey = &ghi->curEntry->key;
+		ghi->curVal = (ghi->gh->flag & GHASH_FLAG_IS_GSET) ? NULL : &((GHashEntry *)ghi->curEntry)->val;
+	}
+	else {
+		ghi->curKey = ghi->curVal = NULL;
+	}
+}
+
+/**
+ * Point the key and value of \a ghi to its current open addressing slot (curBucket).
+ */
+BLI_INLINE void ghash_iterator_set_slot(GHashIterator *ghi)
+{
+	if (ghi->curBucket < ghi->gh->nbuckets) {
+		GHashSlot *slot = ghash_oa_slot(ghi->gh, ghi->curBucket);
+		ghi->curKey = &slot->key;
+		ghi->curVal = (ghi->gh->flag & GHASH_FLAG_IS_GSET) ? NULL : &slot->val;
+	}
+	else {
+		ghi->curKey = ghi->curVal = NULL;
+	}
+}
+
 /**
  * Create a new GHashIterator. The hash table must not be mutated
  * while the iterator is in use, and the iterator will step exactly
@@ -1041,6 +1851,11 @@ void BLI_ghashIterator_init(GHashIterator *ghi, GHash *gh)
 	ghi->gh = gh;
 	ghi->curEntry = NULL;
 	ghi->curBucket = UINT_MAX;  /* wraps to zero */
+	if (ghash_is_open_addressing(gh)) {
+		ghi->curBucket = gh->nentries ? ghash_oa_find_next_used_index(gh, 0) : gh->nbuckets;
+		ghash_iterator_set_slot(ghi);
+		return;
+	}
 	if (gh->nentries) {
 		do {
 			ghi->curBucket++;
@@ -1049,6 +1864,7 @@ void BLI_ghashIterator_init(GHashIterator *ghi, GHash *gh)
 			ghi->curEntry = ghi->gh->buckets[ghi->curBucket];
 		} while (!ghi->curEntry);
 	}
+	ghash_iterator_set_entry(ghi);
 }
 
 /**
@@ -1058,7 +1874,11 @@ void BLI_ghashIterator_init(GHashIterator *ghi, GHash *gh)
  */
 void BLI_ghashIterator_step(GHashIterator *ghi)
 {
-	if (ghi->curEntry) {
+	if (ghi->curKey && ghash_is_open_addressing(ghi->gh)) {
+		ghi->curBucket = ghash_oa_find_next_used_index(ghi->gh, ghi->curBucket + 1);
+		ghash_iterator_set_slot(ghi);
+	}
+	else if (ghi->curEntry) {
 		ghi->curEntry = ghi->curEntry->next;
 		while (!ghi->curEntry) {
 			ghi->curBucket++;
@@ -1066,6 +1886,7 @@ void BLI_ghashIterator_step(GHashIterator *ghi)
 				break;
 			ghi->curEntry = ghi->gh->buckets[ghi->curBucket];
 		}
+		ghash_iterator_set_entry(ghi);
 	}
 }
 
@@ -1090,7 +1911,7 @@ void BLI_ghashIterator_free(GHashIterator *ghi)
  */
 void *BLI_ghashIterator_getKey(GHashIterator *ghi)
 {
-	return ghi->curEntry->key;
+	return *ghi->curKey;
 }
 
 /**
@@ -1102,7 +1923,7 @@ void *BLI_ghashIterator_getKey(GHashIterator *ghi)
  */
 void *BLI_ghashIterator_getValue(GHashIterator *ghi)
 {
-	return ghi->curEntry->val;
+	return *ghi->curVal;
 }
 
 /**
@@ -1114,7 +1935,7 @@ void *BLI_ghashIterator_getValue(GHashIterator *ghi)
  */
 void **BLI_ghashIterator_getValue_p(GHashIterator *ghi)
 {
-	return &ghi->curEntry->val;
+	return ghi->curVal;
 }
 
 /**
@@ -1126,7 +1947,7 @@ void **BLI_ghashIterator_getValue_p(GHashIterator *ghi)
  */
 bool BLI_ghashIterator_done(GHashIterator *ghi)
 {
-	return ghi->curEntry == NULL;
+	return ghi->curKey == NULL;
 }
 #endif
 
@@ -1354,6 +2175,15 @@ GSet *BLI_gset_new_ex(GSetHashFP hashfp, GSetCmpFP cmpfp, const char *info,
 	return (GSet *)ghash_new(hashfp, cmpfp, info, nentries_reserve, GHASH_FLAG_IS_GSET);
 }
 
+/**
+ * Set counterpart to #BLI_ghash_new_flag_ex.
+ */
+GSet *BLI_gset_new_flag_ex(GSetHashFP hashfp, GSetCmpFP cmpfp, const char *info,
+                           const unsigned int nentries_reserve, const unsigned int flag)
+{
+	return (GSet *)ghash_new(hashfp, cmpfp, info, nentries_reserve, flag | GHASH_FLAG_IS_GSET);
+}
+
 GSet *BLI_gset_new(GSetHashFP hashfp, GSetCmpFP cmpfp, const char *info)
 {
 	return BLI_gset_new_ex(hashfp, cmpfp, info, 0);
@@ -1378,8 +2208,15 @@ unsigned int BLI_gset_size(GSet *gs)
  */
 void BLI_gset_insert(GSet *gs, void *key)
 {
-	const unsigned int hash = ghash_keyhash((GHash *)gs, key);
-	const unsigned int bucket_index = ghash_bucket_index((GHash *)gs, hash);
+	unsigned int hash, bucket_index;
+
+	if (ghash_is_open_addressing((GHash *)gs)) {
+		ghash_oa_insert_keyonly((GHash *)gs, key, ghash_oa_keyhash((GHash *)gs, key));
+		return;
+	}
+
+	hash = ghash_keyhash((GHash *)gs, key);
+	bucket_index = ghash_bucket_index((GHash *)gs, hash);
 	ghash_insert_ex_keyonly((GHash *)gs, key, bucket_index);
 }
 
@@ -1402,10 +2239,23 @@ bool BLI_gset_add(GSet *gs, void *key)
  */
 bool BLI_gset_ensure_p_ex(GSet *gs, const void *key, void ***r_key)
 {
-	const unsigned int hash = ghash_keyhash((GHash *)gs, key);
-	const unsigned int bucket_index = ghash_bucket_index((GHash *)gs, hash);
-	GSetEntry *e = (GSetEntry *)ghash_lookup_entry_ex((GHash *)gs, key, bucket_index);
-	const bool haskey = (e != NULL);
+	unsigned int hash, bucket_index;
+	GSetEntry *e;
+	bool haskey;
+
+	if (ghash_is_open_addressing((GHash *)gs)) {
+		GHashSlot *slot = ghash_oa_ensure_slot((GHash *)gs, (void *)key, &haskey);
+		if (!haskey) {
+			slot->key = NULL;  /* caller must re-assign */
+		}
+		*r_key = &slot->key;
+		return haskey;
+	}
+
+	hash = ghash_keyhash((GHash *)gs, key);
+	bucket_index = ghash_bucket_index((GHash *)gs, hash);
+	e = (GSetEntry *)ghash_lookup_entry_ex((GHash *)gs, key, bucket_index);
+	haskey = (e != NULL);
 
 	if (!haskey) {
 		/* pass 'key' incase we resize */
@@ -1437,7 +2287,7 @@ bool BLI_gset_remove(GSet *gs, const void *key, GSetKeyFreeFP keyfreefp)
 
 bool BLI_gset_haskey(GSet *gs, const void *key)
 {
-	return (ghash_lookup_entry((GHash *)gs, key) != NULL);
+	return ghash_haskey((GHash *)gs, key);
 }
 
 /**
@@ -1451,7 +2301,17 @@ bool BLI_gset_pop(
         GSet *gs, GSetIterState *state,
         void **r_key)
 {
-	GSetEntry *e = (GSetEntry *)ghash_pop((GHash *)gs, (GHashIterState *)state);
+	GSetEntry *e;
+
+	if (ghash_is_open_addressing((GHash *)gs)) {
+		if (ghash_oa_pop((GHash *)gs, (GHashIterState *)state, r_key, NULL)) {
+			return true;
+		}
+		*r_key = NULL;
+		return false;
+	}
+
+	e = (GSetEntry *)ghash_pop((GHash *)gs, (GHashIterState *)state);
 
 	if (e) {
 		*r_key = e->key;
@@ -1484,12 +2344,12 @@ void BLI_gset_free(GSet *gs, GSetKeyFreeFP keyfreefp)
 
 void BLI_gset_flag_set(GSet *gs, unsigned int flag)
 {
-	((GHash *)gs)->flag |= flag;
+	BLI_ghash_flag_set((GHash *)gs, flag);
 }
 
 void BLI_gset_flag_clear(GSet *gs, unsigned int flag)
 {
-	((GHash *)gs)->flag &= ~flag;
+	BLI_ghash_flag_clear((GHash *)gs, flag);
 }
 
 /** \} */
@@ -1533,6 +2393,30 @@ GSet *BLI_gset_pair_new(const char *info)
 
 #include "BLI_math.h"
 
+/**
+ * \return number of entries in bucket \a i, for open addressing groups of slots are used as buckets.
+ */
+static unsigned int ghash_bucket_size(GHash *gh, const unsigned int i)
+{
+	unsigned int count = 0;
+
+	if (ghash_is_open_addressing(gh)) {
+		unsigned int j;
+		for (j = 0; j < GHASH_OA_GROUP_SIZE; j++) {
+			if (ghash_oa_ctrl_is_used(gh->oa_ctrl[i * GHASH_OA_GROUP_SIZE + j])) {
+				count++;
+			}
+		}
+	}
+	else {
+		Entry *e;
+		for (e = gh->buckets[i]; e; e = e->next) {
+			count++;
+		}
+	}
+	return count;
+}
+
 /**
  * \return number of buckets in the GHash.
  */
@@ -1557,6 +2441,7 @@ double BLI_ghash_calc_quality_ex(
 {
 	double mean;
 	unsigned int i;
+	const unsigned int nbuckets = ghash_is_open_addressing(gh) ? gh->oa_group_mask + 1 : gh->nbuckets;
 
 	if (gh->nentries == 0) {
 		if (r_load) {
@@ -1578,7 +2463,7 @@ double BLI_ghash_calc_quality_ex(
 		return 0.0;
 	}
 
-	mean = (double)gh->nentries / (double)gh->nbuckets;
+	mean = (double)gh->nentries / (double)nbuckets;
 	if (r_load) {
 		*r_load = mean;
 	}
@@ -1591,29 +2476,22 @@ double BLI_ghash_calc_quality_ex(
 		 * See https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Two-pass_algorithm
 		 */
 		double sum = 0.0;
-		for (i = 0; i < gh->nbuckets; i++) {
-			int count = 0;
-			Entry *e;
-			for (e = gh->buckets[i]; e; e = e->next) {
-				count++;
-			}
-			sum += ((double)count - mean) * ((double)count - mean);
+		for (i = 0; i < nbuckets; i++) {
+			const double count = (double)ghash_bucket_size(gh, i);
+			sum += (count - mean) * (count - mean);
 		}
-		*r_variance = sum / (double)(gh->nbuckets - 1);
+		*r_variance = sum / (double)(nbuckets - 1);
 	}
 
 	{
 		uint64_t sum = 0;
-		uint64_t overloaded_buckets_threshold = (uint64_t)max_ii(GHASH_LIMIT_GROW(1), 1);
+		uint64_t overloaded_buckets_threshold = ghash_is_open_addressing(gh) ?
+		        (uint64_t)GHASH_OA_LIMIT_GROW(GHASH_OA_GROUP_SIZE) : (uint64_t)max_ii(GHASH_LIMIT_GROW(1), 1);
 		uint64_t sum_overloaded = 0;
 		uint64_t sum_empty = 0;
 
-		for (i = 0; i < gh->nbuckets; i++) {
-			uint64_t count = 0;
-			Entry *e;
-			for (e = gh->buckets[i]; e; e = e->next) {
-				count++;
-			}
+		for (i = 0; i < nbuckets; i++) {
+			const uint64_t count = ghash_bucket_size(gh, i);
 			if (r_biggest_bucket) {
 				*r_biggest_bucket = max_ii(*r_biggest_bucket, (int)count);
 			}
@@ -1626,13 +2504,13 @@ double BLI_ghash_calc_quality_ex(
 			sum += count * (count + 1);
 		}
 		if (r_prop_overloaded_buckets) {
-			*r_prop_overloaded_buckets = (double)sum_overloaded / (double)gh->nbuckets;
+			*r_prop_overloaded_buckets = (double)sum_overloaded / (double)nbuckets;
 		}
 		if (r_prop_empty_buckets) {
-			*r_prop_empty_buckets = (double)sum_empty / (double)gh->nbuckets;
+			*r_prop_empty_buckets = (double)sum_empty / (double)nbuckets;
 		}
-		return ((double)sum * (double)gh->nbuckets /
-		        ((double)gh->nentries * (gh->nentries + 2 * gh->nbuckets - 1)));
+		return ((double)sum * (double)nbuckets /
+		        ((double)gh->nentries * (gh->nentries + 2 * nbuckets - 1)));
 	}
 }
 double BLI_gset_calc_quality_ex(
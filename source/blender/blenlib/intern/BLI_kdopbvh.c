@@ -44,6 +44,8 @@
  *   #BLI_bvhtree_overlap, #BVHOverlapData_Shared, #BVHOverlapData_Thread
  * - Range Query:
  *   #BLI_bvhtree_range_query
+ * - Batched ray-cast & nearest point (packets of rays/points traversing the tree together):
+ *   #BLI_bvhtree_ray_cast_batch, #BLI_bvhtree_find_nearest_batch, #BVHRayPacket, #BVHNearestPacket
  */
 
 #include <assert.h>
@@ -58,6 +60,10 @@
 #include "BLI_strict_flags.h"
 #include "BLI_task.h"
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 /* used for iterative_raycast */
 // #define USE_SKIP_LINKS
 
@@ -92,12 +98,15 @@ typedef struct BVHNode {
 	char main_axis; /* Axis used to split this node */
 } BVHNode;
 
+struct BVHTreeRefit;
+
 /* keep under 26 bytes for speed purposes */
 struct BVHTree {
 	BVHNode **nodes;
 	BVHNode *nodearray;     /* pre-alloc branch nodes */
 	BVHNode **nodechild;    /* pre-alloc childs for nodes */
 	float   *nodebv;        /* pre-alloc bounding-volumes for nodes */
+	struct BVHTreeRefit *refit;  /* optional refit quality tracking */
 	float epsilon;          /* epslion is used for inflation of the k-dop	   */
 	int totleaf;            /* leafs */
 	int totbranch;
@@ -107,8 +116,8 @@ struct BVHTree {
 };
 
 /* optimization, ensure we stay small */
-BLI_STATIC_ASSERT((sizeof(void *) == 8 && sizeof(BVHTree) <= 48) ||
-                  (sizeof(void *) == 4 && sizeof(BVHTree) <= 32),
+BLI_STATIC_ASSERT((sizeof(void *) == 8 && sizeof(BVHTree) <= 56) ||
+                  (sizeof(void *) == 4 && sizeof(BVHTree) <= 36),
                   "over sized")
 
 /* avoid duplicating vars in BVHOverlapData_Thread */
@@ -934,6 +943,272 @@ static void non_recursive_bvh_div_nodes(BVHTree *tree, BVHNode *branches_array,
 /** \} */
 
 
+/* -------------------------------------------------------------------- */
+
+/** \name Refit Quality Tracking
+ *
+ * Refitting keeps the tree topology while the primitives move, under large deformation
+ * the bounds of sibling nodes grow to overlap and all queries get slower.
+ *
+ * When enabled (see #BLI_bvhtree_refit_policy_set), each refit measures the SAH (surface area heuristic)
+ * cost of every subtree, relative to its cost when it was last built.
+ * Subtrees which degraded beyond the threshold get their leafs partitioned again into the same branches,
+ * so the tree layout (and the implicit ordering of branches) is kept.
+ *
+ * \{ */
+
+/* Smaller subtrees are never rebuilt on their own (their ancestors can be). */
+#define BVH_REFIT_SUBTREE_MIN_LEAFS 32
+
+typedef struct BVHRefitBranch {
+	float cost;        /* SAH cost of the subtree (sum of its branches area, relative to the area of its root) */
+	float cost_build;  /* cost when the subtree was last (re)built */
+	int leaf_start;    /* leafs of the subtree, as a range of tree->nodes */
+	int leaf_num;
+} BVHRefitBranch;
+
+typedef struct BVHTreeRefit {
+	float rebuild_threshold;
+	BVHRefitBranch *branches;    /* one per branch, allocated once the tree is balanced */
+	BVHNode **rebuild_nodes;     /* roots of the subtrees to rebuild (one per branch at most) */
+	BVHTreeRefitStats stats;
+} BVHTreeRefit;
+
+BLI_INLINE BVHRefitBranch *refit_branch(const BVHTree *tree, const BVHNode *node)
+{
+	return &tree->refit->branches[node - tree->nodearray - tree->totleaf];
+}
+
+/**
+ * Area of the bounds over the first 3 axes of the k-DOP (x/y/z for all but 18-DOP),
+ * only used relative to other nodes.
+ */
+static float node_area(const BVHTree *tree, const BVHNode *node)
+{
+	const float *bv = &node->bv[2 * tree->start_axis];
+	const float dx = bv[1] - bv[0], dy = bv[3] - bv[2], dz = bv[5] - bv[4];
+
+	return max_ff(dx * dy + dy * dz + dz * dx, FLT_EPSILON);
+}
+
+/* the costs of the child branches must be up to date */
+static void refit_branch_cost_update(const BVHTree *tree, const BVHNode *node)
+{
+	const float area = node_area(tree, node);
+	float cost = area;
+	int i;
+
+	for (i = 0; i != node->totnode; i++) {
+		const BVHNode *child = node->children[i];
+		if (child->totnode != 0) {
+			cost += refit_branch(tree, child)->cost * node_area(tree, child);
+		}
+	}
+
+	refit_branch(tree, node)->cost = cost / area;
+}
+
+/* \return number of leafs in the subtree */
+static int refit_branch_init(BVHTree *tree, BVHNode *node, int leaf_start)
+{
+	BVHRefitBranch *branch = refit_branch(tree, node);
+	int i, leaf_num = 0;
+
+	for (i = 0; i != node->totnode; i++) {
+		BVHNode *child = node->children[i];
+		if (child->totnode != 0) {
+			leaf_num += refit_branch_init(tree, child, leaf_start + leaf_num);
+		}
+		else {
+			/* balancing stores the leafs of each subtree contiguously, in depth-first order */
+			BLI_assert(tree->nodes[leaf_start + leaf_num] == child);
+			leaf_num += 1;
+		}
+	}
+
+	branch->leaf_start = leaf_start;
+	branch->leaf_num = leaf_num;
+
+	refit_branch_cost_update(tree, node);
+	branch->cost_build = branch->cost;
+
+	return leaf_num;
+}
+
+static void bvhtree_refit_init(BVHTree *tree)
+{
+	BVHTreeRefit *refit = tree->refit;
+
+	MEM_SAFE_FREE(refit->branches);
+	MEM_SAFE_FREE(refit->rebuild_nodes);
+
+	if (tree->totbranch != 0) {
+		refit->branches = MEM_mallocN(sizeof(*refit->branches) * (size_t)tree->totbranch, __func__);
+		refit->rebuild_nodes = MEM_mallocN(sizeof(*refit->rebuild_nodes) * (size_t)tree->totbranch, __func__);
+		refit_branch_init(tree, tree->nodes[tree->totleaf], 0);
+	}
+}
+
+static void bvhtree_refit_free(BVHTree *tree)
+{
+	MEM_SAFE_FREE(tree->refit->branches);
+	MEM_SAFE_FREE(tree->refit->rebuild_nodes);
+	MEM_freeN(tree->refit);
+	tree->refit = NULL;
+}
+
+static void refit_subtree_find_degraded(BVHTree *tree, BVHNode *node, int *r_rebuild_num)
+{
+	const BVHRefitBranch *branch = refit_branch(tree, node);
+	int i;
+
+	if (branch->leaf_num < BVH_REFIT_SUBTREE_MIN_LEAFS) {
+		return;
+	}
+
+	if (branch->cost > branch->cost_build * tree->refit->rebuild_threshold) {
+		tree->refit->rebuild_nodes[(*r_rebuild_num)++] = node;
+		return;
+	}
+
+	for (i = 0; i != node->totnode; i++) {
+		if (node->children[i]->totnode != 0) {
+			refit_subtree_find_degraded(tree, node->children[i], r_rebuild_num);
+		}
+	}
+}
+
+static void refit_subtree_rebuild_task_run(TaskPool *__restrict pool, void *taskdata, int thread_id);
+
+/**
+ * Same as #non_recursive_bvh_div_nodes_task_cb for a single branch,
+ * except the number of leafs of each child is given by the existing topology.
+ */
+static void refit_subtree_rebuild(BVHTree *tree, BVHNode *node, TaskPool *pool, int thread_id)
+{
+	const BVHRefitBranch *branch = refit_branch(tree, node);
+	int nth_positions[MAX_TREETYPE + 1];
+	char split_axis;
+	int k;
+
+	refit_kdop_hull(tree, node, branch->leaf_start, branch->leaf_start + branch->leaf_num);
+	split_axis = get_largest_axis(node->bv);
+	node->main_axis = split_axis / 2;
+
+	nth_positions[0] = branch->leaf_start;
+	for (k = 0; k != node->totnode; k++) {
+		const BVHNode *child = node->children[k];
+		nth_positions[k + 1] = nth_positions[k] + ((child->totnode != 0) ? refit_branch(tree, child)->leaf_num : 1);
+	}
+	BLI_assert(nth_positions[node->totnode] == branch->leaf_start + branch->leaf_num);
+
+	split_leafs(tree->nodes, nth_positions, node->totnode, split_axis);
+
+	for (k = 0; k != node->totnode; k++) {
+		BVHNode *child = node->children[k];
+
+		if (child->totnode != 0) {
+			/* branches keep their place and range of leafs */
+			BLI_assert(refit_branch(tree, child)->leaf_start == nth_positions[k]);
+
+			if (pool && refit_branch(tree, child)->leaf_num > KDOPBVH_THREAD_LEAF_THRESHOLD) {
+				BLI_task_pool_push_from_thread(
+				        pool, refit_subtree_rebuild_task_run, child, false, TASK_PRIORITY_HIGH, thread_id);
+			}
+			else {
+				refit_subtree_rebuild(tree, child, NULL, thread_id);
+			}
+		}
+		else {
+			node->children[k] = tree->nodes[nth_positions[k]];
+			node->children[k]->parent = node;
+		}
+	}
+}
+
+static void refit_subtree_rebuild_task_run(TaskPool *__restrict pool, void *taskdata, int thread_id)
+{
+	BVHTree *tree = BLI_task_pool_userdata(pool);
+	refit_subtree_rebuild(tree, taskdata, pool, thread_id);
+}
+
+/* bottom-up, once the subtree has been rebuilt */
+static void refit_subtree_cost_reset(BVHTree *tree, BVHNode *node)
+{
+	BVHRefitBranch *branch = refit_branch(tree, node);
+	int i;
+
+	for (i = 0; i != node->totnode; i++) {
+		if (node->children[i]->totnode != 0) {
+			refit_subtree_cost_reset(tree, node->children[i]);
+		}
+	}
+
+	refit_branch_cost_update(tree, node);
+	branch->cost_build = branch->cost;
+}
+
+/**
+ * Called after the bounds have been updated by #BLI_bvhtree_update_tree.
+ */
+static void bvhtree_refit_update(BVHTree *tree)
+{
+	BVHTreeRefit *refit = tree->refit;
+	BVHNode *root = tree->nodes[tree->totleaf];
+	int i, rebuild_num = 0, leaf_rebuild_num = 0;
+
+	refit->stats.refit_num++;
+
+	if (refit->branches == NULL) {
+		return;
+	}
+
+	/* same bottom-up order as #BLI_bvhtree_update_tree */
+	for (i = tree->totbranch - 1; i >= 0; i--) {
+		refit_branch_cost_update(tree, tree->nodes[tree->totleaf + i]);
+	}
+
+	refit->stats.quality = refit_branch(tree, root)->cost_build / refit_branch(tree, root)->cost;
+
+	refit_subtree_find_degraded(tree, root, &rebuild_num);
+	if (rebuild_num == 0) {
+		return;
+	}
+
+	for (i = 0; i != rebuild_num; i++) {
+		leaf_rebuild_num += refit_branch(tree, refit->rebuild_nodes[i])->leaf_num;
+	}
+
+	if (leaf_rebuild_num > KDOPBVH_THREAD_LEAF_THRESHOLD) {
+		TaskScheduler *scheduler = BLI_task_scheduler_get();
+		TaskPool *pool = BLI_task_pool_create(scheduler, tree);
+
+		for (i = 0; i != rebuild_num; i++) {
+			BLI_task_pool_push(pool, refit_subtree_rebuild_task_run, refit->rebuild_nodes[i], false, TASK_PRIORITY_HIGH);
+		}
+
+		BLI_task_pool_work_and_wait(pool);
+		BLI_task_pool_free(pool);
+	}
+	else {
+		for (i = 0; i != rebuild_num; i++) {
+			refit_subtree_rebuild(tree, refit->rebuild_nodes[i], NULL, 0);
+		}
+	}
+
+	for (i = 0; i != rebuild_num; i++) {
+		refit_subtree_cost_reset(tree, refit->rebuild_nodes[i]);
+	}
+
+	refit->stats.rebuild_num++;
+	refit->stats.subtree_rebuild_num += rebuild_num;
+	refit->stats.leaf_rebuild_num += leaf_rebuild_num;
+}
+
+/** \} */
+
+
+
 /* -------------------------------------------------------------------- */
 
 /** \name BLI_bvhtree API
@@ -1029,6 +1304,9 @@ fail:
 void BLI_bvhtree_free(BVHTree *tree)
 {
 	if (tree) {
+		if (tree->refit) {
+			bvhtree_refit_free(tree);
+		}
 		MEM_freeN(tree->nodes);
 		MEM_freeN(tree->nodearray);
 		MEM_freeN(tree->nodebv);
@@ -1060,6 +1338,10 @@ void BLI_bvhtree_balance(BVHTree *tree)
 	build_skip_links(tree, tree->nodes[tree->totleaf], NULL, NULL);
 #endif
 
+	if (tree->refit) {
+		bvhtree_refit_init(tree);
+	}
+
 	/* bvhtree_info(tree); */
 }
 
@@ -1124,6 +1406,50 @@ void BLI_bvhtree_update_tree(BVHTree *tree)
 
 	for (; index >= root; index--)
 		node_join(tree, *index);
+
+	if (tree->refit) {
+		bvhtree_refit_update(tree);
+	}
+}
+
+/**
+ * Track the quality of the tree on each #BLI_bvhtree_update_tree,
+ * rebuilding the subtrees which degraded too much (in parallel).
+ *
+ * \param rebuild_threshold: Rebuild a subtree when its SAH cost grows by this factor
+ * since it was built (#BVH_REFIT_REBUILD_THRESHOLD is a good default), zero disables tracking.
+ */
+void BLI_bvhtree_refit_policy_set(BVHTree *tree, float rebuild_threshold)
+{
+	if (rebuild_threshold <= 0.0f) {
+		if (tree->refit) {
+			bvhtree_refit_free(tree);
+		}
+		return;
+	}
+
+	BLI_assert(rebuild_threshold > 1.0f);
+
+	if (tree->refit == NULL) {
+		tree->refit = MEM_callocN(sizeof(*tree->refit), __func__);
+		tree->refit->stats.quality = 1.0f;
+		if (tree->totbranch != 0) {
+			bvhtree_refit_init(tree);
+		}
+	}
+	tree->refit->rebuild_threshold = rebuild_threshold;
+}
+
+/**
+ * \return false when refit tracking isn't enabled.
+ */
+bool BLI_bvhtree_refit_stats_get(const BVHTree *tree, BVHTreeRefitStats *r_stats)
+{
+	if (tree->refit == NULL) {
+		return false;
+	}
+	*r_stats = tree->refit->stats;
+	return true;
 }
 /**
  * Number of times #BLI_bvhtree_insert has been called.
@@ -2507,3 +2833,510 @@ void BLI_bvhtree_walk_dfs(
 }
 
 /** \} */
+
+
+/* -------------------------------------------------------------------- */
+
+/** \name BLI_bvhtree batched queries
+ *
+ * Rays (or points) are grouped in packets of #BVH_PACKET_SIZE which traverse the tree together,
+ * each node is tested against all active members of the packet at once (using SSE when available).
+ *
+ * Before traversal the tree is flattened into a contiguous breadth-first array of x/y/z bounds,
+ * so siblings are adjacent in memory and no #BVHNode.children pointers are chased.
+ * This only works for trees which store the x/y/z axes first (all but 18-DOP),
+ * other trees fall back to one query at a time.
+ *
+ * Packets are distributed over threads, so callbacks must be thread-safe.
+ *
+ * \{ */
+
+#define BVH_PACKET_SIZE 4
+
+/* Only thread when there are enough packets to amortize the task overhead. */
+#define BVH_PACKET_THREADED_MIN 64
+
+typedef struct BVHFlatNode {
+	float bv[6];
+	int index;       /* leaf: primitive index, branch: index of the first child in the flat array */
+	char totnode;
+	axis_t main_axis;  /* 3 or more when the split axis isn't x/y/z */
+} BVHFlatNode;
+
+static bool bvhtree_flatten_supported(const BVHTree *tree)
+{
+	return (tree->start_axis == 0) && (tree->totleaf != 0);
+}
+
+/**
+ * Store all nodes reachable from the root in breadth-first order,
+ * the children of a branch are consecutive in the returned array.
+ */
+static BVHFlatNode *bvhtree_flatten(const BVHTree *tree)
+{
+	const int totnode = tree->totleaf + tree->totbranch;
+	const BVHNode **queue = MEM_mallocN(sizeof(*queue) * (size_t)totnode, __func__);
+	BVHFlatNode *flat = MEM_mallocN(sizeof(*flat) * (size_t)totnode, __func__);
+	int head, tail = 0;
+
+	queue[tail++] = tree->nodes[tree->totleaf];
+
+	for (head = 0; head < tail; head++) {
+		const BVHNode *node = queue[head];
+		BVHFlatNode *fnode = &flat[head];
+
+		memcpy(fnode->bv, node->bv, sizeof(fnode->bv));
+		fnode->totnode = node->totnode;
+		fnode->main_axis = (axis_t)node->main_axis;
+
+		if (node->totnode == 0) {
+			fnode->index = node->index;
+		}
+		else {
+			int i;
+			fnode->index = tail;
+			for (i = 0; i != node->totnode; i++) {
+				queue[tail++] = node->children[i];
+			}
+		}
+	}
+	BLI_assert(tail <= totnode);
+
+	MEM_freeN(queue);
+
+	return flat;
+}
+
+BLI_INLINE int bvh_packet_lane_first(int mask)
+{
+	int lane = 0;
+	while ((mask & (1 << lane)) == 0) {
+		lane++;
+	}
+	return lane;
+}
+
+/** \name Ray Packets
+ * \{ */
+
+typedef struct BVHRayPacket {
+	BVHRayCastData data[BVH_PACKET_SIZE];
+
+	/* transposed copy of the rays for SIMD tests, unused lanes never hit (their dist is negative) */
+	float origin[3][BVH_PACKET_SIZE];
+	float idot_axis[3][BVH_PACKET_SIZE];
+	float radius[BVH_PACKET_SIZE];
+	float dist[BVH_PACKET_SIZE];
+} BVHRayPacket;
+
+/**
+ * Slab test of all rays in the packet against \a bv.
+ *
+ * \param r_dist: Distance each ray must travel to enter \a bv.
+ * \return Bit-mask of the rays which hit \a bv closer than their current hit.
+ */
+static int ray_packet_nearest_hit(const BVHRayPacket *packet, const float bv[6], float r_dist[BVH_PACKET_SIZE])
+{
+#ifdef __SSE2__
+	const __m128 radius = _mm_loadu_ps(packet->radius);
+	const __m128 dist = _mm_loadu_ps(packet->dist);
+	__m128 low = _mm_setzero_ps(), upper = dist;
+	int i;
+
+	for (i = 0; i != 3; i++) {
+		const __m128 origin = _mm_loadu_ps(packet->origin[i]);
+		const __m128 idot = _mm_loadu_ps(packet->idot_axis[i]);
+		const __m128 ll = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(bv[2 * i]), radius), origin), idot);
+		const __m128 lu = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(bv[2 * i + 1]), radius), origin), idot);
+
+		low = _mm_max_ps(low, _mm_min_ps(ll, lu));
+		upper = _mm_min_ps(upper, _mm_max_ps(ll, lu));
+	}
+
+	_mm_storeu_ps(r_dist, low);
+	return _mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(low, upper), _mm_cmplt_ps(low, dist)));
+#else
+	int lane, mask = 0;
+
+	for (lane = 0; lane != BVH_PACKET_SIZE; lane++) {
+		float low = 0.0f, upper = packet->dist[lane];
+		int i;
+
+		for (i = 0; i != 3; i++) {
+			const float ll = (bv[2 * i]     - packet->radius[lane] - packet->origin[i][lane]) * packet->idot_axis[i][lane];
+			const float lu = (bv[2 * i + 1] + packet->radius[lane] - packet->origin[i][lane]) * packet->idot_axis[i][lane];
+
+			low = max_ff(low, min_ff(ll, lu));
+			upper = min_ff(upper, max_ff(ll, lu));
+		}
+
+		r_dist[lane] = low;
+		if (low <= upper && low < packet->dist[lane]) {
+			mask |= (1 << lane);
+		}
+	}
+	return mask;
+#endif
+}
+
+static void dfs_raycast_packet(BVHRayPacket *packet, const BVHFlatNode *flat, const BVHFlatNode *node, int mask)
+{
+	float dist[BVH_PACKET_SIZE];
+	int lane, i;
+
+	mask &= ray_packet_nearest_hit(packet, node->bv, dist);
+	if (mask == 0) {
+		return;
+	}
+
+	if (node->totnode == 0) {
+		for (lane = 0; lane != BVH_PACKET_SIZE; lane++) {
+			if (mask & (1 << lane)) {
+				BVHRayCastData *data = &packet->data[lane];
+
+				if (data->callback) {
+					data->callback(data->userdata, node->index, &data->ray, &data->hit);
+				}
+				else {
+					data->hit.index = node->index;
+					data->hit.dist  = dist[lane];
+					madd_v3_v3v3fl(data->hit.co, data->ray.origin, data->ray.direction, dist[lane]);
+				}
+				packet->dist[lane] = data->hit.dist;
+			}
+		}
+	}
+	else {
+		const BVHFlatNode *children = &flat[node->index];
+
+		/* pick loop direction from the first active ray (based on ray direction and split axis) */
+		lane = bvh_packet_lane_first(mask);
+		if (node->main_axis >= 3 || packet->data[lane].ray_dot_axis[node->main_axis] > 0.0f) {
+			for (i = 0; i != node->totnode; i++) {
+				dfs_raycast_packet(packet, flat, &children[i], mask);
+			}
+		}
+		else {
+			for (i = node->totnode - 1; i >= 0; i--) {
+				dfs_raycast_packet(packet, flat, &children[i], mask);
+			}
+		}
+	}
+}
+
+typedef struct BVHRayCastBatchData {
+	BVHTree *tree;
+	const BVHFlatNode *flat;
+
+	const float (*co)[3];
+	const float (*dir)[3];
+	float radius;
+	BVHTreeRayHit *hit;
+	int rays_num;
+
+	BVHTree_RayCastCallback callback;
+	void *userdata;
+	int flag;
+} BVHRayCastBatchData;
+
+static void bvhtree_ray_cast_batch_cb(void *userdata, const int packet_index)
+{
+	const BVHRayCastBatchData *batch = userdata;
+	const int ray_start = packet_index * BVH_PACKET_SIZE;
+	const int lanes = min_ii(BVH_PACKET_SIZE, batch->rays_num - ray_start);
+	BVHRayPacket packet;
+	int lane, i;
+
+	for (lane = 0; lane != BVH_PACKET_SIZE; lane++) {
+		BVHRayCastData *data = &packet.data[lane];
+
+		if (lane < lanes) {
+			const int ray_index = ray_start + lane;
+
+			BLI_ASSERT_UNIT_V3(batch->dir[ray_index]);
+
+			data->tree = batch->tree;
+			data->callback = batch->callback;
+			data->userdata = batch->userdata;
+
+			copy_v3_v3(data->ray.origin,    batch->co[ray_index]);
+			copy_v3_v3(data->ray.direction, batch->dir[ray_index]);
+			data->ray.radius = batch->radius;
+
+			bvhtree_ray_cast_data_precalc(data, batch->flag);
+
+			data->hit = batch->hit[ray_index];
+
+			for (i = 0; i != 3; i++) {
+				packet.origin[i][lane] = data->ray.origin[i];
+				packet.idot_axis[i][lane] = data->idot_axis[i];
+			}
+			packet.radius[lane] = data->ray.radius;
+			packet.dist[lane] = data->hit.dist;
+		}
+		else {
+			for (i = 0; i != 3; i++) {
+				packet.origin[i][lane] = 0.0f;
+				packet.idot_axis[i][lane] = 0.0f;
+			}
+			packet.radius[lane] = 0.0f;
+			packet.dist[lane] = -1.0f;
+		}
+	}
+
+	dfs_raycast_packet(&packet, batch->flat, &batch->flat[0], (1 << lanes) - 1);
+
+	for (lane = 0; lane != lanes; lane++) {
+		batch->hit[ray_start + lane] = packet.data[lane].hit;
+	}
+}
+
+/**
+ * Cast \a rays_num rays at once, see #BLI_bvhtree_ray_cast_ex.
+ *
+ * \param hit: Array of \a rays_num hits, initialized by the caller
+ * (the index & dist are used to limit the search, as when passing a hit to #BLI_bvhtree_ray_cast_ex).
+ * \note Rays are traversed in packets over multiple threads, the \a callback must be thread-safe.
+ * Coherent rays (similar origin & direction) that are next to each other in the arrays perform best.
+ */
+void BLI_bvhtree_ray_cast_batch(
+        BVHTree *tree, const float (*co)[3], const float (*dir)[3], float radius,
+        BVHTreeRayHit *hit, const int rays_num,
+        BVHTree_RayCastCallback callback, void *userdata,
+        int flag)
+{
+	BVHRayCastBatchData batch;
+	const int packets_num = (rays_num + (BVH_PACKET_SIZE - 1)) / BVH_PACKET_SIZE;
+
+	if (rays_num == 0 || tree->totleaf == 0) {
+		return;
+	}
+
+	if (!bvhtree_flatten_supported(tree)) {
+		int i;
+		for (i = 0; i != rays_num; i++) {
+			BLI_bvhtree_ray_cast_ex(tree, co[i], dir[i], radius, &hit[i], callback, userdata, flag);
+		}
+		return;
+	}
+
+	batch.tree = tree;
+	batch.flat = bvhtree_flatten(tree);
+	batch.co = co;
+	batch.dir = dir;
+	batch.radius = radius;
+	batch.hit = hit;
+	batch.rays_num = rays_num;
+	batch.callback = callback;
+	batch.userdata = userdata;
+	batch.flag = flag;
+
+	BLI_task_parallel_range(
+	        0, packets_num, &batch, bvhtree_ray_cast_batch_cb,
+	        packets_num >= BVH_PACKET_THREADED_MIN);
+
+	MEM_freeN((void *)batch.flat);
+}
+
+/** \} */
+
+/** \name Nearest Point Packets
+ * \{ */
+
+typedef struct BVHNearestPacket {
+	BVHNearestData data[BVH_PACKET_SIZE];
+
+	/* transposed copy of the points for SIMD tests, unused lanes never pass (their dist_sq is negative) */
+	float co[3][BVH_PACKET_SIZE];
+	float dist_sq[BVH_PACKET_SIZE];
+} BVHNearestPacket;
+
+/**
+ * \return Bit-mask of the points which are closer to \a bv than their current nearest.
+ */
+static int nearest_packet_test(const BVHNearestPacket *packet, const float bv[6])
+{
+#ifdef __SSE2__
+	const __m128 zero = _mm_setzero_ps();
+	__m128 dist_sq = zero;
+	int i;
+
+	for (i = 0; i != 3; i++) {
+		const __m128 co = _mm_loadu_ps(packet->co[i]);
+		/* only one of both is non-zero */
+		const __m128 d = _mm_add_ps(
+		        _mm_max_ps(_mm_sub_ps(_mm_set1_ps(bv[2 * i]), co), zero),
+		        _mm_max_ps(_mm_sub_ps(co, _mm_set1_ps(bv[2 * i + 1])), zero));
+		dist_sq = _mm_add_ps(dist_sq, _mm_mul_ps(d, d));
+	}
+
+	return _mm_movemask_ps(_mm_cmplt_ps(dist_sq, _mm_loadu_ps(packet->dist_sq)));
+#else
+	int lane, mask = 0;
+
+	for (lane = 0; lane != BVH_PACKET_SIZE; lane++) {
+		float dist_sq = 0.0f;
+		int i;
+
+		for (i = 0; i != 3; i++) {
+			const float d = max_ff(bv[2 * i] - packet->co[i][lane], 0.0f) +
+			                max_ff(packet->co[i][lane] - bv[2 * i + 1], 0.0f);
+			dist_sq += d * d;
+		}
+
+		if (dist_sq < packet->dist_sq[lane]) {
+			mask |= (1 << lane);
+		}
+	}
+	return mask;
+#endif
+}
+
+static void dfs_find_nearest_packet(
+        BVHNearestPacket *packet, const BVHFlatNode *flat, const BVHFlatNode *node, int mask)
+{
+	int lane, i;
+
+	mask &= nearest_packet_test(packet, node->bv);
+	if (mask == 0) {
+		return;
+	}
+
+	if (node->totnode == 0) {
+		for (lane = 0; lane != BVH_PACKET_SIZE; lane++) {
+			if (mask & (1 << lane)) {
+				BVHNearestData *data = &packet->data[lane];
+
+				if (data->callback) {
+					data->callback(data->userdata, node->index, data->co, &data->nearest);
+				}
+				else {
+					/* nearest on AABB hull */
+					for (i = 0; i != 3; i++) {
+						data->nearest.co[i] = CLAMPIS(data->co[i], node->bv[2 * i], node->bv[2 * i + 1]);
+					}
+					data->nearest.index = node->index;
+					data->nearest.dist_sq = len_squared_v3v3(data->co, data->nearest.co);
+				}
+				packet->dist_sq[lane] = data->nearest.dist_sq;
+			}
+		}
+	}
+	else {
+		const BVHFlatNode *children = &flat[node->index];
+		const axis_t axis = node->main_axis;
+
+		/* Better heuristic to pick the closest node to dive on (based on the first active point) */
+		lane = bvh_packet_lane_first(mask);
+		if (axis >= 3 || packet->co[axis][lane] <= children[0].bv[axis * 2 + 1]) {
+			for (i = 0; i != node->totnode; i++) {
+				dfs_find_nearest_packet(packet, flat, &children[i], mask);
+			}
+		}
+		else {
+			for (i = node->totnode - 1; i >= 0; i--) {
+				dfs_find_nearest_packet(packet, flat, &children[i], mask);
+			}
+		}
+	}
+}
+
+typedef struct BVHNearestBatchData {
+	BVHTree *tree;
+	const BVHFlatNode *flat;
+
+	const float (*co)[3];
+	BVHTreeNearest *nearest;
+	int co_num;
+
+	BVHTree_NearestPointCallback callback;
+	void *userdata;
+} BVHNearestBatchData;
+
+static void bvhtree_find_nearest_batch_cb(void *userdata, const int packet_index)
+{
+	const BVHNearestBatchData *batch = userdata;
+	const int co_start = packet_index * BVH_PACKET_SIZE;
+	const int lanes = min_ii(BVH_PACKET_SIZE, batch->co_num - co_start);
+	BVHNearestPacket packet;
+	int lane, i;
+
+	for (lane = 0; lane != BVH_PACKET_SIZE; lane++) {
+		BVHNearestData *data = &packet.data[lane];
+
+		if (lane < lanes) {
+			const int co_index = co_start + lane;
+
+			data->tree = batch->tree;
+			data->co = batch->co[co_index];
+			data->callback = batch->callback;
+			data->userdata = batch->userdata;
+
+			for (i = 0; i != 3; i++) {
+				data->proj[i] = data->co[i];
+				packet.co[i][lane] = data->co[i];
+			}
+
+			data->nearest = batch->nearest[co_index];
+			packet.dist_sq[lane] = data->nearest.dist_sq;
+		}
+		else {
+			for (i = 0; i != 3; i++) {
+				packet.co[i][lane] = 0.0f;
+			}
+			packet.dist_sq[lane] = -1.0f;
+		}
+	}
+
+	dfs_find_nearest_packet(&packet, batch->flat, &batch->flat[0], (1 << lanes) - 1);
+
+	for (lane = 0; lane != lanes; lane++) {
+		batch->nearest[co_start + lane] = packet.data[lane].nearest;
+	}
+}
+
+/**
+ * Find the nearest node for \a co_num coordinates at once, see #BLI_bvhtree_find_nearest.
+ *
+ * \param nearest: Array of \a co_num results, initialized by the caller
+ * (index -1 and dist_sq #FLT_MAX, or a smaller dist_sq to limit the search).
+ * \note Points are traversed in packets over multiple threads, the \a callback must be thread-safe.
+ * Points that are close to each other and next to each other in \a co perform best.
+ */
+void BLI_bvhtree_find_nearest_batch(
+        BVHTree *tree, const float (*co)[3], BVHTreeNearest *nearest, const int co_num,
+        BVHTree_NearestPointCallback callback, void *userdata)
+{
+	BVHNearestBatchData batch;
+	const int packets_num = (co_num + (BVH_PACKET_SIZE - 1)) / BVH_PACKET_SIZE;
+
+	if (co_num == 0 || tree->totleaf == 0) {
+		return;
+	}
+
+	if (!bvhtree_flatten_supported(tree)) {
+		int i;
+		for (i = 0; i != co_num; i++) {
+			BLI_bvhtree_find_nearest(tree, co[i], &nearest[i], callback, userdata);
+		}
+		return;
+	}
+
+	batch.tree = tree;
+	batch.flat = bvhtree_flatten(tree);
+	batch.co = co;
+	batch.nearest = nearest;
+	batch.co_num = co_num;
+	batch.callback = callback;
+	batch.userdata = userdata;
+
+	BLI_task_parallel_range(
+	        0, packets_num, &batch, bvhtree_find_nearest_batch_cb,
+	        packets_num >= BVH_PACKET_THREADED_MIN);
+
+	MEM_freeN((void *)batch.flat);
+}
+
+/** \} */
+
+/** \} */
@@ -29,38 +29,76 @@
 
 #include "BLI_math.h"
 #include "BLI_kdtree.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
 #include "BLI_utildefines.h"
 #include "BLI_strict_flags.h"
 
-typedef struct KDTreeNode_head {
-	unsigned int left, right;
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+/**
+ * Points are stored in buckets of up to #KD_LEAF_SIZE at the leaves, interior nodes only hold the split plane.
+ *
+ * After balancing, the points of each leaf are contiguous in #KDTree.points,
+ * their coordinates are also copied into separate x/y/z arrays (#KDTree.co_soa)
+ * so nearest queries can test a whole bucket at once using SSE.
+ */
+typedef struct KDTreePoint {
 	float co[3];
 	int index;
-} KDTreeNode_head;
+} KDTreePoint;
 
 typedef struct KDTreeNode {
-	unsigned int left, right;
-	float co[3];
-	int index;
-	unsigned int d;  /* range is only (0-2) */
+	unsigned int left, right;  /* KD_NODE_UNSET for leaves */
+	unsigned int start, tot;   /* range of points in #KDTree.points (used by leaves) */
+	float split;               /* position of the split plane along \a d */
+	unsigned int d;            /* range is only (0-2) */
 } KDTreeNode;
 
 struct KDTree {
+	KDTreePoint *points;
+	unsigned int totpoint;
 	KDTreeNode *nodes;
 	unsigned int totnode;
 	unsigned int root;
+	/* x, y then z coordinates of all points, each array is \a soa_stride long. */
+	float *co_soa;
+	unsigned int soa_stride;
 #ifdef DEBUG
 	bool is_balanced;  /* ensure we call balance first */
 	unsigned int maxsize;   /* max size of the tree */
 #endif
 };
 
-#define KD_STACK_INIT 100      /* initial size for array (on the stack) */
-#define KD_NEAR_ALLOC_INC 100  /* alloc increment for collecting nearest */
+typedef struct KDTreeStackItem {
+	unsigned int node;
+	float dist_sq;  /* lower bound of the squared distance to any point in the node */
+} KDTreeStackItem;
+
+/* Queries push at most 2 children per popped node and the tree is balanced,
+ * so the stack never holds more than the tree depth (at most 32) + 1 items. */
+#define KD_STACK_SIZE 100
 #define KD_FOUND_ALLOC_INC 50  /* alloc increment for collecting nearest */
 
 #define KD_NODE_UNSET ((unsigned int)-1)
 
+/* Maximum number of points in a leaf, leaves have at least half of this. */
+#define KD_LEAF_SIZE 16
+
+/* Padding after each of the x/y/z arrays, so SSE loads of the last bucket stay in bounds. */
+#define KD_SOA_PAD 3
+
+/* Subtrees smaller than this are balanced in a single task. */
+#define KD_BALANCE_TASK_MIN 10000
+
+/* Minimum number of points to use threading for batched queries. */
+#define KD_BATCH_THREADED_MIN 1000
+
+#define KD_NODE_IS_LEAF(node) ((node)->left == KD_NODE_UNSET)
+
 /**
  * Creates or free a kdtree
  */
@@ -69,9 +107,13 @@ KDTree *BLI_kdtree_new(unsigned int maxsize)
 	KDTree *tree;
 
 	tree = MEM_mallocN(sizeof(KDTree), "KDTree");
-	tree->nodes = MEM_mallocN(sizeof(KDTreeNode) * maxsize, "KDTreeNode");
+	tree->points = MEM_mallocN(sizeof(KDTreePoint) * maxsize, "KDTreePoint");
+	tree->totpoint = 0;
+	tree->nodes = NULL;
 	tree->totnode = 0;
 	tree->root = KD_NODE_UNSET;
+	tree->co_soa = NULL;
+	tree->soa_stride = 0;
 
 #ifdef DEBUG
 	tree->is_balanced = false;
@@ -84,7 +126,9 @@ KDTree *BLI_kdtree_new(unsigned int maxsize)
 void BLI_kdtree_free(KDTree *tree)
 {
 	if (tree) {
-		MEM_freeN(tree->nodes);
+		MEM_freeN(tree->points);
+		MEM_SAFE_FREE(tree->nodes);
+		MEM_SAFE_FREE(tree->co_soa);
 		MEM_freeN(tree);
 	}
 }
@@ -94,76 +138,225 @@ void BLI_kdtree_free(KDTree *tree)
  */
 void BLI_kdtree_insert(KDTree *tree, int index, const float co[3])
 {
-	KDTreeNode *node = &tree->nodes[tree->totnode++];
+	KDTreePoint *point = &tree->points[tree->totpoint++];
 
 #ifdef DEBUG
-	BLI_assert(tree->totnode <= tree->maxsize);
+	BLI_assert(tree->totpoint <= tree->maxsize);
 #endif
 
-	/* note, array isn't calloc'd,
-	 * need to initialize all struct members */
-
-	node->left = node->right = KD_NODE_UNSET;
-	copy_v3_v3(node->co, co);
-	node->index = index;
-	node->d = 0;
+	copy_v3_v3(point->co, co);
+	point->index = index;
 
 #ifdef DEBUG
 	tree->is_balanced = false;
 #endif
 }
 
-static unsigned int kdtree_balance(KDTreeNode *nodes, unsigned int totnode, unsigned int axis, const unsigned int ofs)
+/**
+ * Quicksort style partitioning of \a points around their median along \a axis.
+ *
+ * \return the index of the median point.
+ */
+static unsigned int kdtree_balance_partition(KDTreePoint *points, unsigned int totpoint, unsigned int axis)
 {
-	KDTreeNode *node;
 	float co;
 	unsigned int left, right, median, i, j;
 
-	if (totnode <= 0)
-		return KD_NODE_UNSET;
-	else if (totnode == 1)
-		return 0 + ofs;
-	
-	/* quicksort style sorting around median */
 	left = 0;
-	right = totnode - 1;
-	median = totnode / 2;
+	right = totpoint - 1;
+	median = totpoint / 2;
 
 	while (right > left) {
-		co = nodes[right].co[axis];
+		co = points[right].co[axis];
 		i = left - 1;
 		j = right;
 
 		while (1) {
-			while (nodes[++i].co[axis] < co) ;
-			while (nodes[--j].co[axis] > co && j > left) ;
+			while (points[++i].co[axis] < co) ;
+			while (points[--j].co[axis] > co && j > left) ;
 
 			if (i >= j)
 				break;
 
-			SWAP(KDTreeNode_head, *(KDTreeNode_head *)&nodes[i], *(KDTreeNode_head *)&nodes[j]);
+			SWAP(KDTreePoint, points[i], points[j]);
 		}
 
-		SWAP(KDTreeNode_head, *(KDTreeNode_head *)&nodes[i], *(KDTreeNode_head *)&nodes[right]);
+		SWAP(KDTreePoint, points[i], points[right]);
 		if (i >= median)
 			right = i - 1;
 		if (i <= median)
 			left = i + 1;
 	}
 
-	/* set node and sort subnodes */
-	node = &nodes[median];
+	return median;
+}
+
+/**
+ * Number of nodes #kdtree_balance creates for \a totpoint points.
+ */
+static unsigned int kdtree_node_count(unsigned int totpoint)
+{
+	if (totpoint <= KD_LEAF_SIZE) {
+		return 1;
+	}
+	return 1 + kdtree_node_count(totpoint / 2) + kdtree_node_count(totpoint - totpoint / 2);
+}
+
+/**
+ * Initialize \a node, splitting its points when there are too many for a leaf.
+ *
+ * \return the index of the median point, 0 for leaves.
+ */
+static unsigned int kdtree_balance_node(
+        KDTreeNode *node, KDTreePoint *points, unsigned int totpoint, unsigned int axis, const unsigned int ofs)
+{
+	unsigned int median;
+
+	node->start = ofs;
+	node->tot = totpoint;
+	node->left = node->right = KD_NODE_UNSET;
+	node->split = 0.0f;
 	node->d = axis;
+
+	if (totpoint <= KD_LEAF_SIZE) {
+		return 0;
+	}
+
+	/* quicksort style sorting around median, points before it are <= split, points after are >= split */
+	median = kdtree_balance_partition(points, totpoint, axis);
+	node->split = points[median].co[axis];
+
+	return median;
+}
+
+/**
+ * Build the subtree of \a points in \a nodes, starting at \a node_index (nodes are stored in depth-first order).
+ *
+ * \return the index after the last node of the subtree.
+ */
+static unsigned int kdtree_balance(
+        KDTreeNode *nodes, const unsigned int node_index,
+        KDTreePoint *points, unsigned int totpoint, unsigned int axis, const unsigned int ofs)
+{
+	KDTreeNode *node = &nodes[node_index];
+	const unsigned int median = kdtree_balance_node(node, points, totpoint, axis, ofs);
+
+	if (median == 0) {
+		return node_index + 1;
+	}
+
 	axis = (axis + 1) % 3;
-	node->left = kdtree_balance(nodes, median, axis, ofs);
-	node->right = kdtree_balance(nodes + median + 1, (totnode - (median + 1)), axis, (median + 1) + ofs);
+	node->left = node_index + 1;
+	node->right = kdtree_balance(nodes, node->left, points, median, axis, ofs);
+	return kdtree_balance(nodes, node->right, points + median, totpoint - median, axis, ofs + median);
+}
+
+typedef struct KDTreeBalanceTask {
+	KDTreeNode *nodes;
+	unsigned int node_index;
+	KDTreePoint *points;
+	unsigned int totpoint, axis, ofs;
+} KDTreeBalanceTask;
+
+static void kdtree_balance_threaded(
+        TaskPool *pool, KDTreeNode *nodes, const unsigned int node_index,
+        KDTreePoint *points, unsigned int totpoint, unsigned int axis, const unsigned int ofs,
+        const int thread_id);
 
-	return median + ofs;
+static void kdtree_balance_task_run(TaskPool *__restrict pool, void *taskdata, int thread_id)
+{
+	KDTreeBalanceTask *task = taskdata;
+	kdtree_balance_threaded(
+	        pool, task->nodes, task->node_index, task->points, task->totpoint, task->axis, task->ofs, thread_id);
+}
+
+/**
+ * Same as #kdtree_balance, but the left subtree of big enough nodes is balanced in another task.
+ * Both subtrees use separate ranges of \a points and \a nodes, so no locking is needed.
+ */
+static void kdtree_balance_threaded(
+        TaskPool *pool, KDTreeNode *nodes, const unsigned int node_index,
+        KDTreePoint *points, unsigned int totpoint, unsigned int axis, const unsigned int ofs,
+        const int thread_id)
+{
+	KDTreeNode *node;
+	KDTreeBalanceTask *task;
+	unsigned int median;
+
+	if (totpoint < KD_BALANCE_TASK_MIN) {
+		kdtree_balance(nodes, node_index, points, totpoint, axis, ofs);
+		return;
+	}
+
+	node = &nodes[node_index];
+	median = kdtree_balance_node(node, points, totpoint, axis, ofs);
+	axis = (axis + 1) % 3;
+	node->left = node_index + 1;
+	node->right = node->left + kdtree_node_count(median);
+
+	task = MEM_mallocN(sizeof(*task), __func__);
+	task->nodes = nodes;
+	task->node_index = node->left;
+	task->points = points;
+	task->totpoint = median;
+	task->axis = axis;
+	task->ofs = ofs;
+	BLI_task_pool_push_from_thread(pool, kdtree_balance_task_run, task, true, TASK_PRIORITY_HIGH, thread_id);
+
+	kdtree_balance_threaded(
+	        pool, nodes, node->right, points + median, totpoint - median, axis, ofs + median, thread_id);
+}
+
+/**
+ * Copy the (balanced) point coordinates into the x/y/z arrays.
+ */
+static void kdtree_build_soa(KDTree *tree)
+{
+	const unsigned int stride = tree->totpoint + KD_SOA_PAD;
+	float *co_x, *co_y, *co_z;
+	unsigned int i;
+
+	co_x = tree->co_soa = MEM_callocN(sizeof(float) * 3 * stride, "KDTree.co_soa");
+	co_y = co_x + stride;
+	co_z = co_y + stride;
+	tree->soa_stride = stride;
+
+	for (i = 0; i < tree->totpoint; i++) {
+		co_x[i] = tree->points[i].co[0];
+		co_y[i] = tree->points[i].co[1];
+		co_z[i] = tree->points[i].co[2];
+	}
 }
 
 void BLI_kdtree_balance(KDTree *tree)
 {
-	tree->root = kdtree_balance(tree->nodes, tree->totnode, 0, 0);
+	MEM_SAFE_FREE(tree->nodes);
+	MEM_SAFE_FREE(tree->co_soa);
+
+	if (tree->totpoint == 0) {
+		tree->totnode = 0;
+		tree->root = KD_NODE_UNSET;
+	}
+	else {
+		tree->totnode = kdtree_node_count(tree->totpoint);
+		tree->nodes = MEM_mallocN(sizeof(KDTreeNode) * tree->totnode, "KDTreeNode");
+		tree->root = 0;
+
+		if (tree->totpoint < KD_BALANCE_TASK_MIN) {
+			kdtree_balance(tree->nodes, 0, tree->points, tree->totpoint, 0, 0);
+		}
+		else {
+			TaskScheduler *scheduler = BLI_task_scheduler_get();
+			TaskPool *pool = BLI_task_pool_create(scheduler, NULL);
+
+			kdtree_balance_threaded(pool, tree->nodes, 0, tree->points, tree->totpoint, 0, 0, 0);
+
+			BLI_task_pool_work_and_wait(pool);
+			BLI_task_pool_free(pool);
+		}
+	}
+
+	kdtree_build_soa(tree);
 
 #ifdef DEBUG
 	tree->is_balanced = true;
@@ -188,15 +381,82 @@ static float squared_distance(const float v2[3], const float v1[3], const float
 	return dist;
 }
 
-static unsigned int *realloc_nodes(unsigned int *stack, unsigned int *totstack, const bool is_alloc)
+/**
+ * Push both children of the interior \a node, the one on the side of \a co last so it's visited first.
+ *
+ * \param dist_sq: The lower bound of the distance to \a node, the far child also can't be closer than the split plane.
+ * \return the new stack size.
+ */
+BLI_INLINE unsigned int kdtree_stack_push_children(
+        const KDTreeNode *node, const float co[3], const float dist_sq,
+        KDTreeStackItem *stack, unsigned int cur)
 {
-	unsigned int *stack_new = MEM_mallocN((*totstack + KD_NEAR_ALLOC_INC) * sizeof(unsigned int), "KDTree.treestack");
-	memcpy(stack_new, stack, *totstack * sizeof(unsigned int));
-	// memset(stack_new + *totstack, 0, sizeof(unsigned int) * KD_NEAR_ALLOC_INC);
-	if (is_alloc)
-		MEM_freeN(stack);
-	*totstack += KD_NEAR_ALLOC_INC;
-	return stack_new;
+	const float plane_dist = co[node->d] - node->split;
+	const bool is_left = (plane_dist < 0.0f);
+
+	stack[cur].node = is_left ? node->right : node->left;
+	stack[cur++].dist_sq = max_ff(dist_sq, plane_dist * plane_dist);
+	stack[cur].node = is_left ? node->left : node->right;
+	stack[cur++].dist_sq = dist_sq;
+
+	BLI_assert(cur <= KD_STACK_SIZE);
+	return cur;
+}
+
+/**
+ * Test all points of the leaf \a node, updating \a r_min_dist and \a r_min_point when one is closer.
+ */
+BLI_INLINE void kdtree_leaf_find_nearest(
+        const KDTree *tree, const KDTreeNode *node, const float co[3],
+        float *r_min_dist, unsigned int *r_min_point)
+{
+	const float *co_x = tree->co_soa + node->start;
+	const float *co_y = co_x + tree->soa_stride;
+	const float *co_z = co_y + tree->soa_stride;
+	float min_dist = *r_min_dist;
+	unsigned int i;
+
+#ifdef __SSE2__
+	const __m128 qx = _mm_set1_ps(co[0]);
+	const __m128 qy = _mm_set1_ps(co[1]);
+	const __m128 qz = _mm_set1_ps(co[2]);
+
+	for (i = 0; i < node->tot; i += 4) {
+		const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&co_x[i]), qx);
+		const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&co_y[i]), qy);
+		const __m128 dz = _mm_sub_ps(_mm_loadu_ps(&co_z[i]), qz);
+		const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(dist, _mm_set1_ps(min_dist)))) {
+			/* lanes past the end of the bucket hold other points (or padding), skip them */
+			const unsigned int tot = MIN2(node->tot - i, 4u);
+			float dist_v[4];
+			unsigned int j;
+
+			_mm_storeu_ps(dist_v, dist);
+			for (j = 0; j < tot; j++) {
+				if (dist_v[j] < min_dist) {
+					min_dist = dist_v[j];
+					*r_min_point = node->start + i + j;
+				}
+			}
+		}
+	}
+#else
+	for (i = 0; i < node->tot; i++) {
+		const float dx = co_x[i] - co[0];
+		const float dy = co_y[i] - co[1];
+		const float dz = co_z[i] - co[2];
+		const float dist = dx * dx + dy * dy + dz * dz;
+
+		if (dist < min_dist) {
+			min_dist = dist;
+			*r_min_point = node->start + i;
+		}
+	}
+#endif
+
+	*r_min_dist = min_dist;
 }
 
 /**
@@ -207,10 +467,10 @@ int BLI_kdtree_find_nearest(
         KDTreeNearest *r_nearest)
 {
 	const KDTreeNode *nodes = tree->nodes;
-	const KDTreeNode *root, *min_node;
-	unsigned int *stack, defaultstack[KD_STACK_INIT];
-	float min_dist, cur_dist;
-	unsigned int totstack, cur = 0;
+	const KDTreePoint *min_point;
+	KDTreeStackItem stack[KD_STACK_SIZE];
+	float min_dist = FLT_MAX;
+	unsigned int min_point_index = 0, cur = 0;
 
 #ifdef DEBUG
 	BLI_assert(tree->is_balanced == true);
@@ -219,78 +479,77 @@ int BLI_kdtree_find_nearest(
 	if (UNLIKELY(tree->root == KD_NODE_UNSET))
 		return -1;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
+	stack[cur].node = tree->root;
+	stack[cur++].dist_sq = 0.0f;
 
-	root = &nodes[tree->root];
-	min_node = root;
-	min_dist = len_squared_v3v3(root->co, co);
-
-	if (co[root->d] < root->co[root->d]) {
-		if (root->right != KD_NODE_UNSET)
-			stack[cur++] = root->right;
-		if (root->left != KD_NODE_UNSET)
-			stack[cur++] = root->left;
-	}
-	else {
-		if (root->left != KD_NODE_UNSET)
-			stack[cur++] = root->left;
-		if (root->right != KD_NODE_UNSET)
-			stack[cur++] = root->right;
-	}
-	
 	while (cur--) {
-		const KDTreeNode *node = &nodes[stack[cur]];
-
-		cur_dist = node->co[node->d] - co[node->d];
+		const KDTreeStackItem item = stack[cur];
+		const KDTreeNode *node = &nodes[item.node];
 
-		if (cur_dist < 0.0f) {
-			cur_dist = -cur_dist * cur_dist;
+		if (item.dist_sq >= min_dist)
+			continue;
 
-			if (-cur_dist < min_dist) {
-				cur_dist = len_squared_v3v3(node->co, co);
-				if (cur_dist < min_dist) {
-					min_dist = cur_dist;
-					min_node = node;
-				}
-				if (node->left != KD_NODE_UNSET)
-					stack[cur++] = node->left;
-			}
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
+		if (KD_NODE_IS_LEAF(node)) {
+			kdtree_leaf_find_nearest(tree, node, co, &min_dist, &min_point_index);
 		}
 		else {
-			cur_dist = cur_dist * cur_dist;
-
-			if (cur_dist < min_dist) {
-				cur_dist = len_squared_v3v3(node->co, co);
-				if (cur_dist < min_dist) {
-					min_dist = cur_dist;
-					min_node = node;
-				}
-				if (node->right != KD_NODE_UNSET)
-					stack[cur++] = node->right;
-			}
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-		}
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
+			cur = kdtree_stack_push_children(node, co, item.dist_sq, stack, cur);
 		}
 	}
 
+	min_point = &tree->points[min_point_index];
+
 	if (r_nearest) {
-		r_nearest->index = min_node->index;
+		r_nearest->index = min_point->index;
 		r_nearest->dist = sqrtf(min_dist);
-		copy_v3_v3(r_nearest->co, min_node->co);
+		copy_v3_v3(r_nearest->co, min_point->co);
 	}
 
-	if (stack != defaultstack)
-		MEM_freeN(stack);
+	return min_point->index;
+}
 
-	return min_node->index;
+
+typedef struct KDTreeFindNearestBatchData {
+	const KDTree *tree;
+	const float (*co)[3];
+	int *r_index;
+	KDTreeNearest *r_nearest;
+} KDTreeFindNearestBatchData;
+
+static void kdtree_find_nearest_batch_cb(void *userdata, const int iter)
+{
+	KDTreeFindNearestBatchData *data = userdata;
+	const int index = BLI_kdtree_find_nearest(
+	        data->tree, data->co[iter], data->r_nearest ? &data->r_nearest[iter] : NULL);
+
+	if (data->r_index) {
+		data->r_index[iter] = index;
+	}
 }
 
+/**
+ * Find the nearest point of each of the \a co_num points in \a co,
+ * queries are distributed over all threads when there are enough of them,
+ * each one testing the leaf buckets with SSE (see #kdtree_leaf_find_nearest).
+ *
+ * \param r_index: Optional array of \a co_num found indices (-1 if none).
+ * \param r_nearest: Optional array of \a co_num results.
+ */
+void BLI_kdtree_find_nearest_batch(
+        const KDTree *tree, const float (*co)[3], const unsigned int co_num,
+        int *r_index, KDTreeNearest *r_nearest)
+{
+	KDTreeFindNearestBatchData data = {
+		.tree = tree,
+		.co = co,
+		.r_index = r_index,
+		.r_nearest = r_nearest,
+	};
+
+	BLI_task_parallel_range(
+	        0, (int)co_num, &data, kdtree_find_nearest_batch_cb,
+	        co_num >= KD_BATCH_THREADED_MIN);
+}
 
 /**
  * A version of #BLI_kdtree_find_nearest which runs a callback
@@ -305,11 +564,11 @@ int BLI_kdtree_find_nearest_cb(
         KDTreeNearest *r_nearest)
 {
 	const KDTreeNode *nodes = tree->nodes;
-	const KDTreeNode *min_node = NULL;
+	const KDTreePoint *min_point = NULL;
 
-	unsigned int *stack, defaultstack[KD_STACK_INIT];
-	float min_dist = FLT_MAX, cur_dist;
-	unsigned int totstack, cur = 0;
+	KDTreeStackItem stack[KD_STACK_SIZE];
+	float min_dist = FLT_MAX;
+	unsigned int cur = 0, i;
 
 #ifdef DEBUG
 	BLI_assert(tree->is_balanced == true);
@@ -318,17 +577,14 @@ int BLI_kdtree_find_nearest_cb(
 	if (UNLIKELY(tree->root == KD_NODE_UNSET))
 		return -1;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
-
-#define NODE_TEST_NEAREST(node) \
+#define POINT_TEST_NEAREST(point) \
 { \
-	const float dist_sq = len_squared_v3v3((node)->co, co); \
+	const float dist_sq = len_squared_v3v3((point)->co, co); \
 	if (dist_sq < min_dist) { \
-		const int result = filter_cb(user_data, (node)->index, (node)->co, dist_sq); \
+		const int result = filter_cb(user_data, (point)->index, (point)->co, dist_sq); \
 		if (result == 1) { \
 			min_dist = dist_sq; \
-			min_node = node; \
+			min_point = point; \
 		} \
 		else if (result == 0) { \
 			/* pass */ \
@@ -340,57 +596,40 @@ int BLI_kdtree_find_nearest_cb(
 	} \
 } ((void)0)
 
-	stack[cur++] = tree->root;
+	stack[cur].node = tree->root;
+	stack[cur++].dist_sq = 0.0f;
 
 	while (cur--) {
-		const KDTreeNode *node = &nodes[stack[cur]];
-
-		cur_dist = node->co[node->d] - co[node->d];
+		const KDTreeStackItem item = stack[cur];
+		const KDTreeNode *node = &nodes[item.node];
 
-		if (cur_dist < 0.0f) {
-			cur_dist = -cur_dist * cur_dist;
+		if (item.dist_sq >= min_dist)
+			continue;
 
-			if (-cur_dist < min_dist) {
-				NODE_TEST_NEAREST(node);
-
-				if (node->left != KD_NODE_UNSET)
-					stack[cur++] = node->left;
+		if (KD_NODE_IS_LEAF(node)) {
+			/* scalar loop, the filter callback runs per point anyway */
+			for (i = node->start; i < node->start + node->tot; i++) {
+				const KDTreePoint *point = &tree->points[i];
+				POINT_TEST_NEAREST(point);
 			}
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
 		}
 		else {
-			cur_dist = cur_dist * cur_dist;
-
-			if (cur_dist < min_dist) {
-				NODE_TEST_NEAREST(node);
-
-				if (node->right != KD_NODE_UNSET)
-					stack[cur++] = node->right;
-			}
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-		}
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
+			cur = kdtree_stack_push_children(node, co, item.dist_sq, stack, cur);
 		}
 	}
 
-#undef NODE_TEST_NEAREST
+#undef POINT_TEST_NEAREST
 
 
 finally:
-	if (stack != defaultstack)
-		MEM_freeN(stack);
-
-	if (min_node) {
+	if (min_point) {
 		if (r_nearest) {
-			r_nearest->index = min_node->index;
+			r_nearest->index = min_point->index;
 			r_nearest->dist = sqrtf(min_dist);
-			copy_v3_v3(r_nearest->co, min_node->co);
+			copy_v3_v3(r_nearest->co, min_point->co);
 		}
 
-		return min_node->index;
+		return min_point->index;
 	}
 	else {
 		return -1;
@@ -428,10 +667,9 @@ int BLI_kdtree_find_nearest_n__normal(
         unsigned int n)
 {
 	const KDTreeNode *nodes = tree->nodes;
-	const KDTreeNode *root;
-	unsigned int *stack, defaultstack[KD_STACK_INIT];
+	KDTreeStackItem stack[KD_STACK_SIZE];
 	float cur_dist;
-	unsigned int totstack, cur = 0;
+	unsigned int cur = 0;
 	unsigned int i, found = 0;
 
 #ifdef DEBUG
@@ -441,72 +679,34 @@ int BLI_kdtree_find_nearest_n__normal(
 	if (UNLIKELY((tree->root == KD_NODE_UNSET) || n == 0))
 		return 0;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
-
-	root = &nodes[tree->root];
-
-	cur_dist = squared_distance(root->co, co, nor);
-	add_nearest(r_nearest, &found, n, root->index, cur_dist, root->co);
-	
-	if (co[root->d] < root->co[root->d]) {
-		if (root->right != KD_NODE_UNSET)
-			stack[cur++] = root->right;
-		if (root->left != KD_NODE_UNSET)
-			stack[cur++] = root->left;
-	}
-	else {
-		if (root->left != KD_NODE_UNSET)
-			stack[cur++] = root->left;
-		if (root->right != KD_NODE_UNSET)
-			stack[cur++] = root->right;
-	}
+	stack[cur].node = tree->root;
+	stack[cur++].dist_sq = 0.0f;
 
+	/* the normal only ever scales distances up, so the split plane distance is still a lower bound */
 	while (cur--) {
-		const KDTreeNode *node = &nodes[stack[cur]];
-
-		cur_dist = node->co[node->d] - co[node->d];
+		const KDTreeStackItem item = stack[cur];
+		const KDTreeNode *node = &nodes[item.node];
 
-		if (cur_dist < 0.0f) {
-			cur_dist = -cur_dist * cur_dist;
+		if (found == n && item.dist_sq >= r_nearest[found - 1].dist)
+			continue;
 
-			if (found < n || -cur_dist < r_nearest[found - 1].dist) {
-				cur_dist = squared_distance(node->co, co, nor);
+		if (KD_NODE_IS_LEAF(node)) {
+			for (i = node->start; i < node->start + node->tot; i++) {
+				const KDTreePoint *point = &tree->points[i];
 
+				cur_dist = squared_distance(point->co, co, nor);
 				if (found < n || cur_dist < r_nearest[found - 1].dist)
-					add_nearest(r_nearest, &found, n, node->index, cur_dist, node->co);
-
-				if (node->left != KD_NODE_UNSET)
-					stack[cur++] = node->left;
+					add_nearest(r_nearest, &found, n, point->index, cur_dist, point->co);
 			}
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
 		}
 		else {
-			cur_dist = cur_dist * cur_dist;
-
-			if (found < n || cur_dist < r_nearest[found - 1].dist) {
-				cur_dist = squared_distance(node->co, co, nor);
-				if (found < n || cur_dist < r_nearest[found - 1].dist)
-					add_nearest(r_nearest, &found, n, node->index, cur_dist, node->co);
-
-				if (node->right != KD_NODE_UNSET)
-					stack[cur++] = node->right;
-			}
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-		}
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
+			cur = kdtree_stack_push_children(node, co, item.dist_sq, stack, cur);
 		}
 	}
 
 	for (i = 0; i < found; i++)
 		r_nearest[i].dist = sqrtf(r_nearest[i].dist);
 
-	if (stack != defaultstack)
-		MEM_freeN(stack);
-
 	return (int)found;
 }
 
@@ -533,7 +733,7 @@ static void add_in_range(
 	if (UNLIKELY(found >= *r_foundstack_tot_alloc)) {
 		*r_foundstack = MEM_reallocN_id(
 		        *r_foundstack,
-		        (*r_foundstack_tot_alloc += KD_FOUND_ALLOC_INC) * sizeof(KDTreeNode),
+		        (*r_foundstack_tot_alloc += KD_FOUND_ALLOC_INC) * sizeof(KDTreeNearest),
 		        __func__);
 	}
 
@@ -544,6 +744,25 @@ static void add_in_range(
 	copy_v3_v3(to->co, co);
 }
 
+/**
+ * Push the children of the interior \a node which may have points within \a range of \a co.
+ *
+ * \return the new stack size.
+ */
+BLI_INLINE unsigned int kdtree_stack_push_children_in_range(
+        const KDTreeNode *node, const float co[3], const float range,
+        unsigned int *stack, unsigned int cur)
+{
+	/* points in the left child are <= split, points in the right child are >= split */
+	if (co[node->d] - range <= node->split)
+		stack[cur++] = node->left;
+	if (co[node->d] + range >= node->split)
+		stack[cur++] = node->right;
+
+	BLI_assert(cur <= KD_STACK_SIZE);
+	return cur;
+}
+
 /**
  * Range search returns number of points found, with results in nearest
  * Normal is optional, but if given will limit results to points in normal direction from co.
@@ -554,10 +773,10 @@ int BLI_kdtree_range_search__normal(
         KDTreeNearest **r_nearest, float range)
 {
 	const KDTreeNode *nodes = tree->nodes;
-	unsigned int *stack, defaultstack[KD_STACK_INIT];
+	unsigned int stack[KD_STACK_SIZE];
 	KDTreeNearest *foundstack = NULL;
 	float range_sq = range * range, dist_sq;
-	unsigned int totstack, cur = 0, found = 0, totfoundstack = 0;
+	unsigned int cur = 0, found = 0, totfoundstack = 0, i;
 
 #ifdef DEBUG
 	BLI_assert(tree->is_balanced == true);
@@ -566,42 +785,26 @@ int BLI_kdtree_range_search__normal(
 	if (UNLIKELY(tree->root == KD_NODE_UNSET))
 		return 0;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
-
 	stack[cur++] = tree->root;
 
 	while (cur--) {
 		const KDTreeNode *node = &nodes[stack[cur]];
 
-		if (co[node->d] + range < node->co[node->d]) {
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-		}
-		else if (co[node->d] - range > node->co[node->d]) {
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
-		}
-		else {
-			dist_sq = squared_distance(node->co, co, nor);
-			if (dist_sq <= range_sq) {
-				add_in_range(&foundstack, &totfoundstack, found++, node->index, dist_sq, node->co);
-			}
+		if (KD_NODE_IS_LEAF(node)) {
+			for (i = node->start; i < node->start + node->tot; i++) {
+				const KDTreePoint *point = &tree->points[i];
 
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
+				dist_sq = squared_distance(point->co, co, nor);
+				if (dist_sq <= range_sq) {
+					add_in_range(&foundstack, &totfoundstack, found++, point->index, dist_sq, point->co);
+				}
+			}
 		}
-
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
+		else {
+			cur = kdtree_stack_push_children_in_range(node, co, range, stack, cur);
 		}
 	}
 
-	if (stack != defaultstack)
-		MEM_freeN(stack);
-
 	if (found)
 		qsort(foundstack, found, sizeof(KDTreeNearest), range_compare);
 
@@ -624,9 +827,9 @@ void BLI_kdtree_range_search_cb(
 {
 	const KDTreeNode *nodes = tree->nodes;
 
-	unsigned int *stack, defaultstack[KD_STACK_INIT];
+	unsigned int stack[KD_STACK_SIZE];
 	float range_sq = range * range, dist_sq;
-	unsigned int totstack, cur = 0;
+	unsigned int cur = 0, i;
 
 #ifdef DEBUG
 	BLI_assert(tree->is_balanced == true);
@@ -635,42 +838,25 @@ void BLI_kdtree_range_search_cb(
 	if (UNLIKELY(tree->root == KD_NODE_UNSET))
 		return;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
-
 	stack[cur++] = tree->root;
 
 	while (cur--) {
 		const KDTreeNode *node = &nodes[stack[cur]];
 
-		if (co[node->d] + range < node->co[node->d]) {
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-		}
-		else if (co[node->d] - range > node->co[node->d]) {
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
-		}
-		else {
-			dist_sq = len_squared_v3v3(node->co, co);
-			if (dist_sq <= range_sq) {
-				if (search_cb(user_data, node->index, node->co, dist_sq) == false) {
-					goto finally;
+		if (KD_NODE_IS_LEAF(node)) {
+			for (i = node->start; i < node->start + node->tot; i++) {
+				const KDTreePoint *point = &tree->points[i];
+
+				dist_sq = len_squared_v3v3(point->co, co);
+				if (dist_sq <= range_sq) {
+					if (search_cb(user_data, point->index, point->co, dist_sq) == false) {
+						return;
+					}
 				}
 			}
-
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
 		}
-
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
+		else {
+			cur = kdtree_stack_push_children_in_range(node, co, range, stack, cur);
 		}
 	}
-
-finally:
-	if (stack != defaultstack)
-		MEM_freeN(stack);
 }
@@ -139,6 +139,35 @@ struct TaskPool {
 #endif
 };
 
+/* Per-worker queue of tasks.
+ *
+ * Every worker thread owns one queue and pops tasks from it first. Once its
+ * own queue is exhausted the worker tries to steal tasks from the queues of
+ * other workers, so no single lock is shared by all threads of the scheduler.
+ *
+ * The owner pops from the head, where tasks it pushes itself are added with
+ * high priority, so it runs the task it spawned last while its data is still
+ * in the cache. Other workers steal from the tail, taking the oldest tasks.
+ * Tasks pushed from outside of the workers go to an extra queue which every
+ * worker checks before stealing, so they keep their order.
+ *
+ * Each queue is protected by its own spin lock, which is only contended when
+ * somebody steals from it or pushes to it from another thread. The queue can
+ * not be a pure lock-free deque since pools need to find and remove their own
+ * tasks from the middle of it (see BLI_task_pool_work_and_wait() and
+ * task_scheduler_clear()).
+ */
+typedef struct TaskQueue {
+	ListBase list;
+	SpinLock lock;
+	/* Number of tasks in the list, allows to skip empty queues without
+	 * locking them. */
+	volatile int num_tasks;
+	/* Number of tasks from background pools, allows the background-only
+	 * worker to skip queues which have nothing to do for it. */
+	volatile int num_background_tasks;
+} TaskQueue;
+
 struct TaskScheduler {
 	pthread_t *threads;
 	struct TaskThread *task_threads;
@@ -146,9 +175,19 @@ struct TaskScheduler {
 	int num_threads;
 	bool background_thread_only;
 
-	ListBase queue;
-	ThreadMutex queue_mutex;
-	ThreadCondition queue_cond;
+	/* Queue of every worker thread, indexed by thread_id - 1, followed by the
+	 * queue of tasks pushed from outside of the worker threads. With a global
+	 * queue there is only the latter. */
+	TaskQueue *queues;
+	int num_queues;
+
+	/* Workers which did not find any task sleep on this condition until
+	 * new tasks are pushed. */
+	ThreadMutex sleep_mutex;
+	ThreadCondition sleep_cond;
+	unsigned int num_sleeping;
+	/* Incremented on every push, used to avoid lost wake-ups. */
+	unsigned int push_epoch;
 
 	volatile bool do_exit;
 };
@@ -228,7 +267,7 @@ static void task_free(TaskPool *pool, Task *task, const int thread_id)
 	}
 }
 
-/* Task Scheduler */
+/* Task Pool Counters */
 
 static void task_pool_num_decrease(TaskPool *pool, size_t done)
 {
@@ -237,7 +276,9 @@ static void task_pool_num_decrease(TaskPool *pool, size_t done)
 	BLI_assert(pool->num >= done);
 
 	pool->num -= done;
-	atomic_sub_and_fetch_z(&pool->currently_running_tasks, done);
+	if (pool->num_threads != 0) {
+		atomic_sub_and_fetch_z(&pool->currently_running_tasks, done);
+	}
 	pool->done += done;
 
 	if (pool->num == 0)
@@ -256,61 +297,191 @@ static void task_pool_num_increase(TaskPool *pool)
 	BLI_mutex_unlock(&pool->num_mutex);
 }
 
-static bool task_scheduler_thread_wait_pop(TaskScheduler *scheduler, Task **task)
+/* Queue */
+
+static void task_queue_push(TaskQueue *queue, Task *task, TaskPriority priority)
 {
-	bool found_task = false;
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	BLI_spin_lock(&queue->lock);
+
+	if (priority == TASK_PRIORITY_HIGH)
+		BLI_addhead(&queue->list, task);
+	else
+		BLI_addtail(&queue->list, task);
+	queue->num_tasks++;
+	if (task->pool->run_in_background) {
+		queue->num_background_tasks++;
+	}
 
-	while (!scheduler->queue.first && !scheduler->do_exit)
-		BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
+	BLI_spin_unlock(&queue->lock);
+}
 
-	do {
-		Task *current_task;
+/* Check whether the worker may run a task of the pool, respecting pool's
+ * threads limit. Running tasks are only counted for pools with a limit. */
+BLI_INLINE bool task_pool_try_acquire(TaskScheduler *scheduler, TaskPool *pool)
+{
+	if (scheduler->background_thread_only && !pool->run_in_background) {
+		return false;
+	}
+	if (pool->num_threads == 0) {
+		return true;
+	}
+	if (atomic_add_and_fetch_z(&pool->currently_running_tasks, 1) <= pool->num_threads) {
+		return true;
+	}
+	atomic_sub_and_fetch_z(&pool->currently_running_tasks, 1);
+	return false;
+}
 
-		/* Assuming we can only have a void queue in 'exit' case here seems logical (we should only be here after
-		 * our worker thread has been woken up from a condition_wait(), which only happens after a new task was
-		 * added to the queue), but it is wrong.
-		 * Waiting on condition may wake up the thread even if condition is not signaled (spurious wake-ups), and some
-		 * race condition may also empty the queue **after** condition has been signaled, but **before** awoken thread
-		 * reaches this point...
-		 * See http://stackoverflow.com/questions/8594591
-		 *
-		 * So we only abort here if do_exit is set.
-		 */
-		if (scheduler->do_exit) {
-			BLI_mutex_unlock(&scheduler->queue_mutex);
-			return false;
+/* Pop a task from the queue which is allowed to be run by the worker thread,
+ * from the head for the owner of the queue and from the tail when stealing. */
+static bool task_queue_pop(TaskScheduler *scheduler, TaskQueue *queue, const bool steal, Task **task)
+{
+	Task *current_task;
+
+	if (queue->num_tasks == 0) {
+		return false;
+	}
+	if (scheduler->background_thread_only && queue->num_background_tasks == 0) {
+		return false;
+	}
+
+	BLI_spin_lock(&queue->lock);
+
+	current_task = steal ? queue->list.last : queue->list.first;
+
+	/* Only look further when the first task can not be run, which only happens
+	 * for pools with a threads limit or for the background-only worker. */
+	while (current_task != NULL && !task_pool_try_acquire(scheduler, current_task->pool)) {
+		current_task = steal ? current_task->prev : current_task->next;
+	}
+
+	if (current_task != NULL) {
+		BLI_remlink(&queue->list, current_task);
+		queue->num_tasks--;
+		if (current_task->pool->run_in_background) {
+			queue->num_background_tasks--;
 		}
+	}
 
-		for (current_task = scheduler->queue.first;
-		     current_task != NULL;
-		     current_task = current_task->next)
-		{
-			TaskPool *pool = current_task->pool;
+	BLI_spin_unlock(&queue->lock);
 
-			if (scheduler->background_thread_only && !pool->run_in_background) {
-				continue;
-			}
+	*task = current_task;
+	return (current_task != NULL);
+}
 
-			if (atomic_add_and_fetch_z(&pool->currently_running_tasks, 1) <= pool->num_threads ||
-			    pool->num_threads == 0)
-			{
-				*task = current_task;
-				found_task = true;
-				BLI_remlink(&scheduler->queue, *task);
-				break;
+/* Pop first task of the given pool from the queue. */
+static bool task_queue_pop_pool(TaskQueue *queue, TaskPool *pool, Task **task)
+{
+	Task *current_task;
+	bool found_task = false;
+
+	if (queue->num_tasks == 0) {
+		return false;
+	}
+
+	BLI_spin_lock(&queue->lock);
+
+	for (current_task = queue->list.first;
+	     current_task != NULL;
+	     current_task = current_task->next)
+	{
+		if (current_task->pool == pool) {
+			*task = current_task;
+			found_task = true;
+			BLI_remlink(&queue->list, current_task);
+			queue->num_tasks--;
+			if (current_task->pool->run_in_background) {
+				queue->num_background_tasks--;
 			}
-			else {
-				atomic_sub_and_fetch_z(&pool->currently_running_tasks, 1);
+			break;
+		}
+	}
+
+	BLI_spin_unlock(&queue->lock);
+
+	return found_task;
+}
+
+/* Remove all tasks of the given pool from the queue, returns number of removed tasks. */
+static size_t task_queue_clear_pool(TaskQueue *queue, TaskPool *pool)
+{
+	Task *task, *nexttask;
+	size_t done = 0;
+
+	if (queue->num_tasks == 0) {
+		return 0;
+	}
+
+	BLI_spin_lock(&queue->lock);
+
+	for (task = queue->list.first; task; task = nexttask) {
+		nexttask = task->next;
+
+		if (task->pool == pool) {
+			task_data_free(task, 0);
+			BLI_freelinkN(&queue->list, task);
+			queue->num_tasks--;
+			if (pool->run_in_background) {
+				queue->num_background_tasks--;
 			}
+
+			done++;
+		}
+	}
+
+	BLI_spin_unlock(&queue->lock);
+
+	return done;
+}
+
+/* Task Scheduler */
+
+static bool task_scheduler_thread_wait_pop(TaskScheduler *scheduler, const int thread_id, Task **task)
+{
+	const int num_worker_queues = scheduler->num_queues - 1;
+	TaskQueue *shared_queue = &scheduler->queues[num_worker_queues];
+
+	while (true) {
+		/* Remember the push counter before looking into the queues, so we know
+		 * whether new tasks arrived while we were searching. */
+		const unsigned int push_epoch = atomic_add_and_fetch_u(&scheduler->push_epoch, 0);
+		int i;
+
+		if (scheduler->do_exit) {
+			return false;
 		}
-		if (!found_task)
-			BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
-	} while (!found_task);
 
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+		/* Own queue first, then tasks pushed from outside of the workers, then
+		 * try to steal from other workers. */
+		if (num_worker_queues != 0 &&
+		    task_queue_pop(scheduler, &scheduler->queues[thread_id - 1], false, task))
+		{
+			return true;
+		}
+		if (task_queue_pop(scheduler, shared_queue, false, task)) {
+			return true;
+		}
+		for (i = 1; i < num_worker_queues; i++) {
+			TaskQueue *queue = &scheduler->queues[(thread_id - 1 + i) % num_worker_queues];
+			if (task_queue_pop(scheduler, queue, true, task)) {
+				return true;
+			}
+		}
 
-	return true;
+		/* Nothing to do, wait for new tasks.
+		 *
+		 * Waiting on condition may wake up the thread even if condition is not signaled (spurious wake-ups),
+		 * so we simply go for another round of searching for a task after waking up.
+		 * See http://stackoverflow.com/questions/8594591
+		 */
+		BLI_mutex_lock(&scheduler->sleep_mutex);
+		atomic_add_and_fetch_u(&scheduler->num_sleeping, 1);
+		if (!scheduler->do_exit && atomic_add_and_fetch_u(&scheduler->push_epoch, 0) == push_epoch) {
+			BLI_condition_wait(&scheduler->sleep_cond, &scheduler->sleep_mutex);
+		}
+		atomic_sub_and_fetch_u(&scheduler->num_sleeping, 1);
+		BLI_mutex_unlock(&scheduler->sleep_mutex);
+	}
 }
 
 static void *task_scheduler_thread_run(void *thread_p)
@@ -321,7 +492,7 @@ static void *task_scheduler_thread_run(void *thread_p)
 	Task *task;
 
 	/* keep popping off tasks */
-	while (task_scheduler_thread_wait_pop(scheduler, &task)) {
+	while (task_scheduler_thread_wait_pop(scheduler, thread_id, &task)) {
 		TaskPool *pool = task->pool;
 
 		/* run task */
@@ -337,7 +508,11 @@ static void *task_scheduler_thread_run(void *thread_p)
 	return NULL;
 }
 
-TaskScheduler *BLI_task_scheduler_create(int num_threads)
+/**
+ * Create a scheduler, with \a use_global_queue all workers share a single queue instead
+ * of stealing from each other, which is only meant for comparing performance.
+ */
+TaskScheduler *BLI_task_scheduler_create_ex(int num_threads, const bool use_global_queue)
 {
 	TaskScheduler *scheduler = MEM_callocN(sizeof(TaskScheduler), "TaskScheduler");
 
@@ -345,9 +520,8 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 	 * threads, so we keep track of the number of users. */
 	scheduler->do_exit = false;
 
-	BLI_listbase_clear(&scheduler->queue);
-	BLI_mutex_init(&scheduler->queue_mutex);
-	BLI_condition_init(&scheduler->queue_cond);
+	BLI_mutex_init(&scheduler->sleep_mutex);
+	BLI_condition_init(&scheduler->sleep_cond);
 
 	if (num_threads == 0) {
 		/* automatic number of threads will be main thread + num cores */
@@ -371,6 +545,13 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 		scheduler->threads = MEM_callocN(sizeof(pthread_t) * num_threads, "TaskScheduler threads");
 		scheduler->task_threads = MEM_callocN(sizeof(TaskThread) * num_threads, "TaskScheduler task threads");
 
+		scheduler->num_queues = use_global_queue ? 1 : num_threads + 1;
+		scheduler->queues = MEM_callocN(sizeof(TaskQueue) * scheduler->num_queues, "TaskScheduler queues");
+
+		for (i = 0; i < scheduler->num_queues; i++) {
+			BLI_spin_init(&scheduler->queues[i].lock);
+		}
+
 		for (i = 0; i < num_threads; i++) {
 			TaskThread *thread = &scheduler->task_threads[i];
 			thread->scheduler = scheduler;
@@ -388,15 +569,20 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 	return scheduler;
 }
 
+TaskScheduler *BLI_task_scheduler_create(int num_threads)
+{
+	return BLI_task_scheduler_create_ex(num_threads, false);
+}
+
 void BLI_task_scheduler_free(TaskScheduler *scheduler)
 {
 	Task *task;
 
 	/* stop all waiting threads */
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	BLI_mutex_lock(&scheduler->sleep_mutex);
 	scheduler->do_exit = true;
-	BLI_condition_notify_all(&scheduler->queue_cond);
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+	BLI_condition_notify_all(&scheduler->sleep_cond);
+	BLI_mutex_unlock(&scheduler->sleep_mutex);
 
 	/* delete threads */
 	if (scheduler->threads) {
@@ -426,14 +612,23 @@ void BLI_task_scheduler_free(TaskScheduler *scheduler)
 	}
 
 	/* delete leftover tasks */
-	for (task = scheduler->queue.first; task; task = task->next) {
-		task_data_free(task, 0);
+	if (scheduler->queues) {
+		int i;
+
+		for (i = 0; i < scheduler->num_queues; i++) {
+			TaskQueue *queue = &scheduler->queues[i];
+			for (task = queue->list.first; task; task = task->next) {
+				task_data_free(task, 0);
+			}
+			BLI_freelistN(&queue->list);
+			BLI_spin_end(&queue->lock);
+		}
+		MEM_freeN(scheduler->queues);
 	}
-	BLI_freelistN(&scheduler->queue);
 
 	/* delete mutex/condition */
-	BLI_mutex_end(&scheduler->queue_mutex);
-	BLI_condition_end(&scheduler->queue_cond);
+	BLI_mutex_end(&scheduler->sleep_mutex);
+	BLI_condition_end(&scheduler->sleep_cond);
 
 	MEM_freeN(scheduler);
 }
@@ -443,43 +638,44 @@ int BLI_task_scheduler_num_threads(TaskScheduler *scheduler)
 	return scheduler->num_threads + 1;
 }
 
-static void task_scheduler_push(TaskScheduler *scheduler, Task *task, TaskPriority priority)
+static void task_scheduler_push(TaskScheduler *scheduler, Task *task, TaskPriority priority, int thread_id)
 {
-	task_pool_num_increase(task->pool);
+	TaskQueue *queue;
 
-	/* add task to queue */
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	task_pool_num_increase(task->pool);
 
-	if (priority == TASK_PRIORITY_HIGH)
-		BLI_addhead(&scheduler->queue, task);
-	else
-		BLI_addtail(&scheduler->queue, task);
+	/* Tasks pushed from a worker go to its own queue, keeping them hot in the
+	 * cache of that worker. Tasks pushed from other threads go to the shared
+	 * queue, which all workers check before stealing. */
+	if (scheduler->num_queues > 1 && thread_id >= 1 && thread_id <= scheduler->num_threads) {
+		queue = &scheduler->queues[thread_id - 1];
+	}
+	else {
+		queue = &scheduler->queues[scheduler->num_queues - 1];
+	}
 
-	BLI_condition_notify_one(&scheduler->queue_cond);
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+	/* add task to queue */
+	task_queue_push(queue, task, priority);
+
+	/* wake up a sleeping worker */
+	atomic_add_and_fetch_u(&scheduler->push_epoch, 1);
+	if (atomic_add_and_fetch_u(&scheduler->num_sleeping, 0) != 0) {
+		BLI_mutex_lock(&scheduler->sleep_mutex);
+		BLI_condition_notify_one(&scheduler->sleep_cond);
+		BLI_mutex_unlock(&scheduler->sleep_mutex);
+	}
 }
 
 static void task_scheduler_clear(TaskScheduler *scheduler, TaskPool *pool)
 {
-	Task *task, *nexttask;
 	size_t done = 0;
+	int i;
 
-	BLI_mutex_lock(&scheduler->queue_mutex);
-
-	/* free all tasks from this pool from the queue */
-	for (task = scheduler->queue.first; task; task = nexttask) {
-		nexttask = task->next;
-
-		if (task->pool == pool) {
-			task_data_free(task, 0);
-			BLI_freelinkN(&scheduler->queue, task);
-
-			done++;
-		}
+	/* free all tasks from this pool from the queues */
+	for (i = 0; i < scheduler->num_queues; i++) {
+		done += task_queue_clear_pool(&scheduler->queues[i], pool);
 	}
 
-	BLI_mutex_unlock(&scheduler->queue_mutex);
-
 	/* notify done */
 	task_pool_num_decrease(pool, done);
 }
@@ -612,7 +808,7 @@ static void task_pool_push(
 	task->freedata = freedata;
 	task->pool = pool;
 
-	task_scheduler_push(pool->scheduler, task, priority);
+	task_scheduler_push(pool->scheduler, task, priority, thread_id);
 }
 
 void BLI_task_pool_push_ex(
@@ -641,39 +837,37 @@ void BLI_task_pool_work_and_wait(TaskPool *pool)
 	BLI_mutex_lock(&pool->num_mutex);
 
 	while (pool->num != 0) {
-		Task *task, *work_task = NULL;
+		Task *work_task = NULL;
 		bool found_task = false;
+		int i;
 
 		BLI_mutex_unlock(&pool->num_mutex);
 
-		BLI_mutex_lock(&scheduler->queue_mutex);
-
 		/* find task from this pool. if we get a task from another pool,
 		 * we can get into deadlock */
 
 		if (pool->num_threads == 0 ||
 		    pool->currently_running_tasks < pool->num_threads)
 		{
-			for (task = scheduler->queue.first; task; task = task->next) {
-				if (task->pool == pool) {
-					work_task = task;
+			/* shared queue first, where tasks pushed from this thread are */
+			for (i = scheduler->num_queues - 1; i >= 0; i--) {
+				if (task_queue_pop_pool(&scheduler->queues[i], pool, &work_task)) {
 					found_task = true;
-					BLI_remlink(&scheduler->queue, task);
 					break;
 				}
 			}
 		}
 
-		BLI_mutex_unlock(&scheduler->queue_mutex);
-
 		/* if found task, do it, otherwise wait until other tasks are done */
 		if (found_task) {
 			/* run task */
-			atomic_add_and_fetch_z(&pool->currently_running_tasks, 1);
+			if (pool->num_threads != 0) {
+				atomic_add_and_fetch_z(&pool->currently_running_tasks, 1);
+			}
 			work_task->run(pool, work_task->taskdata, 0);
 
 			/* delete task */
-			task_free(pool, task, 0);
+			task_free(pool, work_task, 0);
 
 			/* notify pool task was done */
 			task_pool_num_decrease(pool, 1);
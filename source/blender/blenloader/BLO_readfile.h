@@ -106,6 +106,11 @@ void BLO_library_link_end(struct Main *mainl, BlendHandle **bh, short flag, stru
 
 void BLO_library_link_copypaste(struct Main *mainl, BlendHandle *bh);
 
+void BLO_library_deferred_loading_set(const bool use_deferred_loading);
+bool BLO_library_deferred_loading_get(void);
+int BLO_library_deferred_load_tagged(struct Main *bmain, const short tag, struct ReportList *reports);
+void BLO_library_deferred_print(struct Main *bmain);
+
 void *BLO_library_read_struct(struct FileData *fd, struct BHead *bh, const char *blockname);
 
 BlendFileData *blo_read_blendafterruntime(int file, const char *name, int actualsize, struct ReportList *reports);
@@ -45,6 +45,8 @@
 #include "BLI_utildefines.h"
 #ifndef WIN32
 #  include <unistd.h> // for read close
+#  include <sys/mman.h> // for mmap
+#  include <sys/stat.h> // for fstat
 #else
 #  include <io.h> // for open close read
 #  include "winsock2.h"
@@ -107,8 +109,12 @@
 #include "BLI_endian_switch.h"
 #include "BLI_blenlib.h"
 #include "BLI_math.h"
+#include "BLI_task.h"
 #include "BLI_threads.h"
 #include "BLI_mempool.h"
+#include "BLI_linklist.h"
+
+#include "PIL_time.h"
 
 #include "BLT_translation.h"
 
@@ -128,6 +134,7 @@
 #include "BKE_library.h" // for which_libbase
 #include "BKE_library_idmap.h"
 #include "BKE_library_query.h"
+#include "BKE_library_remap.h"
 #include "BKE_idcode.h"
 #include "BKE_material.h"
 #include "BKE_main.h" // for Main
@@ -780,13 +787,28 @@ static BHeadN *get_bhead(FileData *fd)
 			/* bhead now contains the (converted) bhead structure. Now read
 			 * the associated data and put everything in a BHeadN (creative naming !)
 			 */
-			if (!fd->eof) {
+			if (!fd->eof && (fd->flags & FD_FLAGS_USE_MMAP)) {
+				/* no need to read, reference the data in the mapping */
+				if ((size_t)bhead.len <= fd->mmap_size - fd->mmap_seek) {
+					new_bhead = MEM_mallocN(sizeof(BHeadN), "new_bhead");
+					new_bhead->next = new_bhead->prev = NULL;
+					new_bhead->data = fd->mmap_data + fd->mmap_seek;
+					new_bhead->bhead = bhead;
+
+					fd->mmap_seek += (size_t)bhead.len;
+				}
+				else {
+					fd->eof = 1;
+				}
+			}
+			else if (!fd->eof) {
 				new_bhead = MEM_mallocN(sizeof(BHeadN) + bhead.len, "new_bhead");
 				if (new_bhead) {
 					new_bhead->next = new_bhead->prev = NULL;
+					new_bhead->data = new_bhead + 1;
 					new_bhead->bhead = bhead;
 					
-					readsize = fd->read(fd, new_bhead + 1, bhead.len);
+					readsize = fd->read(fd, new_bhead->data, bhead.len);
 					
 					if (readsize != bhead.len) {
 						fd->eof = 1;
@@ -833,7 +855,7 @@ BHead *blo_firstbhead(FileData *fd)
 
 BHead *blo_prevbhead(FileData *UNUSED(fd), BHead *thisblock)
 {
-	BHeadN *bheadn = (BHeadN *)POINTER_OFFSET(thisblock, -offsetof(BHeadN, bhead));
+	BHeadN *bheadn = BHEADN_FROM_BHEAD(thisblock);
 	BHeadN *prev = bheadn->prev;
 	
 	return (prev) ? &prev->bhead : NULL;
@@ -847,7 +869,7 @@ BHead *blo_nextbhead(FileData *fd, BHead *thisblock)
 	if (thisblock) {
 		/* bhead is actually a sub part of BHeadN
 		 * We calculate the BHeadN pointer from the BHead pointer below */
-		new_bhead = (BHeadN *)POINTER_OFFSET(thisblock, -offsetof(BHeadN, bhead));
+		new_bhead = BHEADN_FROM_BHEAD(thisblock);
 		
 		/* get the next BHeadN. If it doesn't exist we read in the next one */
 		new_bhead = new_bhead->next;
@@ -865,10 +887,16 @@ BHead *blo_nextbhead(FileData *fd, BHead *thisblock)
 	return(bhead);
 }
 
+/* Data of the block, don't assume it follows the BHead in memory. */
+void *blo_bhead_data(const BHead *bhead)
+{
+	return BHEADN_FROM_BHEAD(bhead)->data;
+}
+
 /* Warning! Caller's responsability to ensure given bhead **is** and ID one! */
 const char *bhead_id_name(const FileData *fd, const BHead *bhead)
 {
-	return (const char *)POINTER_OFFSET(bhead, sizeof(*bhead) + fd->id_name_offs);
+	return (const char *)POINTER_OFFSET(blo_bhead_data(bhead), fd->id_name_offs);
 }
 
 static void decode_blender_header(FileData *fd)
@@ -922,10 +950,10 @@ static bool read_file_dna(FileData *fd, const char **r_error_message)
 		if (bhead->code == DNA1) {
 			const bool do_endian_swap = (fd->flags & FD_FLAGS_SWITCH_ENDIAN) != 0;
 			
-			fd->filesdna = DNA_sdna_from_data(&bhead[1], bhead->len, do_endian_swap, true, r_error_message);
+			fd->filesdna = DNA_sdna_from_data(blo_bhead_data(bhead), bhead->len, do_endian_swap, true, r_error_message);
 			if (fd->filesdna) {
 				fd->compflags = DNA_struct_get_compareflags(fd->filesdna, fd->memsdna);
-				/* used to retrieve ID names from (bhead+1) */
+				/* used to retrieve ID names from block data */
 				fd->id_name_offs = DNA_elem_offset(fd->filesdna, "ID", "char", "name[]");
 
 				return true;
@@ -951,7 +979,7 @@ static int *read_file_thumbnail(FileData *fd)
 	for (bhead = blo_firstbhead(fd); bhead; bhead = blo_nextbhead(fd, bhead)) {
 		if (bhead->code == TEST) {
 			const bool do_endian_swap = (fd->flags & FD_FLAGS_SWITCH_ENDIAN) != 0;
-			int *data = (int *)(bhead + 1);
+			int *data = blo_bhead_data(bhead);
 
 			if (bhead->len < (2 * sizeof(int))) {
 				break;
@@ -1017,6 +1045,17 @@ static int fd_read_from_memory(FileData *filedata, void *buffer, unsigned int si
 	return (readsize);
 }
 
+static int fd_read_from_mmap(FileData *filedata, void *buffer, unsigned int size)
+{
+	/* don't read more bytes then there are available in the mapping */
+	size_t readsize = MIN2((size_t)size, filedata->mmap_size - filedata->mmap_seek);
+
+	memcpy(buffer, filedata->mmap_data + filedata->mmap_seek, readsize);
+	filedata->mmap_seek += readsize;
+
+	return (int)readsize;
+}
+
 static int fd_read_from_memfile(FileData *filedata, void *buffer, unsigned int size)
 {
 	static unsigned int seek = (1<<30);	/* the current position */
@@ -1115,11 +1154,229 @@ static FileData *blo_decode_and_check(FileData *fd, ReportList *reports)
 	return fd;
 }
 
+#ifndef WIN32
+
+/* Member of a compressed file written in parallel, see BLEN_GZIP_EXTRA_ID1. */
+typedef struct GzipMember {
+	const unsigned char *data;
+	size_t size;
+	/* Uncompressed data. */
+	size_t offset, len;
+} GzipMember;
+
+typedef struct GzipParallelData {
+	const GzipMember *members;
+	unsigned char *out;
+	bool error;
+} GzipParallelData;
+
+static size_t gzip_load_u32(const unsigned char *data)
+{
+	return (size_t)data[0] | ((size_t)data[1] << 8) | ((size_t)data[2] << 16) | ((size_t)data[3] << 24);
+}
+
+/**
+ * \return false when \a data doesn't start with a gzip member written in parallel.
+ */
+static bool gzip_member_parse(const unsigned char *data, size_t data_len, size_t *r_size, size_t *r_len)
+{
+	if (data_len < BLEN_GZIP_HEADER_SIZE + BLEN_GZIP_TRAILER_SIZE) {
+		return false;
+	}
+
+	/* only FEXTRA flag, so the header size is known */
+	if (data[0] != 0x1f || data[1] != 0x8b || data[2] != Z_DEFLATED || data[3] != 0x04 ||
+	    data[10] != BLEN_GZIP_EXTRA_SIZE || data[11] != 0 ||
+	    data[12] != BLEN_GZIP_EXTRA_ID1 || data[13] != BLEN_GZIP_EXTRA_ID2)
+	{
+		return false;
+	}
+
+	*r_size = gzip_load_u32(&data[16]);
+	*r_len = gzip_load_u32(&data[20]);
+
+	return (*r_size >= BLEN_GZIP_HEADER_SIZE + BLEN_GZIP_TRAILER_SIZE) && (*r_size <= data_len);
+}
+
+static void gzip_member_decompress_cb(void *userdata, const int index)
+{
+	GzipParallelData *data = userdata;
+	const GzipMember *member = &data->members[index];
+	const unsigned char *trailer = member->data + member->size - BLEN_GZIP_TRAILER_SIZE;
+	unsigned char *out = data->out + member->offset;
+	z_stream strm = {NULL};
+	bool ok;
+
+	if (inflateInit2(&strm, -MAX_WBITS) != Z_OK) {
+		data->error = true;
+		return;
+	}
+
+	strm.next_in = (unsigned char *)member->data + BLEN_GZIP_HEADER_SIZE;
+	strm.avail_in = (uInt)(member->size - BLEN_GZIP_HEADER_SIZE - BLEN_GZIP_TRAILER_SIZE);
+	strm.next_out = out;
+	strm.avail_out = (uInt)member->len;
+
+	ok = (inflate(&strm, Z_FINISH) == Z_STREAM_END) && (strm.total_out == member->len);
+	inflateEnd(&strm);
+
+	if (!ok ||
+	    gzip_load_u32(trailer) != crc32(crc32(0L, Z_NULL, 0), out, (uInt)member->len) ||
+	    gzip_load_u32(trailer + 4) != member->len)
+	{
+		data->error = true;
+	}
+}
+
+/**
+ * Decompress files written with parallel compression (see BLEN_GZIP_EXTRA_ID1), members in parallel.
+ *
+ * \return The uncompressed data in an anonymous mapping,
+ * NULL when the file has been compressed differently (or is corrupt).
+ */
+static char *blo_gzip_parallel_decompress(const unsigned char *data, size_t data_len, size_t *r_len)
+{
+	GzipParallelData gzip_data = {NULL};
+	GzipMember *members;
+	size_t pos, member_size, member_len, len = 0;
+	int members_num = 0, i;
+	char *out;
+
+	for (pos = 0; pos < data_len; pos += member_size) {
+		if (!gzip_member_parse(data + pos, data_len - pos, &member_size, &member_len)) {
+			return NULL;
+		}
+		len += member_len;
+		members_num++;
+	}
+
+	if (len == 0) {
+		return NULL;
+	}
+
+	out = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (out == MAP_FAILED) {
+		return NULL;
+	}
+
+	members = MEM_mallocN(sizeof(*members) * (size_t)members_num, __func__);
+	for (pos = 0, len = 0, i = 0; i < members_num; pos += member_size, i++) {
+		gzip_member_parse(data + pos, data_len - pos, &member_size, &member_len);
+		members[i].data = data + pos;
+		members[i].size = member_size;
+		members[i].offset = len;
+		members[i].len = member_len;
+		len += member_len;
+	}
+
+	gzip_data.members = members;
+	gzip_data.out = (unsigned char *)out;
+	BLI_task_parallel_range(0, members_num, &gzip_data, gzip_member_decompress_cb, members_num > 1);
+
+	MEM_freeN(members);
+
+	if (gzip_data.error) {
+		munmap(out, len);
+		return NULL;
+	}
+
+	*r_len = len;
+	return out;
+}
+
+#endif  /* WIN32 */
+
+/**
+ * Memory map uncompressed files, so block data doesn't have to be read & copied,
+ * only the blocks actually accessed are loaded from disk (useful when linking from big libraries).
+ *
+ * Compressed files written in parallel are decompressed in parallel too, into anonymous memory
+ * used in the same way.
+ *
+ * \return NULL when the file is compressed otherwise or can't be mapped, regular reading is used then.
+ */
+static FileData *blo_openblenderfile_mmap(const char *filepath)
+{
+#ifdef WIN32
+	UNUSED_VARS(filepath);
+	return NULL;
+#else
+	struct stat st;
+	char *data;
+	size_t data_len;
+	int file;
+
+	/* avoid running out of address space with big files */
+	if (sizeof(void *) < 8) {
+		return NULL;
+	}
+
+	file = BLI_open(filepath, O_BINARY | O_RDONLY, 0);
+	if (file == -1) {
+		return NULL;
+	}
+
+	if (fstat(file, &st) == -1 || st.st_size < SIZEOFBLENDERHEADER) {
+		close(file);
+		return NULL;
+	}
+
+	/* private & writable, so in-place changes (endian switching) never reach the file */
+	data_len = (size_t)st.st_size;
+	data = mmap(NULL, data_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+
+	/* gzip compressed files don't start with the header */
+	if (!STREQLEN(data, "BLENDER", 7)) {
+		size_t data_uncompressed_len;
+		char *data_uncompressed = blo_gzip_parallel_decompress(
+		        (const unsigned char *)data, data_len, &data_uncompressed_len);
+
+		munmap(data, data_len);
+
+		if (data_uncompressed == NULL) {
+			return NULL;
+		}
+
+		data = data_uncompressed;
+		data_len = data_uncompressed_len;
+	}
+
+	if (data_len < SIZEOFBLENDERHEADER || !STREQLEN(data, "BLENDER", 7)) {
+		munmap(data, data_len);
+		return NULL;
+	}
+	else {
+		FileData *fd = filedata_new();
+		fd->mmap_data = data;
+		fd->mmap_size = data_len;
+		fd->read = fd_read_from_mmap;
+		fd->flags |= FD_FLAGS_USE_MMAP;
+
+		return fd;
+	}
+#endif
+}
+
 /* cannot be called with relative paths anymore! */
 /* on each new library added, it now checks for the current FileData and expands relativeness */
 FileData *blo_openblenderfile(const char *filepath, ReportList *reports)
 {
 	gzFile gzfile;
+	FileData *fd;
+
+	fd = blo_openblenderfile_mmap(filepath);
+	if (fd) {
+		/* needed for library_append and read_libraries */
+		BLI_strncpy(fd->relabase, filepath, sizeof(fd->relabase));
+
+		return blo_decode_and_check(fd, reports);
+	}
+
 	errno = 0;
 	gzfile = BLI_gzopen(filepath, "rb");
 	
@@ -1129,7 +1386,7 @@ FileData *blo_openblenderfile(const char *filepath, ReportList *reports)
 		return NULL;
 	}
 	else {
-		FileData *fd = filedata_new();
+		fd = filedata_new();
 		fd->gzfiledes = gzfile;
 		fd->read = fd_read_gzip_from_file;
 		
@@ -1279,6 +1536,12 @@ void blo_freefiledata(FileData *fd)
 		// Free all BHeadN data blocks
 		BLI_freelistN(&fd->listbase);
 
+#ifndef WIN32
+		if (fd->mmap_data) {
+			munmap(fd->mmap_data, fd->mmap_size);
+		}
+#endif
+
 		if (fd->filesdna)
 			DNA_sdna_free(fd->filesdna);
 		if (fd->compflags)
@@ -1856,7 +2119,7 @@ static void switch_endian_structs(const struct SDNA *filesdna, BHead *bhead)
 	int blocksize, nblocks;
 	char *data;
 	
-	data = (char *)(bhead+1);
+	data = blo_bhead_data(bhead);
 	blocksize = filesdna->typelens[ filesdna->structs[bhead->SDNAnr][0] ];
 	
 	nblocks = bhead->nr;
@@ -1878,12 +2141,12 @@ static void *read_struct(FileData *fd, BHead *bh, const char *blockname)
 		
 		if (fd->compflags[bh->SDNAnr] != SDNA_CMP_REMOVED) {
 			if (fd->compflags[bh->SDNAnr] == SDNA_CMP_NOT_EQUAL) {
-				temp = DNA_struct_reconstruct(fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, (bh+1));
+				temp = DNA_struct_reconstruct(fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, blo_bhead_data(bh));
 			}
 			else {
 				/* SDNA_CMP_EQUAL */
 				temp = MEM_mallocN(bh->len, blockname);
-				memcpy(temp, (bh+1), bh->len);
+				memcpy(temp, blo_bhead_data(bh), bh->len);
 			}
 		}
 	}
@@ -7285,6 +7548,7 @@ static void direct_link_library(FileData *fd, Library *lib, Main *main)
 //	printf("direct_link_library: filepath %s\n", lib->filepath);
 	
 	lib->packedfile = direct_link_packedfile(fd, lib->packedfile);
+	lib->deferred_ids = NULL;
 	
 	/* new main */
 	newmain = BKE_main_new();
@@ -8502,6 +8766,8 @@ static BHead *read_userdef(BlendFileData *bfd, FileData *fd, BHead *bhead)
 
 BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 {
+	const double time_start = PIL_check_seconds_timer();
+	double time_read, time_versioning;
 	BHead *bhead = blo_firstbhead(fd);
 	BlendFileData *bfd;
 	ListBase mainlist = {NULL, NULL};
@@ -8567,12 +8833,16 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 		}
 	}
 	
+	time_read = PIL_check_seconds_timer();
+	
 	/* do before read_libraries, but skip undo case */
 	if (fd->memfile == NULL) {
 		do_versions(fd, NULL, bfd->main);
 		do_versions_userdef(fd, bfd);
 	}
 	
+	time_versioning = PIL_check_seconds_timer();
+	
 	read_libraries(fd, &mainlist);
 	
 	blo_join_main(&mainlist);
@@ -8586,6 +8856,12 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 	
 	fd->mainlist = NULL;  /* Safety, this is local variable, shall not be used afterward. */
 
+	if (G.debug & G_DEBUG) {
+		printf("blo_read_file_internal: '%s'%s, read %.4fs, versioning %.4fs, relink %.4fs\n",
+		       filepath, (fd->flags & FD_FLAGS_USE_MMAP) ? " (mapped)" : "",
+		       time_read - time_start, time_versioning - time_read, PIL_check_seconds_timer() - time_versioning);
+	}
+
 	return bfd;
 }
 
@@ -8716,6 +8992,49 @@ static ID *is_yet_read(FileData *fd, Main *mainvar, BHead *bhead)
 	return BLI_findstring(which_libbase(mainvar, GS(idname)), idname, offsetof(ID, name));
 }
 
+static ID *create_placeholder(Main *mainvar, const short idcode, const char *idname, const short tag);
+
+/* Deferred library loading: instead of reading them, only generate an empty place-holder for some linked IDs.
+ * Their real data is read on demand by BLO_library_deferred_load_tagged().
+ * Only meshes for now, an empty mesh being a valid (and cheap) one for all its users. */
+static bool read_libblock_is_deferred(FileData *fd, Main *main, BHead *bhead)
+{
+	return ((fd->flags & FD_FLAGS_DEFER_LIBRARY_IDS) && (main->curlib != NULL) && (bhead->code == ID_ME));
+}
+
+static ID *read_libblock_deferred(FileData *fd, Main *main, BHead *bhead, const short tag)
+{
+	const char *idname = bhead_id_name(fd, bhead);
+	ID *ph_id = create_placeholder(
+	        main, GS(idname), idname + 2, (tag & (LIB_TAG_EXTERN | LIB_TAG_INDIRECT)) | LIB_TAG_DEFERRED);
+
+	/* Keep the material slots count (with empty slots), so that objects using the place-holder
+	 * do not see an inconsistent material array and keep their own materials. */
+	if (GS(idname) == ID_ME) {
+		Mesh *me = read_struct(fd, bhead, "Mesh");
+		Mesh *ph_me = (Mesh *)ph_id;
+
+		if (me) {
+			if (me->totcol > 0) {
+				ph_me->totcol = me->totcol;
+				ph_me->mat = MEM_callocN(sizeof(*ph_me->mat) * (size_t)me->totcol, "ph_me->mat");
+			}
+			MEM_freeN(me);
+		}
+	}
+
+	/* So that lib_link of other datablocks from that library find the place-holder. */
+	oldnewmap_insert(fd->libmap, bhead->old, ph_id, bhead->code);
+
+	/* So that loading its real data later does not have to search the library file for it. */
+	if (main->curlib->deferred_ids == NULL) {
+		main->curlib->deferred_ids = BLI_ghash_ptr_new(__func__);
+	}
+	BLI_ghash_reinsert(main->curlib->deferred_ids, ph_id, (void *)bhead->old, NULL, NULL);
+
+	return ph_id;
+}
+
 static void expand_doit_library(void *fdhandle, Main *mainvar, void *old)
 {
 	BHead *bhead;
@@ -8781,7 +9100,12 @@ static void expand_doit_library(void *fdhandle, Main *mainvar, void *old)
 		else {
 			id = is_yet_read(fd, mainvar, bhead);
 			if (id == NULL) {
-				read_libblock(fd, mainvar, bhead, LIB_TAG_TESTIND, NULL);
+				if (read_libblock_is_deferred(fd, mainvar, bhead)) {
+					read_libblock_deferred(fd, mainvar, bhead, LIB_TAG_INDIRECT);
+				}
+				else {
+					read_libblock(fd, mainvar, bhead, LIB_TAG_TESTIND, NULL);
+				}
 			}
 			else {
 				/* this is actually only needed on UI call? when ID was already read before, and another append
@@ -9846,7 +10170,7 @@ static ID *create_placeholder(Main *mainvar, const short idcode, const char *idn
 	BLI_strncpy(ph_id->name + 2, idname, sizeof(ph_id->name) - 2);
 	BKE_libblock_init_empty(ph_id);
 	ph_id->lib = mainvar->curlib;
-	ph_id->tag = tag | LIB_TAG_MISSING;
+	ph_id->tag = tag;
 	ph_id->us = ID_FAKE_USERS(ph_id);
 	ph_id->icon_id = 0;
 
@@ -9892,7 +10216,8 @@ static ID *link_named_part(
 	}
 	else if (use_placeholders) {
 		/* XXX flag part is weak! */
-		id = create_placeholder(mainl, idcode, name, force_indirect ? LIB_TAG_INDIRECT : LIB_TAG_EXTERN);
+		id = create_placeholder(
+		        mainl, idcode, name, (force_indirect ? LIB_TAG_INDIRECT : LIB_TAG_EXTERN) | LIB_TAG_MISSING);
 	}
 	else {
 		id = NULL;
@@ -10048,7 +10373,13 @@ static void link_id_part(ReportList *reports, FileData *fd, Main *mainvar, ID *i
 		        library_parent_filepath(mainvar->curlib));
 	}
 
-	if (bhead) {
+	if (bhead && read_libblock_is_deferred(fd, mainvar, bhead)) {
+		ID *ph_id = read_libblock_deferred(fd, mainvar, bhead, id->tag);
+		if (r_id) {
+			*r_id = ph_id;
+		}
+	}
+	else if (bhead) {
 		id->tag |= LIB_TAG_NEED_EXPAND;
 		// printf("read lib block %s\n", id->name);
 		read_libblock(fd, mainvar, bhead, id->tag, r_id);
@@ -10064,11 +10395,24 @@ static void link_id_part(ReportList *reports, FileData *fd, Main *mainvar, ID *i
 
 		/* Generate a placeholder for this ID (simplified version of read_libblock actually...). */
 		if (r_id) {
-			*r_id = is_valid ? create_placeholder(mainvar, GS(id->name), id->name + 2, id->tag) : NULL;
+			*r_id = is_valid ? create_placeholder(mainvar, GS(id->name), id->name + 2, id->tag | LIB_TAG_MISSING) : NULL;
 		}
 	}
 }
 
+/* Deferred loading of linked IDs, see read_libblock_is_deferred(). */
+static bool use_deferred_loading = false;
+
+void BLO_library_deferred_loading_set(const bool use_deferred_loading_)
+{
+	use_deferred_loading = use_deferred_loading_;
+}
+
+bool BLO_library_deferred_loading_get(void)
+{
+	return use_deferred_loading;
+}
+
 /* common routine to append/link something from a library */
 
 static Main *library_link_begin(Main *mainvar, FileData **fd, const char *filepath)
@@ -10116,6 +10460,11 @@ static void library_link_end(Main *mainl, FileData **fd, const short flag, Scene
 	Main *mainvar;
 	Library *curlib;
 
+	/* Appended data becomes local, it has to be read completely. */
+	if (use_deferred_loading && (flag & FILE_LINK) && !(*fd)->memfile) {
+		(*fd)->flags |= FD_FLAGS_DEFER_LIBRARY_IDS;
+	}
+
 	/* expander now is callback function */
 	BLO_main_expander(expand_doit_library);
 
@@ -10187,6 +10536,173 @@ void BLO_library_link_end(Main *mainl, BlendHandle **bh, short flag, Scene *scen
 	*bh = (BlendHandle*)fd;
 }
 
+/* Find the real data of a deferred place-holder, from the old address recorded when the place-holder was made. */
+static BHead *library_deferred_find_bhead(FileData *fd, Library *lib, ID *id)
+{
+	void *old = lib->deferred_ids ? BLI_ghash_lookup(lib->deferred_ids, id) : NULL;
+	BHead *bhead = find_bhead(fd, old);
+
+	/* The library file may have been saved again since the place-holder was made. */
+	if (bhead == NULL || bhead->code != GS(id->name) || !STREQ(bhead_id_name(fd, bhead), id->name)) {
+		bhead = find_bhead_from_code_name(fd, GS(id->name), id->name + 2);
+	}
+
+	return bhead;
+}
+
+/* Read the real data of the place-holders \a ids, all from library \a lib, with a single read of the library file. */
+static int library_deferred_load(Main *bmain, Library *lib, LinkNode *ids, ReportList *reports)
+{
+	FileData *fd;
+	Main *mainl;
+	LinkNode *node;
+	ID **new_ids;
+	int i, tot = 0;
+
+	for (node = ids; node; node = node->next) {
+		((ID *)node->link)->tag &= ~LIB_TAG_DEFERRED;
+	}
+
+	fd = blo_openblenderfile(lib->filepath, reports);
+	if (fd == NULL) {
+		for (node = ids; node; node = node->next) {
+			((ID *)node->link)->tag |= LIB_TAG_MISSING;
+		}
+		return 0;
+	}
+	fd->reports = reports;
+
+	/* The place-holders shall not be found by library reading code (they have the same names as their real data). */
+	for (node = ids; node; node = node->next) {
+		ID *id = node->link;
+		BLI_remlink(which_libbase(bmain, GS(id->name)), id);
+	}
+
+	mainl = library_link_begin(bmain, &fd, lib->filepath);
+
+	new_ids = MEM_callocN(sizeof(*new_ids) * (size_t)BLI_linklist_count(ids), __func__);
+
+	for (node = ids, i = 0; node; node = node->next, i++) {
+		ID *id = node->link;
+		BHead *bhead = library_deferred_find_bhead(fd, lib, id);
+
+		if (bhead) {
+			read_libblock(fd, mainl, bhead, (id->tag & (LIB_TAG_EXTERN | LIB_TAG_INDIRECT)) | LIB_TAG_NEED_EXPAND,
+			              &new_ids[i]);
+		}
+		else {
+			blo_reportf_wrap(
+			        reports, RPT_WARNING, TIP_("LIB: %s: '%s' missing from '%s'"),
+			        BKE_idcode_to_name(GS(id->name)), id->name + 2, lib->filepath);
+		}
+	}
+
+	/* Expands and reads what all the new IDs use at once. */
+	library_link_end(mainl, &fd, 0, NULL, NULL);
+	if (fd) {
+		blo_freefiledata(fd);
+	}
+
+	for (node = ids, i = 0; node; node = node->next, i++) {
+		ID *id = node->link;
+		ListBase *lb = which_libbase(bmain, GS(id->name));
+
+		BLI_addtail(lb, id);
+		id_sort_by_name(lb, id);
+
+		if (lib->deferred_ids) {
+			BLI_ghash_remove(lib->deferred_ids, id, NULL, NULL);
+		}
+
+		if (new_ids[i] == NULL) {
+			id->tag |= LIB_TAG_MISSING;
+			continue;
+		}
+
+		BKE_libblock_remap(bmain, id, new_ids[i], ID_REMAP_SKIP_NEVER_NULL_USAGE);
+		if (id->flag & LIB_FAKEUSER) {
+			id_fake_user_clear(id);
+			id_fake_user_set(new_ids[i]);
+		}
+		BKE_libblock_free(bmain, id);
+		tot++;
+	}
+
+	MEM_freeN(new_ids);
+
+	return tot;
+}
+
+/**
+ * Read the real data of the place-holders generated by deferred library loading (tagged with LIB_TAG_DEFERRED)
+ * that are also tagged with \a tag, and replace all usages of the place-holders by it.
+ * The place-holders are freed. Each library file is read only once, for all its tagged place-holders.
+ *
+ * \note Main thread only, dependency graph relations have to be updated afterwards.
+ *
+ * \return The number of IDs read. Place-holders not found in their library are tagged as missing and kept.
+ */
+int BLO_library_deferred_load_tagged(Main *bmain, const short tag, ReportList *reports)
+{
+	ListBase *lbarray[MAX_LIBARRAY];
+	LinkNode *ids = NULL;
+	int a, tot = 0;
+
+	a = set_listbasepointers(bmain, lbarray);
+	while (a--) {
+		ID *id;
+
+		for (id = lbarray[a]->first; id; id = id->next) {
+			if ((id->tag & LIB_TAG_DEFERRED) && (id->tag & tag)) {
+				BLI_linklist_prepend(&ids, id);
+			}
+		}
+	}
+
+	/* One batch per library. */
+	while (ids) {
+		Library *lib = ((ID *)ids->link)->lib;
+		LinkNode *lib_ids = NULL, *other_ids = NULL;
+
+		while (ids) {
+			ID *id = BLI_linklist_pop(&ids);
+			BLI_linklist_prepend((id->lib == lib) ? &lib_ids : &other_ids, id);
+		}
+
+		tot += library_deferred_load(bmain, lib, lib_ids, reports);
+
+		BLI_linklist_free(lib_ids, NULL);
+		ids = other_ids;
+	}
+
+	return tot;
+}
+
+/**
+ * Print the linked IDs which real data was never needed (still tagged with LIB_TAG_DEFERRED).
+ */
+void BLO_library_deferred_print(Main *bmain)
+{
+	ListBase *lbarray[MAX_LIBARRAY];
+	int a, tot = 0;
+
+	a = set_listbasepointers(bmain, lbarray);
+	while (a--) {
+		ID *id;
+
+		for (id = lbarray[a]->first; id; id = id->next) {
+			if (id->tag & LIB_TAG_DEFERRED) {
+				printf("Deferred library data never loaded: %s (%s)\n", id->name, id->lib->filepath);
+				tot++;
+			}
+		}
+	}
+
+	if (tot) {
+		printf("Deferred library loading skipped %d data-block(s)\n", tot);
+	}
+}
+
 void *BLO_library_read_struct(FileData *fd, BHead *bh, const char *blockname)
 {
 	return read_struct(fd, bh, blockname);
@@ -10259,6 +10775,10 @@ static void read_libraries(FileData *basefd, ListBase *mainlist)
 						        mainptr->curlib->name,
 						        library_parent_filepath(mainptr->curlib));
 						fd = blo_openblenderfile(mainptr->curlib->filepath, basefd->reports);
+
+						if (fd && use_deferred_loading) {
+							fd->flags |= FD_FLAGS_DEFER_LIBRARY_IDS;
+						}
 					}
 					/* allow typing in a new lib path */
 					if (G.debug_value == -666) {
@@ -62,6 +62,10 @@ typedef struct FileData {
 	int filedes;
 	gzFile gzfiledes;
 
+	// variables needed for reading from memory mapped file (see FD_FLAGS_USE_MMAP)
+	char *mmap_data;
+	size_t mmap_size, mmap_seek;
+
 	// now only in use for library appending
 	char relabase[FILE_MAX];
 	
@@ -107,9 +111,13 @@ typedef struct FileData {
 
 typedef struct BHeadN {
 	struct BHeadN *next, *prev;
+	/* Block data, right after this struct or directly in the file mapping (see FD_FLAGS_USE_MMAP). */
+	void *data;
 	struct BHead bhead;
 } BHeadN;
 
+#define BHEADN_FROM_BHEAD(bh) ((BHeadN *)POINTER_OFFSET(bh, -offsetof(BHeadN, bhead)))
+
 /* FileData->flags */
 enum {
 	FD_FLAGS_SWITCH_ENDIAN         = 1 << 0,
@@ -118,10 +126,21 @@ enum {
 	FD_FLAGS_FILE_OK               = 1 << 3,
 	FD_FLAGS_NOT_MY_BUFFER         = 1 << 4,
 	FD_FLAGS_NOT_MY_LIBMAP         = 1 << 5,  /* XXX Unused in practice (checked once but never set). */
+	FD_FLAGS_USE_MMAP              = 1 << 6,  /* Uncompressed file, block data is used in-place from the mapping. */
+	FD_FLAGS_DEFER_LIBRARY_IDS     = 1 << 7,  /* Library file, some linked IDs only get a place-holder for now. */
 };
 
 #define SIZEOFBLENDERHEADER 12
 
+/* Compressed files written in parallel are a sequence of gzip members (so still readable with gzread),
+ * each member header has an extra field with the member and uncompressed sizes,
+ * so members can be located and decompressed in parallel too. */
+#define BLEN_GZIP_EXTRA_ID1 'B'
+#define BLEN_GZIP_EXTRA_ID2 'L'
+#define BLEN_GZIP_EXTRA_SIZE 12  /* subfield id (2), length (2), member size (4), uncompressed size (4) */
+#define BLEN_GZIP_HEADER_SIZE (10 + 2 + BLEN_GZIP_EXTRA_SIZE)
+#define BLEN_GZIP_TRAILER_SIZE 8
+
 /***/
 struct Main;
 void blo_join_main(ListBase *mainlist);
@@ -150,6 +169,7 @@ BHead *blo_firstbhead(FileData *fd);
 BHead *blo_nextbhead(FileData *fd, BHead *thisblock);
 BHead *blo_prevbhead(FileData *fd, BHead *thisblock);
 
+void *blo_bhead_data(const BHead *bhead);
 const char *bhead_id_name(const FileData *fd, const BHead *bhead);
 
 /* do versions stuff */
@@ -154,6 +154,8 @@
 #include "BLI_blenlib.h"
 #include "BLI_linklist.h"
 #include "BLI_mempool.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
 
 #include "BKE_action.h"
 #include "BKE_blender_version.h"
@@ -203,6 +205,7 @@
 typedef enum {
 	WW_WRAP_NONE = 1,
 	WW_WRAP_ZLIB,
+	WW_WRAP_ZLIB_PARALLEL,
 } eWriteWrapType;
 
 typedef struct WriteWrap WriteWrap;
@@ -216,6 +219,7 @@ struct WriteWrap {
 	union {
 		int file_handle;
 		gzFile gz_handle;
+		struct ZlibParallel *zlib_parallel;
 	} _user_data;
 };
 
@@ -275,6 +279,212 @@ static size_t ww_write_zlib(WriteWrap *ww, const char *buf, size_t buf_len)
 }
 #undef FILE_HANDLE
 
+/* zlib parallel, data is split in gzip members compressed on the task scheduler,
+ * see BLEN_GZIP_EXTRA_ID1 for the format. */
+#define FILE_HANDLE(ww) \
+	(ww)->_user_data.zlib_parallel
+
+/* Uncompressed size of each gzip member. */
+#define WW_ZLIB_PARALLEL_CHUNK_SIZE (1 << 20)
+
+typedef struct ZlibParallelChunk {
+	unsigned char *in, *out;
+	size_t in_len, out_len;
+	bool error;
+} ZlibParallelChunk;
+
+typedef struct ZlibParallel {
+	int file_handle;
+	/* Chunks are filled in turn, then all compressed at once. */
+	ZlibParallelChunk *chunks;
+	int chunks_num, chunks_used;
+	bool error;
+} ZlibParallel;
+
+static void ww_zlib_parallel_store_u32(unsigned char *data, unsigned int value)
+{
+	data[0] = (unsigned char)(value & 0xff);
+	data[1] = (unsigned char)((value >> 8) & 0xff);
+	data[2] = (unsigned char)((value >> 16) & 0xff);
+	data[3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+static void ww_zlib_parallel_compress_cb(void *userdata, const int index)
+{
+	ZlibParallel *zp = userdata;
+	ZlibParallelChunk *chunk = &zp->chunks[index];
+	unsigned char *header = chunk->out;
+	z_stream strm = {NULL};
+	size_t member_size;
+
+	/* raw deflate, the gzip header & trailer are written here */
+	if (deflateInit2(&strm, 1, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		chunk->error = true;
+		return;
+	}
+
+	strm.next_in = chunk->in;
+	strm.avail_in = (uInt)chunk->in_len;
+	strm.next_out = chunk->out + BLEN_GZIP_HEADER_SIZE;
+	strm.avail_out = (uInt)deflateBound(&strm, (uLong)chunk->in_len);
+
+	if (deflate(&strm, Z_FINISH) != Z_STREAM_END) {
+		deflateEnd(&strm);
+		chunk->error = true;
+		return;
+	}
+	deflateEnd(&strm);
+
+	member_size = BLEN_GZIP_HEADER_SIZE + strm.total_out + BLEN_GZIP_TRAILER_SIZE;
+
+	/* gzip header, with FEXTRA flag, no time stamp, fastest compression, unknown OS */
+	header[0] = 0x1f;
+	header[1] = 0x8b;
+	header[2] = Z_DEFLATED;
+	header[3] = 0x04;
+	memset(&header[4], 0, 4);
+	header[8] = 0x04;
+	header[9] = 0xff;
+	header[10] = BLEN_GZIP_EXTRA_SIZE;
+	header[11] = 0;
+	header[12] = BLEN_GZIP_EXTRA_ID1;
+	header[13] = BLEN_GZIP_EXTRA_ID2;
+	header[14] = BLEN_GZIP_EXTRA_SIZE - 4;
+	header[15] = 0;
+	ww_zlib_parallel_store_u32(&header[16], (unsigned int)member_size);
+	ww_zlib_parallel_store_u32(&header[20], (unsigned int)chunk->in_len);
+
+	/* gzip trailer */
+	ww_zlib_parallel_store_u32(
+	        strm.next_out, (unsigned int)crc32(crc32(0L, Z_NULL, 0), chunk->in, (uInt)chunk->in_len));
+	ww_zlib_parallel_store_u32(strm.next_out + 4, (unsigned int)chunk->in_len);
+
+	chunk->out_len = member_size;
+}
+
+/* write() may write less than asked for (signals, pipes, some file systems), write the rest. */
+static bool ww_zlib_parallel_write_all(int file, const unsigned char *buf, size_t buf_len)
+{
+	while (buf_len != 0) {
+		const ssize_t written = write(file, buf, buf_len);
+
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		else if (written == 0) {
+			return false;
+		}
+
+		buf += written;
+		buf_len -= (size_t)written;
+	}
+
+	return true;
+}
+
+/* Compress all filled chunks and write them in order. */
+static void ww_zlib_parallel_flush(ZlibParallel *zp)
+{
+	int i;
+
+	/* last chunk, partially filled */
+	if ((zp->chunks_used < zp->chunks_num) && (zp->chunks[zp->chunks_used].in_len != 0)) {
+		zp->chunks_used++;
+	}
+
+	BLI_task_parallel_range(0, zp->chunks_used, zp, ww_zlib_parallel_compress_cb, zp->chunks_used > 1);
+
+	for (i = 0; i < zp->chunks_used; i++) {
+		ZlibParallelChunk *chunk = &zp->chunks[i];
+		if (chunk->error || !ww_zlib_parallel_write_all(zp->file_handle, chunk->out, chunk->out_len)) {
+			zp->error = true;
+		}
+		chunk->in_len = chunk->out_len = 0;
+	}
+
+	zp->chunks_used = 0;
+}
+
+static bool ww_open_zlib_parallel(WriteWrap *ww, const char *filepath)
+{
+	ZlibParallel *zp;
+	int file, i;
+
+	file = BLI_open(filepath, O_BINARY + O_WRONLY + O_CREAT + O_TRUNC, 0666);
+
+	if (file == -1) {
+		return false;
+	}
+
+	zp = MEM_callocN(sizeof(*zp), __func__);
+	zp->file_handle = file;
+	/* enough work to keep all threads busy */
+	zp->chunks_num = BLI_system_thread_count() * 2;
+	zp->chunks = MEM_callocN(sizeof(*zp->chunks) * (size_t)zp->chunks_num, __func__);
+	for (i = 0; i < zp->chunks_num; i++) {
+		z_stream strm = {NULL};
+		size_t out_len_max;
+
+		deflateInit2(&strm, 1, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+		out_len_max = BLEN_GZIP_HEADER_SIZE + deflateBound(&strm, WW_ZLIB_PARALLEL_CHUNK_SIZE) + BLEN_GZIP_TRAILER_SIZE;
+		deflateEnd(&strm);
+
+		zp->chunks[i].in = MEM_mallocN(WW_ZLIB_PARALLEL_CHUNK_SIZE, __func__);
+		zp->chunks[i].out = MEM_mallocN(out_len_max, __func__);
+	}
+
+	FILE_HANDLE(ww) = zp;
+	return true;
+}
+static bool ww_close_zlib_parallel(WriteWrap *ww)
+{
+	ZlibParallel *zp = FILE_HANDLE(ww);
+	bool ok;
+	int i;
+
+	ww_zlib_parallel_flush(zp);
+
+	/* always close, even after an error */
+	ok = (close(zp->file_handle) != -1);
+	ok = ok && (zp->error == false);
+
+	for (i = 0; i < zp->chunks_num; i++) {
+		MEM_freeN(zp->chunks[i].in);
+		MEM_freeN(zp->chunks[i].out);
+	}
+	MEM_freeN(zp->chunks);
+	MEM_freeN(zp);
+
+	return ok;
+}
+static size_t ww_write_zlib_parallel(WriteWrap *ww, const char *buf, size_t buf_len)
+{
+	ZlibParallel *zp = FILE_HANDLE(ww);
+	size_t written = 0;
+
+	while (written < buf_len) {
+		ZlibParallelChunk *chunk = &zp->chunks[zp->chunks_used];
+		const size_t len = MIN2(buf_len - written, WW_ZLIB_PARALLEL_CHUNK_SIZE - chunk->in_len);
+
+		memcpy(chunk->in + chunk->in_len, buf + written, len);
+		chunk->in_len += len;
+		written += len;
+
+		if (chunk->in_len == WW_ZLIB_PARALLEL_CHUNK_SIZE) {
+			zp->chunks_used++;
+			if (zp->chunks_used == zp->chunks_num) {
+				ww_zlib_parallel_flush(zp);
+			}
+		}
+	}
+
+	return zp->error ? 0 : buf_len;
+}
+#undef FILE_HANDLE
+
 /* --- end compression types --- */
 
 static void ww_handle_init(eWriteWrapType ww_type, WriteWrap *r_ww)
@@ -289,6 +499,13 @@ static void ww_handle_init(eWriteWrapType ww_type, WriteWrap *r_ww)
 			r_ww->write = ww_write_zlib;
 			break;
 		}
+		case WW_WRAP_ZLIB_PARALLEL:
+		{
+			r_ww->open  = ww_open_zlib_parallel;
+			r_ww->close = ww_close_zlib_parallel;
+			r_ww->write = ww_write_zlib_parallel;
+			break;
+		}
 		default:
 		{
 			r_ww->open  = ww_open_none;
@@ -4197,7 +4414,8 @@ bool BLO_write_file(
 	BLI_snprintf(tempname, sizeof(tempname), "%s@", filepath);
 
 	if (write_flags & G_FILE_COMPRESS) {
-		ww_type = WW_WRAP_ZLIB;
+		/* streaming through gzwrite uses less memory when there are no threads to use */
+		ww_type = (BLI_system_thread_count() > 1) ? WW_WRAP_ZLIB_PARALLEL : WW_WRAP_ZLIB;
 	}
 	else {
 		ww_type = WW_WRAP_NONE;
@@ -4246,9 +4464,12 @@ bool BLO_write_file(
 	}
 
 	/* actual file writing */
-	const bool err = write_file_handle(mainvar, &ww, NULL, NULL, write_flags, thumb);
+	bool err = write_file_handle(mainvar, &ww, NULL, NULL, write_flags, thumb);
 
-	ww.close(&ww);
+	/* compressed data may only be written on close */
+	if (ww.close(&ww) == false) {
+		err = true;
+	}
 
 	if (UNLIKELY(path_list_backup)) {
 		BKE_bpath_list_restore(mainvar, path_list_flag, path_list_backup);
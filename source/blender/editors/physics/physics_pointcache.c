@@ -45,6 +45,7 @@
 #include "BKE_main.h"
 #include "BKE_particle.h"
 #include "BKE_pointcache.h"
+#include "BKE_report.h"
 
 #include "ED_particle.h"
 
@@ -141,6 +142,10 @@ static void ptcache_job_endjob(void *customdata)
 
 	WM_set_locked_interface(G.main->wm.first, false);
 
+	if (job->baker->write_failed) {
+		WM_report(RPT_ERROR, "Some point cache frames could not be written to disk");
+	}
+
 	WM_main_add_notifier(NC_SCENE | ND_FRAME, scene);
 	WM_main_add_notifier(NC_OBJECT | ND_POINTCACHE, job->baker->pid.ob);
 }
@@ -197,6 +202,10 @@ static int ptcache_bake_exec(bContext *C, wmOperator *op)
 
 	PTCacheBaker *baker = ptcache_baker_create(C, op, all);
 	BKE_ptcache_bake(baker);
+	if (baker->write_failed) {
+		BKE_reportf(op->reports, RPT_ERROR, "%d point cache frame(s) could not be written to disk",
+		            baker->write_failed);
+	}
 	MEM_freeN(baker);
 
 	return OPERATOR_FINISHED;
@@ -307,6 +307,9 @@ static int screen_render_exec(bContext *C, wmOperator *op)
 	re = RE_NewRender(scene->id.name);
 	lay_override = (v3d && v3d->lay != scene->lay) ? v3d->lay : 0;
 
+	/* frame updates in the render pipeline don't load deferred library data */
+	BKE_scene_load_deferred_library_data(mainp, scene, lay_override ? lay_override : scene->lay);
+
 	G.is_break = false;
 	RE_test_break_cb(re, NULL, render_break);
 
@@ -925,6 +928,9 @@ static int screen_render_invoke(bContext *C, wmOperator *op, const wmEvent *even
 			rj->lay_override |= v3d->localvd->lay;
 	}
 
+	/* frame updates in the render job don't load deferred library data, it can't be done off the main thread */
+	BKE_scene_load_deferred_library_data(mainp, scene, rj->lay_override ? rj->lay_override : scene->lay);
+
 	/* Lock the user interface depending on render settings. */
 	if (scene->r.use_lock_interface) {
 		int renderlay = rj->lay_override ? rj->lay_override : scene->lay;
@@ -41,6 +41,7 @@ extern "C" {
 
 struct Library;
 struct FileData;
+struct GHash;
 struct ID;
 struct PackedFile;
 struct GPUTexture;
@@ -157,6 +158,10 @@ typedef struct Library {
 
 	int temp_index;
 	int _pad;
+
+	/* runtime, deferred place-holders of this library mapped to the old (file) address of their real data,
+	 * see BLO_library_deferred_load_tagged() */
+	struct GHash *deferred_ids;
 } Library;
 
 enum eIconSizes {
@@ -330,6 +335,9 @@ enum {
 
 	/* RESET_NEVER tag datablock as a place-holder (because the real one could not be linked from its library e.g.). */
 	LIB_TAG_MISSING         = 1 << 6,
+	/* RESET_NEVER tag linked datablock as a place-holder whose real data has not been read from its library yet
+	 * (deferred library loading), see BLO_library_deferred_load_tagged(). */
+	LIB_TAG_DEFERRED        = 1 << 9,
 
 	/* tag datablock has having an extra user. */
 	LIB_TAG_EXTRAUSER       = 1 << 2,
@@ -100,6 +100,7 @@ enum {
 	RENDER_PASS_DEBUG_BVH_TRAVERSAL_STEPS = 0,
 	RENDER_PASS_DEBUG_BVH_TRAVERSED_INSTANCES = 1,
 	RENDER_PASS_DEBUG_RAY_BOUNCES = 2,
+	RENDER_PASS_DEBUG_SAMPLE_COUNT = 3,
 };
 
 /* a renderlayer is a full image, but with all passes and samples */
@@ -45,6 +45,7 @@
 #include "BKE_camera.h"
 #include "BKE_global.h"
 #include "BKE_colortools.h"
+#include "BKE_depsgraph.h"
 #include "BKE_report.h"
 #include "BKE_scene.h"
 
@@ -590,6 +591,7 @@ int RE_engine_render(Render *re, int do_all)
 	RenderEngineType *type = RE_engines_find(re->r.engine);
 	RenderEngine *engine;
 	bool persistent_data = (re->r.mode & R_PERSISTENT_DATA) != 0;
+	bool keep_recalc = persistent_data && re->engine && (re->r.scemode & (R_NO_FRAME_UPDATE | R_BUTS_PREVIEW)) == 0;
 
 	/* verify if we can render */
 	if (!type->render)
@@ -642,7 +644,12 @@ int RE_engine_render(Render *re, int do_all)
 			lay &= non_excluded_lay;
 		}
 
-		BKE_scene_update_for_newframe_ex(re->eval_ctx, re->main, re->scene, lay, true);
+		/* engines with persistent data only sync the datablocks changed since the
+		 * previous frame, so keep the recalc flags until the engine update ran */
+		if (keep_recalc)
+			BKE_scene_update_for_newframe_keep_recalc(re->eval_ctx, re->main, re->scene, lay, true);
+		else
+			BKE_scene_update_for_newframe_ex(re->eval_ctx, re->main, re->scene, lay, true);
 		render_update_anim_renderdata(re, &re->scene->r);
 	}
 
@@ -711,6 +718,9 @@ int RE_engine_render(Render *re, int do_all)
 	if (type->update)
 		type->update(engine, re->main, re->scene);
 
+	if (keep_recalc)
+		DAG_ids_clear_recalc(re->main);
+
 	/* Clear UI drawing locks. */
 	if (re->draw_lock) {
 		re->draw_lock(re->dlh, 0);
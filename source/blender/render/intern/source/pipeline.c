@@ -3103,6 +3103,11 @@ static void update_physics_cache(Render *re, Scene *scene, int UNUSED(anim_init)
 	baker.quick_step = 1;
 
 	BKE_ptcache_bake(&baker);
+
+	if (baker.write_failed) {
+		BKE_reportf(re->reports, RPT_ERROR, "%d point cache frame(s) could not be written to disk",
+		            baker.write_failed);
+	}
 }
 
 void RE_SetActiveRenderView(Render *re, const char *viewname)
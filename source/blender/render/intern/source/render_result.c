@@ -556,6 +556,8 @@ const char *RE_debug_pass_name_get(int debug_type)
 			return "BVH Traversed Instances";
 		case RENDER_PASS_DEBUG_RAY_BOUNCES:
 			return "Ray Bounces";
+		case RENDER_PASS_DEBUG_SAMPLE_COUNT:
+			return "Sample Count";
 	}
 	return "Unknown";
 }
@@ -52,6 +52,7 @@
 #include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
+#include "BLO_readfile.h"
 #include "BLO_writefile.h"
 
 #include "BKE_blender.h"
@@ -482,6 +483,10 @@ void WM_exit_ext(bContext *C, const bool do_python)
 		}
 	}
 
+	if ((G.debug & G_DEBUG) && BLO_library_deferred_loading_get()) {
+		BLO_library_deferred_print(G.main);
+	}
+
 	BKE_addon_pref_type_free();
 	wm_operatortype_free();
 	wm_dropbox_free();
@@ -267,21 +267,32 @@ int main(
 	/* NOTE: Special exception for guarded allocator type switch:
 	 *       we need to perform switch from lock-free to fully
 	 *       guarded allocator before any allocation happened.
+	 *       Same goes for the thread cached allocator, guarded one wins.
 	 */
 	{
 		int i;
+		bool use_threadcache = false;
+		bool use_guarded = false;
 		for (i = 0; i < argc; i++) {
 			if (STREQ(argv[i], "--debug") || STREQ(argv[i], "-d") ||
 			    STREQ(argv[i], "--debug-memory") || STREQ(argv[i], "--debug-all"))
 			{
 				printf("Switching to fully guarded memory allocator.\n");
 				MEM_use_guarded_allocator();
+				use_guarded = true;
 				break;
 			}
+			else if (STREQ(argv[i], "--enable-thread-cache-alloc")) {
+				use_threadcache = true;
+			}
 			else if (STREQ(argv[i], "--")) {
 				break;
 			}
 		}
+		if (use_threadcache && !use_guarded) {
+			printf("Switching to thread cached memory allocator.\n");
+			MEM_use_threadcache_allocator();
+		}
 	}
 
 #ifdef BUILD_DATE
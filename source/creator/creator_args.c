@@ -55,6 +55,8 @@
 #include "BKE_sound.h"
 #include "BKE_image.h"
 
+#include "BLO_readfile.h"
+
 #include "DEG_depsgraph.h"
 
 #ifdef WITH_FFMPEG
@@ -588,6 +590,8 @@ static int arg_handle_print_help(int UNUSED(argc), const char **UNUSED(argv), vo
 	printf("Experimental Features:\n");
 	BLI_argsPrintArgDoc(ba, "--enable-new-depsgraph");
 	BLI_argsPrintArgDoc(ba, "--enable-new-basic-shader-glsl");
+	BLI_argsPrintArgDoc(ba, "--enable-thread-cache-alloc");
+	BLI_argsPrintArgDoc(ba, "--enable-deferred-library-loading");
 
 	/* Other options _must_ be last (anything not handled will show here) */
 	printf("\n");
@@ -1186,6 +1190,25 @@ static int arg_handle_depsgraph_use_new(int UNUSED(argc), const char **UNUSED(ar
 	return 0;
 }
 
+static const char arg_handle_threadcache_alloc_use_doc[] =
+"\n\tUse thread cached memory allocator (ignored when memory debugging is enabled)"
+;
+static int arg_handle_threadcache_alloc_use(int UNUSED(argc), const char **UNUSED(argv), void *UNUSED(data))
+{
+	/* Nothing to do here, allocator is switched in main() before any allocation. */
+	return 0;
+}
+
+static const char arg_handle_deferred_library_loading_use_doc[] =
+"\n\tOnly read linked meshes from their libraries once they are used by a visible object"
+;
+static int arg_handle_deferred_library_loading_use(int UNUSED(argc), const char **UNUSED(argv), void *UNUSED(data))
+{
+	printf("Using deferred library loading.\n");
+	BLO_library_deferred_loading_set(true);
+	return 0;
+}
+
 static const char arg_handle_basic_shader_glsl_use_new_doc[] =
 "\n\tUse new GLSL basic shader"
 ;
@@ -1358,6 +1381,7 @@ static int arg_handle_render_frame(int argc, const char **argv, void *data)
 			BKE_reports_init(&reports, RPT_PRINT);
 
 			RE_SetReports(re, &reports);
+			BKE_scene_load_deferred_library_data(bmain, scene, scene->lay);
 			for (int i = 0; i < frames_range_len; i++) {
 				/* We could pass in frame ranges,
 				 * but prefer having exact behavior as passing in multiple frames */
@@ -1399,6 +1423,7 @@ static int arg_handle_render_animation(int UNUSED(argc), const char **UNUSED(arg
 		BLI_begin_threaded_malloc();
 		BKE_reports_init(&reports, RPT_PRINT);
 		RE_SetReports(re, &reports);
+		BKE_scene_load_deferred_library_data(bmain, scene, scene->lay);
 		RE_BlenderAnim(re, bmain, scene, NULL, scene->lay, scene->r.sfra, scene->r.efra, scene->r.frame_step);
 		RE_SetReports(re, NULL);
 		BLI_end_threaded_malloc();
@@ -1831,6 +1856,8 @@ void main_args_setup(bContext *C, bArgs *ba, SYS_SystemHandle *syshandle)
 
 	BLI_argsAdd(ba, 1, NULL, "--enable-new-depsgraph", CB(arg_handle_depsgraph_use_new), NULL);
 	BLI_argsAdd(ba, 1, NULL, "--enable-new-basic-shader-glsl", CB(arg_handle_basic_shader_glsl_use_new), NULL);
+	BLI_argsAdd(ba, 1, NULL, "--enable-thread-cache-alloc", CB(arg_handle_threadcache_alloc_use), NULL);
+	BLI_argsAdd(ba, 1, NULL, "--enable-deferred-library-loading", CB(arg_handle_deferred_library_loading_use), NULL);
 
 	BLI_argsAdd(ba, 1, NULL, "--verbose", CB(arg_handle_verbosity_set), NULL);
 
@@ -163,6 +163,14 @@ TEST(ghash, TextMurmur2a)
 	str_ghash_tests(ghash, "StrGHash - Murmur");
 }
 
+TEST(ghash, TextGHashOpenAddressing)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_strhash_p, BLI_ghashutil_strcmp, __func__);
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING);
+
+	str_ghash_tests(ghash, "StrGHash - GHash - Open Addressing");
+}
+
 
 /* Int: uniform 100M first integers. */
 
@@ -237,6 +245,24 @@ TEST(ghash, IntGHash100000000)
 }
 #endif
 
+TEST(ghash, IntGHashOpenAddressing12000)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING);
+
+	int_ghash_tests(ghash, "IntGHash - GHash - Open Addressing - 12000", 12000);
+}
+
+#ifdef GHASH_RUN_BIG
+TEST(ghash, IntGHashOpenAddressing100000000)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING);
+
+	int_ghash_tests(ghash, "IntGHash - GHash - Open Addressing - 100000000", 100000000);
+}
+#endif
+
 TEST(ghash, IntMurmur2a12000)
 {
 	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p_murmur, BLI_ghashutil_intcmp, __func__);
@@ -319,6 +345,24 @@ TEST(ghash, IntRandGHash50000000)
 }
 #endif
 
+TEST(ghash, IntRandGHashOpenAddressing12000)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING);
+
+	randint_ghash_tests(ghash, "RandIntGHash - GHash - Open Addressing - 12000", 12000);
+}
+
+#ifdef GHASH_RUN_BIG
+TEST(ghash, IntRandGHashOpenAddressing50000000)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING);
+
+	randint_ghash_tests(ghash, "RandIntGHash - GHash - Open Addressing - 50000000", 50000000);
+}
+#endif
+
 TEST(ghash, IntRandMurmur2a12000)
 {
 	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p_murmur, BLI_ghashutil_intcmp, __func__);
@@ -521,6 +565,22 @@ TEST(ghash, MultiRandIntGHash200000)
 	multi_small_ghash_tests(ghash, "MultiSmall RandIntGHash - GHash - 200000", 200000);
 }
 
+TEST(ghash, MultiRandIntGHashOpenAddressing2000)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING);
+
+	multi_small_ghash_tests(ghash, "MultiSmall RandIntGHash - GHash - Open Addressing - 2000", 2000);
+}
+
+TEST(ghash, MultiRandIntGHashOpenAddressing200000)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING);
+
+	multi_small_ghash_tests(ghash, "MultiSmall RandIntGHash - GHash - Open Addressing - 200000", 200000);
+}
+
 TEST(ghash, MultiRandIntMurmur2a2000)
 {
 	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p_murmur, BLI_ghashutil_intcmp, __func__);
@@ -534,3 +594,93 @@ TEST(ghash, MultiRandIntMurmur2a200000)
 
 	multi_small_ghash_tests(ghash, "MultiSmall RandIntGHash - Murmur2a - 200000", 200000);
 }
+
+
+/* Storage: compare chained and open addressing storages on insert, lookup, iterate and remove of 1M random
+ * integers. */
+
+static void storage_ghash_tests(GHash *ghash, const char *id, const unsigned int nbr)
+{
+	printf("\n========== STARTING %s ==========\n", id);
+
+	unsigned int *data = (unsigned int *)MEM_mallocN(sizeof(*data) * (size_t)nbr, __func__);
+	unsigned int *dt;
+	unsigned int i;
+
+	{
+		RNG *rng = BLI_rng_new(0);
+		for (i = nbr, dt = data; i--; dt++) {
+			*dt = BLI_rng_get_uint(rng);
+		}
+		BLI_rng_free(rng);
+	}
+
+	{
+		TIMEIT_START(int_insert);
+
+		for (i = nbr, dt = data; i--; dt++) {
+			BLI_ghash_reinsert(ghash, SET_UINT_IN_POINTER(*dt), SET_UINT_IN_POINTER(*dt), NULL, NULL);
+		}
+
+		TIMEIT_END(int_insert);
+	}
+
+	PRINTF_GHASH_STATS(ghash);
+
+	{
+		TIMEIT_START(int_lookup);
+
+		for (i = nbr, dt = data; i--; dt++) {
+			void *v = BLI_ghash_lookup(ghash, SET_UINT_IN_POINTER(*dt));
+			EXPECT_EQ(*dt, GET_UINT_FROM_POINTER(v));
+		}
+
+		TIMEIT_END(int_lookup);
+	}
+
+	{
+		GHashIterator ghi;
+		unsigned int count = 0;
+
+		TIMEIT_START(int_iterate);
+
+		GHASH_ITER (ghi, ghash) {
+			count += (BLI_ghashIterator_getKey(&ghi) == BLI_ghashIterator_getValue(&ghi));
+		}
+
+		TIMEIT_END(int_iterate);
+
+		EXPECT_EQ(BLI_ghash_size(ghash), count);
+	}
+
+	{
+		TIMEIT_START(int_remove);
+
+		for (i = nbr, dt = data; i--; dt++) {
+			BLI_ghash_remove(ghash, SET_UINT_IN_POINTER(*dt), NULL, NULL);
+		}
+
+		TIMEIT_END(int_remove);
+	}
+	EXPECT_EQ(0, BLI_ghash_size(ghash));
+
+	BLI_ghash_free(ghash, NULL, NULL);
+	MEM_freeN(data);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(ghash, StorageChained1000000)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	storage_ghash_tests(ghash, "Storage - Chained - 1000000", 1000000);
+}
+
+TEST(ghash, StorageOpenAddressing1000000)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING);
+
+	storage_ghash_tests(ghash, "Storage - Open Addressing - 1000000", 1000000);
+}
@@ -198,3 +198,231 @@ TEST(ghash, Pop)
 
 	BLI_ghash_free(ghash, NULL, NULL);
 }
+
+/* Same as InsertLookup, using open addressing storage. */
+TEST(ghash, OpenAddressingInsertLookup)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING);
+	init_keys(keys, 0);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	EXPECT_EQ(TESTCASE_SIZE, BLI_ghash_size(ghash));
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void *v = BLI_ghash_lookup(ghash, SET_UINT_IN_POINTER(*k));
+		EXPECT_EQ(*k, GET_UINT_FROM_POINTER(v));
+	}
+
+	EXPECT_EQ(NULL, BLI_ghash_lookup_p(ghash, SET_UINT_IN_POINTER(0)));
+
+	BLI_ghash_free(ghash, NULL, NULL);
+}
+
+/* Remove half of the keys, then re-insert them, re-using deleted slots. */
+TEST(ghash, OpenAddressingInsertRemove)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i, bkt_size;
+
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING);
+	init_keys(keys, 10);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	EXPECT_EQ(TESTCASE_SIZE, BLI_ghash_size(ghash));
+	bkt_size = BLI_ghash_buckets_size(ghash);
+
+	for (i = TESTCASE_SIZE / 2, k = keys; i--; k++) {
+		EXPECT_TRUE(BLI_ghash_remove(ghash, SET_UINT_IN_POINTER(*k), NULL, NULL));
+	}
+	EXPECT_EQ(TESTCASE_SIZE - TESTCASE_SIZE / 2, BLI_ghash_size(ghash));
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void **v;
+		const bool haskey = BLI_ghash_ensure_p(ghash, SET_UINT_IN_POINTER(*k), &v);
+		EXPECT_EQ(i < TESTCASE_SIZE - TESTCASE_SIZE / 2, haskey);
+		*v = SET_UINT_IN_POINTER(*k);
+	}
+	EXPECT_EQ(TESTCASE_SIZE, BLI_ghash_size(ghash));
+	EXPECT_EQ(bkt_size, BLI_ghash_buckets_size(ghash));
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void *v = BLI_ghash_popkey(ghash, SET_UINT_IN_POINTER(*k), NULL);
+		EXPECT_EQ(*k, GET_UINT_FROM_POINTER(v));
+	}
+
+	EXPECT_EQ(0, BLI_ghash_size(ghash));
+	EXPECT_EQ(bkt_size, BLI_ghash_buckets_size(ghash));
+
+	BLI_ghash_free(ghash, NULL, NULL);
+}
+
+/* Same as InsertRemoveShrink, using open addressing storage. */
+TEST(ghash, OpenAddressingInsertRemoveShrink)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i, bkt_size;
+
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING | GHASH_FLAG_ALLOW_SHRINK);
+	init_keys(keys, 20);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	EXPECT_EQ(TESTCASE_SIZE, BLI_ghash_size(ghash));
+	bkt_size = BLI_ghash_buckets_size(ghash);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void *v = BLI_ghash_popkey(ghash, SET_UINT_IN_POINTER(*k), NULL);
+		EXPECT_EQ(*k, GET_UINT_FROM_POINTER(v));
+	}
+
+	EXPECT_EQ(0, BLI_ghash_size(ghash));
+	EXPECT_LT(BLI_ghash_buckets_size(ghash), bkt_size);
+
+	BLI_ghash_free(ghash, NULL, NULL);
+}
+
+/* Check copy and iteration, using open addressing storage. */
+TEST(ghash, OpenAddressingCopyIter)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	GHash *ghash_copy;
+	GHashIterator ghi;
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING);
+	init_keys(keys, 30);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	ghash_copy = BLI_ghash_copy(ghash, NULL, NULL);
+
+	EXPECT_EQ(TESTCASE_SIZE, BLI_ghash_size(ghash_copy));
+	EXPECT_EQ(BLI_ghash_buckets_size(ghash), BLI_ghash_buckets_size(ghash_copy));
+
+	i = 0;
+	GHASH_ITER (ghi, ghash_copy) {
+		EXPECT_EQ(BLI_ghashIterator_getKey(&ghi), BLI_ghashIterator_getValue(&ghi));
+		EXPECT_TRUE(BLI_ghash_haskey(ghash, BLI_ghashIterator_getKey(&ghi)));
+		i++;
+	}
+	EXPECT_EQ(TESTCASE_SIZE, i);
+
+	BLI_ghash_free(ghash, NULL, NULL);
+	BLI_ghash_free(ghash_copy, NULL, NULL);
+}
+
+/* Check pop, using open addressing storage. */
+TEST(ghash, OpenAddressingPop)
+{
+	GHash *ghash = BLI_ghash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	BLI_ghash_flag_set(ghash, GHASH_FLAG_OPEN_ADDRESSING | GHASH_FLAG_ALLOW_SHRINK);
+	init_keys(keys, 30);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	GHashIterState pop_state = {0};
+
+	for (i = TESTCASE_SIZE / 2; i--; ) {
+		void *k, *v;
+		bool success = BLI_ghash_pop(ghash, &pop_state, &k, &v);
+		EXPECT_EQ(k, v);
+		EXPECT_EQ(success, true);
+
+		if (i % 2) {
+			BLI_ghash_insert(ghash, SET_UINT_IN_POINTER(i * 4), SET_UINT_IN_POINTER(i * 4));
+		}
+	}
+
+	EXPECT_EQ((TESTCASE_SIZE - TESTCASE_SIZE / 2 + TESTCASE_SIZE / 4), BLI_ghash_size(ghash));
+
+	{
+		void *k, *v;
+		while (BLI_ghash_pop(ghash, &pop_state, &k, &v)) {
+			EXPECT_EQ(k, v);
+		}
+	}
+	EXPECT_EQ(0, BLI_ghash_size(ghash));
+
+	BLI_ghash_free(ghash, NULL, NULL);
+}
+
+/* Switch storage back and forth on a non-empty GSet. */
+TEST(ghash, OpenAddressingConvertGSet)
+{
+	GSet *gset = BLI_gset_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	init_keys(keys, 40);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_gset_insert(gset, SET_UINT_IN_POINTER(*k));
+	}
+
+	BLI_gset_flag_set(gset, GHASH_FLAG_OPEN_ADDRESSING);
+	EXPECT_EQ(TESTCASE_SIZE, BLI_gset_size(gset));
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		EXPECT_TRUE(BLI_gset_haskey(gset, SET_UINT_IN_POINTER(*k)));
+		EXPECT_FALSE(BLI_gset_add(gset, SET_UINT_IN_POINTER(*k)));
+	}
+
+	BLI_gset_flag_clear(gset, GHASH_FLAG_OPEN_ADDRESSING);
+	EXPECT_EQ(TESTCASE_SIZE, BLI_gset_size(gset));
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		EXPECT_TRUE(BLI_gset_remove(gset, SET_UINT_IN_POINTER(*k), NULL));
+	}
+	EXPECT_EQ(0, BLI_gset_size(gset));
+
+	BLI_gset_free(gset, NULL);
+}
+
+/* Create an open addressing GSet directly, iterate and copy its packed slots. */
+TEST(ghash, OpenAddressingGSetIterCopy)
+{
+	GSet *gset = BLI_gset_new_flag_ex(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__,
+	                                  TESTCASE_SIZE, GHASH_FLAG_OPEN_ADDRESSING);
+	GSet *gset_copy;
+	GSetIterator gsi;
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	init_keys(keys, 50);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_gset_insert(gset, SET_UINT_IN_POINTER(*k));
+	}
+
+	gset_copy = BLI_gset_copy(gset, NULL);
+
+	i = 0;
+	GSET_ITER (gsi, gset_copy) {
+		EXPECT_TRUE(BLI_gset_haskey(gset, BLI_gsetIterator_getKey(&gsi)));
+		i++;
+	}
+	EXPECT_EQ(TESTCASE_SIZE, i);
+
+	BLI_gset_free(gset, NULL);
+	BLI_gset_free(gset_copy, NULL);
+}
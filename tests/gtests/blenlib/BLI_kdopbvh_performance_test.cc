@@ -0,0 +1,231 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_kdopbvh.h"
+#include "BLI_math.h"
+#include "BLI_rand.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "PIL_time_utildefines.h"
+}
+
+/* Resolution of the height-field grid (two triangles per quad). */
+#define GRID_RES 1000
+
+/* Number of rays & nearest point queries. */
+#define QUERY_SIZE 500000
+
+typedef struct MeshData {
+	const float (*tris)[3][3];
+} MeshData;
+
+typedef struct QueryData {
+	BVHTree *tree;
+	MeshData *mesh;
+	const float (*co)[3];
+	const float (*dir)[3];
+	BVHTreeRayHit *hit;
+	BVHTreeNearest *nearest;
+} QueryData;
+
+static void mesh_raycast_cb(void *userdata, int index, const BVHTreeRay *ray, BVHTreeRayHit *hit)
+{
+	const MeshData *mesh = (const MeshData *)userdata;
+	const float (*tri)[3] = mesh->tris[index];
+	float dist;
+
+	if (isect_ray_tri_v3(ray->origin, ray->direction, tri[0], tri[1], tri[2], &dist, NULL) && dist < hit->dist) {
+		hit->index = index;
+		hit->dist = dist;
+		madd_v3_v3v3fl(hit->co, ray->origin, ray->direction, dist);
+	}
+}
+
+static void mesh_nearest_cb(void *userdata, int index, const float co[3], BVHTreeNearest *nearest)
+{
+	const MeshData *mesh = (const MeshData *)userdata;
+	const float (*tri)[3] = mesh->tris[index];
+	float co_tri[3], dist_sq;
+
+	closest_on_tri_to_point_v3(co_tri, co, tri[0], tri[1], tri[2]);
+	dist_sq = len_squared_v3v3(co, co_tri);
+	if (dist_sq < nearest->dist_sq) {
+		nearest->index = index;
+		nearest->dist_sq = dist_sq;
+		copy_v3_v3(nearest->co, co_tri);
+	}
+}
+
+static void ray_cast_single_func(void *userdata, const int iter)
+{
+	QueryData *data = (QueryData *)userdata;
+	BLI_bvhtree_ray_cast(
+	        data->tree, data->co[iter], data->dir[iter], 0.0f, &data->hit[iter], mesh_raycast_cb, data->mesh);
+}
+
+static void find_nearest_single_func(void *userdata, const int iter)
+{
+	QueryData *data = (QueryData *)userdata;
+	BLI_bvhtree_find_nearest(data->tree, data->co[iter], &data->nearest[iter], mesh_nearest_cb, data->mesh);
+}
+
+static void hits_reset(BVHTreeRayHit *hit)
+{
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		hit[i].index = -1;
+		hit[i].dist = BVH_RAYCAST_DIST_MAX;
+	}
+}
+
+static void nearest_reset(BVHTreeNearest *nearest)
+{
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		nearest[i].index = -1;
+		nearest[i].dist_sq = FLT_MAX;
+	}
+}
+
+static void kdopbvh_query_tests(const char axis, const char *id)
+{
+	RNG *rng = BLI_rng_new(0);
+	float (*verts)[3] = (float (*)[3])MEM_mallocN(sizeof(*verts) * (GRID_RES + 1) * (GRID_RES + 1), __func__);
+	float (*tris)[3][3] = (float (*)[3][3])MEM_mallocN(sizeof(*tris) * GRID_RES * GRID_RES * 2, __func__);
+	float (*co)[3] = (float (*)[3])MEM_mallocN(sizeof(*co) * QUERY_SIZE, __func__);
+	float (*dir)[3] = (float (*)[3])MEM_mallocN(sizeof(*dir) * QUERY_SIZE, __func__);
+	BVHTreeRayHit *hit = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hit) * QUERY_SIZE, __func__);
+	BVHTreeRayHit *hit_batch = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hit_batch) * QUERY_SIZE, __func__);
+	BVHTreeNearest *nearest = (BVHTreeNearest *)MEM_mallocN(sizeof(*nearest) * QUERY_SIZE, __func__);
+	BVHTreeNearest *nearest_batch = (BVHTreeNearest *)MEM_mallocN(sizeof(*nearest_batch) * QUERY_SIZE, __func__);
+	const int tris_num = GRID_RES * GRID_RES * 2;
+	MeshData mesh = {(const float (*)[3][3])tris};
+	QueryData data = {NULL, &mesh, (const float (*)[3])co, (const float (*)[3])dir, hit, nearest};
+
+	printf("\n========== STARTING %s ==========\n", id);
+
+	BLI_threadapi_init();
+
+	/* Noisy height-field, like a displaced plane. */
+	for (int y = 0; y <= GRID_RES; y++) {
+		for (int x = 0; x <= GRID_RES; x++) {
+			float *v = verts[y * (GRID_RES + 1) + x];
+			v[0] = (float)x / GRID_RES;
+			v[1] = (float)y / GRID_RES;
+			v[2] = BLI_rng_get_float(rng) * 0.05f;
+		}
+	}
+	for (int y = 0; y < GRID_RES; y++) {
+		for (int x = 0; x < GRID_RES; x++) {
+			const int v = y * (GRID_RES + 1) + x;
+			float (*tri)[3] = tris[(y * GRID_RES + x) * 2];
+			copy_v3_v3(tri[0], verts[v]);
+			copy_v3_v3(tri[1], verts[v + 1]);
+			copy_v3_v3(tri[2], verts[v + GRID_RES + 2]);
+			copy_v3_v3(tri[3], verts[v]);
+			copy_v3_v3(tri[4], verts[v + GRID_RES + 2]);
+			copy_v3_v3(tri[5], verts[v + GRID_RES + 1]);
+		}
+	}
+
+	TIMEIT_START(build);
+
+	data.tree = BLI_bvhtree_new(tris_num, 0.0f, 4, axis);
+	for (int i = 0; i < tris_num; i++) {
+		BLI_bvhtree_insert(data.tree, i, &tris[i][0][0], 3);
+	}
+	BLI_bvhtree_balance(data.tree);
+
+	TIMEIT_END(build);
+
+	/* Coherent rays (scan-lines of a camera looking down at the grid). */
+	{
+		const int res = (int)sqrtf((float)QUERY_SIZE);
+		for (int i = 0; i < QUERY_SIZE; i++) {
+			const float u = (float)(i % res) / res, v = (float)(i / res) / res;
+			co[i][0] = 0.5f;
+			co[i][1] = 0.5f;
+			co[i][2] = 1.0f;
+			dir[i][0] = u - 0.5f;
+			dir[i][1] = v - 0.5f;
+			dir[i][2] = -1.0f;
+			normalize_v3(dir[i]);
+		}
+	}
+
+	hits_reset(hit);
+	TIMEIT_START(ray_cast_single);
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		ray_cast_single_func(&data, i);
+	}
+	TIMEIT_END(ray_cast_single);
+
+	hits_reset(hit);
+	TIMEIT_START(ray_cast_single_threaded);
+	BLI_task_parallel_range(0, QUERY_SIZE, &data, ray_cast_single_func, true);
+	TIMEIT_END(ray_cast_single_threaded);
+
+	hits_reset(hit_batch);
+	TIMEIT_START(ray_cast_batch);
+	BLI_bvhtree_ray_cast_batch(
+	        data.tree, data.co, data.dir, 0.0f, hit_batch, QUERY_SIZE,
+	        mesh_raycast_cb, &mesh, BVH_RAYCAST_DEFAULT);
+	TIMEIT_END(ray_cast_batch);
+
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		EXPECT_FLOAT_EQ(hit[i].dist, hit_batch[i].dist);
+	}
+
+	/* Points close to the surface, in scan-line order. */
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		madd_v3_v3v3fl(co[i], co[i], dir[i], hit[i].dist - 0.01f);
+	}
+
+	nearest_reset(nearest);
+	TIMEIT_START(find_nearest_single);
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		find_nearest_single_func(&data, i);
+	}
+	TIMEIT_END(find_nearest_single);
+
+	nearest_reset(nearest);
+	TIMEIT_START(find_nearest_single_threaded);
+	BLI_task_parallel_range(0, QUERY_SIZE, &data, find_nearest_single_func, true);
+	TIMEIT_END(find_nearest_single_threaded);
+
+	nearest_reset(nearest_batch);
+	TIMEIT_START(find_nearest_batch);
+	BLI_bvhtree_find_nearest_batch(data.tree, data.co, nearest_batch, QUERY_SIZE, mesh_nearest_cb, &mesh);
+	TIMEIT_END(find_nearest_batch);
+
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		EXPECT_FLOAT_EQ(nearest[i].dist_sq, nearest_batch[i].dist_sq);
+	}
+
+	BLI_bvhtree_free(data.tree);
+	MEM_freeN(verts);
+	MEM_freeN(tris);
+	MEM_freeN(co);
+	MEM_freeN(dir);
+	MEM_freeN(hit);
+	MEM_freeN(hit_batch);
+	MEM_freeN(nearest);
+	MEM_freeN(nearest_batch);
+	BLI_rng_free(rng);
+
+	BLI_threadapi_exit();
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(kdopbvh, QueriesGrid2M_AABB)
+{
+	kdopbvh_query_tests(6, "Queries on 2M triangles grid - AABB tree");
+}
+
+TEST(kdopbvh, QueriesGrid2M_KDOP26)
+{
+	kdopbvh_query_tests(26, "Queries on 2M triangles grid - 26-DOP tree");
+}
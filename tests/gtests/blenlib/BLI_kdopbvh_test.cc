@@ -0,0 +1,266 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_kdopbvh.h"
+#include "BLI_math.h"
+#include "BLI_rand.h"
+#include "BLI_threads.h"
+}
+
+/* Enough rays & points for batched queries to use multiple packets and threads. */
+#define TRIS_NUM 2000
+#define QUERY_SIZE 3000
+
+static void rng_co(RNG *rng, float co[3])
+{
+	co[0] = BLI_rng_get_float(rng);
+	co[1] = BLI_rng_get_float(rng);
+	co[2] = BLI_rng_get_float(rng);
+}
+
+static void tris_raycast_cb(void *userdata, int index, const BVHTreeRay *ray, BVHTreeRayHit *hit)
+{
+	const float (*tris)[3][3] = (const float (*)[3][3])userdata;
+	float dist;
+
+	if (isect_ray_tri_v3(ray->origin, ray->direction, tris[index][0], tris[index][1], tris[index][2], &dist, NULL) &&
+	    dist < hit->dist)
+	{
+		hit->index = index;
+		hit->dist = dist;
+		madd_v3_v3v3fl(hit->co, ray->origin, ray->direction, dist);
+	}
+}
+
+static void tris_nearest_cb(void *userdata, int index, const float co[3], BVHTreeNearest *nearest)
+{
+	const float (*tris)[3][3] = (const float (*)[3][3])userdata;
+	float co_tri[3], dist_sq;
+
+	closest_on_tri_to_point_v3(co_tri, co, tris[index][0], tris[index][1], tris[index][2]);
+	dist_sq = len_squared_v3v3(co, co_tri);
+	if (dist_sq < nearest->dist_sq) {
+		nearest->index = index;
+		nearest->dist_sq = dist_sq;
+		copy_v3_v3(nearest->co, co_tri);
+	}
+}
+
+static BVHTree *tris_tree_create(RNG *rng, float (*tris)[3][3], const char axis)
+{
+	BVHTree *tree = BLI_bvhtree_new(TRIS_NUM, 0.0f, 4, axis);
+
+	for (int i = 0; i < TRIS_NUM; i++) {
+		float center[3];
+		rng_co(rng, center);
+		for (int j = 0; j < 3; j++) {
+			rng_co(rng, tris[i][j]);
+			interp_v3_v3v3(tris[i][j], center, tris[i][j], 0.05f);
+		}
+		BLI_bvhtree_insert(tree, i, &tris[i][0][0], 3);
+	}
+	BLI_bvhtree_balance(tree);
+
+	return tree;
+}
+
+static void ray_cast_batch_test(const char axis, const float radius)
+{
+	RNG *rng = BLI_rng_new(0);
+	float (*tris)[3][3] = (float (*)[3][3])MEM_mallocN(sizeof(*tris) * TRIS_NUM, __func__);
+	float (*co)[3] = (float (*)[3])MEM_mallocN(sizeof(*co) * QUERY_SIZE, __func__);
+	float (*dir)[3] = (float (*)[3])MEM_mallocN(sizeof(*dir) * QUERY_SIZE, __func__);
+	BVHTreeRayHit *hit = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hit) * QUERY_SIZE, __func__);
+	BVHTree *tree;
+	int hits_num = 0;
+
+	BLI_threadapi_init();
+
+	tree = tris_tree_create(rng, tris, axis);
+
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		rng_co(rng, co[i]);
+		co[i][2] = -1.0f;
+		rng_co(rng, dir[i]);
+		dir[i][0] -= 0.5f;
+		dir[i][1] -= 0.5f;
+		dir[i][2] += 1.0f;
+		normalize_v3(dir[i]);
+		hit[i].index = -1;
+		hit[i].dist = BVH_RAYCAST_DIST_MAX;
+	}
+
+	BLI_bvhtree_ray_cast_batch(
+	        tree, (const float (*)[3])co, (const float (*)[3])dir, radius, hit, QUERY_SIZE,
+	        tris_raycast_cb, tris, BVH_RAYCAST_DEFAULT);
+
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		BVHTreeRayHit hit_single;
+		hit_single.index = -1;
+		hit_single.dist = BVH_RAYCAST_DIST_MAX;
+		BLI_bvhtree_ray_cast(tree, co[i], dir[i], radius, &hit_single, tris_raycast_cb, tris);
+		EXPECT_EQ(hit_single.index, hit[i].index);
+		EXPECT_FLOAT_EQ(hit_single.dist, hit[i].dist);
+		hits_num += (hit[i].index != -1);
+	}
+	/* ensure the test isn't trivially passing */
+	EXPECT_LT(0, hits_num);
+
+	BLI_bvhtree_free(tree);
+	MEM_freeN(tris);
+	MEM_freeN(co);
+	MEM_freeN(dir);
+	MEM_freeN(hit);
+	BLI_rng_free(rng);
+
+	BLI_threadapi_exit();
+}
+
+static void find_nearest_batch_test(const char axis)
+{
+	RNG *rng = BLI_rng_new(0);
+	float (*tris)[3][3] = (float (*)[3][3])MEM_mallocN(sizeof(*tris) * TRIS_NUM, __func__);
+	float (*co)[3] = (float (*)[3])MEM_mallocN(sizeof(*co) * QUERY_SIZE, __func__);
+	BVHTreeNearest *nearest = (BVHTreeNearest *)MEM_mallocN(sizeof(*nearest) * QUERY_SIZE, __func__);
+	BVHTree *tree;
+
+	BLI_threadapi_init();
+
+	tree = tris_tree_create(rng, tris, axis);
+
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		rng_co(rng, co[i]);
+		nearest[i].index = -1;
+		nearest[i].dist_sq = FLT_MAX;
+	}
+
+	BLI_bvhtree_find_nearest_batch(tree, (const float (*)[3])co, nearest, QUERY_SIZE, tris_nearest_cb, tris);
+
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		BVHTreeNearest nearest_single;
+		nearest_single.index = -1;
+		nearest_single.dist_sq = FLT_MAX;
+		BLI_bvhtree_find_nearest(tree, co[i], &nearest_single, tris_nearest_cb, tris);
+		EXPECT_EQ(nearest_single.index, nearest[i].index);
+		EXPECT_FLOAT_EQ(nearest_single.dist_sq, nearest[i].dist_sq);
+	}
+
+	BLI_bvhtree_free(tree);
+	MEM_freeN(tris);
+	MEM_freeN(co);
+	MEM_freeN(nearest);
+	BLI_rng_free(rng);
+
+	BLI_threadapi_exit();
+}
+
+TEST(kdopbvh, RayCastBatch)
+{
+	ray_cast_batch_test(6, 0.0f);
+}
+
+TEST(kdopbvh, RayCastBatchRadius)
+{
+	ray_cast_batch_test(6, 0.01f);
+}
+
+TEST(kdopbvh, RayCastBatchKDOP26)
+{
+	ray_cast_batch_test(26, 0.0f);
+}
+
+TEST(kdopbvh, FindNearestBatch)
+{
+	find_nearest_batch_test(6);
+}
+
+TEST(kdopbvh, FindNearestBatchKDOP26)
+{
+	find_nearest_batch_test(26);
+}
+
+/* Points are scrambled between refits, so the tree degrades as much as it can. */
+#define REFIT_POINTS_NUM 10000
+
+static int find_nearest_point_brute_force(const float (*points)[3], const int points_num, const float co[3])
+{
+	int i, index = -1;
+	float dist_min = FLT_MAX;
+
+	for (i = 0; i < points_num; i++) {
+		const float dist = len_squared_v3v3(points[i], co);
+		if (dist < dist_min) {
+			dist_min = dist;
+			index = i;
+		}
+	}
+	return index;
+}
+
+TEST(kdopbvh, RefitRebuild)
+{
+	RNG *rng = BLI_rng_new(0);
+	float (*points)[3] = (float (*)[3])MEM_mallocN(sizeof(*points) * REFIT_POINTS_NUM, __func__);
+	BVHTree *tree = BLI_bvhtree_new(REFIT_POINTS_NUM, 0.0f, 4, 26);
+	BVHTreeRefitStats stats;
+
+	BLI_threadapi_init();
+
+	for (int i = 0; i < REFIT_POINTS_NUM; i++) {
+		rng_co(rng, points[i]);
+		BLI_bvhtree_insert(tree, i, points[i], 1);
+	}
+	BLI_bvhtree_balance(tree);
+
+	EXPECT_FALSE(BLI_bvhtree_refit_stats_get(tree, &stats));
+	BLI_bvhtree_refit_policy_set(tree, BVH_REFIT_REBUILD_THRESHOLD);
+
+	/* translating doesn't degrade the tree */
+	for (int i = 0; i < REFIT_POINTS_NUM; i++) {
+		add_v3_fl(points[i], 1.0f);
+		BLI_bvhtree_update_node(tree, i, points[i], NULL, 1);
+	}
+	BLI_bvhtree_update_tree(tree);
+
+	EXPECT_TRUE(BLI_bvhtree_refit_stats_get(tree, &stats));
+	EXPECT_EQ(1, stats.refit_num);
+	EXPECT_EQ(0, stats.rebuild_num);
+	EXPECT_NEAR(1.0f, stats.quality, 1e-3f);
+
+	/* scrambling does */
+	for (int i = 0; i < REFIT_POINTS_NUM; i++) {
+		rng_co(rng, points[i]);
+		BLI_bvhtree_update_node(tree, i, points[i], NULL, 1);
+	}
+	BLI_bvhtree_update_tree(tree);
+
+	BLI_bvhtree_refit_stats_get(tree, &stats);
+	EXPECT_EQ(2, stats.refit_num);
+	EXPECT_EQ(1, stats.rebuild_num);
+	EXPECT_LT(0, stats.subtree_rebuild_num);
+	EXPECT_LT(0, stats.leaf_rebuild_num);
+	EXPECT_GT(1.0f / BVH_REFIT_REBUILD_THRESHOLD, stats.quality);
+
+	/* the rebuilt tree is valid and doesn't need another rebuild */
+	BLI_bvhtree_update_tree(tree);
+	BLI_bvhtree_refit_stats_get(tree, &stats);
+	EXPECT_EQ(1, stats.rebuild_num);
+	EXPECT_LT(1.0f / BVH_REFIT_REBUILD_THRESHOLD, stats.quality);
+
+	for (int i = 0; i < QUERY_SIZE; i++) {
+		float co[3];
+		rng_co(rng, co);
+		EXPECT_EQ(find_nearest_point_brute_force((const float (*)[3])points, REFIT_POINTS_NUM, co),
+		          BLI_bvhtree_find_nearest(tree, co, NULL, NULL, NULL));
+	}
+
+	BLI_bvhtree_free(tree);
+	MEM_freeN(points);
+	BLI_rng_free(rng);
+
+	BLI_threadapi_exit();
+}
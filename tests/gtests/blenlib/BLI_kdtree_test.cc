@@ -0,0 +1,168 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_kdtree.h"
+#include "BLI_math.h"
+#include "BLI_rand.h"
+#include "BLI_threads.h"
+}
+
+/* Big enough to use threaded balancing and batched queries. */
+#define TREE_SIZE 50000
+#define QUERY_SIZE 2000
+
+static void rng_co(RNG *rng, float co[3])
+{
+	co[0] = BLI_rng_get_float(rng);
+	co[1] = BLI_rng_get_float(rng);
+	co[2] = BLI_rng_get_float(rng);
+}
+
+static int find_nearest_brute_force(const float (*points)[3], const int points_num, const float co[3])
+{
+	int i, index = -1;
+	float dist_min = FLT_MAX;
+
+	for (i = 0; i < points_num; i++) {
+		const float dist = len_squared_v3v3(points[i], co);
+		if (dist < dist_min) {
+			dist_min = dist;
+			index = i;
+		}
+	}
+	return index;
+}
+
+TEST(kdtree, FindNearest)
+{
+	RNG *rng = BLI_rng_new(0);
+	float (*points)[3] = (float (*)[3])MEM_mallocN(sizeof(*points) * TREE_SIZE, __func__);
+	float (*queries)[3] = (float (*)[3])MEM_mallocN(sizeof(*queries) * QUERY_SIZE, __func__);
+	int *r_index = (int *)MEM_mallocN(sizeof(*r_index) * QUERY_SIZE, __func__);
+	KDTreeNearest *r_nearest = (KDTreeNearest *)MEM_mallocN(sizeof(*r_nearest) * QUERY_SIZE, __func__);
+	KDTree *tree;
+	int i;
+
+	BLI_threadapi_init();
+
+	tree = BLI_kdtree_new(TREE_SIZE);
+	for (i = 0; i < TREE_SIZE; i++) {
+		rng_co(rng, points[i]);
+		BLI_kdtree_insert(tree, i, points[i]);
+	}
+	BLI_kdtree_balance(tree);
+
+	for (i = 0; i < QUERY_SIZE; i++) {
+		rng_co(rng, queries[i]);
+	}
+
+	BLI_kdtree_find_nearest_batch(tree, (const float (*)[3])queries, QUERY_SIZE, r_index, r_nearest);
+
+	for (i = 0; i < QUERY_SIZE; i++) {
+		const int index = find_nearest_brute_force((const float (*)[3])points, TREE_SIZE, queries[i]);
+		EXPECT_EQ(index, BLI_kdtree_find_nearest(tree, queries[i], NULL));
+		EXPECT_EQ(index, r_index[i]);
+		EXPECT_EQ(index, r_nearest[i].index);
+		EXPECT_FLOAT_EQ(len_v3v3(points[index], queries[i]), r_nearest[i].dist);
+	}
+
+	BLI_kdtree_free(tree);
+	MEM_freeN(points);
+	MEM_freeN(queries);
+	MEM_freeN(r_index);
+	MEM_freeN(r_nearest);
+	BLI_rng_free(rng);
+
+	BLI_threadapi_exit();
+}
+
+static bool range_search_count_cb(void *user_data, int UNUSED(index), const float UNUSED(co[3]), float UNUSED(dist_sq))
+{
+	(*(int *)user_data)++;
+	return true;
+}
+
+static int find_nearest_cb_skip_odd(void *UNUSED(user_data), int index, const float UNUSED(co[3]), float UNUSED(dist_sq))
+{
+	return (index % 2) == 0;
+}
+
+/* Sizes around the leaf bucket size, to test trees that are a single leaf or a few leaves. */
+static void kdtree_queries_test(const int tree_size)
+{
+	RNG *rng = BLI_rng_new(tree_size);
+	float (*points)[3] = (float (*)[3])MEM_mallocN(sizeof(*points) * (size_t)max_ii(tree_size, 1), __func__);
+	KDTreeNearest nearest[4], *range_nearest;
+	const float range = 0.2f;
+	KDTree *tree;
+	int i, j;
+
+	tree = BLI_kdtree_new((unsigned int)tree_size);
+	for (i = 0; i < tree_size; i++) {
+		rng_co(rng, points[i]);
+		BLI_kdtree_insert(tree, i, points[i]);
+	}
+	BLI_kdtree_balance(tree);
+
+	for (i = 0; i < 100; i++) {
+		float co[3];
+		int index, found, found_cb = 0, in_range = 0, closest_even = -1;
+		float dist_even = FLT_MAX;
+
+		rng_co(rng, co);
+		index = find_nearest_brute_force((const float (*)[3])points, tree_size, co);
+		EXPECT_EQ(index, BLI_kdtree_find_nearest(tree, co, NULL));
+
+		for (j = 0; j < tree_size; j++) {
+			const float dist = len_squared_v3v3(points[j], co);
+			if (dist <= range * range) {
+				in_range++;
+			}
+			if ((j % 2) == 0 && dist < dist_even) {
+				dist_even = dist;
+				closest_even = j;
+			}
+		}
+		EXPECT_EQ(closest_even, BLI_kdtree_find_nearest_cb(tree, co, find_nearest_cb_skip_odd, NULL, NULL));
+
+		found = BLI_kdtree_find_nearest_n(tree, co, nearest, 4);
+		EXPECT_EQ(min_ii(tree_size, 4), found);
+		if (found) {
+			EXPECT_EQ(index, nearest[0].index);
+		}
+		for (j = 1; j < found; j++) {
+			EXPECT_LE(nearest[j - 1].dist, nearest[j].dist);
+		}
+
+		range_nearest = NULL;
+		found = BLI_kdtree_range_search(tree, co, &range_nearest, range);
+		EXPECT_EQ(in_range, found);
+		for (j = 0; j < found; j++) {
+			EXPECT_LE(range_nearest[j].dist, range);
+		}
+		if (range_nearest) {
+			MEM_freeN(range_nearest);
+		}
+
+		BLI_kdtree_range_search_cb(tree, co, range, range_search_count_cb, &found_cb);
+		EXPECT_EQ(in_range, found_cb);
+	}
+
+	BLI_kdtree_free(tree);
+	MEM_freeN(points);
+	BLI_rng_free(rng);
+}
+
+TEST(kdtree, Queries)
+{
+	const int sizes[] = {0, 1, 3, 16, 17, 33, 100, 1000};
+	int i;
+
+	for (i = 0; i < (int)ARRAY_SIZE(sizes); i++) {
+		kdtree_queries_test(sizes[i]);
+	}
+}
@@ -0,0 +1,206 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "PIL_time_utildefines.h"
+
+#include "atomic_ops.h"
+}
+
+/* Every test runs with per-worker queues and with a single queue shared by all workers,
+ * the way the scheduler worked before work stealing, so both are timed in one run. */
+
+/* Number of tasks pushed from the main thread. */
+#define NUM_TASKS_MAIN 1000000
+
+/* Number of tasks spawning sub-tasks, and number of sub-tasks each of them spawns. */
+#define NUM_TASKS_ROOT 256
+#define NUM_TASKS_CHILD 4096
+
+/* Number of iterations of the parallel range. */
+#define NUM_ITERS_RANGE 10000000
+
+/* Number of threads for the contended tests, more than most machines have cores. */
+#define NUM_THREADS_MANY 32
+
+/* Tiny tasks, so the measured time is dominated by the scheduler overhead. */
+
+static void task_increment_run(TaskPool *__restrict pool, void *UNUSED(taskdata), int UNUSED(threadid))
+{
+	size_t *counter = (size_t *)BLI_task_pool_userdata(pool);
+	atomic_add_and_fetch_z(counter, 1);
+}
+
+static void task_spawn_run(TaskPool *__restrict pool, void *UNUSED(taskdata), int threadid)
+{
+	for (int i = 0; i < NUM_TASKS_CHILD; i++) {
+		BLI_task_pool_push_from_thread(pool, task_increment_run, NULL, false, TASK_PRIORITY_HIGH, threadid);
+	}
+}
+
+static void range_increment_func(void *userdata, void *UNUSED(userdata_chunk), const int UNUSED(iter), const int UNUSED(thread_id))
+{
+	size_t *counter = (size_t *)userdata;
+	atomic_add_and_fetch_z(counter, 1);
+}
+
+/* Untimed run, so whichever scheduler is timed first does not pay for growing the heap. */
+static void task_warm_up(TaskScheduler *scheduler)
+{
+	size_t counter = 0;
+	TaskPool *pool = BLI_task_pool_create(scheduler, &counter);
+
+	for (int i = 0; i < NUM_TASKS_MAIN; i++) {
+		BLI_task_pool_push(pool, task_increment_run, NULL, false, TASK_PRIORITY_LOW);
+	}
+	BLI_task_pool_work_and_wait(pool);
+
+	BLI_task_pool_free(pool);
+}
+
+static void task_push_pop_tests(const int num_threads, const bool use_global_queue, const char *id)
+{
+	BLI_threadapi_init();
+
+	TaskScheduler *scheduler = BLI_task_scheduler_create_ex(num_threads, use_global_queue);
+	task_warm_up(scheduler);
+
+	printf("\n========== STARTING %s (%d threads, %s) ==========\n",
+	       id, BLI_task_scheduler_num_threads(scheduler),
+	       use_global_queue ? "global queue" : "per-worker queues");
+
+	{
+		size_t counter = 0;
+		TaskPool *pool = BLI_task_pool_create(scheduler, &counter);
+
+		TIMEIT_START(push_pop_main_thread);
+
+		for (int i = 0; i < NUM_TASKS_MAIN; i++) {
+			BLI_task_pool_push(pool, task_increment_run, NULL, false, TASK_PRIORITY_LOW);
+		}
+		BLI_task_pool_work_and_wait(pool);
+
+		TIMEIT_END(push_pop_main_thread);
+
+		EXPECT_EQ(NUM_TASKS_MAIN, counter);
+		BLI_task_pool_free(pool);
+	}
+
+	{
+		size_t counter = 0;
+		TaskPool *pool = BLI_task_pool_create(scheduler, &counter);
+
+		TIMEIT_START(push_pop_worker_threads);
+
+		for (int i = 0; i < NUM_TASKS_ROOT; i++) {
+			BLI_task_pool_push(pool, task_spawn_run, NULL, false, TASK_PRIORITY_LOW);
+		}
+		BLI_task_pool_work_and_wait(pool);
+
+		TIMEIT_END(push_pop_worker_threads);
+
+		EXPECT_EQ(NUM_TASKS_ROOT * NUM_TASKS_CHILD, counter);
+		BLI_task_pool_free(pool);
+	}
+
+	printf("========== ENDED %s ==========\n\n", id);
+
+	BLI_task_scheduler_free(scheduler);
+	BLI_threadapi_exit();
+}
+
+TEST(task, PushPopSingleThread)
+{
+	task_push_pop_tests(TASK_SCHEDULER_SINGLE_THREAD, false, "PushPop - Single Thread");
+	task_push_pop_tests(TASK_SCHEDULER_SINGLE_THREAD, true, "PushPop - Single Thread");
+}
+
+TEST(task, PushPopAutoThreads)
+{
+	task_push_pop_tests(TASK_SCHEDULER_AUTO_THREADS, false, "PushPop - Auto Threads");
+	task_push_pop_tests(TASK_SCHEDULER_AUTO_THREADS, true, "PushPop - Auto Threads");
+}
+
+TEST(task, PushPopManyThreads)
+{
+	task_push_pop_tests(NUM_THREADS_MANY, false, "PushPop - Many Threads");
+	task_push_pop_tests(NUM_THREADS_MANY, true, "PushPop - Many Threads");
+}
+
+static void task_push_pop_limited_pool_test(const bool use_global_queue)
+{
+	BLI_threadapi_init();
+
+	TaskScheduler *scheduler = BLI_task_scheduler_create_ex(TASK_SCHEDULER_AUTO_THREADS, use_global_queue);
+	task_warm_up(scheduler);
+	size_t counter = 0;
+	TaskPool *pool = BLI_task_pool_create(scheduler, &counter);
+
+	printf("\n========== STARTING PushPop - Pool Limited To 2 Threads (%s) ==========\n",
+	       use_global_queue ? "global queue" : "per-worker queues");
+
+	BLI_pool_set_num_threads(pool, 2);
+
+	TIMEIT_START(push_pop_limited_pool);
+
+	for (int i = 0; i < NUM_TASKS_MAIN; i++) {
+		BLI_task_pool_push(pool, task_increment_run, NULL, false, TASK_PRIORITY_LOW);
+	}
+	BLI_task_pool_work_and_wait(pool);
+
+	TIMEIT_END(push_pop_limited_pool);
+
+	EXPECT_EQ(NUM_TASKS_MAIN, counter);
+
+	printf("========== ENDED PushPop - Pool Limited To 2 Threads ==========\n\n");
+
+	BLI_task_pool_free(pool);
+	BLI_task_scheduler_free(scheduler);
+	BLI_threadapi_exit();
+}
+
+TEST(task, PushPopLimitedPool)
+{
+	task_push_pop_limited_pool_test(false);
+	task_push_pop_limited_pool_test(true);
+}
+
+TEST(task, ParallelRange)
+{
+	size_t counter = 0;
+
+	BLI_threadapi_init();
+
+	printf("\n========== STARTING Parallel Range ==========\n");
+
+	{
+		TIMEIT_START(parallel_range_dynamic);
+
+		BLI_task_parallel_range_ex(0, NUM_ITERS_RANGE, &counter, NULL, 0, range_increment_func, true, true);
+
+		TIMEIT_END(parallel_range_dynamic);
+
+		EXPECT_EQ(NUM_ITERS_RANGE, counter);
+	}
+
+	counter = 0;
+
+	{
+		TIMEIT_START(parallel_range_static);
+
+		BLI_task_parallel_range_ex(0, NUM_ITERS_RANGE, &counter, NULL, 0, range_increment_func, true, false);
+
+		TIMEIT_END(parallel_range_static);
+
+		EXPECT_EQ(NUM_ITERS_RANGE, counter);
+	}
+
+	printf("========== ENDED Parallel Range ==========\n\n");
+
+	BLI_threadapi_exit();
+}
@@ -39,6 +39,12 @@ TEST(guardedalloc, LockfreeAlignedAlloc16)
 	DoBasicAlignmentChecks(16);
 }
 
+TEST(guardedalloc, ThreadCacheAlignedAlloc16)
+{
+	MEM_use_threadcache_allocator();
+	DoBasicAlignmentChecks(16);
+}
+
 TEST(guardedalloc, GuardedAlignedAlloc16)
 {
 	MEM_use_guarded_allocator();
@@ -0,0 +1,116 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "BLI_utildefines.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
+#include "PIL_time_utildefines.h"
+}
+
+#include "MEM_guardedalloc.h"
+
+#define THREADS_NUM 8
+
+/* Number of tasks, each one allocating and freeing ALLOC_NUM blocks. */
+#define TASKS_NUM 256
+#define ALLOC_NUM 10000
+
+/* Number of blocks alive at the same time in a task. */
+#define ALLOC_LIVE_NUM 64
+
+/* Number of blocks allocated by one range and freed by another one. */
+#define ALLOC_CROSS_NUM 200000
+
+static size_t alloc_size(const unsigned int i)
+{
+	/* Cheap pseudo-random sizes, mostly small ones with a few bigger than the size-classes. */
+	const unsigned int hash = (i * 2654435761u) >> 16;
+	return (hash % 16 == 0) ? (size_t)(hash % 4096) + 1 : (size_t)(hash % 256) + 1;
+}
+
+static void alloc_free_task(void *UNUSED(userdata), const int index)
+{
+	void *blocks[ALLOC_LIVE_NUM] = {NULL};
+
+	for (unsigned int i = 0; i < ALLOC_NUM; i++) {
+		const unsigned int slot = i % ALLOC_LIVE_NUM;
+		if (blocks[slot]) {
+			MEM_freeN(blocks[slot]);
+		}
+		blocks[slot] = MEM_mallocN(alloc_size(i + (unsigned int)index * ALLOC_NUM), __func__);
+		*(char *)blocks[slot] = (char)i;
+	}
+
+	for (unsigned int i = 0; i < ALLOC_LIVE_NUM; i++) {
+		MEM_freeN(blocks[i]);
+	}
+}
+
+static void alloc_task(void *userdata, const int index)
+{
+	void **blocks = (void **)userdata;
+	blocks[index] = MEM_callocN(alloc_size((unsigned int)index), __func__);
+}
+
+static void free_task(void *userdata, const int index)
+{
+	/* Free in reverse order, so blocks usually come from another thread. */
+	void **blocks = (void **)userdata;
+	MEM_freeN(blocks[ALLOC_CROSS_NUM - 1 - index]);
+}
+
+static void alloc_benchmark(const char *id)
+{
+	const unsigned int blocks_in_use = MEM_get_memory_blocks_in_use();
+	const size_t memory_in_use = MEM_get_memory_in_use();
+
+	printf("\n========== STARTING %s ==========\n", id);
+
+	/* Scheduler is created lazily, with the allocator under test. */
+	BLI_system_num_threads_override_set(THREADS_NUM);
+	BLI_threadapi_init();
+
+	{
+		TIMEIT_START(alloc_free);
+		BLI_task_parallel_range(0, TASKS_NUM, NULL, alloc_free_task, true);
+		TIMEIT_END(alloc_free);
+	}
+
+	{
+		void **blocks = (void **)MEM_mallocN(sizeof(*blocks) * ALLOC_CROSS_NUM, __func__);
+
+		TIMEIT_START(alloc_free_cross_threads);
+		BLI_task_parallel_range(0, ALLOC_CROSS_NUM, blocks, alloc_task, true);
+		BLI_task_parallel_range(0, ALLOC_CROSS_NUM, blocks, free_task, true);
+		TIMEIT_END(alloc_free_cross_threads);
+
+		MEM_freeN(blocks);
+	}
+
+	BLI_threadapi_exit();
+	BLI_system_num_threads_override_set(0);
+
+	EXPECT_EQ(blocks_in_use, MEM_get_memory_blocks_in_use());
+	EXPECT_EQ(memory_in_use, MEM_get_memory_in_use());
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(guardedalloc, LockfreeMultiThreaded)
+{
+	alloc_benchmark("Lockfree");
+}
+
+TEST(guardedalloc, ThreadCacheMultiThreaded)
+{
+	MEM_use_threadcache_allocator();
+	alloc_benchmark("ThreadCache");
+}
+
+TEST(guardedalloc, GuardedMultiThreaded)
+{
+	MEM_use_guarded_allocator();
+	alloc_benchmark("Guarded");
+}